@@ -0,0 +1,185 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+
+namespace dg {
+	// キャッシュのヒット/ミス/追い出し回数
+	struct LruCacheStats {
+			uint64_t hit = 0;
+			uint64_t miss = 0;
+			uint64_t eviction = 0;
+
+			double hitRate() const noexcept {
+				const uint64_t total = hit + miss;
+				return total == 0 ? 0.0 : static_cast<double>(hit) / static_cast<double>(total);
+			}
+	};
+
+	/**
+	 * @brief 最近使われていない物から捨てるキャッシュ (スレッドセーフではない)
+	 *
+	 * 各エントリはコストを持ち、合計コストが capacity を超えたら古い物から破棄する。
+	 * コストを全て1にすれば件数上限、バイト数にすればメモリ上限として使える。
+	 */
+	template <typename Key, typename Value, typename Hash = std::hash<Key>>
+	class LruCache {
+		public:
+			using Stats = LruCacheStats;
+
+		private:
+			struct Entry {
+					Key key;
+					Value value;
+					size_t cost;
+			};
+			using List = std::list<Entry>;
+			// 先頭ほど最近使われたエントリ
+			List _list;
+			std::unordered_map<Key, typename List::iterator, Hash> _map;
+			size_t _capacity;
+			size_t _cost = 0;
+			Stats _stats;
+
+			void _evict(const size_t capacity) {
+				while (_cost > capacity && !_list.empty()) {
+					auto &last = _list.back();
+					_cost -= last.cost;
+					_map.erase(last.key);
+					_list.pop_back();
+					++_stats.eviction;
+				}
+			}
+
+		public:
+			explicit LruCache(const size_t capacity) : _capacity(capacity) {
+			}
+
+			// 見つかった場合は最近使った扱いにしてポインタを返す (次の insert/erase まで有効)
+			Value *find(const Key &key) {
+				const auto itr = _map.find(key);
+				if (itr == _map.end()) {
+					++_stats.miss;
+					return nullptr;
+				}
+				++_stats.hit;
+				_list.splice(_list.begin(), _list, itr->second);
+				return &itr->second->value;
+			}
+			// 統計や順序を変えずに存在確認
+			bool contains(const Key &key) const {
+				return _map.contains(key);
+			}
+			// 既に同じキーがあれば置き換える
+			Value &insert(const Key &key, Value value, const size_t cost = 1) {
+				erase(key);
+				// 単体で容量を超えるエントリも一旦は保持する (次の挿入で追い出される)
+				_evict(cost >= _capacity ? 0 : _capacity - cost);
+				_list.push_front(Entry{key, std::move(value), cost});
+				_map.emplace(key, _list.begin());
+				_cost += cost;
+				return _list.front().value;
+			}
+			bool erase(const Key &key) {
+				const auto itr = _map.find(key);
+				if (itr == _map.end())
+					return false;
+				_cost -= itr->second->cost;
+				_list.erase(itr->second);
+				_map.erase(itr);
+				return true;
+			}
+			void clear() {
+				_map.clear();
+				_list.clear();
+				_cost = 0;
+			}
+			void setCapacity(const size_t capacity) {
+				_capacity = capacity;
+				_evict(_capacity);
+			}
+			// 全エントリに対して関数を呼ぶ (最近使った順)
+			template <typename Proc>
+			void forEach(Proc &&proc) {
+				for (auto &ent : _list)
+					proc(ent.key, ent.value);
+			}
+
+			size_t size() const noexcept {
+				return _list.size();
+			}
+			size_t cost() const noexcept {
+				return _cost;
+			}
+			size_t capacity() const noexcept {
+				return _capacity;
+			}
+			const Stats &stats() const noexcept {
+				return _stats;
+			}
+	};
+
+	/**
+	 * @brief 複数スレッドから使えるLruCache (内部で排他する)
+	 *
+	 * 要素へのポインタは他スレッドの操作で無効になり得るので、値のコピーを返す。
+	 */
+	template <typename Key, typename Value, typename Hash = std::hash<Key>>
+	class SharedLruCache {
+		public:
+			using Cache = LruCache<Key, Value, Hash>;
+			using Stats = typename Cache::Stats;
+
+		private:
+			mutable std::mutex _mutex;
+			Cache _cache;
+
+		public:
+			explicit SharedLruCache(const size_t capacity) : _cache(capacity) {
+			}
+
+			std::optional<Value> find(const Key &key) {
+				std::lock_guard lk(_mutex);
+				if (auto *v = _cache.find(key))
+					return *v;
+				return std::nullopt;
+			}
+			void insert(const Key &key, Value value, const size_t cost = 1) {
+				std::lock_guard lk(_mutex);
+				_cache.insert(key, std::move(value), cost);
+			}
+			bool erase(const Key &key) {
+				std::lock_guard lk(_mutex);
+				return _cache.erase(key);
+			}
+			void clear() {
+				std::lock_guard lk(_mutex);
+				_cache.clear();
+			}
+			void setCapacity(const size_t capacity) {
+				std::lock_guard lk(_mutex);
+				_cache.setCapacity(capacity);
+			}
+
+			size_t size() const {
+				std::lock_guard lk(_mutex);
+				return _cache.size();
+			}
+			size_t cost() const {
+				std::lock_guard lk(_mutex);
+				return _cache.cost();
+			}
+			size_t capacity() const {
+				std::lock_guard lk(_mutex);
+				return _cache.capacity();
+			}
+			Stats stats() const {
+				std::lock_guard lk(_mutex);
+				return _cache.stats();
+			}
+	};
+} // namespace dg
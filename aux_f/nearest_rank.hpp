@@ -0,0 +1,242 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <span>
+#include <unordered_set>
+#include <vector>
+#include "rank_merge.hpp"
+
+namespace dg {
+	/**
+	 * @brief 値の昇順に並べた列 (二分探索で目標値の位置を求める為のもの)
+	 *
+	 * NaN の要素は含めない。id は元の列でのインデックス。
+	 */
+	struct SortedColumn {
+			std::vector<float> value;
+			std::vector<uint32_t> id;
+
+			static SortedColumn Make(const std::span<const float> col) {
+				std::vector<uint32_t> order;
+				order.reserve(col.size());
+				for (uint32_t i = 0; i < col.size(); ++i) {
+					if (!std::isnan(col[i]))
+						order.emplace_back(i);
+				}
+				std::sort(order.begin(), order.end(), [col](const uint32_t a, const uint32_t b) {
+					if (col[a] != col[b])
+						return col[a] < col[b];
+					return a < b;
+				});
+				SortedColumn ret;
+				ret.value.reserve(order.size());
+				for (const uint32_t i : order)
+					ret.value.emplace_back(col[i]);
+				ret.id = std::move(order);
+				return ret;
+			}
+			size_t size() const noexcept {
+				return value.size();
+			}
+			bool empty() const noexcept {
+				return value.empty();
+			}
+	};
+
+	// 周期 period の値同士の距離 (period が 0 なら通常の差)
+	inline float PeriodicDistance(const float a, const float b, const float period) noexcept {
+		const float d = std::abs(a - b);
+		return period > 0 ? std::min(d, period - d) : d;
+	}
+
+	/**
+	 * @brief 目標値に近い順に要素を取り出す
+	 *
+	 * 目標値の位置を二分探索で求め、そこから上下両方向に1つずつ広げていく。
+	 * period を指定すると角度の様に端が繋がっているものとして、列の端で反対側に回り込む。
+	 * K件取り出すのに O(log N + K)
+	 */
+	class NearestWalk {
+		public:
+			struct Item {
+					uint32_t id;
+					float dist;
+			};
+
+		private:
+			const SortedColumn *_col;
+			float _target;
+			float _period;
+			// 目標値の位置と、そこから下側・上側に進んだ数
+			size_t _start, _nLo = 0, _nHi = 0;
+
+			size_t _posLo() const noexcept {
+				const size_t n = _col->size();
+				return (_start + n - 1 - _nLo % n) % n;
+			}
+			size_t _posHi() const noexcept {
+				return (_start + _nHi) % _col->size();
+			}
+			float _distLo() const noexcept {
+				if (exhausted() || (_period <= 0 && _nLo >= _start))
+					return std::numeric_limits<float>::infinity();
+				const float d = _target - _col->value[_posLo()];
+				// 回り込んだ先は目標値より大きい
+				return d < 0 ? d + _period : d;
+			}
+			float _distHi() const noexcept {
+				if (exhausted() || (_period <= 0 && _start + _nHi >= _col->size()))
+					return std::numeric_limits<float>::infinity();
+				const float d = _col->value[_posHi()] - _target;
+				return d < 0 ? d + _period : d;
+			}
+
+		public:
+			// period: 値の周期 (0なら回り込まない)
+			NearestWalk(const SortedColumn &col, const float target, const float period = 0) :
+				_col(&col), _target(target), _period(period) {
+				_start = std::lower_bound(col.value.begin(), col.value.end(), target) - col.value.begin();
+			}
+			bool exhausted() const noexcept {
+				return _nLo + _nHi == _col->size();
+			}
+			// 次に返す要素の距離 (尽きていたら +inf)
+			float peekDistance() const noexcept {
+				return std::min(_distLo(), _distHi());
+			}
+			std::optional<Item> next() noexcept {
+				if (exhausted())
+					return std::nullopt;
+				const float dl = _distLo(), dh = _distHi();
+				if (dl <= dh) {
+					const size_t pos = _posLo();
+					++_nLo;
+					return Item{_col->id[pos], dl};
+				}
+				const size_t pos = _posHi();
+				++_nHi;
+				return Item{_col->id[pos], dh};
+			}
+	};
+
+	/**
+	 * @brief 軸毎の項の和をスコアとし、スコアの降順に取り出すソース
+	 *
+	 * 各項は目標値からの距離に対して単調減少する関数 term で求める (値が無い軸の項は足さない)。
+	 * 軸毎に NearestWalk で近い順に辿り、初出の要素はその場で全軸のスコアを確定させてヒープに積む。
+	 * まだどの軸でも出ていない要素が取り得る上限をヒープの先頭が下回らなくなったら、それを返す。
+	 *
+	 * 要素のスコアを列の値から別の方法で求める場合は score を与える。
+	 * その時の term は、その距離以上の要素が取り得る項の上限であること。
+	 */
+	class SeparableRankSource : public RankSource {
+		public:
+			struct Axis {
+					const SortedColumn *sorted;
+					// 元の列 (ランダムアクセス用, 値が無い要素は NaN)
+					std::span<const float> column;
+					float target;
+					// 値の周期 (角度なら 2π、0なら周期無し)
+					float period = 0;
+			};
+			// 距離 -> 項 (単調減少であること)
+			using Term = std::function<float(float)>;
+			// 要素 -> 係数を掛ける前のスコア (値が無ければ NaN)
+			using Score = std::function<float(uint32_t)>;
+
+		private:
+			std::vector<Axis> _axis;
+			std::vector<NearestWalk> _walk;
+			Term _term;
+			Score _score;
+			float _scale;
+			std::unordered_set<uint32_t> _seen;
+			// 確定済みで未取り出しの要素 (スコアのヒープ)
+			std::vector<Item> _heap;
+
+			static bool _Less(const Item &a, const Item &b) noexcept {
+				if (a.score != b.score)
+					return a.score < b.score;
+				return a.id > b.id;
+			}
+			// まだどの軸でも出ていない要素のスコアの上限 (無ければ -inf)
+			float _bound() const {
+				constexpr float NInf = -std::numeric_limits<float>::infinity();
+				float sumPos = 0, best = NInf;
+				bool any = false;
+				for (auto &w : _walk) {
+					if (w.exhausted())
+						continue;
+					const float t = _term(w.peekDistance());
+					any = true;
+					best = std::max(best, t);
+					sumPos += std::max(t, 0.f);
+				}
+				if (!any)
+					return NInf;
+				// 値を持つ軸の組み合わせのうち最大になるもの
+				return (best > 0 ? sumPos : best) * _scale;
+			}
+
+		public:
+			// scale: 全体に掛ける係数 (順序を保つ為に 0 以上)
+			SeparableRankSource(std::vector<Axis> axis, Term term, const float scale) :
+				SeparableRankSource(std::move(axis), std::move(term), nullptr, scale) {}
+			SeparableRankSource(std::vector<Axis> axis, Term term, Score score, const float scale) :
+				_axis(std::move(axis)), _term(std::move(term)), _score(std::move(score)), _scale(scale) {
+				_walk.reserve(_axis.size());
+				for (auto &a : _axis)
+					_walk.emplace_back(*a.sorted, a.target, a.period);
+			}
+
+			std::optional<Item> next() override {
+				for (;;) {
+					// 全ての軸を辿り終えていれば上限は -inf なので、残りをそのまま返す
+					const float bound = _bound();
+					if (!_heap.empty() && _heap.front().score >= bound) {
+						std::pop_heap(_heap.begin(), _heap.end(), _Less);
+						const Item ret = _heap.back();
+						_heap.pop_back();
+						return ret;
+					}
+					if (bound == -std::numeric_limits<float>::infinity())
+						return std::nullopt;
+					// 上限を決めている(項が最も大きい)軸を進める
+					size_t best = _walk.size();
+					float bestTerm = 0;
+					for (size_t i = 0; i < _walk.size(); ++i) {
+						if (_walk[i].exhausted())
+							continue;
+						const float t = _term(_walk[i].peekDistance());
+						if (best == _walk.size() || t > bestTerm) {
+							best = i;
+							bestTerm = t;
+						}
+					}
+					const auto item = _walk[best].next();
+					if (_seen.emplace(item->id).second) {
+						_heap.emplace_back(Item{item->id, at(item->id)});
+						std::push_heap(_heap.begin(), _heap.end(), _Less);
+					}
+				}
+			}
+			float at(const uint32_t id) const override {
+				if (_score)
+					return _score(id) * _scale;
+				float score = 0;
+				bool has = false;
+				for (auto &a : _axis) {
+					const float v = a.column[id];
+					if (std::isnan(v))
+						continue;
+					score += _term(PeriodicDistance(v, a.target, a.period));
+					has = true;
+				}
+				return has ? score * _scale : std::numeric_limits<float>::quiet_NaN();
+			}
+	};
+} // namespace dg
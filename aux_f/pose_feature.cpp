@@ -0,0 +1,51 @@
+#include "pose_feature.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace dg {
+	namespace {
+		// 正規化して書き込む (値が無ければ 0 のまま)
+		float *PutDir(float *dst, const PoseFeature::Vec3 &v) {
+			const float len = std::sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+			if (std::isfinite(len) && len > 0) {
+				for (int i = 0; i < 3; ++i)
+					dst[i] = v[i] / len;
+			}
+			return dst + 3;
+		}
+		float *PutAngle(float *dst, const float rad) {
+			if (std::isfinite(rad)) {
+				dst[0] = std::cos(rad);
+				dst[1] = std::sin(rad);
+			}
+			return dst + 2;
+		}
+	} // namespace
+
+	PoseFeature PoseFeature::Make(const Vec3 &torsoDir, const Pair3 &thighDir, const Pair3 &crusDir,
+								  const Pair &thighFlex, const Pair &crusFlex) {
+		PoseFeature ret;
+		float *p = ret.value.data();
+		p = PutDir(p, torsoDir);
+		for (int s = 0; s < 2; ++s) {
+			p = PutDir(p, thighDir[s]);
+			p = PutDir(p, crusDir[s]);
+		}
+		for (int s = 0; s < 2; ++s) {
+			p = PutAngle(p, thighFlex[s]);
+			p = PutAngle(p, crusFlex[s]);
+		}
+		return ret;
+	}
+	float PoseFeature::distance(const PoseFeature &other) const noexcept {
+		float sum = 0;
+		for (size_t i = 0; i < Dim; ++i) {
+			const float d = value[i] - other.value[i];
+			sum += d * d;
+		}
+		return std::sqrt(sum);
+	}
+	float PoseFeature::Score(const float distance) noexcept {
+		return std::clamp(1.f - distance / MaxDistance, 0.f, 1.f);
+	}
+} // namespace dg
@@ -0,0 +1,36 @@
+#pragma once
+#include <array>
+#include <cstddef>
+
+namespace dg {
+	/**
+	 * @brief 「似たポーズ」の検索に使う、ポーズ全体の特徴ベクトル
+	 *
+	 * 胴体・左右の大腿・左右の下腿の方向(単位ベクトル)と、左右の大腿・下腿の屈曲角を
+	 * (cos, sin) にした物を並べる。どの要素も2つのポーズで角度が θ ずれると
+	 * 距離が 2sin(θ/2) になるので、L2距離はそれぞれの角度の差を同じ重みで合わせた物になる。
+	 * 値が無い要素(NaN や長さ 0)は 0 で埋める (どの値からも距離 1 の中立な位置)。
+	 */
+	struct PoseFeature {
+			// 方向 3 × 5 + 屈曲角 2 × 4
+			constexpr static size_t Dim = 23;
+			// 要素の数 (方向 5 + 屈曲角 4)
+			constexpr static size_t NPart = 9;
+			// 全ての要素が正反対の時の距離
+			constexpr static float MaxDistance = 6.f;
+
+			using Vec3 = std::array<float, 3>;
+			// [0] = left, [1] = right
+			using Pair3 = std::array<Vec3, 2>;
+			using Pair = std::array<float, 2>;
+
+			std::array<float, Dim> value{};
+
+			// flex: 屈曲角 [rad]
+			static PoseFeature Make(const Vec3 &torsoDir, const Pair3 &thighDir, const Pair3 &crusDir,
+									const Pair &thighFlex, const Pair &crusFlex);
+			float distance(const PoseFeature &other) const noexcept;
+			// 距離を [0, 1] のスコア(1 が同じポーズ)にする
+			static float Score(float distance) noexcept;
+	};
+} // namespace dg
@@ -0,0 +1,166 @@
+#include "qoi.hpp"
+#include <array>
+#include <cstring>
+
+namespace dg::qoi {
+	namespace {
+		constexpr uint8_t OpIndex = 0x00;
+		constexpr uint8_t OpDiff = 0x40;
+		constexpr uint8_t OpLuma = 0x80;
+		constexpr uint8_t OpRun = 0xc0;
+		constexpr uint8_t OpRgb = 0xfe;
+		constexpr uint8_t OpRgba = 0xff;
+		constexpr uint8_t OpMask = 0xc0;
+		constexpr int MaxRun = 62;
+		constexpr uint8_t Magic[4] = {'q', 'o', 'i', 'f'};
+		constexpr uint8_t EndMarker[EndMarkerSize] = {0, 0, 0, 0, 0, 0, 0, 1};
+
+		struct Px {
+				uint8_t r, g, b, a;
+				bool operator==(const Px &) const = default;
+		};
+		static_assert(sizeof(Px) == 4);
+
+		int Hash(const Px &p) noexcept {
+			return (p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11) % 64;
+		}
+		void Write32(std::vector<uint8_t> &dst, const uint32_t v) {
+			dst.push_back(static_cast<uint8_t>(v >> 24));
+			dst.push_back(static_cast<uint8_t>(v >> 16));
+			dst.push_back(static_cast<uint8_t>(v >> 8));
+			dst.push_back(static_cast<uint8_t>(v));
+		}
+		uint32_t Read32(const uint8_t *src) noexcept {
+			return (uint32_t(src[0]) << 24) | (uint32_t(src[1]) << 16) | (uint32_t(src[2]) << 8) | uint32_t(src[3]);
+		}
+	} // namespace
+
+	std::vector<uint8_t> Encode(const uint8_t *pixels, const uint32_t width, const uint32_t height,
+								const size_t stride) {
+		std::vector<uint8_t> dst;
+		// 大抵は生の画素より小さくなる
+		dst.reserve(HeaderSize + size_t(width) * height * 2 + EndMarkerSize);
+		dst.insert(dst.end(), std::begin(Magic), std::end(Magic));
+		Write32(dst, width);
+		Write32(dst, height);
+		// チャンネル数, 色空間
+		dst.push_back(4);
+		dst.push_back(0);
+
+		std::array<Px, 64> index{};
+		Px prev{0, 0, 0, 255};
+		int run = 0;
+		for (uint32_t y = 0; y < height; ++y) {
+			const uint8_t *line = pixels + y * stride;
+			for (uint32_t x = 0; x < width; ++x) {
+				Px px;
+				std::memcpy(&px, line + x * 4, 4);
+				if (px == prev) {
+					if (++run == MaxRun) {
+						dst.push_back(OpRun | (run - 1));
+						run = 0;
+					}
+					continue;
+				}
+				if (run > 0) {
+					dst.push_back(OpRun | (run - 1));
+					run = 0;
+				}
+				const int h = Hash(px);
+				if (index[h] == px)
+					dst.push_back(OpIndex | h);
+				else {
+					index[h] = px;
+					if (px.a == prev.a) {
+						const int vr = int8_t(px.r - prev.r), vg = int8_t(px.g - prev.g), vb = int8_t(px.b - prev.b);
+						const int vgr = vr - vg, vgb = vb - vg;
+						if (vr >= -2 && vr <= 1 && vg >= -2 && vg <= 1 && vb >= -2 && vb <= 1)
+							dst.push_back(OpDiff | ((vr + 2) << 4) | ((vg + 2) << 2) | (vb + 2));
+						else if (vgr >= -8 && vgr <= 7 && vg >= -32 && vg <= 31 && vgb >= -8 && vgb <= 7) {
+							dst.push_back(OpLuma | (vg + 32));
+							dst.push_back(((vgr + 8) << 4) | (vgb + 8));
+						}
+						else
+							dst.insert(dst.end(), {OpRgb, px.r, px.g, px.b});
+					}
+					else
+						dst.insert(dst.end(), {OpRgba, px.r, px.g, px.b, px.a});
+				}
+				prev = px;
+			}
+		}
+		if (run > 0)
+			dst.push_back(OpRun | (run - 1));
+		dst.insert(dst.end(), std::begin(EndMarker), std::end(EndMarker));
+		return dst;
+	}
+
+	std::optional<Header> ReadHeader(const uint8_t *data, const size_t size) {
+		if (size < HeaderSize + EndMarkerSize || std::memcmp(data, Magic, sizeof(Magic)) != 0)
+			return std::nullopt;
+		const Header h{Read32(data + 4), Read32(data + 8)};
+		if (data[12] != 4)
+			return std::nullopt;
+		return h;
+	}
+
+	bool Decode(const uint8_t *data, const size_t size, uint8_t *dst, const size_t stride) {
+		const auto header = ReadHeader(data, size);
+		if (!header)
+			return false;
+		// 終端を除いた符号の範囲
+		const size_t end = size - EndMarkerSize;
+		size_t p = HeaderSize;
+
+		std::array<Px, 64> index{};
+		Px px{0, 0, 0, 255};
+		int run = 0;
+		for (uint32_t y = 0; y < header->height; ++y) {
+			uint8_t *line = dst + y * stride;
+			for (uint32_t x = 0; x < header->width; ++x) {
+				if (run > 0)
+					--run;
+				else {
+					if (p >= end)
+						return false;
+					const uint8_t b1 = data[p++];
+					if (b1 == OpRgb) {
+						if (p + 3 > end)
+							return false;
+						px.r = data[p];
+						px.g = data[p + 1];
+						px.b = data[p + 2];
+						p += 3;
+					}
+					else if (b1 == OpRgba) {
+						if (p + 4 > end)
+							return false;
+						px = Px{data[p], data[p + 1], data[p + 2], data[p + 3]};
+						p += 4;
+					}
+					else if ((b1 & OpMask) == OpIndex)
+						px = index[b1];
+					else if ((b1 & OpMask) == OpDiff) {
+						px.r += ((b1 >> 4) & 0x03) - 2;
+						px.g += ((b1 >> 2) & 0x03) - 2;
+						px.b += (b1 & 0x03) - 2;
+					}
+					else if ((b1 & OpMask) == OpLuma) {
+						if (p >= end)
+							return false;
+						const uint8_t b2 = data[p++];
+						const int vg = (b1 & 0x3f) - 32;
+						px.r += vg - 8 + ((b2 >> 4) & 0x0f);
+						px.g += vg;
+						px.b += vg - 8 + (b2 & 0x0f);
+					}
+					else
+						run = b1 & 0x3f;
+					index[Hash(px)] = px;
+				}
+				std::memcpy(line + x * 4, &px, 4);
+			}
+		}
+		return true;
+	}
+} // namespace dg::qoi
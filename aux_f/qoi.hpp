@@ -0,0 +1,34 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+/**
+ * @brief QOI (Quite OK Image) 形式の可逆圧縮
+ *
+ * 画素は4バイト単位で扱い、チャンネルの並びは問わない (エンコード時と同じ並びで戻る)。
+ * 直前の画素との差分・同色の連続・最近使った色の参照だけで符号化するので、PNG(zlib)より大幅に速い。
+ */
+namespace dg::qoi {
+	struct Header {
+			uint32_t width, height;
+	};
+	// ヘッダとデータ終端のバイト数
+	constexpr size_t HeaderSize = 14;
+	constexpr size_t EndMarkerSize = 8;
+
+	/**
+	 * @param pixels 先頭の画素
+	 * @param stride 1行のバイト数 (width * 4 以上)
+	 */
+	std::vector<uint8_t> Encode(const uint8_t *pixels, uint32_t width, uint32_t height, size_t stride);
+	// 形式が違えば nullopt
+	std::optional<Header> ReadHeader(const uint8_t *data, size_t size);
+	/**
+	 * @brief dst に展開する (ReadHeaderで得た大きさの領域を用意しておく)
+	 *
+	 * @return データが壊れていれば false
+	 */
+	bool Decode(const uint8_t *data, size_t size, uint8_t *dst, size_t stride);
+} // namespace dg::qoi
@@ -0,0 +1,120 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <unordered_set>
+#include <vector>
+
+namespace dg {
+	/**
+	 * @brief スコア降順に要素を取り出せるソース (Threshold Algorithm用)
+	 *
+	 * 要素IDは 0 以上の整数。ソースに含まれない要素のスコアは 0 として扱う。
+	 */
+	class RankSource {
+		public:
+			struct Item {
+					uint32_t id;
+					float score;
+			};
+			virtual ~RankSource() = default;
+
+			// スコアが大きい順に次の要素を返す (尽きたら nullopt)
+			virtual std::optional<Item> next() = 0;
+			// 任意の要素のスコア (ソースに含まれない場合は NaN)
+			virtual float at(uint32_t id) const = 0;
+			// 全要素を網羅しているか (falseなら未出現の要素はスコア0の可能性がある)
+			virtual bool dense() const noexcept {
+				return false;
+			}
+	};
+	using RankSource_U = std::unique_ptr<RankSource>;
+
+	struct RankedItem {
+			uint32_t id;
+			double score;
+	};
+	using RankedItemV = std::vector<RankedItem>;
+
+	/**
+	 * @brief 複数ソースのスコア合計の上位k件を求める (Fagin の Threshold Algorithm)
+	 *
+	 * 各ソースから降順に1件ずつ取り出し、初出の要素は全ソースのスコアを合計する。
+	 * 未出現要素が取り得るスコアの上限(閾値)をk番目のスコアが下回らなくなった時点で打ち切る。
+	 *
+	 * @param k 求める件数
+	 * @param sources スコアソース
+	 * @param accept 結果に含めて良い要素かを判定する関数 (bool(uint32_t))
+	 * @return スコア降順 (同点はID昇順) に並べた上位k件
+	 */
+	template <typename Accept>
+	RankedItemV ThresholdTopK(const size_t k, const std::vector<RankSource_U> &sources, Accept &&accept) {
+		if (k == 0 || sources.empty())
+			return {};
+
+		const auto better = [](const RankedItem &a, const RankedItem &b) {
+			if (a.score != b.score)
+				return a.score > b.score;
+			return a.id < b.id;
+		};
+		// 上位k件 (先頭が最も悪い要素となるヒープ)
+		RankedItemV top;
+		top.reserve(k + 1);
+		std::unordered_set<uint32_t> seen;
+
+		const size_t nSrc = sources.size();
+		std::vector<float> last(nSrc, 0.f);
+		std::vector<bool> exhausted(nSrc, false);
+		size_t nExhausted = 0;
+
+		while (nExhausted < nSrc) {
+			for (size_t s = 0; s < nSrc; ++s) {
+				if (exhausted[s])
+					continue;
+				const auto item = sources[s]->next();
+				if (!item) {
+					exhausted[s] = true;
+					++nExhausted;
+					continue;
+				}
+				last[s] = item->score;
+				if (!seen.emplace(item->id).second || !accept(item->id))
+					continue;
+
+				// ランダムアクセスで合計スコアを確定させる
+				double total = 0;
+				for (auto &src : sources) {
+					const float sc = src->at(item->id);
+					if (!std::isnan(sc))
+						total += sc;
+				}
+				const RankedItem ri{item->id, total};
+				if (top.size() < k) {
+					top.emplace_back(ri);
+					std::push_heap(top.begin(), top.end(), better);
+				}
+				else if (better(ri, top.front())) {
+					std::pop_heap(top.begin(), top.end(), better);
+					top.back() = ri;
+					std::push_heap(top.begin(), top.end(), better);
+				}
+			}
+			if (top.size() < k)
+				continue;
+
+			// 未出現要素が取り得る最大スコア
+			double threshold = 0;
+			for (size_t s = 0; s < nSrc; ++s) {
+				if (exhausted[s])
+					continue;
+				threshold += sources[s]->dense() ? last[s] : std::max(last[s], 0.f);
+			}
+			if (top.front().score >= threshold)
+				break;
+		}
+		std::sort_heap(top.begin(), top.end(), better);
+		return top;
+	}
+} // namespace dg
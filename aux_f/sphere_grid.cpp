@@ -0,0 +1,175 @@
+#include "sphere_grid.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numbers>
+
+namespace dg {
+	namespace {
+		// float で計算したスコアとの誤差を吸収する為、下限を少しだけ緩める
+		constexpr double AngleSlack = 1e-6;
+		constexpr float DistanceSlack = 1e-5f;
+
+		// 面の座標 [-1, 1] -> 面上の位置 (tan)
+		double Unwarp(const double w) noexcept {
+			return std::tan(w * std::numbers::pi / 4);
+		}
+		uint32_t Bin(const float t, const uint32_t div) noexcept {
+			// 面上の位置 -> 角度が均等な [0, 1]
+			const double w = (std::atan(double(t)) * 4 / std::numbers::pi + 1) / 2;
+			return std::min(div - 1, static_cast<uint32_t>(std::max(0.0, w * div)));
+		}
+	} // namespace
+
+	float MinChordDistance(const float theta, const float qn, const float rMin, const float rMax) {
+		const float c = std::cos(std::clamp(theta, 0.f, std::numbers::pi_v<float>));
+		const float r = std::clamp(qn * c, rMin, rMax);
+		return std::sqrt(std::max(r * r + qn * qn - 2 * r * qn * c, 0.f));
+	}
+
+	// ------------ SphereGrid ----------------------
+	uint32_t SphereGrid::NumCells(const uint32_t div) noexcept {
+		return 6 * div * div;
+	}
+	uint32_t SphereGrid::CellOf(const float x, const float y, const float z, const uint32_t div) noexcept {
+		const std::array<float, 3> p{x, y, z};
+		// 絶対値が最大の軸の面に投影する
+		int axis = 0;
+		for (int i = 1; i < 3; ++i) {
+			if (std::abs(p[i]) > std::abs(p[axis]))
+				axis = i;
+		}
+		const float major = p[axis];
+		if (major == 0)
+			return 0;
+		const uint32_t face = axis * 2 + (major < 0 ? 1 : 0);
+		const float inv = 1.f / std::abs(major);
+		const uint32_t i = Bin(p[(axis + 1) % 3] * inv, div);
+		const uint32_t j = Bin(p[(axis + 2) % 3] * inv, div);
+		return (face * div + i) * div + j;
+	}
+	std::array<float, 3> SphereGrid::CellCenter(const uint32_t cell, const uint32_t div) noexcept {
+		const uint32_t face = cell / (div * div);
+		const uint32_t i = (cell / div) % div, j = cell % div;
+		const int axis = face / 2;
+		std::array<double, 3> p;
+		p[axis] = (face % 2) ? -1 : 1;
+		p[(axis + 1) % 3] = Unwarp((i + 0.5) / div * 2 - 1);
+		p[(axis + 2) % 3] = Unwarp((j + 0.5) / div * 2 - 1);
+		const double len = std::sqrt(p[0] * p[0] + p[1] * p[1] + p[2] * p[2]);
+		return {float(p[0] / len), float(p[1] / len), float(p[2] / len)};
+	}
+
+	SphereGrid::SphereGrid(const std::span<const float> x, const std::span<const float> y,
+						   const std::span<const float> z, const uint32_t div) :
+		_div(div) {
+		const uint32_t nCell = NumCells(div);
+		// セル毎の個数を数えてから詰める
+		std::vector<uint32_t> cellOf(x.size(), nCell);
+		std::vector<uint32_t> count(nCell + 1, 0);
+		for (uint32_t i = 0; i < x.size(); ++i) {
+			if (std::isnan(x[i]) || std::isnan(y[i]) || std::isnan(z[i]))
+				continue;
+			cellOf[i] = CellOf(x[i], y[i], z[i], div);
+			++count[cellOf[i]];
+		}
+		std::vector<uint32_t> offset(nCell + 1, 0);
+		for (uint32_t c = 0; c < nCell; ++c)
+			offset[c + 1] = offset[c] + count[c];
+		_id.resize(offset[nCell]);
+		{
+			auto cursor = offset;
+			for (uint32_t i = 0; i < x.size(); ++i) {
+				if (cellOf[i] != nCell)
+					_id[cursor[cellOf[i]]++] = i;
+			}
+		}
+		for (uint32_t c = 0; c < nCell; ++c) {
+			if (count[c] == 0)
+				continue;
+			Cell cell{
+				.index = c,
+				.center = CellCenter(c, div),
+				.radius = 0,
+				.normMin = std::numeric_limits<float>::infinity(),
+				.normMax = 0,
+				.begin = offset[c],
+				.end = offset[c + 1],
+			};
+			double maxAngle = 0;
+			for (uint32_t k = cell.begin; k < cell.end; ++k) {
+				const uint32_t id = _id[k];
+				const double len = std::sqrt(double(x[id]) * x[id] + double(y[id]) * y[id] + double(z[id]) * z[id]);
+				cell.normMin = std::min(cell.normMin, float(len));
+				cell.normMax = std::max(cell.normMax, float(len));
+				if (len == 0)
+					continue;
+				const double dot =
+					(x[id] * double(cell.center[0]) + y[id] * double(cell.center[1]) + z[id] * double(cell.center[2])) / len;
+				maxAngle = std::max(maxAngle, std::acos(std::clamp(dot, -1.0, 1.0)));
+			}
+			cell.radius = float(maxAngle + AngleSlack);
+			_cell.emplace_back(cell);
+		}
+	}
+	uint32_t SphereGrid::div() const noexcept {
+		return _div;
+	}
+	const std::vector<SphereGrid::Cell> &SphereGrid::cells() const noexcept {
+		return _cell;
+	}
+	std::span<const uint32_t> SphereGrid::ids(const Cell &cell) const noexcept {
+		return std::span<const uint32_t>(_id).subspan(cell.begin, cell.end - cell.begin);
+	}
+	float SphereGrid::minDistance(const Cell &cell, const float x, const float y, const float z) const noexcept {
+		const double qn = std::sqrt(double(x) * x + double(y) * y + double(z) * z);
+		double theta = 0;
+		if (qn > 0) {
+			const double dot = (x * double(cell.center[0]) + y * double(cell.center[1]) + z * double(cell.center[2])) / qn;
+			theta = std::max(0.0, std::acos(std::clamp(dot, -1.0, 1.0)) - cell.radius);
+		}
+		return std::max(0.f, MinChordDistance(float(theta), float(qn), cell.normMin, cell.normMax) - DistanceSlack);
+	}
+
+	// ------------ SphereRankSource ----------------------
+	bool SphereRankSource::_Less(const Item &a, const Item &b) noexcept {
+		if (a.score != b.score)
+			return a.score < b.score;
+		return a.id > b.id;
+	}
+	SphereRankSource::SphereRankSource(const SphereGrid &grid, const std::span<const float> x,
+									   const std::span<const float> y, const std::span<const float> z,
+									   const std::array<float, 3> &q, const float scale) :
+		_grid(&grid), _x(x), _y(y), _z(z), _q(q), _scale(scale) {
+		_order.reserve(grid.cells().size());
+		for (auto &cell : grid.cells())
+			_order.emplace_back((2.f - grid.minDistance(cell, q[0], q[1], q[2])) / 2 * scale, &cell);
+		std::sort(_order.begin(), _order.end(), [](auto &a, auto &b) { return a.first > b.first; });
+	}
+	std::optional<RankSource::Item> SphereRankSource::next() {
+		for (;;) {
+			// 全てのセルを開いていれば、残りをそのまま返す
+			const bool more = _cursor < _order.size();
+			if (!_heap.empty() && (!more || _heap.front().score >= _order[_cursor].first)) {
+				std::pop_heap(_heap.begin(), _heap.end(), _Less);
+				const Item ret = _heap.back();
+				_heap.pop_back();
+				return ret;
+			}
+			if (!more)
+				return std::nullopt;
+			for (const uint32_t id : _grid->ids(*_order[_cursor].second)) {
+				_heap.emplace_back(Item{id, at(id)});
+				std::push_heap(_heap.begin(), _heap.end(), _Less);
+			}
+			++_cursor;
+		}
+	}
+	float SphereRankSource::at(const uint32_t id) const {
+		const float dx = _x[id] - _q[0];
+		const float dy = _y[id] - _q[1];
+		const float dz = _z[id] - _q[2];
+		// NaN の要素は NaN になる
+		return (2.f - std::sqrt(dx * dx + dy * dy + dz * dz)) / 2 * _scale;
+	}
+} // namespace dg
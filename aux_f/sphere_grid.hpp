@@ -0,0 +1,87 @@
+#pragma once
+#include <array>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "rank_merge.hpp"
+
+namespace dg {
+	/**
+	 * @brief 長さ qn のベクトルと、それから角度 theta 以上離れた長さ [rMin, rMax] のベクトルとの距離の下限
+	 *
+	 * |p - q|^2 = r^2 + qn^2 - 2*r*qn*cos(theta) を r について最小化する。
+	 */
+	float MinChordDistance(float theta, float qn, float rMin, float rMax);
+
+	/**
+	 * @brief 単位球面を立方体の各面で div×div に分けたセルの索引
+	 *
+	 * 面上の座標は atan で角度が均等になる様に歪めてあるので、セルの大きさはほぼ揃う。
+	 * 各セルは中心の方向と、所属する要素までの最大の角度(半径)、要素の長さの範囲を持ち、
+	 * クエリから見たセル内の要素のスコアの上限を求められる。
+	 */
+	class SphereGrid {
+		public:
+			struct Cell {
+					uint32_t index;
+					// 中心の方向 (単位ベクトル)
+					std::array<float, 3> center;
+					// 中心から所属する要素までの最大の角度
+					float radius;
+					// 所属する要素の長さの範囲
+					float normMin, normMax;
+					// ids() の中での範囲
+					uint32_t begin, end;
+			};
+
+		private:
+			uint32_t _div;
+			// 要素の無いセルは含めない
+			std::vector<Cell> _cell;
+			// セル毎にまとめた要素
+			std::vector<uint32_t> _id;
+
+		public:
+			static uint32_t NumCells(uint32_t div) noexcept;
+			// 長さが 0 のベクトルはセル 0 とする
+			static uint32_t CellOf(float x, float y, float z, uint32_t div) noexcept;
+			static std::array<float, 3> CellCenter(uint32_t cell, uint32_t div) noexcept;
+
+			SphereGrid() = default;
+			// 値が NaN の要素は含めない
+			SphereGrid(std::span<const float> x, std::span<const float> y, std::span<const float> z, uint32_t div);
+
+			uint32_t div() const noexcept;
+			const std::vector<Cell> &cells() const noexcept;
+			std::span<const uint32_t> ids(const Cell &cell) const noexcept;
+			// (x, y, z) の方向から見て、セル内の要素との距離の下限
+			float minDistance(const Cell &cell, float x, float y, float z) const noexcept;
+	};
+
+	/**
+	 * @brief (2 - |p - q|)/2 をスコアとし、SphereGrid のセルを上限の高い順に開いて降順に取り出すソース
+	 *
+	 * 開いたセルの要素はヒープに積み、その先頭が次のセルの上限を下回らなくなったら返す。
+	 * K件取り出すのに開くのはおおよそ K件を含むセルとその周囲だけ。
+	 */
+	class SphereRankSource : public RankSource {
+		private:
+			const SphereGrid *_grid;
+			std::span<const float> _x, _y, _z;
+			std::array<float, 3> _q;
+			float _scale;
+			// 上限の降順に並べたセル
+			std::vector<std::pair<float, const SphereGrid::Cell *>> _order;
+			size_t _cursor = 0;
+			std::vector<Item> _heap;
+
+			static bool _Less(const Item &a, const Item &b) noexcept;
+
+		public:
+			// scale: 全体に掛ける係数 (順序を保つ為に 0 以上)
+			SphereRankSource(const SphereGrid &grid, std::span<const float> x, std::span<const float> y,
+							 std::span<const float> z, const std::array<float, 3> &q, float scale);
+			std::optional<Item> next() override;
+			float at(uint32_t id) const override;
+	};
+} // namespace dg
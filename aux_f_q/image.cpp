@@ -1,4 +1,70 @@
 #include "image.hpp"
+#include <QDebug>
+#include <QIODevice>
+#include <QSize>
+
+namespace {
+	// TIFFのバイト順に従って読む
+	struct TiffReader {
+			const QByteArray &data;
+			bool bigEndian;
+
+			bool has(const qsizetype pos, const qsizetype len) const noexcept {
+				return pos >= 0 && len >= 0 && pos + len <= data.size();
+			}
+			uint32_t u16(const qsizetype pos) const noexcept {
+				const auto *p = reinterpret_cast<const uchar *>(data.constData()) + pos;
+				return bigEndian ? (p[0] << 8) | p[1] : (p[1] << 8) | p[0];
+			}
+			uint32_t u32(const qsizetype pos) const noexcept {
+				return bigEndian ? (u16(pos) << 16) | u16(pos + 2) : (u16(pos + 2) << 16) | u16(pos);
+			}
+	};
+
+	QByteArray ThumbnailFromTiff(const QByteArray &tiff) {
+		if (tiff.size() < 8)
+			return {};
+		TiffReader r{tiff, tiff.startsWith("MM")};
+		if (!r.bigEndian && !tiff.startsWith("II"))
+			return {};
+		if (r.u16(2) != 42)
+			return {};
+		// IFD0を読み飛ばしてIFD1(サムネイル)へ
+		const qsizetype ifd0 = r.u32(4);
+		if (!r.has(ifd0, 2))
+			return {};
+		const qsizetype n0 = r.u16(ifd0);
+		const qsizetype next = ifd0 + 2 + n0 * 12;
+		if (!r.has(next, 4))
+			return {};
+		const qsizetype ifd1 = r.u32(next);
+		if (ifd1 == 0 || !r.has(ifd1, 2))
+			return {};
+		const qsizetype n1 = r.u16(ifd1);
+		if (!r.has(ifd1 + 2, n1 * 12))
+			return {};
+		qsizetype offset = -1, length = -1;
+		for (qsizetype i = 0; i < n1; ++i) {
+			const qsizetype ent = ifd1 + 2 + i * 12;
+			switch (r.u16(ent)) {
+				case 0x0201: // JPEGInterchangeFormat
+					offset = r.u32(ent + 8);
+					break;
+				case 0x0202: // JPEGInterchangeFormatLength
+					length = r.u32(ent + 8);
+					break;
+				default:
+					break;
+			}
+		}
+		if (length <= 0 || !r.has(offset, length))
+			return {};
+		QByteArray ret = tiff.mid(offset, length);
+		if (!ret.startsWith("\xFF\xD8"))
+			return {};
+		return ret;
+	}
+} // namespace
 
 namespace dg {
 	QImage RotateByExif(const QImageIOHandler::Transformations tfFlag, const QImage &img) {
@@ -23,4 +89,42 @@ namespace dg {
 		}
 		return {};
 	}
+
+	QByteArray ExifThumbnail(QIODevice &dev) {
+		if (!dev.seek(0) || dev.read(2) != "\xFF\xD8")
+			return {};
+		// APP1(Exif)はSOIの直後に並ぶマーカー群の中にある
+		for (;;) {
+			const QByteArray marker = dev.read(4);
+			if (marker.size() < 4 || uchar(marker[0]) != 0xFF)
+				return {};
+			const uchar type = marker[1];
+			// 画像データに入ったら終わり
+			if (type == 0xDA || type == 0xD9)
+				return {};
+			const qint64 len = (uchar(marker[2]) << 8 | uchar(marker[3])) - 2;
+			if (len < 0)
+				return {};
+			if (type == 0xE1) {
+				const QByteArray payload = dev.read(len);
+				if (payload.size() < len)
+					return {};
+				if (payload.startsWith(QByteArray("Exif\0\0", 6)))
+					return ThumbnailFromTiff(payload.mid(6));
+				continue;
+			}
+			if (!dev.seek(dev.pos() + len))
+				return {};
+		}
+	}
+
+	QSize JpegReducedSize(const QSize &src, const int minSide) {
+		for (const int denom : {8, 4, 2}) {
+			// libjpegの縮小デコードは端数を切り上げる
+			const QSize s((src.width() + denom - 1) / denom, (src.height() + denom - 1) / denom);
+			if (s.width() >= minSide && s.height() >= minSide)
+				return s;
+		}
+		return src;
+	}
 } // namespace dg
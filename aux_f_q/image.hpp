@@ -1,8 +1,23 @@
 #pragma once
+#include <QByteArray>
 #include <QImage>
 #include <QImageIOHandler>
 
+class QIODevice;
 namespace dg {
 	// Exif の回転情報を反映
 	QImage RotateByExif(const QImageIOHandler::Transformations tfFlag, const QImage &img);
+	/**
+	 * @brief JPEGのExif(IFD1)に埋め込まれたサムネイル(JPEG)を取り出す
+	 *
+	 * @param dev 先頭から読み込めるデバイス (読み込み位置は変わる)
+	 * @return JPEGのバイト列 (JPEGでない、またはサムネイルが無ければ空)
+	 */
+	QByteArray ExifThumbnail(QIODevice &dev);
+	/**
+	 * @brief JPEGの縮小デコード(1/2, 1/4, 1/8)で各辺 minSide 以上を保てる最も小さいサイズ
+	 *
+	 * @return 縮小できない場合は src
+	 */
+	QSize JpegReducedSize(const QSize &src, int minSide);
 } // namespace dg
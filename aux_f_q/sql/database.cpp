@@ -9,7 +9,14 @@
 namespace dg::sql {
 	namespace {
 		const QString c_dbType("QSQLITE");
-	}
+
+		// 結果を使い回しても安全な(スキーマやトランザクションを変更しない)文か
+		bool IsCacheable(const QString &text) {
+			static const QRegularExpression s_reg(R"(^\s*(SELECT|WITH|INSERT|REPLACE|UPDATE|DELETE)\b)",
+												  QRegularExpression::CaseInsensitiveOption);
+			return s_reg.match(text).hasMatch();
+		}
+	} // namespace
 	Database::Database(const QString &name, const QString &path, const FeatureV &feature, const PragmaV &pragma) :
 		Database(name, feature, pragma) {
 		setMainDB(path);
@@ -23,6 +30,48 @@ namespace dg::sql {
 				throw FeatureNotSupported(f);
 		}
 	}
+	std::shared_ptr<QSqlQuery> Database::_prepare(const QString &text) const {
+		const auto prepare = [this, &text]() {
+			auto q = std::make_shared<QSqlQuery>(_db);
+			// prepareに失敗した場合はキャッシュせず、実行時にエラーとする
+			const bool ok = q->prepare(text);
+			return std::make_pair(std::move(q), ok);
+		};
+		if (!IsCacheable(text)) {
+			// DDL等の前に、キャッシュ中のステートメントが握っているロックを解放しておく
+			finishStatements();
+			return prepare().first;
+		}
+		if (auto *cached = _stmtCache.find(text)) {
+			// 貸し出し中 (外側で結果を読んでいる最中に同じSQL文が呼ばれた) なら別に用意する
+			if (cached->use_count() > 1)
+				return prepare().first;
+			// 前回の結果を破棄し、バインド値をNULLに戻してから再利用
+			auto &q = **cached;
+			q.finish();
+			const auto nBound = q.boundValues().size();
+			for (int i = 0; i < nBound; ++i)
+				q.bindValue(i, QVariant());
+			return *cached;
+		}
+		auto [q, ok] = prepare();
+		if (ok)
+			_stmtCache.insert(text, q);
+		return q;
+	}
+	const Database::StatementCache::Stats &Database::statementCacheStats() const noexcept {
+		return _stmtCache.stats();
+	}
+	void Database::setStatementCacheSize(const size_t n) {
+		_stmtCache.setCapacity(n);
+	}
+	void Database::finishStatements() const {
+		_stmtCache.forEach([](const QString &, std::shared_ptr<QSqlQuery> &q) {
+			// 貸し出し中の物は外側で結果を読んでいるので触らない
+			if (q.use_count() == 1)
+				q->finish();
+		});
+	}
 	void Database::createTempTable(const QString &tableName, const QString &body, const bool ignoreError) const {
 		exec(QString("CREATE TEMPORARY TABLE %2 %1 (%3)").arg(tableName, ignoreError ? "IF NOT EXISTS" : "", body));
 	}
@@ -42,7 +91,36 @@ namespace dg::sql {
 		_db.setDatabaseName(QDir(path).absolutePath());
 	}
 	void Database::attach(const QString &path, const QString &name) {
-		sql::Query(_db, QString("ATTACH DATABASE ? AS ?"), QDir(path).absolutePath(), name);
+		finishStatements();
+		const auto absPath = QDir(path).absolutePath();
+		sql::Query(_db, QString("ATTACH DATABASE ? AS ?"), absPath, name);
+		std::lock_guard lk(_stateMutex);
+		_attached.emplace_back(absPath, name);
+	}
+	std::unique_ptr<Database> Database::openReadOnlyCopy(const QString &name) const {
+		auto pragma = _pragma;
+		pragma.emplace_back("query_only", "true");
+		auto ret = std::make_unique<Database>(name, _db.databaseName(), FeatureV{}, pragma);
+		QString2V extensions;
+		{
+			std::lock_guard lk(_stateMutex);
+			extensions = _extensions;
+		}
+		for (auto &&[path, entry] : extensions)
+			ret->loadExtension(path, entry);
+		return ret;
+	}
+	size_t Database::replayAttach(Database &dst, const size_t from) const {
+		QString2V attached;
+		{
+			std::lock_guard lk(_stateMutex);
+			if (from >= _attached.size())
+				return _attached.size();
+			attached.assign(_attached.begin() + from, _attached.end());
+		}
+		for (auto &&[path, name] : attached)
+			dst.attach(path, name);
+		return from + attached.size();
 	}
 	QSqlQuery Database::_makeSchemaQuery(const Name &target, const QString &column, const QString &type) const {
 		return sql::Query(_db,
@@ -60,6 +138,8 @@ namespace dg::sql {
 	}
 	void Database::detach(const QString &path) {
 		exec(QString("DETACH DATABASE ?"), path);
+		std::lock_guard lk(_stateMutex);
+		std::erase_if(_attached, [&path](const auto &a) { return std::get<1>(a) == path; });
 	}
 	void Database::open() {
 		if (!_db.isOpen()) {
@@ -72,6 +152,7 @@ namespace dg::sql {
 		}
 	}
 	void Database::close() {
+		_stmtCache.clear();
 		if (_db.isOpen()) {
 			_db.close();
 		}
@@ -142,6 +223,8 @@ namespace dg::sql {
 		catch (const ExecutionError &e) {
 			throw CantLoadExtension(e.what());
 		}
+		std::lock_guard lk(_stateMutex);
+		_extensions.emplace_back(path, entry_point);
 	}
 	void Database::beginTransaction() {
 		exec("BEGIN TRANSACTION");
@@ -1,20 +1,39 @@
 #pragma once
 #include <QSqlDatabase>
 #include <QSqlDriver>
+#include <mutex>
 #include "aux_f/debug.hpp"
+#include "aux_f/lru_cache.hpp"
 #include "name.hpp"
 #include "query.hpp"
+#include "statement.hpp"
 
 namespace dg::sql {
 	using FeatureV = std::vector<QSqlDriver::DriverFeature>;
 	using PragmaV = std::vector<std::pair<QString, QString>>;
 	using QString2V = std::vector<std::tuple<QString, QString>>;
 	class Database {
+		public:
+			using StatementCache = LruCache<QString, std::shared_ptr<QSqlQuery>>;
+			// キャッシュするprepare済みステートメントの最大数
+			constexpr static size_t DefaultStatementCacheSize = 64;
+
 		private:
 			QString _name;
 			PragmaV _pragma;
 			QSqlDatabase _db;
+			// SQL文字列をキーとしたprepare済みステートメント
+			mutable StatementCache _stmtCache{DefaultStatementCacheSize};
+			// ロード済みの拡張(path, entry_point)とattach済みのDB(path, name)
+			// (読み取り専用の複製接続で同じ状態を再現する為に記録しておく)
+			mutable std::mutex _stateMutex;
+			QString2V _extensions;
+			QString2V _attached;
+
 			QSqlQuery _makeSchemaQuery(const Name &target, const QString &column, const QString &type) const;
+			// キャッシュ済みのステートメントを取得 (無ければprepareして登録)
+			// 貸し出し中(前回の結果を読んでいる最中)なら、キャッシュせずに別にprepareする
+			std::shared_ptr<QSqlQuery> _prepare(const QString &text) const;
 
 		public:
 			Database(const QString &name, const FeatureV &feature, const PragmaV &pragma);
@@ -30,6 +49,11 @@ namespace dg::sql {
 			QString getSchema(const Name &src) const;
 			QString2V getIndex(const Name &src) const;
 			const QSqlDatabase &database() const noexcept;
+			// 同じDBファイルを読み取り専用(query_only)で開いた別の接続を作る
+			// ロード済みの拡張も読み込む。接続は呼び出したスレッドでのみ使用可能
+			std::unique_ptr<Database> openReadOnlyCopy(const QString &name) const;
+			// attach済みのDBのうち from 番目以降を dst にもattachし、attach済みの数を返す
+			size_t replayAttach(Database &dst, size_t from) const;
 			// --- Transaction ---
 			void beginTransaction();
 			void commitTransaction();
@@ -46,10 +70,20 @@ namespace dg::sql {
 			int getNTempTable() const;
 			bool hasTable(const Name &name) const;
 
+			// --- Statement cache ---
+			const StatementCache::Stats &statementCacheStats() const noexcept;
+			void setStatementCacheSize(size_t n);
+			// 貸し出し中でないキャッシュ中のステートメントを全てリセットする (DDLやトランザクション制御の前に呼ばれる)
+			void finishStatements() const;
+
 			// --- Query ---
+			// SELECT/INSERT/UPDATE/DELETE はprepare済みステートメントを再利用する
+			// (返されたStatementを破棄するまで、そのステートメントは他のexecに使われない)
 			template <typename... Ts>
-			QSqlQuery exec(WithLocation<QString> text, Ts &&...ts) const {
-				return ::dg::sql::Query(_db, text, std::forward<Ts>(ts)...);
+			Statement exec(WithLocation<QString> text, Ts &&...ts) const {
+				auto q = _prepare(text);
+				::dg::sql::ExecInPlace(*q, std::forward<Ts>(ts)...);
+				return Statement(std::move(q));
 			}
 
 			template <typename... Ts>
@@ -0,0 +1,19 @@
+#pragma once
+#include <QString>
+#include <QStringList>
+#include "id.hpp"
+
+namespace dg::sql {
+	/**
+	 * @brief ID(enum class)の並びをJSON配列の文字列にする
+	 *
+	 * "... IN (SELECT value FROM json_each(?))" の様に、任意個のIDを1つのパラメータで渡す為のもの
+	 */
+	template <typename Range>
+	QString MakeIdArray(const Range &ids) {
+		QStringList str;
+		for (auto &&id : ids)
+			str.append(QString::number(EnumToInt(id)));
+		return "[" + str.join(',') + "]";
+	}
+} // namespace dg::sql
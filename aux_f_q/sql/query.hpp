@@ -23,16 +23,37 @@ namespace dg::sql {
 			AddBind<WithNull, Proc>(q, args...);
 		}
 
+		template <bool WithNull, Proc_p Proc, class... Args>
+		void ExecInPlace(QSqlQuery &q, const Args &...args) {
+			AddBind<WithNull, Proc>(q, args...);
+			Proc(q);
+		}
+		template <bool WithNull, Proc_p Proc, class... Args>
+		QSqlQuery Exec(QSqlQuery q, const Args &...args) {
+			ExecInPlace<WithNull, Proc>(q, args...);
+			return q;
+		}
+
 		template <bool WithNull, Proc_p Proc, class Str, class... Args>
 		QSqlQuery Query(const QSqlDatabase &db, const Str &str, const Args &...args) {
 			QSqlQuery q(db);
 			q.prepare(str);
-			AddBind<WithNull, Proc>(q, args...);
-			Proc(q);
-			return std::move(q);
+			return Exec<WithNull, Proc>(std::move(q), args...);
 		}
 	} // namespace detail
 
+	// prepare済みのクエリに値をバインドして実行
+	template <Proc_p Proc = &Query, typename... Args>
+	QSqlQuery Exec(QSqlQuery q, const Args &...args) {
+		return detail::Exec<false, Proc>(std::move(q), args...);
+	}
+
+	// prepare済みのクエリをそのまま(複製せずに)実行
+	template <Proc_p Proc = &Query, typename... Args>
+	void ExecInPlace(QSqlQuery &q, const Args &...args) {
+		detail::ExecInPlace<false, Proc>(q, args...);
+	}
+
 	template <Proc_p Proc = &Query, typename Str, typename... Args>
 	QSqlQuery Query(const QSqlDatabase &db, const Str &str, const Args &...args) {
 		return detail::Query<false, Proc>(db, str, args...);
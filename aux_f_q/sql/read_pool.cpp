@@ -0,0 +1,26 @@
+#include "read_pool.hpp"
+
+namespace dg::sql {
+	ReadPool::ReadPool(const Database &src, const QString &name, const int nConnection) : _src(src), _name(name) {
+		_pool.setMaxThreadCount(std::max(1, nConnection));
+		// スレッドが破棄されると接続も開き直しになるので、常駐させる
+		_pool.setExpiryTimeout(-1);
+	}
+	ReadPool::~ReadPool() {
+		_pool.waitForDone();
+	}
+	int ReadPool::size() const {
+		return _pool.maxThreadCount();
+	}
+	Database &ReadPool::_acquire() {
+		if (!_local.hasLocalData()) {
+			auto *local = new Local;
+			local->db = _src.openReadOnlyCopy(QString("%1_%2").arg(_name).arg(_serial++));
+			_local.setLocalData(local);
+		}
+		auto *local = _local.localData();
+		// プール作成後にattachされたDBがあれば反映する
+		local->nAttached = _src.replayAttach(*local->db, local->nAttached);
+		return *local->db;
+	}
+} // namespace dg::sql
@@ -0,0 +1,54 @@
+#pragma once
+#include <QThreadPool>
+#include <QThreadStorage>
+#include <QtConcurrent/QtConcurrentRun>
+#include <atomic>
+#include <memory>
+#include <type_traits>
+#include "database.hpp"
+
+namespace dg::sql {
+	/**
+	 * @brief 読み取り専用接続のプール
+	 *
+	 * 専用のスレッドプールの各スレッドが、元のDatabaseを複製した接続を1つずつ持つ。
+	 * (Qtの接続は作成したスレッドでしか使えない為、接続ではなくスレッドを貸し出す)
+	 * 接続は最初に使われた時に開き、以降はスレッドと共に使い回す。
+	 */
+	class ReadPool {
+		private:
+			struct Local {
+					std::unique_ptr<Database> db;
+					// 元のDatabaseからattachを反映済みの数
+					size_t nAttached = 0;
+			};
+			const Database &_src;
+			QString _name;
+			std::atomic_int _serial{0};
+			// スレッド終了時に各スレッド上で接続を破棄する
+			// (_poolより先に宣言し、プールの停止後に破棄されるようにする)
+			QThreadStorage<Local *> _local;
+			QThreadPool _pool;
+
+			Database &_acquire();
+
+		public:
+			/**
+			 * @param src 複製元の接続 (ReadPoolより長く生存している必要がある)
+			 * @param nConnection 接続(スレッド)数
+			 */
+			ReadPool(const Database &src, const QString &name, int nConnection);
+			~ReadPool();
+
+			int size() const;
+			/**
+			 * @brief プールのスレッドで f(Database&) を実行する
+			 *
+			 * @return fの戻り値を受け取るQFuture
+			 */
+			template <typename F>
+			auto run(F f) -> QFuture<std::invoke_result_t<F, Database &>> {
+				return QtConcurrent::run(&_pool, [this, f = std::move(f)]() mutable { return f(_acquire()); });
+			}
+	};
+} // namespace dg::sql
@@ -0,0 +1,65 @@
+#pragma once
+#include <QSqlQuery>
+#include <QVariant>
+#include <memory>
+
+namespace dg::sql {
+	/**
+	 * @brief Database::exec が返す実行済みのクエリ
+	 *
+	 * キャッシュ中のステートメントを使う場合、このオブジェクトが生きている間は貸し出し中になり、
+	 * 同じSQL文の exec は別のステートメントをprepareする (外側の結果セットを壊さない為)。
+	 * 破棄する時に結果を捨てて、握っている読み取りロックを解放する。
+	 */
+	class Statement {
+		private:
+			std::shared_ptr<QSqlQuery> _q;
+
+		public:
+			explicit Statement(std::shared_ptr<QSqlQuery> q) : _q(std::move(q)) {
+			}
+			Statement(Statement &&) noexcept = default;
+			Statement &operator=(Statement &&other) noexcept {
+				if (this != &other) {
+					release();
+					_q = std::move(other._q);
+				}
+				return *this;
+			}
+			Statement(const Statement &) = delete;
+			Statement &operator=(const Statement &) = delete;
+			~Statement() {
+				release();
+			}
+
+			// 結果を捨ててステートメントを返却する
+			void release() noexcept {
+				if (_q) {
+					_q->finish();
+					_q.reset();
+				}
+			}
+			bool next() {
+				return _q->next();
+			}
+			QVariant value(const int index) const {
+				return _q->value(index);
+			}
+			QVariant value(const QString &name) const {
+				return _q->value(name);
+			}
+			int numRowsAffected() const {
+				return _q->numRowsAffected();
+			}
+			QVariant lastInsertId() const {
+				return _q->lastInsertId();
+			}
+			// QSqlQuery を受け取る関数に渡す用
+			QSqlQuery &query() noexcept {
+				return *_q;
+			}
+			operator QSqlQuery &() noexcept {
+				return *_q;
+			}
+	};
+} // namespace dg::sql
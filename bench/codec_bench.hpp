@@ -0,0 +1,22 @@
+#pragma once
+#include <QImage>
+#include <vector>
+#include "singleton/thumbnail_codec.hpp"
+
+struct CodecBenchResult {
+		ThumbnailCodec::Kind kind;
+		// 1枚あたりの平均 [us]
+		double encodeUs, decodeUs;
+		// 1枚あたりの平均 [byte]
+		double bytes;
+		// デコード結果が元と一致したか
+		bool lossless;
+};
+/**
+ * @brief ベンチマーク用の画像を作る (写真に近い滑らかな部分と細かい模様が混ざった物)
+ *
+ * @param seed 同じ値なら同じ画像を作る
+ */
+std::vector<QImage> MakeCodecBenchImages(int count, int size, unsigned seed = 0);
+// 全ての方式でエンコード・デコードの時間と大きさを測る
+std::vector<CodecBenchResult> BenchmarkCodecs(const std::vector<QImage> &images, int repeat);
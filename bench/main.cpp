@@ -0,0 +1,81 @@
+#include <QCoreApplication>
+#include <QDebug>
+#include <algorithm>
+#include <cstring>
+#include "aux_f/exception.hpp"
+#include "aux_f_q/sql/database.hpp"
+#include "codec_bench.hpp"
+#include "singleton/my_thumbnail.hpp"
+#include "vec_index_bench.hpp"
+
+// GUIアプリとは別に、サムネイルの保存方式とvec0の索引を測るベンチマーク
+// 引数無しなら全て、--codec / --hnsw を指定したらその分だけ行う
+namespace {
+	// サムネイルの保存方式を比較するオプション (データベースは使わない)
+	constexpr auto CodecOption = "--codec";
+	// vec0 の HNSW 索引と総当たりの KNN を比較するオプション (データベースはメモリ上に作る)
+	constexpr auto HnswOption = "--hnsw";
+
+	bool HasOption(const int argc, char *argv[], const char *option) {
+		return std::any_of(argv + 1, argv + argc, [option](const char *arg) { return std::strcmp(arg, option) == 0; });
+	}
+
+	int RunCodecBenchmark() {
+		constexpr int NImage = 256, Repeat = 4;
+		for (const int size : MyThumbnail::LevelSize) {
+			const auto images = MakeCodecBenchImages(NImage, size);
+			qInfo().noquote() << QString("--- %1x%1, %2 images ---").arg(size).arg(NImage);
+			qInfo().noquote() << "codec      encode[us]  decode[us]     bytes  lossless";
+			for (auto &&res : BenchmarkCodecs(images, Repeat)) {
+				qInfo().noquote() << QString("%1 %2 %3 %4  %5")
+										 .arg(ThumbnailCodec::Get(res.kind).name(), -8)
+										 .arg(res.encodeUs, 12, 'f', 1)
+										 .arg(res.decodeUs, 11, 'f', 1)
+										 .arg(res.bytes, 9, 'f', 0)
+										 .arg(res.lossless ? "yes" : "no");
+			}
+		}
+		return 0;
+	}
+
+	int RunHnswBenchmark() {
+		try {
+			dg::sql::Database db("VecBench", ":memory:", dg::sql::FeatureV{}, dg::sql::PragmaV{});
+			db.loadExtension("sqlite-vec.dll", "sqlite3_vec_init");
+			const VecIndexBenchParam param;
+			qInfo().noquote() << QString("--- %1 vectors, %2 dims, k=%3, %4 queries (M=%5, efConstruction=%6) ---")
+									 .arg(param.nVector)
+									 .arg(param.dim)
+									 .arg(param.k)
+									 .arg(param.nQuery)
+									 .arg(param.m)
+									 .arg(param.efConstruction);
+			const auto res = BenchmarkVecIndex(db, param);
+			qInfo().noquote() << QString("build: exact %1ms, hnsw %2ms")
+									 .arg(res.exactBuildMs, 0, 'f', 0)
+									 .arg(res.hnswBuildMs, 0, 'f', 0);
+			qInfo().noquote() << "efSearch  recall  query[us]";
+			qInfo().noquote() << QString("exact     %1 %2").arg(1.0, 6, 'f', 3).arg(res.exactQueryUs, 10, 'f', 1);
+			for (auto &&p : res.sweep) {
+				qInfo().noquote()
+					<< QString("%1 %2 %3").arg(p.efSearch, -8).arg(p.recall, 7, 'f', 3).arg(p.queryUs, 10, 'f', 1);
+			}
+		}
+		catch (const dg::RuntimeError &e) {
+			qCritical().noquote() << "An error has occurred:" << QString::fromStdString(e.s_what());
+			return 1;
+		}
+		return 0;
+	}
+} // namespace
+
+int main(int argc, char *argv[]) {
+	QCoreApplication a(argc, argv);
+	const bool all = argc <= 1;
+	int ret = 0;
+	if (all || HasOption(argc, argv, CodecOption))
+		ret |= RunCodecBenchmark();
+	if (all || HasOption(argc, argv, HnswOption))
+		ret |= RunHnswBenchmark();
+	return ret;
+}
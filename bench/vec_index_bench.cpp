@@ -0,0 +1,112 @@
+#include "vec_index_bench.hpp"
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <QVariantList>
+#include <algorithm>
+#include <random>
+#include <unordered_set>
+#include "aux_f_q/sql/database.hpp"
+
+namespace {
+	constexpr auto ExactTable = "temp.VecBenchExact", HnswTable = "temp.VecBenchHnsw";
+
+	// 姿勢の埋め込みに近づける為、一様乱数ではなく幾つかの塊に分かれた分布にする
+	std::vector<QByteArray> MakeVectors(const int n, const int dim, std::mt19937 &mt) {
+		constexpr int NCluster = 64;
+		std::normal_distribution<float> nd;
+		std::vector<std::vector<float>> center(NCluster, std::vector<float>(dim));
+		for (auto &c : center)
+			std::generate(c.begin(), c.end(), [&] { return nd(mt); });
+		std::uniform_int_distribution<int> pick(0, NCluster - 1);
+		std::vector<QByteArray> ret;
+		ret.reserve(n);
+		std::vector<float> v(dim);
+		for (int i = 0; i < n; ++i) {
+			const auto &c = center[pick(mt)];
+			for (int d = 0; d < dim; ++d)
+				v[d] = c[d] + nd(mt) * 0.5f;
+			ret.emplace_back(reinterpret_cast<const char *>(v.data()), int(v.size() * sizeof(float)));
+		}
+		return ret;
+	}
+
+	double Insert(dg::sql::Database &db, const QString &table, const QVariantList &ids, const QVariantList &vecs) {
+		QElapsedTimer timer;
+		timer.start();
+		db.beginTransaction();
+		try {
+			db.batch(QString("INSERT INTO %1 (rowid, v) VALUES (?,?)").arg(table), ids, vecs);
+			db.commitTransaction();
+		}
+		catch (...) {
+			db.rollbackTransaction();
+			throw;
+		}
+		return timer.nsecsElapsed() / 1e6;
+	}
+
+	std::vector<qint64> Knn(const dg::sql::Database &db, const QString &table, const QByteArray &query, const int k) {
+		std::vector<qint64> ret;
+		auto q = db.exec(QString("SELECT rowid FROM %1 WHERE v MATCH ? AND k = ?").arg(table), query, k);
+		while (q.next())
+			ret.emplace_back(q.value(0).toLongLong());
+		return ret;
+	}
+} // namespace
+
+VecIndexBenchResult BenchmarkVecIndex(dg::sql::Database &db, const VecIndexBenchParam &param) {
+	std::mt19937 mt(param.seed);
+	const auto vectors = MakeVectors(param.nVector, param.dim, mt);
+	const auto queries = MakeVectors(param.nQuery, param.dim, mt);
+
+	db.exec(QString("DROP TABLE IF EXISTS %1").arg(ExactTable));
+	db.exec(QString("DROP TABLE IF EXISTS %1").arg(HnswTable));
+	db.exec(QString("CREATE VIRTUAL TABLE %1 USING vec0(v float[%2])").arg(ExactTable).arg(param.dim));
+	db.exec(QString("CREATE VIRTUAL TABLE %1 USING vec0(v float[%2] index=hnsw hnsw_m=%3 hnsw_ef_construction=%4)")
+				.arg(HnswTable)
+				.arg(param.dim)
+				.arg(param.m)
+				.arg(param.efConstruction));
+
+	VecIndexBenchResult ret{};
+	{
+		QVariantList ids, vecs;
+		for (int i = 0; i < param.nVector; ++i) {
+			ids.append(i + 1);
+			vecs.append(vectors[i]);
+		}
+		ret.exactBuildMs = Insert(db, ExactTable, ids, vecs);
+		ret.hnswBuildMs = Insert(db, HnswTable, ids, vecs);
+	}
+
+	// 正解 (総当たり)
+	std::vector<std::vector<qint64>> truth;
+	QElapsedTimer timer;
+	timer.start();
+	for (auto &&q : queries)
+		truth.emplace_back(Knn(db, ExactTable, q, param.k));
+	ret.exactQueryUs = timer.nsecsElapsed() / 1000.0 / std::max(1, param.nQuery);
+
+	// 最初のクエリで索引をメモリに読み込むので、測る前に1回引いておく
+	if (!queries.empty())
+		Knn(db, HnswTable, queries.front(), param.k);
+	for (const int ef : param.efSearch) {
+		db.exec("SELECT vec_hnsw_ef_search(?)", ef);
+		size_t hit = 0, total = 0;
+		timer.start();
+		std::vector<std::vector<qint64>> found;
+		for (auto &&q : queries)
+			found.emplace_back(Knn(db, HnswTable, q, param.k));
+		const double us = timer.nsecsElapsed() / 1000.0 / std::max(1, param.nQuery);
+		for (size_t i = 0; i < found.size(); ++i) {
+			const std::unordered_set<qint64> set(found[i].begin(), found[i].end());
+			hit += std::count_if(truth[i].begin(), truth[i].end(), [&](const qint64 id) { return set.contains(id); });
+			total += truth[i].size();
+		}
+		ret.sweep.emplace_back(VecIndexBenchResult::Point{ef, total ? double(hit) / total : 1.0, us});
+	}
+	db.exec("SELECT vec_hnsw_ef_search(0)");
+	db.exec(QString("DROP TABLE %1").arg(ExactTable));
+	db.exec(QString("DROP TABLE %1").arg(HnswTable));
+	return ret;
+}
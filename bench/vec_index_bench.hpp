@@ -0,0 +1,42 @@
+#pragma once
+#include <vector>
+
+namespace dg::sql {
+	class Database;
+}
+
+/**
+ * @brief vec0 の HNSW 索引(index=hnsw)と総当たりの KNN を比べるベンチマーク
+ *
+ * 同じベクトルを総当たりの表と HNSW の表に入れ、efSearch を変えながら
+ * 総当たりの結果に対する recall@k と1クエリあたりの時間を測る。
+ * 表は一時スキーマ(temp)に作り、終わったら消す。
+ */
+struct VecIndexBenchParam {
+		int nVector = 50000;
+		int dim = 48;
+		int k = 10;
+		int nQuery = 200;
+		// 索引の構築パラメータ
+		int m = 16;
+		int efConstruction = 200;
+		// 測る efSearch
+		std::vector<int> efSearch{10, 20, 40, 80, 160, 320};
+		unsigned seed = 0;
+};
+struct VecIndexBenchResult {
+		// 表への挿入にかかった時間 [ms]
+		double exactBuildMs, hnswBuildMs;
+		// 総当たりの1クエリあたりの時間 [us]
+		double exactQueryUs;
+		struct Point {
+				int efSearch;
+				// 総当たりの上位k件のうち、HNSW でも返った割合
+				double recall;
+				// 1クエリあたりの時間 [us]
+				double queryUs;
+		};
+		std::vector<Point> sweep;
+};
+// db は sqlite-vec を読み込み済みであること
+VecIndexBenchResult BenchmarkVecIndex(dg::sql::Database &db, const VecIndexBenchParam &param);
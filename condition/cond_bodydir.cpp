@@ -1,8 +1,10 @@
+#include "aux_f/sphere_grid.hpp"
 #include "aux_f_q/convert.hpp"
 #include "condition.hpp"
 #include "param/directionparam3d.h"
 #include "param/paramwrapper.h"
 #include "param/querydialog.h"
+#include "search/pose_store.hpp"
 
 // ------------ Cond_BodyDir ----------------------
 Cond_BodyDir::Cond_BodyDir() : _dir(1.f, 0.f, 0.f) {
@@ -34,16 +36,83 @@ void Cond_BodyDir::loadParamFromDialog(const QVariantList &vl) {
 }
 
 QuerySeed Cond_BodyDir::getSqlQuery(const QueryParam &param) const {
+	const QVector3D dir = param.ratio < 0.f ? -_dir : _dir;
+	const QString score = "(2.0 - SQRT((dirX - :dir_x)*(dirX - :dir_x) + (dirY - :dir_y)*(dirY - :dir_y) + "
+						  "(dirZ - :dir_z)*(dirZ - :dir_z)))/2";
+	// 1. セル毎に、中心との角度から半径を引いた角度と長さの範囲から、スコアの上限を求める
+	//    (dg::SphereGrid::minDistance と同じ計算)
+	// 2. 上限の高い順に合わせて :limit 件に達するまでのセルを開き、その中で :limit 番目のスコア s を求める
+	// 3. 上限が s 以上のセルだけを開いて厳密な上位 :limit 件を求める
+	const QString sql = QString(R"(
+		WITH %1 AS (
+			WITH %1_cell AS (
+				SELECT cell, count,
+					(2.0 - SQRT(MAX(0.0, r*r + :dir_n*:dir_n - 2*r*:dir_n*c)))/2 AS bound
+				FROM (
+					SELECT cell, count, c, MIN(MAX(:dir_n * c, normMin), normMax) AS r
+					FROM (
+						SELECT cell, count, normMin, normMax,
+							COS(MAX(0.0, ACOS(MIN(1.0, MAX(-1.0, (cx*:dir_x + cy*:dir_y + cz*:dir_z) / :dir_n)))
+								- radius)) AS c
+						FROM DirCell
+					)
+				)
+			), %1_near AS (
+				SELECT %2 AS score
+				FROM PoseScalar
+				WHERE dirCell IN (
+					SELECT cell FROM (
+						SELECT cell, SUM(count) OVER (ORDER BY bound DESC ROWS UNBOUNDED PRECEDING) - count AS before
+						FROM %1_cell
+					)
+					WHERE before < :limit
+				)
+				ORDER BY score DESC
+				LIMIT 1 OFFSET :limit - 1
+			)
+			SELECT poseId, %2 AS score
+			FROM PoseScalar
+			WHERE dirCell IN (
+				SELECT cell FROM %1_cell
+				WHERE bound >= COALESCE((SELECT score FROM %1_near), -1e9)
+			)
+			ORDER BY score DESC
+			LIMIT :limit
+		)
+	)")
+							.arg(param.outputTableName, score);
 	return {
-		QString("WITH %1 AS ( "
-				"SELECT poseId, (2.0 - distance)/2 AS score "
-				"	FROM MasseTorsoVec "
-				"	WHERE dir MATCH :body_dir "
-				"	LIMIT :limit )")
-			.arg(param.outputTableName),
+		sql,
 		{
-			{":body_dir", dg::VecToByteArray(param.ratio < 0.f ? -_dir : _dir)},
+			{":dir_x", dir.x()},
+			{":dir_y", dir.y()},
+			{":dir_z", dir.z()},
+			{":dir_n", dir.length()},
 		},
 		std::abs(param.ratio),
 	};
 }
+
+void Cond_BodyDir::scoreNative(const PoseStore &store, const float ratio, const std::span<float> out) const {
+	const QVector3D dir = ratio < 0.f ? -_dir : _dir;
+	const float w = std::abs(ratio);
+	const auto cx = store.column(PoseStore::Column::DirX);
+	const auto cy = store.column(PoseStore::Column::DirY);
+	const auto cz = store.column(PoseStore::Column::DirZ);
+	const float qx = dir.x(), qy = dir.y(), qz = dir.z();
+	for (size_t i = 0; i < out.size(); ++i) {
+		const float dx = cx[i] - qx;
+		const float dy = cy[i] - qy;
+		const float dz = cz[i] - qz;
+		// vec0のL2距離と同じくfloatで計算する
+		const float dist = std::sqrt(dx * dx + dy * dy + dz * dz);
+		out[i] = static_cast<float>((2.0 - dist) / 2 * w);
+	}
+}
+
+dg::RankSource_U Cond_BodyDir::rankSource(const PoseStore &store, const float ratio) const {
+	const QVector3D dir = ratio < 0.f ? -_dir : _dir;
+	return std::make_unique<dg::SphereRankSource>(
+		store.dirGrid(), store.column(PoseStore::Column::DirX), store.column(PoseStore::Column::DirY),
+		store.column(PoseStore::Column::DirZ), std::array<float, 3>{dir.x(), dir.y(), dir.z()}, std::abs(ratio));
+}
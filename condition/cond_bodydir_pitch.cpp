@@ -1,11 +1,11 @@
 #include <qmath.h>
 #include "aux_f/value.hpp"
-#include "aux_f_q/convert.hpp"
 #include "aux_f_q/q_value.hpp"
 #include "condition.hpp"
 #include "param/directionparam_pitch.h"
 #include "param/paramwrapper.h"
 #include "param/querydialog.h"
+#include "search/pose_store.hpp"
 
 // ------------ Cond_BodyDirPitch ----------------------
 Cond_BodyDirPitch::Cond_BodyDirPitch() : _pitch(0) {
@@ -44,19 +44,41 @@ QuerySeed Cond_BodyDirPitch::getSqlQuery(const QueryParam &param) const {
 	// _pitchは[-90, 90]の範囲
 	// テーブルに格納してあるのは[-1, 1]
 	const auto clampedVal = dg::Remap(static_cast<float>(_pitch), -90.f, 90.f, -1.f, 1.f);
-	auto ba = dg::VecToByteArray(clampedVal);
 	return {
 		QString(
-			// Vec0から値を取り出す -> outputTable
+			// 索引を目標値から上下に辿って近い物を取り出す -> outputTable
 			"WITH %1 AS ( "
-			"SELECT poseId, (2.0 - distance)/2 AS score "
-			"FROM MasseTorsoVec "
-			"WHERE pitch MATCH :pitch_val "
+			"SELECT poseId, (2.0 - dist)/2 AS score "
+			"FROM ( "
+			"	SELECT * FROM (SELECT poseId, :pitch_val - pitch AS dist FROM PoseScalar "
+			"		WHERE pitch <= :pitch_val ORDER BY pitch DESC LIMIT :limit) "
+			"	UNION ALL "
+			"	SELECT * FROM (SELECT poseId, pitch - :pitch_val AS dist FROM PoseScalar "
+			"		WHERE pitch > :pitch_val ORDER BY pitch ASC LIMIT :limit) "
+			") "
+			"ORDER BY dist "
 			"LIMIT :limit ) ")
 			.arg(param.outputTableName),
 		{
-			{":pitch_val", std::move(ba)},
+			{":pitch_val", clampedVal},
 		},
 		param.ratio,
 	};
 }
+
+void Cond_BodyDirPitch::scoreNative(const PoseStore &store, const float ratio, const std::span<float> out) const {
+	const float target = dg::Remap(static_cast<float>(_pitch), -90.f, 90.f, -1.f, 1.f);
+	const auto cp = store.column(PoseStore::Column::Pitch);
+	for (size_t i = 0; i < out.size(); ++i) {
+		const float dist = std::abs(cp[i] - target);
+		out[i] = static_cast<float>((2.0 - dist) / 2 * ratio);
+	}
+}
+
+dg::RankSource_U Cond_BodyDirPitch::rankSource(const PoseStore &store, const float ratio) const {
+	const float target = dg::Remap(static_cast<float>(_pitch), -90.f, 90.f, -1.f, 1.f);
+	constexpr auto P = PoseStore::Column::Pitch;
+	return std::make_unique<dg::SeparableRankSource>(
+		std::vector<dg::SeparableRankSource::Axis>{{&store.sorted(P), store.column(P), target}},
+		[](const float dist) { return (2.f - dist) / 2; }, ratio);
+}
@@ -1,10 +1,22 @@
 #include <qmath.h>
+#include "aux_f/sphere_grid.hpp"
 #include "aux_f_q/convert.hpp"
 #include "aux_f_q/q_value.hpp"
 #include "condition.hpp"
 #include "param/directionparam_yaw.h"
 #include "param/paramwrapper.h"
 #include "param/querydialog.h"
+#include "search/pose_store.hpp"
+
+namespace {
+	// MasseTorsoDir の制約 (0.995 <= |yaw|^2 <= 1.005) より少し広く取った、格納されている yaw の長さの範囲
+	constexpr float YawNormMin = 0.99f, YawNormMax = 1.01f;
+
+	// 長さ qn のクエリから角度 theta 以上離れた yaw が取り得るスコアの上限
+	float YawScoreBound(const float theta, const float qn) {
+		return (2.f - dg::MinChordDistance(theta, qn, YawNormMin, YawNormMax)) / 2;
+	}
+} // namespace
 
 // ------------ Cond_BodyDirYaw ----------------------
 Cond_BodyDirYaw::Cond_BodyDirYaw() : _yawDir(-1.f, 0.f) {
@@ -38,16 +50,102 @@ void Cond_BodyDirYaw::loadParamFromDialog(const QVariantList &vl) {
 }
 
 QuerySeed Cond_BodyDirYaw::getSqlQuery(const QueryParam &param) const {
+	const QVector2D yaw = param.ratio < 0.f ? -_yawDir : _yawDir;
+	const QString score = "(2.0 - SQRT((yawX - :yaw_x)*(yawX - :yaw_x) + (yawY - :yaw_y)*(yawY - :yaw_y)))/2";
+	// 角度の索引を目標から円周の両方向に辿る (±πを跨ぐ分は反対側の端から辿る)
+	const QString nearest = "SELECT * FROM (SELECT poseId FROM PoseScalar "
+							"	WHERE yaw <= :yaw_val ORDER BY yaw DESC LIMIT :limit) "
+							"UNION "
+							"SELECT * FROM (SELECT poseId FROM PoseScalar "
+							"	WHERE yaw > :yaw_val ORDER BY yaw ASC LIMIT :limit) "
+							"UNION "
+							"SELECT * FROM (SELECT poseId FROM PoseScalar "
+							"	WHERE yaw > :yaw_val ORDER BY yaw DESC LIMIT :limit) "
+							"UNION "
+							"SELECT * FROM (SELECT poseId FROM PoseScalar "
+							"	WHERE yaw <= :yaw_val ORDER BY yaw ASC LIMIT :limit)";
+	// yaw は単位ベクトルではないので、角度が近い順とスコアの順は一致しない
+	// 1. 角度が近い物を候補とし、その中で :limit 番目のスコア s を求める
+	// 2. スコアが s 以上になり得るのは、距離 d = 2 - 2s 以内の物だけ
+	//    長さ r の yaw が距離 d 以内にある為の cos(角度) の下限を r について最小化し (YawScoreBound を角度について解いた物)、
+	//    その角度 w 以内を索引で走査して厳密な上位 :limit 件を求める
+	const QString sql = QString(R"(
+		WITH %1 AS (
+			WITH %1_near AS (
+				SELECT %2 AS score
+				FROM PoseScalar
+				WHERE poseId IN (%3)
+				ORDER BY score DESC
+				LIMIT 1 OFFSET :limit - 1
+			), %1_dist AS (
+				SELECT d, MIN(MAX(SQRT(MAX(0.0, :yaw_n*:yaw_n - d*d)), :norm_min), :norm_max) AS r
+				FROM (SELECT 2.0 - 2 * score AS d FROM %1_near)
+			), %1_win AS (
+				SELECT COALESCE((
+					SELECT ACOS(MIN(1.0, MAX(-1.0, (r*r + :yaw_n*:yaw_n - d*d) / (2 * r * :yaw_n)))) + 1e-6
+					FROM %1_dist
+				), 1e9) AS w
+			)
+			SELECT poseId, %2 AS score
+			FROM PoseScalar
+			WHERE poseId IN (
+				SELECT poseId FROM %1_win, PoseScalar
+				WHERE yaw BETWEEN :yaw_val - w AND :yaw_val + w
+				UNION ALL
+				SELECT poseId FROM %1_win, PoseScalar
+				WHERE yaw >= :yaw_val - w + 2 * PI()
+				UNION ALL
+				SELECT poseId FROM %1_win, PoseScalar
+				WHERE yaw <= :yaw_val + w - 2 * PI()
+			)
+			ORDER BY score DESC
+			LIMIT :limit
+		)
+	)")
+							.arg(param.outputTableName, score, nearest);
 	return {
-		QString("WITH %1 AS ( "
-				"SELECT poseId, (2.0 - distance)/2 AS score "
-				"	FROM MasseTorsoVec "
-				"	WHERE yaw MATCH :body_yaw "
-				"	LIMIT :limit ) ")
-			.arg(param.outputTableName),
+		sql,
 		{
-			{":body_yaw", dg::VecToByteArray(param.ratio < 0.f ? -_yawDir : _yawDir)},
+			{":yaw_val", std::atan2(yaw.y(), yaw.x())},
+			{":yaw_x", yaw.x()},
+			{":yaw_y", yaw.y()},
+			{":yaw_n", yaw.length()},
+			{":norm_min", YawNormMin},
+			{":norm_max", YawNormMax},
 		},
 		std::abs(param.ratio),
 	};
 }
+
+void Cond_BodyDirYaw::scoreNative(const PoseStore &store, const float ratio, const std::span<float> out) const {
+	const QVector2D yaw = ratio < 0.f ? -_yawDir : _yawDir;
+	const float w = std::abs(ratio);
+	const auto cx = store.column(PoseStore::Column::YawX);
+	const auto cy = store.column(PoseStore::Column::YawY);
+	const float qx = yaw.x(), qy = yaw.y();
+	for (size_t i = 0; i < out.size(); ++i) {
+		const float dx = cx[i] - qx;
+		const float dy = cy[i] - qy;
+		const float dist = std::sqrt(dx * dx + dy * dy);
+		out[i] = static_cast<float>((2.0 - dist) / 2 * w);
+	}
+}
+
+dg::RankSource_U Cond_BodyDirYaw::rankSource(const PoseStore &store, const float ratio) const {
+	const QVector2D yaw = ratio < 0.f ? -_yawDir : _yawDir;
+	const float qx = yaw.x(), qy = yaw.y(), qn = yaw.length();
+	const auto cx = store.column(PoseStore::Column::YawX);
+	const auto cy = store.column(PoseStore::Column::YawY);
+	constexpr auto A = PoseStore::Column::YawAngle;
+	// 角度で辿り、スコアは scoreNative と同じくベクトルの距離から求める
+	return std::make_unique<dg::SeparableRankSource>(
+		std::vector<dg::SeparableRankSource::Axis>{
+			{&store.sorted(A), store.column(A), std::atan2(qy, qx), float(2 * M_PI)}},
+		[qn](const float theta) { return YawScoreBound(theta, qn); },
+		[cx, cy, qx, qy](const uint32_t i) {
+			const float dx = cx[i] - qx;
+			const float dy = cy[i] - qy;
+			return (2.f - std::sqrt(dx * dx + dy * dy)) / 2;
+		},
+		std::abs(ratio));
+}
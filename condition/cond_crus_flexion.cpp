@@ -5,27 +5,12 @@
 #include "param/float_slider_param.h"
 #include "param/paramwrapper.h"
 #include "param/querydialog.h"
+#include "search/pose_store.hpp"
 
 namespace {
 	constexpr dg::Degree FLEX_MIN{0.f};
 	constexpr dg::Degree FLEX_MAX{180.f};
 	constexpr std::array<const char *, 2> FLEX_LABELS{"Flexion Left", "Flexion Right"};
-
-	constexpr const char *SQL_TEMPLATE = R"(
-		WITH %1 AS (
-			SELECT
-				poseId,
-				SUM(
-					2.0 - (
-						POW(ABS(angleRad - :target_left) * (1 - is_right), 2) +
-						POW(ABS(angleRad - :target_right) * is_right, 2)
-					) / 2
-				) AS score
-			FROM CrusFlexion
-			GROUP BY poseId
-			LIMIT :limit
-		)
-	)";
 } // namespace
 
 // ------------ Cond_CrusFlexion ----------------------
@@ -72,14 +57,18 @@ namespace {
 } // namespace
 QuerySeed Cond_CrusFlexion::getSqlQuery(const QueryParam &param) const {
 	ValidateTableName(param.outputTableName);
-	const QString sql = QString(SQL_TEMPLATE).arg(param.outputTableName);
 	Q_ASSERT(param.ratio >= 0.f);
-	return {
-		sql,
-		{
-			{":target_left", _flexDeg[0].toRadian().get()},
-			{":target_right", _flexDeg[1].toRadian().get()},
-		},
-		param.ratio,
-	};
+	return MakeFlexionQuery(param, "crusL", "crusR", _flexDeg);
+}
+
+void Cond_CrusFlexion::scoreNative(const PoseStore &store, const float ratio, const std::span<float> out) const {
+	Q_ASSERT(ratio >= 0.f);
+	ScoreFlexionNative(store.column(PoseStore::Column::CrusFlexL), store.column(PoseStore::Column::CrusFlexR), _flexDeg,
+					   ratio, out);
+}
+
+dg::RankSource_U Cond_CrusFlexion::rankSource(const PoseStore &store, const float ratio) const {
+	Q_ASSERT(ratio >= 0.f);
+	constexpr auto L = PoseStore::Column::CrusFlexL, R = PoseStore::Column::CrusFlexR;
+	return MakeFlexionRankSource(store.sorted(L), store.column(L), store.sorted(R), store.column(R), _flexDeg, ratio);
 }
@@ -2,6 +2,7 @@
 #include "param/paramwrapper.h"
 #include "param/querydialog.h"
 #include "param/tag_param.h"
+#include "search/pose_store.hpp"
 
 QString Cond_Tag::dialogName() const {
 	return "Directory Tag";
@@ -43,3 +44,8 @@ QuerySeed Cond_Tag::getSqlQuery(const QueryParam &param) const {
 			},
 			param.ratio};
 }
+
+void Cond_Tag::scoreNative(const PoseStore &store, const float ratio, const std::span<float> out) const {
+	for (const auto idx : store.tagged(_tagName))
+		out[idx] = 1.f * ratio;
+}
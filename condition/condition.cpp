@@ -3,10 +3,12 @@
 #include <QSqlQuery>
 #include <QSqlRecord>
 #include "aux_f_q/q_value.hpp"
+#include "aux_f_q/math.hpp"
 #include "aux_f_q/sql/database.hpp"
 #include "param/float_slider_param.h"
 #include "param/paramwrapper.h"
 #include "param/querydialog.h"
+#include "search/pose_store.hpp"
 
 // --- QuerySeed ---
 QSqlQuery QuerySeed::exec(dg::sql::Database &db, const QString &qtext, const int limit) const {
@@ -51,6 +53,12 @@ void Condition::loadParamFromDialog(const QVariantList &vl) {
 	_ratio = dg::ConvertQV<float>(vl.back());
 }
 
+dg::RankSource_U Condition::rankSource(const PoseStore &store, const float ratio) const {
+	std::vector<float> score(store.size(), std::numeric_limits<float>::quiet_NaN());
+	scoreNative(store, ratio, score);
+	return std::make_unique<PoseStore::ScoreBufferSource>(std::move(score));
+}
+
 float Condition::getRatio() const noexcept {
 	return _ratio;
 }
@@ -65,6 +73,97 @@ QJsonArray VecToJArray(const QVector3D &v) {
 	return {v.x(), v.y(), v.z()};
 }
 
+void ScoreFlexionNative(const std::span<const float> left, const std::span<const float> right,
+						const std::array<dg::Degree, 2> &target, const float ratio, const std::span<float> out) {
+	const double tl = target[0].toRadian().get();
+	const double tr = target[1].toRadian().get();
+	for (size_t i = 0; i < out.size(); ++i) {
+		// SQL版と同じく、存在する側の行だけを合計する
+		const bool hasL = !std::isnan(left[i]);
+		const bool hasR = !std::isnan(right[i]);
+		if (!hasL && !hasR)
+			continue;
+		double score = 0;
+		if (hasL)
+			score += 2.0 - dg::Square(left[i] - tl) / 2;
+		if (hasR)
+			score += 2.0 - dg::Square(right[i] - tr) / 2;
+		out[i] = static_cast<float>(score * ratio);
+	}
+}
+
+namespace {
+	// 片側の索引から目標値に近い :limit 件 (目標値以下を降順に + 目標値より上を昇順に)
+	QString NearestIds(const QString &col, const QString &target) {
+		return QString("SELECT poseId FROM (SELECT poseId FROM PoseScalar WHERE %1 <= %2 ORDER BY %1 DESC LIMIT :limit) "
+					   "UNION "
+					   "SELECT poseId FROM (SELECT poseId FROM PoseScalar WHERE %1 > %2 ORDER BY %1 ASC LIMIT :limit)")
+			.arg(col, target);
+	}
+	// 屈曲角の片側分の項 (SQL版と同じ式)
+	float FlexionTerm(const float dist) {
+		return 2.f - dist * dist / 2;
+	}
+} // namespace
+
+QuerySeed MakeFlexionQuery(const QueryParam &param, const QString &colL, const QString &colR,
+						   const std::array<dg::Degree, 2> &target) {
+	// 値が無い側の項は足さない
+	const QString score = QString("COALESCE(2.0 - POW(%1 - :target_left, 2) / 2, 0) + "
+								  "COALESCE(2.0 - POW(%2 - :target_right, 2) / 2, 0)")
+							  .arg(colL, colR);
+	// 1. 左右の索引から近い物を候補とし、その中で :limit 番目のスコア s を求める
+	// 2. 両側の値を持つ物のスコアは 4 - (dL^2 + dR^2)/2 なので、s 以上になり得るのは
+	//    左右とも距離 rho = sqrt(8 - 2s) 以内の物だけ (片側だけの物はさらに狭い)
+	//    その範囲を索引で走査して厳密な上位 :limit 件を求める
+	const QString sql = QString(R"(
+		WITH %1 AS (
+			WITH %1_near AS (
+				SELECT %4 AS score
+				FROM PoseScalar
+				WHERE poseId IN (%5 UNION %6)
+				ORDER BY score DESC
+				LIMIT 1 OFFSET :limit - 1
+			), %1_win AS (
+				SELECT COALESCE((SELECT SQRT(MAX(0, 8 - 2 * score)) FROM %1_near), 1e9) AS rho
+			)
+			SELECT poseId, %4 AS score
+			FROM PoseScalar
+			WHERE poseId IN (
+				SELECT poseId FROM %1_win, PoseScalar
+				WHERE %2 BETWEEN :target_left - rho AND :target_left + rho
+					AND (%3 IS NULL OR %3 BETWEEN :target_right - rho AND :target_right + rho)
+				UNION ALL
+				SELECT poseId FROM %1_win, PoseScalar
+				WHERE %2 IS NULL AND %3 BETWEEN :target_right - rho AND :target_right + rho
+			)
+			ORDER BY score DESC
+			LIMIT :limit
+		)
+	)")
+							.arg(param.outputTableName, colL, colR, score, NearestIds(colL, ":target_left"),
+								 NearestIds(colR, ":target_right"));
+	return {
+		sql,
+		{
+			{":target_left", target[0].toRadian().get()},
+			{":target_right", target[1].toRadian().get()},
+		},
+		param.ratio,
+	};
+}
+
+dg::RankSource_U MakeFlexionRankSource(const dg::SortedColumn &sortedL, const std::span<const float> left,
+									   const dg::SortedColumn &sortedR, const std::span<const float> right,
+									   const std::array<dg::Degree, 2> &target, const float ratio) {
+	return std::make_unique<dg::SeparableRankSource>(
+		std::vector<dg::SeparableRankSource::Axis>{
+			{&sortedL, left, target[0].toRadian().get()},
+			{&sortedR, right, target[1].toRadian().get()},
+		},
+		FlexionTerm, ratio);
+}
+
 QString AttachGUID(QJsonObject &js) {
 	const auto uid = QUuid::createUuid();
 	const QString guid = uid.toString(QUuid::StringFormat::Id128);
@@ -2,10 +2,13 @@
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QVector3D>
+#include <span>
 #include <cereal/types/polymorphic.hpp>
 #include <cereal_types/qstring.hpp>
 #include <cereal_types/qvector.hpp>
 #include "aux_f/angle.hpp"
+#include "aux_f/nearest_rank.hpp"
+#include "aux_f/rank_merge.hpp"
 #include "aux_f/value.hpp"
 #include "static_base.hpp"
 
@@ -17,6 +20,7 @@ namespace dg::sql {
 	class Database;
 }
 class QSqlQuery;
+class PoseStore;
 struct QuerySeed {
 		using QueryPair = QPair<QString, QVariant>;
 		using QueryParams = QVector<QueryPair>;
@@ -53,6 +57,12 @@ class Condition {
 		virtual QString textPresent() const = 0;
 
 		virtual QuerySeed getSqlQuery(const QueryParam &param) const = 0;
+		// PoseStoreの列データから全ポーズのスコア(ratio適用済み)を out に書き込む
+		// 該当しないポーズは NaN のままにしておく
+		virtual void scoreNative(const PoseStore &store, float ratio, std::span<float> out) const = 0;
+		// スコアの降順に取り出せるソースを作成 (厳密な上位K件検索用)
+		// デフォルトでは scoreNative で全ポーズを評価してから取り出す
+		virtual dg::RankSource_U rankSource(const PoseStore &store, float ratio) const;
 		float getRatio() const noexcept;
 		void setRatio(float r) noexcept;
 		dg::FRange getRatioRange() const noexcept;
@@ -76,7 +86,8 @@ class Condition {
 	QString textPresent() const override;                                                                              \
 	void setupDialog(QueryDialog &dlg) const override;                                                                 \
 	void loadParamFromDialog(const QVariantList &vl) override;                                                         \
-	QuerySeed getSqlQuery(const QueryParam &param) const override;
+	QuerySeed getSqlQuery(const QueryParam &param) const override;                                                     \
+	void scoreNative(const PoseStore &store, float ratio, std::span<float> out) const override;
 
 // 条件：胴体の方向
 class Cond_BodyDir : public Condition, public StaticClassBase<Cond_BodyDir> {
@@ -86,6 +97,8 @@ class Cond_BodyDir : public Condition, public StaticClassBase<Cond_BodyDir> {
 	public:
 		Cond_BodyDir();
 		DEF_FUNCS
+		// 球面グリッドのセルを上限の高い順に開き、スコア順に取り出す
+		dg::RankSource_U rankSource(const PoseStore &store, float ratio) const override;
 
 		template <typename Ar>
 		void serialize(Ar &ar) {
@@ -115,6 +128,8 @@ class Cond_BodyDirYaw : public Condition, public StaticClassBase<Cond_BodyDirYaw
 	public:
 		Cond_BodyDirYaw();
 		DEF_FUNCS
+		// 角度の索引を目標から円周の両方向に辿り、スコア順に取り出す
+		dg::RankSource_U rankSource(const PoseStore &store, float ratio) const override;
 
 		template <typename Ar>
 		void serialize(Ar &ar) {
@@ -130,6 +145,8 @@ class Cond_BodyDirPitch : public Condition, public StaticClassBase<Cond_BodyDirP
 	public:
 		Cond_BodyDirPitch();
 		DEF_FUNCS
+		// 索引を目標値から上下に辿り、スコア順に取り出す
+		dg::RankSource_U rankSource(const PoseStore &store, float ratio) const override;
 		bool _supportNegativeRatio() const override;
 
 		template <typename Ar>
@@ -145,6 +162,8 @@ class Cond_ThighFlexion : public Condition, public StaticClassBase<Cond_ThighFle
 
 	public:
 		DEF_FUNCS
+		// 索引を目標値から上下に辿り、スコア順に取り出す
+		dg::RankSource_U rankSource(const PoseStore &store, float ratio) const override;
 		bool _supportNegativeRatio() const override;
 
 		template <typename Ar>
@@ -160,6 +179,8 @@ class Cond_CrusFlexion : public Condition, public StaticClassBase<Cond_CrusFlexi
 
 	public:
 		DEF_FUNCS
+		// 索引を目標値から上下に辿り、スコア順に取り出す
+		dg::RankSource_U rankSource(const PoseStore &store, float ratio) const override;
 		bool _supportNegativeRatio() const override;
 
 		template <typename Ar>
@@ -172,4 +193,18 @@ class Cond_CrusFlexion : public Condition, public StaticClassBase<Cond_CrusFlexi
 #undef DEF_FUNCS
 
 QJsonArray VecToJArray(const QVector3D &v);
+// 屈曲角条件(ThighFlexion, CrusFlexion)共通のネイティブスコア計算
+void ScoreFlexionNative(std::span<const float> left, std::span<const float> right, const std::array<dg::Degree, 2> &target,
+						float ratio, std::span<float> out);
+/**
+ * @brief 屈曲角条件共通のSQL (PoseScalarの左右の列を使う)
+ *
+ * 左右それぞれの索引の、目標値を中心とした範囲だけを走査して左右のスコアの合計が高い :limit 件を返す
+ */
+QuerySeed MakeFlexionQuery(const QueryParam &param, const QString &colL, const QString &colR,
+						   const std::array<dg::Degree, 2> &target);
+// 屈曲角条件共通の、スコア順に取り出すソース
+dg::RankSource_U MakeFlexionRankSource(const dg::SortedColumn &sortedL, std::span<const float> left,
+									   const dg::SortedColumn &sortedR, std::span<const float> right,
+									   const std::array<dg::Degree, 2> &target, float ratio);
 QString AttachGUID(QJsonObject &js);
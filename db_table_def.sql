@@ -78,6 +78,11 @@ CREATE TABLE MasseTorsoDir (
     CHECK((yaw_x*yaw_x + yaw_z*yaw_z) BETWEEN 0.995 AND 1.005)
 );
 
+-- vec0 のベクトル列は既定では総当たりで KNN を行う。
+-- 次元が大きく件数の多い列は `emb float[128] index=hnsw` の様に HNSW 索引を付けられる
+-- (hnsw_m, hnsw_ef_construction, hnsw_ef_search で調整。索引は <表>_hnswNN に保存される)。
+-- 3次元以下の列は総当たりで十分速く、近似で結果が変わるので付けない。
+
 -- 胴体ベクトルの高速検索用 (ベクトル型)
 CREATE VIRTUAL TABLE MasseTorsoVec USING vec0(
     poseId      INTEGER NOT NULL UNIQUE,
@@ -151,3 +156,46 @@ CREATE TABLE CrusFlexion (
     angleRad    REAL CHECK(angleRad BETWEEN 0.0 AND 3.141592653589793),
     PRIMARY KEY(poseId, is_right)
 );
+
+-- スカラー特徴量の検索用 (アプリが上のテーブルから作成する、ポーズ数が変わると作り直す)
+-- 列毎の索引を目標値から上下に辿って近い値を取り出す
+CREATE TABLE PoseScalar (
+    poseId      INTEGER PRIMARY KEY REFERENCES Pose(id),
+    pitch       REAL,                       -- MasseTorsoVec.pitch
+    thighL      REAL,                       -- ThighFlexion.angleRad (is_right = 0)
+    thighR      REAL,
+    crusL       REAL,                       -- CrusFlexion.angleRad (is_right = 0)
+    crusR       REAL,
+    yaw         REAL,                       -- atan2(yawY, yawX) [-π, π]
+    yawX        REAL,                       -- MasseTorsoVec.yaw
+    yawY        REAL,
+    dirCell     INTEGER,                    -- dg::SphereGrid のセル (MasseTorsoVec.dir)
+    dirX        REAL,                       -- MasseTorsoVec.dir
+    dirY        REAL,
+    dirZ        REAL
+);
+CREATE INDEX PoseScalar_pitch ON PoseScalar(pitch);
+CREATE INDEX PoseScalar_thighL ON PoseScalar(thighL);
+CREATE INDEX PoseScalar_thighR ON PoseScalar(thighR);
+CREATE INDEX PoseScalar_crusL ON PoseScalar(crusL);
+CREATE INDEX PoseScalar_crusR ON PoseScalar(crusR);
+CREATE INDEX PoseScalar_yaw ON PoseScalar(yaw);
+CREATE INDEX PoseScalar_dirCell ON PoseScalar(dirCell, dirX, dirY, dirZ);
+-- 胴体の方向の球面グリッドのセル (要素のあるセルのみ)
+CREATE TABLE DirCell (
+    cell        INTEGER PRIMARY KEY,
+    cx          REAL NOT NULL,              -- 中心の方向
+    cy          REAL NOT NULL,
+    cz          REAL NOT NULL,
+    radius      REAL NOT NULL,              -- 中心から要素までの最大の角度
+    normMin     REAL NOT NULL,              -- 要素の長さの範囲
+    normMax     REAL NOT NULL,
+    count       INTEGER NOT NULL
+);
+
+-- 「似たポーズを探す」用の特徴ベクトル (アプリが上のテーブルから作成する、ポーズ数が変わると作り直す)
+-- 胴体・左右の大腿・下腿の方向 (3次元×5) と、左右の大腿・下腿の屈曲角の (cos, sin) (2次元×4) を並べた物 (dg::PoseFeature)
+CREATE VIRTUAL TABLE PoseFeatureVec USING vec0(
+    poseId      INTEGER PRIMARY KEY,
+    feature     float[23] index=hnsw hnsw_m=12 hnsw_ef_construction=64 hnsw_ef_search=64
+);
@@ -3,18 +3,58 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QSettings>
+#include <QThread>
+#include <algorithm>
+#include <cstring>
+#include <memory>
 #include "aux_f/exception.hpp"
 #include "mainwindow.h"
 #include "singleton/my_db.hpp"
 #include "singleton/my_settings.hpp"
 #include "singleton/my_thumbnail.hpp"
+#include "singleton/thumbnail_collector.hpp"
+#include "singleton/thumbnail_warmer.hpp"
 #include "widget/cond_data.hpp"
 
+namespace {
+	// ウィンドウを出さずにサムネイルの事前生成だけを行うオプション
+	constexpr auto PrewarmOption = "--prewarm";
+
+	bool HasOption(const int argc, char *argv[], const char *option) {
+		return std::any_of(argv + 1, argv + argc, [option](const char *arg) { return std::strcmp(arg, option) == 0; });
+	}
+
+	int RunPrewarm() {
+		// 先に不要な分を捨てて、上限までの空きを作っておく
+		const size_t collected = ThumbnailCollector().runBlocking();
+		if (collected > 0)
+			qInfo().noquote() << QString("%1 thumbnails collected").arg(collected);
+		ThumbnailWarmer warmer;
+		QObject::connect(&warmer, &ThumbnailWarmer::progress,
+						 [](const qint64 done, const qint64 total, const double filesPerSec) {
+							 qInfo().noquote() << QString("%1 / %2 (%3 files/s)")
+													  .arg(done)
+													  .arg(total)
+													  .arg(filesPerSec, 0, 'f', 1);
+						 });
+		const size_t n = warmer.runBlocking();
+		qInfo().noquote() << QString("%1 thumbnails generated").arg(n);
+		return 0;
+	}
+} // namespace
+
 int main(int argc, char *argv[]) {
-	QApplication a(argc, argv);
+	const bool headless = HasOption(argc, argv, PrewarmOption);
+	// ヘッドレス時はGUIを使わない
+	const std::unique_ptr<QCoreApplication> a =
+		headless ? std::make_unique<QCoreApplication>(argc, argv) : std::make_unique<QApplication>(argc, argv);
 	MySettings::InitializeUsing("./settings.ini");
 	// データベースファイル名の取得。設定に保存されていればそれを、なければファイルダイアログを開く
 	QString dbFileName = mySet_c.getValue(MySettings::Entry::DBFileName).toString();
+	if (headless && (dbFileName.isEmpty() || !QFile::exists(dbFileName))) {
+		qCritical() << "No database is set; open one from the GUI first";
+		return 1;
+	}
 	if (dbFileName.isEmpty() || !QFile::exists(dbFileName)) {
 		dbFileName =
 			QFileDialog::getOpenFileName(nullptr, "open database...", "", "SQLite Database (*.db *.sqlite *.sqlite3)");
@@ -30,15 +70,50 @@ int main(int argc, char *argv[]) {
 													  dg::sql::PragmaV{{"foreign_keys", "true"}});
 		dg::LoadVecExtension(*db);
 		MyDatabase::InitializeUsing(std::move(db));
+		const bool exactRanking = mySet_c.getValue(MySettings::Entry::ExactRanking).toBool();
+		if (exactRanking || mySet_c.getValue(MySettings::Entry::NativeEngine).toBool()) {
+			myDb.enablePoseStore();
+			myDb.setExactRanking(exactRanking);
+		}
+		{
+			// 未設定なら4接続
+			const auto nRead = mySet_c.getValue(MySettings::Entry::ReadConnections);
+			myDb.setReadConnections(nRead.isValid() ? nRead.toInt() : 4);
+		}
+		{
+			// 未設定の項目はデフォルトのまま
+			MyDatabase::CacheBudget budget;
+			if (const auto v = mySet_c.getValue(MySettings::Entry::CacheFileBytes); v.isValid())
+				budget.fileId = budget.filePath = budget.fileHash = v.toULongLong();
+			if (const auto v = mySet_c.getValue(MySettings::Entry::CachePoseInfoBytes); v.isValid())
+				budget.poseInfo = v.toULongLong();
+			myDb.setCacheBudget(budget);
+		}
 		MyThumbnail::InitializeUsing();
+		{
+			// 未設定ならスレッド数はコア数、同時に扱う画像は256枚
+			const auto nThread = mySet_c.getValue(MySettings::Entry::ThumbnailDecodeThreads);
+			const auto inFlight = mySet_c.getValue(MySettings::Entry::ThumbnailInFlight);
+			myTn.setPipeline(nThread.isValid() ? nThread.toInt() : QThread::idealThreadCount(),
+							 inFlight.isValid() ? inFlight.toInt() : 256);
+			if (const auto v = mySet_c.getValue(MySettings::Entry::ThumbnailDiskBytes); v.isValid())
+				myTn.setDiskBudget(v.toLongLong());
+		}
 		auto dInit = MyDatabase::ScopeDeinit();
 		auto dInitT = MyThumbnail::ScopeDeinit();
 
+		if (headless)
+			return RunPrewarm();
+
 		MainWindow mw(nullptr);
 		mw.show();
-		return a.exec();
+		return a->exec();
 	}
 	catch (const dg::RuntimeError &e) {
+		if (headless) {
+			qCritical().noquote() << "An error has occurred:" << QString::fromStdString(e.s_what());
+			return 1;
+		}
 		QMessageBox::critical(
 			nullptr, "Error",
 			QString("An error has occurred \n\nDetails:\n %1").arg(QString::fromStdString(e.s_what())));
@@ -1,6 +1,10 @@
 #include "mainwindow.h"
 #include <QDesktopServices>
+#include <QFutureWatcher>
+#include <QLabel>
+#include <QSlider>
 #include <QMessageBox>
+#include <QProgressDialog>
 #include <QSqlError>
 #include <aux_f_q/sql/database.hpp>
 #include "./ui_mainwindow.h"
@@ -8,9 +12,12 @@
 #include "aux_f_q/sql/query.hpp"
 #include "condition/condition.hpp"
 #include "param/querydialog.h"
+#include "search/query_executor.hpp"
 #include "singleton/my_db.hpp"
 #include "singleton/my_settings.hpp"
 #include "singleton/my_thumbnail.hpp"
+#include "singleton/thumbnail_collector.hpp"
+#include "singleton/thumbnail_warmer.hpp"
 #include "widget/conditionmodel.hpp"
 #include "widget/resultpathmodel.h"
 
@@ -29,6 +36,58 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent), _ui(new Ui::MainW
 
 	_rpm = new ResultPathModel(this);
 	_ui->lvResult->setModel(_rpm);
+	// 表示中の行のサムネイルを優先して読み込む
+	connect(_ui->lvResult, &ResultView::visibleRangeChanged, _rpm, &ResultPathModel::setVisibleRange);
+	connect(_ui->lvResult, &ResultView::findSimilarRequested, this, &MainWindow::findSimilar);
+	// サムネイルの拡大・縮小 (Ctrl+ホイールまたはステータスバーのスライダー)
+	{
+		auto *zoom = new QSlider(Qt::Horizontal, this);
+		zoom->setRange(0, MyThumbnail::NLevel - 1);
+		zoom->setPageStep(1);
+		zoom->setTickPosition(QSlider::TicksBelow);
+		zoom->setFixedWidth(80);
+		zoom->setToolTip("Thumbnail size");
+		_ui->statusBar->addPermanentWidget(zoom);
+		connect(zoom, &QSlider::valueChanged, _ui->lvResult, &ResultView::setZoomLevel);
+		connect(_ui->lvResult, &ResultView::zoomLevelChanged, zoom, &QSlider::setValue);
+		connect(_ui->lvResult, &ResultView::zoomLevelChanged, _rpm, &ResultPathModel::setLevel);
+	}
+
+	_executor = new QueryExecutor(this);
+	// スコアはツールチップ用に保持しておく
+	connect(_executor, &QueryExecutor::scoreReady, this,
+			[](MyDatabase::ScoreMap score) { myDb.setScores(std::move(score)); });
+	connect(_executor, &QueryExecutor::chunkReady, _rpm, &ResultPathModel::addIds);
+	connect(_executor, &QueryExecutor::finished, this, [this](const int count, const qint64 elapsedMs) {
+		_ui->statusBar->showMessage(QString("%1 poses found (%2 ms)").arg(count).arg(elapsedMs));
+	});
+
+	_warmer = new ThumbnailWarmer(this);
+	// 検索中や結果のサムネイル読み込み中は事前生成を止めておく
+	_warmer->setBusyCheck([this]() { return _executor->isRunning() || _rpm->isLoading(); });
+	_warmLabel = new QLabel(this);
+	_ui->statusBar->addPermanentWidget(_warmLabel);
+	connect(_warmer, &ThumbnailWarmer::progress, this,
+			[this](const qint64 done, const qint64 total, const double filesPerSec) {
+				_warmLabel->setText(QString("Thumbnails: %1 / %2 (%3 files/s)")
+										.arg(done)
+										.arg(total)
+										.arg(filesPerSec, 0, 'f', 1));
+			});
+	connect(_warmer, &ThumbnailWarmer::finished, this, [this]() {
+		_warmLabel->setText("Thumbnails: done");
+		_ui->actionPrewarm_Thumbnails_p->setChecked(false);
+	});
+	if (mySet_c.getValue(MySettings::Entry::ThumbnailPrewarm).toBool())
+		_ui->actionPrewarm_Thumbnails_p->setChecked(true);
+
+	_collector = new ThumbnailCollector(this);
+	_collector->setBusyCheck([this]() { return _executor->isRunning() || _rpm->isLoading(); });
+	connect(_collector, &ThumbnailCollector::collected, this, [this](const size_t orphan, const size_t eviction) {
+		_ui->statusBar->showMessage(
+			QString("Thumbnails collected: %1 orphaned, %2 evicted").arg(orphan).arg(eviction), 5000);
+	});
+	_collector->start();
 
 	// 条件リストモデルの作成
 	_setConditionModel(std::make_shared<ConditionModel>(this));
@@ -57,7 +116,8 @@ void MainWindow::_setConditionModel(Cond_SP clm) {
 }
 
 void MainWindow::query() {
-	// 結果モデルをクリア
+	// 実行中の検索があれば中断してから結果モデルをクリア
+	_executor->cancel();
 	_rpm->clear();
 	// 条件リストモデルの内容が空だったら何もしない
 	auto &cs = _clm->data();
@@ -66,17 +126,26 @@ void MainWindow::query() {
 		return;
 	}
 
-	// 結果を表示
+	// 検索中に条件が編集されても影響しないよう、有効な条件を複製して渡す
 	const auto sz = cs.size();
-	std::vector<Condition *> input;
+	QueryExecutor::ConditionV snapshot;
 	for (int i = 0; i < sz; ++i) {
 		if (cs[i].enabled)
-			input.emplace_back(cs[i].cond.get());
+			snapshot.emplace_back(cs[i].cond->clone());
 	}
-	Q_ASSERT(!input.empty());
+	Q_ASSERT(!snapshot.empty());
 
 	const auto limit = _ui->sboxLimit->value();
-	_rpm->addIds(myDb_c.query(limit, input));
+	_ui->statusBar->showMessage("Searching...");
+	_executor->start(limit, std::move(snapshot));
+}
+
+void MainWindow::findSimilar(const PoseId poseId) {
+	// 特徴ベクトルはワーカースレッドが索引に入っている物を引く (条件リストは使わない)
+	_executor->cancel();
+	_rpm->clear();
+	_ui->statusBar->showMessage("Searching...");
+	_executor->startSimilar(_ui->sboxLimit->value(), poseId);
 }
 
 void MainWindow::addCondition() {
@@ -164,3 +233,69 @@ void MainWindow::detachDB() {
 void MainWindow::deleteBlacklist() {
 	myDb.deleteBlacklist();
 }
+
+void MainWindow::compactThumbnails() {
+	// 旧形式(PNG)のキャッシュをパックに移してから詰め直す
+	const size_t migrated = myTn.migratePngCache();
+	const auto res = myTn.compact();
+	QMessageBox::information(this, "Thumbnail Compacted",
+							 QString("Migrated %1 thumbnails.\nTiles: %2 -> %3")
+								 .arg(migrated)
+								 .arg(res.before)
+								 .arg(res.after));
+}
+
+void MainWindow::togglePrewarm(const bool enable) {
+	if (enable)
+		_warmer->start();
+	else
+		_warmer->stop();
+}
+
+void MainWindow::showThumbnailStats() {
+	constexpr double MiB = 1024.0 * 1024.0;
+	const auto &st = myTn.stats();
+	const auto usage = myTn.diskUsage();
+	const qint64 budget = myTn.diskBudget();
+	QMessageBox::information(
+		this, "Thumbnail Statistics",
+		QString("Hit: %1, Miss: %2 (hit rate %3%)\nEvicted: %4, Orphaned: %5\nDisk: %6 MiB used / %7 MiB file / %8")
+			.arg(st.hit)
+			.arg(st.miss)
+			.arg(st.hitRate() * 100.0, 0, 'f', 1)
+			.arg(st.eviction)
+			.arg(st.orphan)
+			.arg(usage.live / MiB, 0, 'f', 1)
+			.arg(usage.file / MiB, 0, 'f', 1)
+			.arg(budget > 0 ? QString("%1 MiB budget").arg(budget / MiB, 0, 'f', 1) : QString("no budget")));
+}
+
+void MainWindow::verifyThumbnails() {
+	// 元画像の確認はワーカーで行い、その間は進捗を出して中断できるようにする
+	const auto task = myTn.startVerify();
+	auto *dlg = new QProgressDialog("Verifying thumbnails...", "Cancel", 0, int(task.items->size()), this);
+	dlg->setWindowModality(Qt::WindowModal);
+	dlg->setAttribute(Qt::WA_DeleteOnClose);
+	// 終わる前に閉じる(とwatcherも破棄される)のを防ぐ
+	dlg->setAutoClose(false);
+	dlg->setAutoReset(false);
+	auto *watcher = new QFutureWatcher<void>(dlg);
+	connect(watcher, &QFutureWatcher<void>::progressValueChanged, dlg, &QProgressDialog::setValue);
+	connect(dlg, &QProgressDialog::canceled, watcher, &QFutureWatcher<void>::cancel);
+	connect(watcher, &QFutureWatcher<void>::finished, this, [this, dlg, task]() {
+		dlg->close();
+		// 元画像が変わっていた物は次に表示する時に作り直される
+		const size_t removed = myTn.finishVerify(task);
+		QMessageBox::information(this, "Thumbnail Verified",
+								 QString("%1Removed %2 stale thumbnails.")
+									 .arg(task.future.isCanceled() ? "Canceled. " : "")
+									 .arg(removed));
+	});
+	// 終わる前にウィンドウごと破棄される場合は、対象の配列を解放する前にワーカーを止める
+	connect(dlg, &QObject::destroyed, [task]() mutable {
+		task.future.cancel();
+		task.future.waitForFinished();
+	});
+	watcher->setFuture(task.future);
+	dlg->show();
+}
@@ -1,6 +1,7 @@
 #pragma once
 #include <QMainWindow>
 #include <QSqlDatabase>
+#include "id.hpp"
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -10,6 +11,10 @@ QT_END_NAMESPACE
 
 class ResultPathModel;
 class ConditionModel;
+class QueryExecutor;
+class ThumbnailWarmer;
+class ThumbnailCollector;
+class QLabel;
 class MainWindow : public QMainWindow {
 		Q_OBJECT
 
@@ -20,12 +25,21 @@ class MainWindow : public QMainWindow {
 		using Cond_SP = std::shared_ptr<ConditionModel>;
 		Cond_SP _clm;
 		ResultPathModel *_rpm;
+		// 検索はワーカースレッドで行い、結果を少しずつ受け取る
+		QueryExecutor *_executor;
+		// 全ファイルのサムネイルを裏で生成しておく
+		ThumbnailWarmer *_warmer;
+		QLabel *_warmLabel;
+		// 不要になったサムネイルを裏で回収する
+		ThumbnailCollector *_collector;
 		QSharedPointer<Ui::MainWindow> _ui;
 
 		void _setConditionModel(Cond_SP clm);
 
 	private slots:
 		void query();
+		// poseId と似たポーズを探して結果を置き換える
+		void findSimilar(PoseId poseId);
 		void addCondition();
 		void deleteCondition();
 		void clearCondition();
@@ -36,6 +50,10 @@ class MainWindow : public QMainWindow {
 		void loadConditions();
 		void saveConditions();
 		void deleteBlacklist();
+		void compactThumbnails();
+		void verifyThumbnails();
+		void togglePrewarm(bool enable);
+		void showThumbnailStats();
 
 		void resultViewDoubleClicked(const QModelIndex &index);
 };
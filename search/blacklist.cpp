@@ -0,0 +1,109 @@
+#include "blacklist.hpp"
+#include <QDebug>
+#include <QSet>
+#include "aux_f_q/q_value.hpp"
+#include "aux_f_q/sql/database.hpp"
+#include "aux_f_q/sql/id_array.hpp"
+
+Blacklist::Blacklist(dg::sql::Database &db, const dg::sql::Name &table, QObject *parent) :
+	QObject(parent), _db(db), _table(table) {
+	auto q = _db.exec(QString("SELECT File.id FROM File "
+							  "INNER JOIN %1 BL "
+							  "	ON File.hash = BL.hash")
+						  .arg(_table.text()));
+	while (q.next())
+		_files.emplace(dg::ConvertQV<FileId>(q.value(0)));
+}
+
+bool Blacklist::contains(const FileId fileId) const {
+	std::shared_lock lk(_mutex);
+	return _files.contains(fileId);
+}
+Blacklist::FileSet Blacklist::files() const {
+	std::shared_lock lk(_mutex);
+	return _files;
+}
+size_t Blacklist::size() const {
+	std::shared_lock lk(_mutex);
+	return _files.size();
+}
+
+FileIds Blacklist::_edit(const FileIds &fileIds, const bool add) {
+	if (fileIds.empty())
+		return {};
+	// DBにはハッシュで登録するので、同じハッシュを持つファイル全てが対象になる
+	QVariantList hashes;
+	FileIds sharing;
+	{
+		QSet<QByteArray> seen;
+		auto q = _db.exec("SELECT id, hash FROM File "
+						  "WHERE hash IN (SELECT hash FROM File WHERE id IN (SELECT value FROM json_each(?)))",
+						  dg::sql::MakeIdArray(fileIds));
+		while (q.next()) {
+			sharing.emplace_back(dg::ConvertQV<FileId>(q.value(0)));
+			const auto hash = dg::ConvertQV<QByteArray>(q.value(1));
+			if (!seen.contains(hash)) {
+				seen.insert(hash);
+				hashes.append(hash);
+			}
+		}
+	}
+	if (hashes.empty()) {
+		qWarning() << "Blacklist: hash not found for" << fileIds.size() << "files";
+		return {};
+	}
+	// 状態が変わる物だけを通知する (全て登録/解除済みならDBも触らない)
+	FileIds changedIds;
+	{
+		std::shared_lock lk(_mutex);
+		for (const auto fileId : sharing) {
+			if (_files.contains(fileId) != add)
+				changedIds.emplace_back(fileId);
+		}
+	}
+	if (changedIds.empty())
+		return {};
+
+	const auto sql = add ? QString("INSERT OR IGNORE INTO %1 (hash) VALUES (?)")
+						 : QString("DELETE FROM %1 WHERE hash = ?");
+	_db.beginTransaction();
+	try {
+		_db.batch(sql.arg(_table.text()), hashes);
+		_db.commitTransaction();
+	}
+	catch (...) {
+		_db.rollbackTransaction();
+		throw;
+	}
+
+	std::unique_lock lk(_mutex);
+	for (const auto fileId : changedIds) {
+		if (add)
+			_files.emplace(fileId);
+		else
+			_files.erase(fileId);
+	}
+	return changedIds;
+}
+
+void Blacklist::add(const FileIds &fileIds) {
+	const auto changedIds = _edit(fileIds, true);
+	if (!changedIds.empty())
+		emit changed(changedIds);
+}
+void Blacklist::remove(const FileIds &fileIds) {
+	const auto changedIds = _edit(fileIds, false);
+	if (!changedIds.empty())
+		emit changed(changedIds);
+}
+void Blacklist::clear() {
+	_db.exec(QString("DELETE FROM %1").arg(_table.text()));
+	FileIds changedIds;
+	{
+		std::unique_lock lk(_mutex);
+		changedIds.assign(_files.begin(), _files.end());
+		_files.clear();
+	}
+	if (!changedIds.empty())
+		emit changed(changedIds);
+}
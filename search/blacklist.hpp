@@ -0,0 +1,54 @@
+#pragma once
+#include <QObject>
+#include <shared_mutex>
+#include <unordered_set>
+#include "aux_f_q/sql/name.hpp"
+#include "id.hpp"
+
+namespace dg::sql {
+	class Database;
+}
+
+/**
+ * @brief ブラックリスト登録されたファイルをメモリ上に保持する
+ *
+ * DBにはファイルのハッシュで登録されているが、判定は起動時に解決したFileIdの集合で行う。
+ * 登録・解除はまとめて1トランザクションで行い、変更されたファイルを changed で通知する。
+ * 判定(contains, files)は検索スレッドからも呼べる。
+ */
+class Blacklist : public QObject {
+		Q_OBJECT
+
+	public:
+		using FileSet = std::unordered_set<FileId>;
+
+		/**
+		 * @param db 編集に使う接続 (blacklistのDBがattach済みであること)
+		 * @param table ブラックリストのテーブル (hash列を持つ)
+		 */
+		Blacklist(dg::sql::Database &db, const dg::sql::Name &table, QObject *parent = nullptr);
+
+		bool contains(FileId fileId) const;
+		// 登録されているファイルの複製
+		FileSet files() const;
+		size_t size() const;
+
+		// 登録されていない物だけを登録する (同じハッシュを持つファイルも登録される)
+		void add(const FileIds &fileIds);
+		// 登録されている物だけを解除する (同じハッシュを持つファイルも解除される)
+		void remove(const FileIds &fileIds);
+		void clear();
+
+	signals:
+		// 登録状態が変わったファイル
+		void changed(const FileIds &fileIds);
+
+	private:
+		dg::sql::Database &_db;
+		dg::sql::Name _table;
+		mutable std::shared_mutex _mutex;
+		FileSet _files;
+
+		// 登録/解除の共通処理 (対象ファイルのハッシュを登録/削除し、同じハッシュを持つファイル全ての状態を変える)
+		FileIds _edit(const FileIds &fileIds, bool add);
+};
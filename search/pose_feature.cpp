@@ -0,0 +1,140 @@
+#include "pose_feature.hpp"
+#include <QByteArray>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+#include "aux_f_q/q_value.hpp"
+#include "aux_f_q/sql/database.hpp"
+#include "source_version.hpp"
+
+namespace {
+	// 23次元・100万件で k=1000 が数ms に収まり、構築も起動時に待てる程度の設定
+	const QString FeatureColumn = QString("poseId INTEGER PRIMARY KEY, feature float[%1] index=hnsw hnsw_m=12 "
+										  "hnsw_ef_construction=64 hnsw_ef_search=64")
+									  .arg(dg::PoseFeature::Dim);
+	constexpr float NaN = std::numeric_limits<float>::quiet_NaN();
+
+	// 組み立て途中の特徴 (値が無い物は NaN)
+	struct Parts {
+			dg::PoseFeature::Vec3 torsoDir{NaN, NaN, NaN};
+			dg::PoseFeature::Pair3 thighDir{{{NaN, NaN, NaN}, {NaN, NaN, NaN}}};
+			dg::PoseFeature::Pair3 crusDir{{{NaN, NaN, NaN}, {NaN, NaN, NaN}}};
+			dg::PoseFeature::Pair thighFlex{NaN, NaN}, crusFlex{NaN, NaN};
+	};
+
+	// DerivedVersion に記録する名前
+	const auto TableName = QStringLiteral("PoseFeatureVec");
+
+	// 列の定義(索引のパラメータを含む)が変わっていたら作り直す
+	void DropIfOutdated(dg::sql::Database &db) {
+		bool outdated = false;
+		{
+			auto q = db.exec("SELECT sql FROM sqlite_master WHERE name = 'PoseFeatureVec'");
+			outdated = q.next() && !q.value(0).toString().contains(FeatureColumn);
+		}
+		if (outdated) {
+			db.exec("DROP TABLE PoseFeatureVec");
+			SetBuiltVersion(db, TableName, -1);
+		}
+	}
+	QByteArray ToBlob(const dg::PoseFeature &f) {
+		return QByteArray(reinterpret_cast<const char *>(f.value.data()), int(sizeof(f.value)));
+	}
+} // namespace
+
+void EnsurePoseFeature(dg::sql::Database &db) {
+	// 元データを読む前の版番号を記録する (作っている間に書き換えられたら、次回また作り直す)
+	const qint64 version = EnsureSourceVersion(db);
+	DropIfOutdated(db);
+	db.exec(QString("CREATE VIRTUAL TABLE IF NOT EXISTS PoseFeatureVec USING vec0(%1)").arg(FeatureColumn));
+	if (BuiltVersion(db, TableName) == version)
+		return;
+
+	std::unordered_map<PoseId, Parts> parts;
+	{
+		auto q = db.exec("SELECT id FROM Pose");
+		while (q.next())
+			parts.emplace(dg::ConvertQV<PoseId>(q.value(0)), Parts{});
+	}
+	const auto partOf = [&parts](const QVariant &v) -> Parts * {
+		const auto itr = parts.find(dg::ConvertQV<PoseId>(v));
+		return itr == parts.end() ? nullptr : &itr->second;
+	};
+	const auto sideOf = [](const QVariant &v) { return dg::ConvertQV<int>(v) != 0 ? 1 : 0; };
+	{
+		// getPoseInfo と同じく、ポーズ毎に最初の行を使う
+		auto q = db.exec("SELECT poseId, x, y, z FROM MasseTorsoDir");
+		while (q.next()) {
+			auto *p = partOf(q.value(0));
+			if (!p || !std::isnan(p->torsoDir[0]))
+				continue;
+			for (int i = 0; i < 3; ++i)
+				p->torsoDir[i] = dg::ConvertQV<float>(q.value(1 + i));
+		}
+	}
+	const auto loadDir = [&](const QString &table, auto member) {
+		auto q = db.exec(QString("SELECT poseId, is_right, x, y, z FROM %1").arg(table));
+		while (q.next()) {
+			if (auto *p = partOf(q.value(0))) {
+				auto &dir = (p->*member)[sideOf(q.value(1))];
+				for (int i = 0; i < 3; ++i)
+					dir[i] = dg::ConvertQV<float>(q.value(2 + i));
+			}
+		}
+	};
+	loadDir("MasseThighDir", &Parts::thighDir);
+	loadDir("MasseCrusDir", &Parts::crusDir);
+	const auto loadFlexion = [&](const QString &table, auto member) {
+		auto q = db.exec(QString("SELECT poseId, is_right, angleRad FROM %1 WHERE angleRad IS NOT NULL").arg(table));
+		while (q.next()) {
+			if (auto *p = partOf(q.value(0)))
+				(p->*member)[sideOf(q.value(1))] = dg::ConvertQV<float>(q.value(2));
+		}
+	};
+	loadFlexion("ThighFlexion", &Parts::thighFlex);
+	loadFlexion("CrusFlexion", &Parts::crusFlex);
+
+	QVariantList ids, features;
+	ids.reserve(parts.size());
+	features.reserve(parts.size());
+	for (auto &&[poseId, p] : parts) {
+		ids.append(EnumToInt(poseId));
+		features.append(ToBlob(dg::PoseFeature::Make(p.torsoDir, p.thighDir, p.crusDir, p.thighFlex, p.crusFlex)));
+	}
+	db.beginTransaction();
+	try {
+		// 索引ごと作り直す方が、行を消して入れ直すより速い
+		// (失敗しても前のテーブルが残る様、同じトランザクションで行う)
+		db.exec("DROP TABLE PoseFeatureVec");
+		db.exec(QString("CREATE VIRTUAL TABLE PoseFeatureVec USING vec0(%1)").arg(FeatureColumn));
+		db.batch("INSERT INTO PoseFeatureVec (poseId, feature) VALUES (?,?)", ids, features);
+		SetBuiltVersion(db, TableName, version);
+		db.commitTransaction();
+	}
+	catch (...) {
+		db.rollbackTransaction();
+		throw;
+	}
+}
+
+std::optional<dg::PoseFeature> PoseFeatureById(const dg::sql::Database &db, const PoseId poseId) {
+	auto q = db.exec("SELECT feature FROM PoseFeatureVec WHERE poseId = ?", EnumToInt(poseId));
+	if (!q.next())
+		return std::nullopt;
+	const auto ba = dg::ConvertQV<QByteArray>(q.value(0));
+	dg::PoseFeature f;
+	if (ba.size() != qsizetype(sizeof(f.value)))
+		return std::nullopt;
+	std::memcpy(f.value.data(), ba.constData(), sizeof(f.value));
+	return f;
+}
+
+std::vector<std::pair<PoseId, float>> FindSimilarPoses(const dg::sql::Database &db, const dg::PoseFeature &feature,
+													   const int k) {
+	std::vector<std::pair<PoseId, float>> ret;
+	auto q = db.exec("SELECT poseId, distance FROM PoseFeatureVec WHERE feature MATCH ? AND k = ?", ToBlob(feature), k);
+	while (q.next())
+		ret.emplace_back(dg::ConvertQV<PoseId>(q.value(0)), dg::ConvertQV<float>(q.value(1)));
+	return ret;
+}
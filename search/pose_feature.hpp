@@ -0,0 +1,27 @@
+#pragma once
+#include <optional>
+#include <utility>
+#include <vector>
+#include "aux_f/pose_feature.hpp"
+#include "id.hpp"
+
+namespace dg::sql {
+	class Database;
+}
+
+/**
+ * @brief ポーズ全体の特徴ベクトル(dg::PoseFeature)を1ポーズ1行に並べた PoseFeatureVec テーブルを用意する
+ *
+ * 「似たポーズを探す」で使う。vec0 の HNSW 索引付きの列に入れ、近似KNNで引く。
+ * 元のテーブル(MasseTorsoDir, MasseThighDir, MasseCrusDir, ThighFlexion, CrusFlexion)から作るので、
+ * 元データの版番号(EnsureSourceVersion)か列の定義が変わっていたら作り直す。
+ * 索引のグラフは接続毎にメモリへ読み込まれるので、検索に使わない接続で作ること。
+ * 時間が掛かるのでGUIスレッドでは呼ばないこと。
+ */
+void EnsurePoseFeature(dg::sql::Database &db);
+
+// 索引に入っている poseId の特徴ベクトル (無ければ nullopt)
+std::optional<dg::PoseFeature> PoseFeatureById(const dg::sql::Database &db, PoseId poseId);
+// feature に近い順に k 件の (poseId, 距離) を返す
+std::vector<std::pair<PoseId, float>> FindSimilarPoses(const dg::sql::Database &db, const dg::PoseFeature &feature,
+													   int k);
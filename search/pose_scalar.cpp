@@ -0,0 +1,176 @@
+#include "pose_scalar.hpp"
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+#include "aux_f/sphere_grid.hpp"
+#include "aux_f_q/q_value.hpp"
+#include "aux_f_q/sql/database.hpp"
+#include "id.hpp"
+#include "source_version.hpp"
+
+namespace {
+	// 列 (値が無い物は NULL)
+	constexpr std::array<const char *, 12> Columns{
+		"pitch", "thighL", "thighR", "crusL", "crusR", "yaw", "yawX", "yawY", "dirCell", "dirX", "dirY", "dirZ",
+	};
+	enum Col { Pitch, ThighL, ThighR, CrusL, CrusR, Yaw, YawX, YawY, DirCell, DirX, DirY, DirZ };
+	// 単独の索引を張るのは yaw まで (yawX, yawY はスコア計算用、dir* は dirCell を先頭にした索引で引く)
+	constexpr size_t NumIndexed = Yaw + 1;
+	using Row = std::array<QVariant, Columns.size()>;
+	// DerivedVersion に記録する名前
+	const auto TableName = QStringLiteral("PoseScalar");
+
+	// 古い版で作ったテーブルは列が足りないので作り直す
+	void DropIfOutdated(dg::sql::Database &db) {
+		qint64 nCol = 0;
+		{
+			auto q = db.exec("SELECT COUNT(*) FROM pragma_table_info('PoseScalar')");
+			if (q.next())
+				nCol = q.value(0).toLongLong();
+		}
+		if (nCol > 0 && nCol != qint64(Columns.size() + 1)) {
+			db.exec("DROP TABLE PoseScalar");
+			SetBuiltVersion(db, TableName, -1);
+		}
+	}
+} // namespace
+
+void EnsurePoseScalar(dg::sql::Database &db) {
+	// 元データを読む前の版番号を記録する (作っている間に書き換えられたら、次回また作り直す)
+	const qint64 version = EnsureSourceVersion(db);
+	DropIfOutdated(db);
+	db.exec(R"(
+		CREATE TABLE IF NOT EXISTS PoseScalar (
+			poseId		INTEGER PRIMARY KEY REFERENCES Pose(id),
+			pitch		REAL,
+			thighL		REAL,
+			thighR		REAL,
+			crusL		REAL,
+			crusR		REAL,
+			yaw			REAL,
+			yawX		REAL,
+			yawY		REAL,
+			dirCell		INTEGER,
+			dirX		REAL,
+			dirY		REAL,
+			dirZ		REAL
+		)
+	)");
+	for (size_t c = 0; c < NumIndexed; ++c)
+		db.exec(QString("CREATE INDEX IF NOT EXISTS PoseScalar_%1 ON PoseScalar(%1)").arg(Columns[c]));
+	// セル内のスコア計算を索引だけで済ませる
+	db.exec("CREATE INDEX IF NOT EXISTS PoseScalar_dirCell ON PoseScalar(dirCell, dirX, dirY, dirZ)");
+	db.exec(R"(
+		CREATE TABLE IF NOT EXISTS DirCell (
+			cell		INTEGER PRIMARY KEY,
+			cx			REAL NOT NULL,
+			cy			REAL NOT NULL,
+			cz			REAL NOT NULL,
+			radius		REAL NOT NULL,
+			normMin		REAL NOT NULL,
+			normMax		REAL NOT NULL,
+			count		INTEGER NOT NULL
+		)
+	)");
+	if (BuiltVersion(db, TableName) == version)
+		return;
+
+	std::unordered_map<PoseId, Row> rows;
+	{
+		auto q = db.exec("SELECT id FROM Pose");
+		while (q.next())
+			rows.emplace(dg::ConvertQV<PoseId>(q.value(0)), Row{});
+	}
+	{
+		// vec0の列はfloat配列のBLOB
+		auto q = db.exec("SELECT poseId, pitch, yaw, dir FROM MasseTorsoVec");
+		while (q.next()) {
+			const auto itr = rows.find(dg::ConvertQV<PoseId>(q.value(0)));
+			if (itr == rows.end())
+				continue;
+			const auto pba = dg::ConvertQV<QByteArray>(q.value(1));
+			if (pba.size() == qsizetype(sizeof(float))) {
+				float pitch;
+				std::memcpy(&pitch, pba.constData(), sizeof(float));
+				itr->second[Pitch] = pitch;
+			}
+			// yaw はベクトルの成分そのものと、円周上の角度 [-π, π] の両方を持つ
+			const auto yba = dg::ConvertQV<QByteArray>(q.value(2));
+			if (yba.size() == qsizetype(sizeof(float) * 2)) {
+				float yaw[2];
+				std::memcpy(yaw, yba.constData(), sizeof(yaw));
+				itr->second[YawX] = yaw[0];
+				itr->second[YawY] = yaw[1];
+				itr->second[Yaw] = std::atan2(yaw[1], yaw[0]);
+			}
+			const auto dba = dg::ConvertQV<QByteArray>(q.value(3));
+			if (dba.size() == qsizetype(sizeof(float) * 3)) {
+				float dir[3];
+				std::memcpy(dir, dba.constData(), sizeof(dir));
+				itr->second[DirX] = dir[0];
+				itr->second[DirY] = dir[1];
+				itr->second[DirZ] = dir[2];
+				itr->second[DirCell] = dg::SphereGrid::CellOf(dir[0], dir[1], dir[2], DirGridDiv);
+			}
+		}
+	}
+	const auto loadFlexion = [&](const QString &table, const Col colL, const Col colR) {
+		auto q = db.exec(QString("SELECT poseId, is_right, angleRad FROM %1 WHERE angleRad IS NOT NULL").arg(table));
+		while (q.next()) {
+			const auto itr = rows.find(dg::ConvertQV<PoseId>(q.value(0)));
+			if (itr == rows.end())
+				continue;
+			itr->second[dg::ConvertQV<int>(q.value(1)) != 0 ? colR : colL] = q.value(2);
+		}
+	};
+	loadFlexion("ThighFlexion", ThighL, ThighR);
+	loadFlexion("CrusFlexion", CrusL, CrusR);
+
+	QVariantList ids;
+	std::array<QVariantList, Columns.size()> vals;
+	// 方向のセル統計用
+	std::vector<float> dx, dy, dz;
+	for (auto &&[poseId, row] : rows) {
+		ids.append(EnumToInt(poseId));
+		for (size_t c = 0; c < Columns.size(); ++c)
+			vals[c].append(row[c]);
+		if (!row[DirCell].isNull()) {
+			dx.emplace_back(row[DirX].toFloat());
+			dy.emplace_back(row[DirY].toFloat());
+			dz.emplace_back(row[DirZ].toFloat());
+		}
+	}
+	const dg::SphereGrid grid(dx, dy, dz, DirGridDiv);
+	std::array<QVariantList, 8> cellVals;
+	for (auto &cell : grid.cells()) {
+		cellVals[0].append(cell.index);
+		for (int i = 0; i < 3; ++i)
+			cellVals[1 + i].append(cell.center[i]);
+		cellVals[4].append(cell.radius);
+		cellVals[5].append(cell.normMin);
+		cellVals[6].append(cell.normMax);
+		cellVals[7].append(cell.end - cell.begin);
+	}
+	db.beginTransaction();
+	try {
+		db.exec("DELETE FROM PoseScalar");
+		db.exec("DELETE FROM DirCell");
+		db.batch("INSERT INTO PoseScalar (poseId, pitch, thighL, thighR, crusL, crusR, yaw, yawX, yawY, "
+				 "dirCell, dirX, dirY, dirZ) "
+				 "VALUES (?,?,?,?,?,?,?,?,?,?,?,?,?)",
+				 ids, vals[Pitch], vals[ThighL], vals[ThighR], vals[CrusL], vals[CrusR], vals[Yaw], vals[YawX],
+				 vals[YawY], vals[DirCell], vals[DirX], vals[DirY], vals[DirZ]);
+		if (!grid.cells().empty()) {
+			db.batch("INSERT INTO DirCell (cell, cx, cy, cz, radius, normMin, normMax, count) VALUES (?,?,?,?,?,?,?,?)",
+					 cellVals[0], cellVals[1], cellVals[2], cellVals[3], cellVals[4], cellVals[5], cellVals[6],
+					 cellVals[7]);
+		}
+		SetBuiltVersion(db, TableName, version);
+		db.commitTransaction();
+	}
+	catch (...) {
+		db.rollbackTransaction();
+		throw;
+	}
+}
@@ -0,0 +1,21 @@
+#pragma once
+#include <cstdint>
+
+namespace dg::sql {
+	class Database;
+}
+
+/**
+ * @brief スカラーの特徴量を1ポーズ1行に並べた PoseScalar テーブルを用意する
+ *
+ * 列(pitch, thighL/R, crusL/R, yaw)毎にB-treeインデックスを張り、
+ * 目標値に近い物を「目標値以下を降順に」「目標値より上を昇順に」の2回の範囲走査で取り出せるようにする。
+ * 胴体の方向(MasseTorsoVec.dir)は dg::SphereGrid のセル番号(dirCell)で引けるようにし、
+ * セル毎の中心と半径を DirCell テーブルに置く。
+ * 元のテーブル(MasseTorsoVec, ThighFlexion, CrusFlexion)から作るので、元データの版番号(EnsureSourceVersion)が
+ * 作った時と違えば作り直す。時間が掛かるのでGUIスレッドでは呼ばないこと。
+ */
+void EnsurePoseScalar(dg::sql::Database &db);
+
+// 胴体の方向の球面グリッドの分割数 (立方体の1面あたり DirGridDiv × DirGridDiv)
+constexpr uint32_t DirGridDiv = 16;
@@ -0,0 +1,283 @@
+#include "pose_store.hpp"
+#include <QElapsedTimer>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include "aux_f_q/q_value.hpp"
+#include "aux_f_q/sql/database.hpp"
+#include "condition/condition.hpp"
+#include "pose_scalar.hpp"
+
+namespace {
+	constexpr float NaN = std::numeric_limits<float>::quiet_NaN();
+
+	// vec0から取り出したfloat配列(BLOB)を展開
+	template <size_t N>
+	bool ReadVecBlob(const QVariant &v, std::array<float, N> &dst) {
+		const auto ba = dg::ConvertQV<QByteArray>(v);
+		if (ba.size() != static_cast<qsizetype>(sizeof(float) * N))
+			return false;
+		std::memcpy(dst.data(), ba.constData(), sizeof(float) * N);
+		return true;
+	}
+} // namespace
+
+PoseStore::PoseStore(const dg::sql::Database &db) {
+	QElapsedTimer timer;
+	timer.start();
+
+	// --- ポーズ一覧 (インデックスの割り当て) ---
+	{
+		auto q = db.exec("SELECT id, fileId FROM Pose ORDER BY id ASC");
+		while (q.next()) {
+			const auto pId = dg::ConvertQV<PoseId>(q.value(0));
+			_index.emplace(pId, static_cast<Index>(_poseId.size()));
+			_poseId.emplace_back(pId);
+			_fileId.emplace_back(dg::ConvertQV<FileId>(q.value(1)));
+		}
+	}
+	const size_t n = _poseId.size();
+	for (auto &col : _column)
+		col.assign(n, NaN);
+
+	// --- MasseTorsoDir ---
+	{
+		auto q = db.exec("SELECT poseId, x, y, z FROM MasseTorsoDir");
+		auto &cx = _col(Column::DirX);
+		auto &cy = _col(Column::DirY);
+		auto &cz = _col(Column::DirZ);
+		while (q.next()) {
+			const Index idx = indexOf(dg::ConvertQV<PoseId>(q.value(0)));
+			if (idx == n)
+				continue;
+			cx[idx] = dg::ConvertQV<float>(q.value(1));
+			cy[idx] = dg::ConvertQV<float>(q.value(2));
+			cz[idx] = dg::ConvertQV<float>(q.value(3));
+		}
+	}
+	// --- MasseTorsoVec (yaw, pitch) ---
+	{
+		auto q = db.exec("SELECT poseId, yaw, pitch FROM MasseTorsoVec");
+		auto &cyx = _col(Column::YawX);
+		auto &cyy = _col(Column::YawY);
+		auto &cya = _col(Column::YawAngle);
+		auto &cp = _col(Column::Pitch);
+		while (q.next()) {
+			const Index idx = indexOf(dg::ConvertQV<PoseId>(q.value(0)));
+			if (idx == n)
+				continue;
+			std::array<float, 2> yaw;
+			std::array<float, 1> pitch;
+			if (!ReadVecBlob(q.value(1), yaw) || !ReadVecBlob(q.value(2), pitch)) {
+				qWarning() << "Invalid MasseTorsoVec blob for poseId" << EnumToInt(_poseId[idx]);
+				continue;
+			}
+			cyx[idx] = yaw[0];
+			cyy[idx] = yaw[1];
+			cya[idx] = std::atan2(yaw[1], yaw[0]);
+			cp[idx] = pitch[0];
+		}
+	}
+	// --- ThighFlexion, CrusFlexion ---
+	const auto loadFlexion = [this, &db, n](const QString &table, const Column colL, const Column colR) {
+		auto q = db.exec(QString("SELECT poseId, is_right, angleRad FROM %1 WHERE angleRad IS NOT NULL").arg(table));
+		auto &cl = _col(colL);
+		auto &cr = _col(colR);
+		while (q.next()) {
+			const Index idx = indexOf(dg::ConvertQV<PoseId>(q.value(0)));
+			if (idx == n)
+				continue;
+			const bool isRight = dg::ConvertQV<int>(q.value(1)) != 0;
+			(isRight ? cr : cl)[idx] = dg::ConvertQV<float>(q.value(2));
+		}
+	};
+	loadFlexion("ThighFlexion", Column::ThighFlexL, Column::ThighFlexR);
+	loadFlexion("CrusFlexion", Column::CrusFlexL, Column::CrusFlexR);
+	// 目標値に近い物から順に取り出す条件の為の並び
+	for (const auto col : {Column::YawAngle, Column::Pitch, Column::ThighFlexL, Column::ThighFlexR, Column::CrusFlexL, Column::CrusFlexR})
+		_sorted[static_cast<size_t>(col)] = dg::SortedColumn::Make(column(col));
+	_dirGrid = dg::SphereGrid(column(Column::DirX), column(Column::DirY), column(Column::DirZ), DirGridDiv);
+
+	// --- Tags ---
+	{
+		auto q = db.exec("SELECT TagInfo.name, Tags.poseId "
+						 "FROM Tags "
+						 "INNER JOIN TagInfo "
+						 "	ON TagInfo.id = Tags.tagId");
+		while (q.next()) {
+			const Index idx = indexOf(dg::ConvertQV<PoseId>(q.value(1)));
+			if (idx == n)
+				continue;
+			_tag[q.value(0).toString()].emplace_back(idx);
+		}
+		for (auto &v : _tag)
+			std::sort(v.begin(), v.end());
+	}
+	qDebug() << QString("PoseStore: loaded %1 poses in %2ms").arg(n).arg(timer.elapsed());
+}
+
+size_t PoseStore::size() const noexcept {
+	return _poseId.size();
+}
+PoseId PoseStore::poseId(const Index idx) const {
+	return _poseId[idx];
+}
+FileId PoseStore::fileId(const Index idx) const {
+	return _fileId[idx];
+}
+PoseStore::Index PoseStore::indexOf(const PoseId poseId) const {
+	const auto itr = _index.find(poseId);
+	if (itr == _index.end())
+		return static_cast<Index>(size());
+	return itr->second;
+}
+std::span<const float> PoseStore::column(const Column col) const {
+	return _column[static_cast<size_t>(col)];
+}
+const dg::SortedColumn &PoseStore::sorted(const Column col) const {
+	return _sorted[static_cast<size_t>(col)];
+}
+const dg::SphereGrid &PoseStore::dirGrid() const noexcept {
+	return _dirGrid;
+}
+std::vector<float> &PoseStore::_col(const Column col) {
+	return _column[static_cast<size_t>(col)];
+}
+std::span<const PoseStore::Index> PoseStore::tagged(const QString &tagName) const {
+	const auto itr = _tag.constFind(tagName);
+	if (itr == _tag.cend())
+		return {};
+	return *itr;
+}
+
+// ---------------------- ScoreBufferSource ----------------------
+PoseStore::ScoreBufferSource::ScoreBufferSource(std::vector<float> score) : _score(std::move(score)) {
+	_heap.reserve(_score.size());
+	for (Index i = 0; i < _score.size(); ++i) {
+		if (!std::isnan(_score[i]))
+			_heap.emplace_back(i);
+	}
+	_dense = _heap.size() == _score.size();
+	std::make_heap(_heap.begin(), _heap.end(), [this](const Index a, const Index b) { return _score[a] < _score[b]; });
+}
+std::optional<dg::RankSource::Item> PoseStore::ScoreBufferSource::next() {
+	if (_heap.empty())
+		return std::nullopt;
+	std::pop_heap(_heap.begin(), _heap.end(), [this](const Index a, const Index b) { return _score[a] < _score[b]; });
+	const Index idx = _heap.back();
+	_heap.pop_back();
+	return Item{idx, _score[idx]};
+}
+float PoseStore::ScoreBufferSource::at(const uint32_t id) const {
+	return _score[id];
+}
+bool PoseStore::ScoreBufferSource::dense() const noexcept {
+	return _dense;
+}
+
+// ---------------------- PoseStore ----------------------
+PoseStore::HitV PoseStore::search(const int limit, const std::vector<Condition *> &clist,
+								  const std::unordered_set<FileId> &excluded, const size_t candidateLimit) const {
+	const size_t n = size();
+	const size_t nCond = clist.size();
+	if (n == 0 || nCond == 0 || limit <= 0)
+		return {};
+
+	// 条件毎のスコア列 (該当しなかったポーズは NaN)
+	std::vector<std::vector<float>> scores(nCond);
+	std::vector<double> total(n, 0.0);
+	std::vector<uint8_t> matched(n, 0);
+	IndexV cand;
+	for (size_t ci = 0; ci < nCond; ++ci) {
+		auto &sc = scores[ci];
+		sc.assign(n, NaN);
+		try {
+			clist[ci]->scoreNative(*this, clist[ci]->getRatio(), sc);
+		}
+		catch (const std::exception &e) {
+			qWarning() << "Native condition scoring failed:" << e.what();
+			sc.assign(n, NaN);
+			continue;
+		}
+
+		// SQL版と同様に、スコア上位 candidateLimit 件だけを採用する
+		cand.clear();
+		for (Index i = 0; i < n; ++i) {
+			if (!std::isnan(sc[i]))
+				cand.emplace_back(i);
+		}
+		if (cand.size() > candidateLimit) {
+			const auto cmp = [&sc](const Index a, const Index b) {
+				if (sc[a] != sc[b])
+					return sc[a] > sc[b];
+				return a < b;
+			};
+			std::nth_element(cand.begin(), cand.begin() + candidateLimit, cand.end(), cmp);
+			for (auto itr = cand.begin() + candidateLimit; itr != cand.end(); ++itr)
+				sc[*itr] = NaN;
+			cand.resize(candidateLimit);
+		}
+		for (const Index i : cand) {
+			total[i] += sc[i];
+			matched[i] = 1;
+		}
+	}
+
+	// ブラックリストを除いてスコア順に並べる
+	cand.clear();
+	for (Index i = 0; i < n; ++i) {
+		if (matched[i] && !excluded.contains(_fileId[i]))
+			cand.emplace_back(i);
+	}
+	const size_t nOut = std::min(cand.size(), static_cast<size_t>(limit));
+	std::partial_sort(cand.begin(), cand.begin() + nOut, cand.end(), [&total](const Index a, const Index b) {
+		if (total[a] != total[b])
+			return total[a] > total[b];
+		return a < b;
+	});
+
+	HitV ret;
+	ret.reserve(nOut);
+	for (size_t k = 0; k < nOut; ++k) {
+		const Index i = cand[k];
+		Hit hit{_poseId[i], static_cast<float>(total[i]), {}};
+		for (auto &sc : scores) {
+			if (!std::isnan(sc[i]))
+				hit.individual.emplace_back(sc[i]);
+		}
+		ret.emplace_back(std::move(hit));
+	}
+	return ret;
+}
+
+PoseStore::HitV PoseStore::searchExact(const int limit, const std::vector<Condition *> &clist,
+									   const std::unordered_set<FileId> &excluded) const {
+	if (size() == 0 || clist.empty() || limit <= 0)
+		return {};
+
+	std::vector<dg::RankSource_U> sources;
+	for (auto *cond : clist) {
+		try {
+			sources.emplace_back(cond->rankSource(*this, cond->getRatio()));
+		}
+		catch (const std::exception &e) {
+			qWarning() << "Native condition scoring failed:" << e.what();
+		}
+	}
+	const auto top = dg::ThresholdTopK(static_cast<size_t>(limit), sources,
+									   [this, &excluded](const uint32_t idx) { return !excluded.contains(_fileId[idx]); });
+
+	HitV ret;
+	ret.reserve(top.size());
+	for (auto &&item : top) {
+		Hit hit{_poseId[item.id], static_cast<float>(item.score), {}};
+		for (auto &src : sources) {
+			const float sc = src->at(item.id);
+			if (!std::isnan(sc))
+				hit.individual.emplace_back(sc);
+		}
+		ret.emplace_back(std::move(hit));
+	}
+	return ret;
+}
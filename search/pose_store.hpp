@@ -0,0 +1,117 @@
+#pragma once
+#include <QHash>
+#include <QString>
+#include <array>
+#include <span>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "aux_f/nearest_rank.hpp"
+#include "aux_f/rank_merge.hpp"
+#include "aux_f/sphere_grid.hpp"
+#include "id.hpp"
+
+namespace dg::sql {
+	class Database;
+}
+class Condition;
+
+// 検索に使う特徴量をポーズ単位の列(SoA)としてメモリ上に保持する
+// (SQLを介さずにConditionのスコアを計算する為のもの)
+class PoseStore {
+	public:
+		// ポーズを詰めて並べた時のインデックス
+		using Index = uint32_t;
+		using IndexV = std::vector<Index>;
+
+		enum class Column : int {
+			// MasseTorsoDir
+			DirX,
+			DirY,
+			DirZ,
+			// MasseTorsoVec.yaw
+			YawX,
+			YawY,
+			// atan2(YawY, YawX) [-π, π]
+			YawAngle,
+			// MasseTorsoVec.pitch
+			Pitch,
+			// ThighFlexion.angleRad
+			ThighFlexL,
+			ThighFlexR,
+			// CrusFlexion.angleRad
+			CrusFlexL,
+			CrusFlexR,
+			_Count,
+		};
+
+		// 1ポーズ分の検索結果
+		struct Hit {
+				PoseId poseId;
+				float score;
+				// 条件毎のスコア(該当しなかった条件は含まない)
+				std::vector<float> individual;
+		};
+		using HitV = std::vector<Hit>;
+
+		// 全ポーズ分のスコア列から降順に取り出すソース
+		class ScoreBufferSource : public dg::RankSource {
+			private:
+				std::vector<float> _score;
+				// 未取り出しの要素 (スコアのヒープ)
+				std::vector<Index> _heap;
+				bool _dense;
+
+			public:
+				explicit ScoreBufferSource(std::vector<float> score);
+				std::optional<Item> next() override;
+				float at(uint32_t id) const override;
+				bool dense() const noexcept override;
+		};
+
+		explicit PoseStore(const dg::sql::Database &db);
+
+		size_t size() const noexcept;
+		PoseId poseId(Index idx) const;
+		FileId fileId(Index idx) const;
+		// 該当するポーズが無い場合は size() を返す
+		Index indexOf(PoseId poseId) const;
+
+		// 値が無い場合は NaN が入っている
+		std::span<const float> column(Column col) const;
+		// 値の昇順に並べた列 (近い値の探索用。ヨー角・ピッチ・屈曲角以外の列は空)
+		const dg::SortedColumn &sorted(Column col) const;
+		// 胴体の方向(DirX, DirY, DirZ)の球面グリッド
+		const dg::SphereGrid &dirGrid() const noexcept;
+		// タグが付いているポーズ(昇順)
+		std::span<const Index> tagged(const QString &tagName) const;
+
+		/**
+		 * @brief 条件リストを列データ上で評価し、スコア上位のポーズを返す
+		 *
+		 * @param limit 返す最大件数
+		 * @param clist 評価する条件リスト
+		 * @param excluded 除外するファイル (ブラックリスト)
+		 * @param candidateLimit 条件毎に採用する候補の最大数 (SQL版の LIMIT :limit 相当)
+		 */
+		HitV search(int limit, const std::vector<Condition *> &clist, const std::unordered_set<FileId> &excluded,
+					size_t candidateLimit) const;
+		/**
+		 * @brief 候補数の制限をせずに、重み付き合計スコアの厳密な上位 limit 件を返す
+		 *
+		 * 条件毎のソートされたソースを Threshold Algorithm で統合し、上位が確定した時点で打ち切る
+		 */
+		HitV searchExact(int limit, const std::vector<Condition *> &clist,
+						 const std::unordered_set<FileId> &excluded) const;
+
+	private:
+		std::vector<PoseId> _poseId;
+		std::vector<FileId> _fileId;
+		std::unordered_map<PoseId, Index> _index;
+		std::array<std::vector<float>, static_cast<size_t>(Column::_Count)> _column;
+		std::array<dg::SortedColumn, static_cast<size_t>(Column::_Count)> _sorted;
+		dg::SphereGrid _dirGrid;
+		QHash<QString, IndexV> _tag;
+
+		std::vector<float> &_col(Column col);
+};
@@ -0,0 +1,74 @@
+#include "query_compiler.hpp"
+#include <QRegularExpression>
+#include <QSqlQuery>
+#include "aux_f/exception.hpp"
+
+namespace {
+	// 条件毎のCTEの名前
+	QString CteName(const size_t index) {
+		return QString("cond_%1").arg(index);
+	}
+	// 条件番号を付けたパラメータ名 (":name" -> ":name_c<index>")
+	QString ParamName(const QString &name, const size_t index) {
+		return QString("%1_c%2").arg(name).arg(index);
+	}
+} // namespace
+
+void QueryCompiler::add(const Condition &cond) {
+	static const QRegularExpression s_with(R"(^\s*WITH\s+)", QRegularExpression::CaseInsensitiveOption);
+	static const QRegularExpression s_param(R"(:([A-Za-z_]\w*))");
+
+	const size_t index = _entry.size();
+	const auto tableName = CteName(index);
+	const auto seed = cond.getSqlQuery({
+		.outputTableName = tableName,
+		.ratio = cond.getRatio(),
+	});
+
+	auto cte = seed.queryText;
+	const auto m = s_with.match(cte);
+	if (!m.hasMatch())
+		throw dg::InvalidInput("QuerySeed must begin with WITH: " + cte.toStdString());
+	cte.remove(0, m.capturedLength());
+	cte.replace(s_param, QString(":\\1_c%1").arg(index));
+
+	QuerySeed::QueryParams params;
+	params.reserve(seed.queryParams.size());
+	for (auto &&p : seed.queryParams)
+		params.emplace_back(ParamName(p.first, index), p.second);
+
+	_entry.emplace_back(Entry{std::move(cte), tableName, std::move(params), seed.ratio});
+}
+
+bool QueryCompiler::empty() const noexcept {
+	return _entry.empty();
+}
+size_t QueryCompiler::size() const noexcept {
+	return _entry.size();
+}
+
+QString QueryCompiler::withClause(const QString &scoreName) const {
+	Q_ASSERT(!empty());
+	QStringList ctes, arms;
+	for (size_t i = 0; i < _entry.size(); ++i) {
+		const auto &ent = _entry[i];
+		ctes.append(ent.cte);
+		arms.append(QString("SELECT poseId, %1 AS cond_index, score * %2 AS score FROM %3")
+						.arg(i)
+						.arg(ParamName(":ratio", i))
+						.arg(ent.tableName));
+	}
+	// 集計と条件毎のスコア取得で2回参照するので、一度だけ評価させる
+	return QString("WITH %1, %2 AS MATERIALIZED ( %3 ) ")
+		.arg(ctes.join(", "), scoreName, arms.join(" UNION ALL "));
+}
+
+void QueryCompiler::bind(QSqlQuery &q, const int candidateLimit) const {
+	for (size_t i = 0; i < _entry.size(); ++i) {
+		const auto &ent = _entry[i];
+		for (auto &&p : ent.params)
+			q.bindValue(p.first, p.second);
+		q.bindValue(ParamName(":ratio", i), ent.ratio);
+		q.bindValue(ParamName(":limit", i), candidateLimit);
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <QString>
+#include <vector>
+#include "condition/condition.hpp"
+
+/**
+ * @brief 複数条件のQuerySeedを1つのSQL文にまとめる
+ *
+ * 条件毎のCTE名とパラメータ名には条件番号を付けて重複を避け、
+ * 全条件のスコアを (poseId, cond_index, score) の UNION ALL として1つのCTEに並べる。
+ */
+class QueryCompiler {
+	private:
+		struct Entry {
+				// 先頭の WITH を除いた "name AS (...)"
+				QString cte;
+				QString tableName;
+				QuerySeed::QueryParams params;
+				float ratio;
+		};
+		std::vector<Entry> _entry;
+
+	public:
+		// 条件を追加 (cond_index は追加した順)
+		void add(const Condition &cond);
+		bool empty() const noexcept;
+		size_t size() const noexcept;
+
+		/**
+		 * @brief "WITH <各条件のCTE>, <scoreName> AS (...)" を生成
+		 *
+		 * scoreNameの列は poseId, cond_index, score (ratio適用済み)
+		 */
+		QString withClause(const QString &scoreName) const;
+		// withClauseで生成した文のパラメータをバインドする
+		void bind(QSqlQuery &q, int candidateLimit) const;
+};
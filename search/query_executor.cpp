@@ -0,0 +1,140 @@
+#include "query_executor.hpp"
+#include <QDebug>
+#include "condition/condition.hpp"
+
+namespace {
+	// ワーカースレッド用の接続名
+	const auto QueryConnectionName = QStringLiteral("DGDB_query");
+} // namespace
+
+// ワーカースレッドに所属し、専用のDB接続で検索を行う
+class QueryExecutor::Worker : public QObject {
+	private:
+		// 接続は作成したスレッドでしか使えないので、最初の検索時にワーカースレッドで開く
+		std::unique_ptr<dg::sql::Database> _db;
+
+	public:
+		void run(QueryExecutor *owner, const quint64 ticket, const RankFunc &rank, const Cancel_SP &cancel) {
+			const auto isCancelled = [&cancel]() { return cancel->load(std::memory_order_relaxed); };
+			if (isCancelled())
+				return;
+			try {
+				if (!_db) {
+					_db = myDb_c.openConnection(QueryConnectionName);
+					owner->_handle.store(dg::SqliteHandle(*_db), std::memory_order_release);
+				}
+
+				auto res = rank(*_db, cancel.get());
+				if (isCancelled())
+					return;
+
+				const int count = static_cast<int>(res.ids.size());
+				QMetaObject::invokeMethod(
+					owner,
+					[owner, ticket, score = std::move(res.score)]() mutable {
+						owner->_deliverScore(ticket, std::move(score));
+					},
+					Qt::QueuedConnection);
+				// 一度に渡すとGUI側の処理(サムネイル等)で固まるので、区切って送る
+				for (int pos = 0; pos < count; pos += ChunkSize) {
+					if (isCancelled())
+						return;
+					const auto itr = res.ids.begin() + pos;
+					PoseIds chunk(itr, itr + std::min(ChunkSize, count - pos));
+					QMetaObject::invokeMethod(
+						owner,
+						[owner, ticket, chunk = std::move(chunk)]() mutable {
+							owner->_deliverChunk(ticket, std::move(chunk));
+						},
+						Qt::QueuedConnection);
+				}
+				QMetaObject::invokeMethod(
+					owner, [owner, ticket, count]() { owner->_deliverFinished(ticket, count); }, Qt::QueuedConnection);
+			}
+			catch (const std::exception &e) {
+				qWarning() << "Query failed:" << e.what();
+				QMetaObject::invokeMethod(
+					owner, [owner, ticket]() { owner->_deliverFinished(ticket, 0); }, Qt::QueuedConnection);
+			}
+		}
+};
+
+QueryExecutor::QueryExecutor(QObject *parent) : QObject(parent), _worker(new Worker) {
+	_worker->moveToThread(&_thread);
+	// スレッド終了時にワーカースレッド上で接続ごと破棄する
+	connect(&_thread, &QThread::finished, _worker, &QObject::deleteLater);
+	_thread.setObjectName("QueryExecutor");
+	_thread.start();
+}
+
+QueryExecutor::~QueryExecutor() {
+	cancel();
+	_thread.quit();
+	_thread.wait();
+}
+
+void QueryExecutor::start(const int limit, ConditionV snapshot) {
+	_start([limit, snapshot = std::move(snapshot)](dg::sql::Database &db, const std::atomic_bool *cancel) {
+		std::vector<Condition *> clist;
+		clist.reserve(snapshot.size());
+		for (auto &cond : snapshot)
+			clist.emplace_back(cond.get());
+		return myDb_c.rank(db, limit, clist, cancel);
+	});
+}
+
+void QueryExecutor::startSimilar(const int limit, const PoseId self) {
+	_start([limit, self](dg::sql::Database &db, const std::atomic_bool *cancel) {
+		return myDb_c.findSimilar(db, self, limit, cancel);
+	});
+}
+
+void QueryExecutor::_start(RankFunc rank) {
+	cancel();
+	const quint64 ticket = ++_ticket;
+	_cancel = std::make_shared<std::atomic_bool>(false);
+	_running = true;
+	_timer.start();
+
+	QMetaObject::invokeMethod(
+		_worker,
+		[this, worker = _worker, ticket, rank = std::move(rank), cancel = _cancel]() {
+			worker->run(this, ticket, rank, cancel);
+		},
+		Qt::QueuedConnection);
+}
+
+void QueryExecutor::cancel() {
+	if (_cancel) {
+		_cancel->store(true, std::memory_order_relaxed);
+		// フラグは段階の区切りでしか見ないので、実行中の長い文はSQLite側で中断させる
+		if (_running)
+			dg::InterruptSqlite(_handle.load(std::memory_order_acquire));
+	}
+	_cancel.reset();
+	_running = false;
+}
+
+bool QueryExecutor::isRunning() const noexcept {
+	return _running;
+}
+
+void QueryExecutor::_deliverScore(const quint64 ticket, MyDatabase::ScoreMap score) {
+	if (ticket != _ticket || !_running)
+		return;
+	emit scoreReady(std::move(score));
+}
+
+void QueryExecutor::_deliverChunk(const quint64 ticket, PoseIds chunk) {
+	if (ticket != _ticket || !_running)
+		return;
+	emit chunkReady(std::move(chunk));
+}
+
+void QueryExecutor::_deliverFinished(const quint64 ticket, const int count) {
+	if (ticket != _ticket || !_running)
+		return;
+	_running = false;
+	_cancel.reset();
+	emit finished(count, _timer.elapsed());
+}
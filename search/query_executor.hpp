@@ -0,0 +1,74 @@
+#pragma once
+#include <QElapsedTimer>
+#include <QObject>
+#include <QThread>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include "id.hpp"
+#include "singleton/my_db.hpp"
+
+class Condition;
+using Condition_SP = std::shared_ptr<Condition>;
+
+/**
+ * @brief 検索をGUIスレッドとは別のスレッド・DB接続で行う
+ *
+ * 結果はスコア順に一定件数ずつ区切ってGUIスレッドへ送る。
+ * 検索中に次の検索を開始すると、前の検索は中断されその結果は破棄される。
+ */
+class QueryExecutor : public QObject {
+		Q_OBJECT
+
+	public:
+		// 一度に通知するポーズの数
+		constexpr static int ChunkSize = 256;
+		using ConditionV = std::vector<Condition_SP>;
+
+		explicit QueryExecutor(QObject *parent = nullptr);
+		~QueryExecutor() override;
+
+		/**
+		 * @brief 検索を開始する (実行中の検索は中断する)
+		 *
+		 * @param limit 最大件数
+		 * @param snapshot 条件リストの複製 (ワーカースレッドが所有する)
+		 */
+		void start(int limit, ConditionV snapshot);
+		// self と特徴ベクトルが近いポーズを探す (self は結果から除く)
+		void startSimilar(int limit, PoseId self);
+		// 実行中の検索を中断する (結果は通知されない。実行中のSQL文も途中で止める)
+		void cancel();
+		bool isRunning() const noexcept;
+
+	signals:
+		// 検索結果のスコア (最初のchunkReadyより前に通知)
+		void scoreReady(MyDatabase::ScoreMap score);
+		// スコア順に区切った検索結果
+		void chunkReady(PoseIds chunk);
+		// 全ての結果を通知し終えた
+		void finished(int count, qint64 elapsedMs);
+
+	private:
+		class Worker;
+		using Cancel_SP = std::shared_ptr<std::atomic_bool>;
+		// ワーカースレッドの接続で検索を行う関数
+		using RankFunc = std::function<MyDatabase::Ranking(dg::sql::Database &, const std::atomic_bool *)>;
+
+		QThread _thread;
+		Worker *_worker;
+		// 実行中の検索の番号 (古い検索からの通知を捨てる為)
+		quint64 _ticket = 0;
+		Cancel_SP _cancel;
+		// ワーカースレッドの接続のsqlite3ハンドル (中断時に実行中の文を止める為)
+		std::atomic<void *> _handle{nullptr};
+		bool _running = false;
+		QElapsedTimer _timer;
+
+		void _start(RankFunc rank);
+
+		// --- ワーカースレッドから(キュー経由で)呼ばれる ---
+		void _deliverScore(quint64 ticket, MyDatabase::ScoreMap score);
+		void _deliverChunk(quint64 ticket, PoseIds chunk);
+		void _deliverFinished(quint64 ticket, int count);
+};
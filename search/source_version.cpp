@@ -0,0 +1,77 @@
+#include "source_version.hpp"
+#include <QStringList>
+#include <array>
+#include "aux_f_q/sql/database.hpp"
+
+namespace {
+	// 派生テーブルの元になるテーブル
+	// (MasseTorsoVec は vec0 でトリガを張れないので、同時に書かれる MasseTorsoDir で代表させる)
+	constexpr std::array<const char *, 6> SourceTables{
+		"Pose", "MasseTorsoDir", "MasseThighDir", "MasseCrusDir", "ThighFlexion", "CrusFlexion",
+	};
+	constexpr std::array<const char *, 3> Operations{"INSERT", "UPDATE", "DELETE"};
+
+	QString TriggerName(const char *table, const char *op) {
+		return QString("SourceVersion_%1_%2").arg(table).arg(op);
+	}
+	bool HasAllTriggers(const dg::sql::Database &db) {
+		QStringList names;
+		for (const char *table : SourceTables)
+			for (const char *op : Operations)
+				names.append(QString("'%1'").arg(TriggerName(table, op)));
+		auto q = db.exec(
+			QString("SELECT COUNT(*) FROM sqlite_master WHERE type = 'trigger' AND name IN (%1)").arg(names.join(',')));
+		return q.next() && q.value(0).toLongLong() == names.size();
+	}
+} // namespace
+
+qint64 EnsureSourceVersion(dg::sql::Database &db) {
+	db.exec(R"(
+		CREATE TABLE IF NOT EXISTS SourceVersion (
+			id			INTEGER PRIMARY KEY CHECK(id = 0),
+			version		INTEGER NOT NULL
+		)
+	)");
+	db.exec("INSERT OR IGNORE INTO SourceVersion (id, version) VALUES (0, 0)");
+	db.exec(R"(
+		CREATE TABLE IF NOT EXISTS DerivedVersion (
+			name		TEXT PRIMARY KEY,
+			version		INTEGER NOT NULL
+		)
+	)");
+	if (!HasAllTriggers(db)) {
+		db.beginTransaction();
+		try {
+			// トリガが無かった間の変更は追えないので、作った物は全て古いとみなす
+			db.exec("UPDATE SourceVersion SET version = version + 1");
+			for (const char *table : SourceTables) {
+				for (const char *op : Operations) {
+					const auto name = TriggerName(table, op);
+					db.exec(QString("DROP TRIGGER IF EXISTS %1").arg(name));
+					db.exec(QString("CREATE TRIGGER %1 AFTER %2 ON %3 "
+									"BEGIN UPDATE SourceVersion SET version = version + 1; END")
+								.arg(name).arg(op).arg(table));
+				}
+			}
+			db.commitTransaction();
+		}
+		catch (...) {
+			db.rollbackTransaction();
+			throw;
+		}
+	}
+	auto q = db.exec("SELECT version FROM SourceVersion");
+	return q.next() ? q.value(0).toLongLong() : 0;
+}
+
+qint64 BuiltVersion(const dg::sql::Database &db, const QString &name) {
+	auto q = db.exec("SELECT version FROM DerivedVersion WHERE name = ?", name);
+	return q.next() ? q.value(0).toLongLong() : -1;
+}
+
+void SetBuiltVersion(dg::sql::Database &db, const QString &name, const qint64 version) {
+	if (version < 0)
+		db.exec("DELETE FROM DerivedVersion WHERE name = ?", name);
+	else
+		db.exec("INSERT OR REPLACE INTO DerivedVersion (name, version) VALUES (?,?)", name, version);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include <QString>
+
+namespace dg::sql {
+	class Database;
+}
+
+/**
+ * @brief 元データ(Pose, MasseTorsoDir 等)の版番号を用意し、その値を返す
+ *
+ * 元のテーブルへの INSERT / UPDATE / DELETE で版番号を1つ進めるトリガを張る。
+ * 派生テーブル(PoseScalar, PoseFeatureVec)は作った時の版番号を記録しておき、
+ * 件数が変わらない書き換えでも、版番号が違えば作り直す。
+ * トリガが欠けていた(外部のツールでテーブルを作り直した等)場合は、その間の変更を追えないので版番号を進める。
+ */
+qint64 EnsureSourceVersion(dg::sql::Database &db);
+// 派生テーブル name を作った時の版番号 (未作成なら -1)
+qint64 BuiltVersion(const dg::sql::Database &db, const QString &name);
+// 派生テーブル name を作った時の版番号を記録する (作り直すトランザクションの中で呼ぶこと。-1 で未作成に戻す)
+void SetBuiltVersion(dg::sql::Database &db, const QString &name, qint64 version);
@@ -1,9 +1,21 @@
 #include "my_db.hpp"
+#include <QLibrary>
 #include <QMessageBox>
+#include <QSqlDriver>
+#include <QThread>
+#include <QtConcurrent/QtConcurrent>
+#include <algorithm>
 #include "aux_f_q/q_value.hpp"
 #include "aux_f_q/sql/exception.hpp"
+#include "aux_f_q/sql/id_array.hpp"
 #include "aux_f_q/sql/query.hpp"
+#include "aux_f_q/sql/read_pool.hpp"
 #include "condition/condition.hpp"
+#include "search/blacklist.hpp"
+#include "search/pose_feature.hpp"
+#include "search/pose_scalar.hpp"
+#include "search/pose_store.hpp"
+#include "search/query_compiler.hpp"
 
 namespace {
 	const auto BLACKLIST_FILE = QStringLiteral("blacklist.sqlite3");
@@ -20,13 +32,11 @@ namespace {
 		)").arg(BLACKLIST_TABLE.text());
 	// clang-format on
 
-	// スコア計算用の一時テーブルのレイアウト
-	const auto score_layout = QStringLiteral("poseId INTEGER NOT NULL,"
-											 "cond_index INTEGER NOT NULL,"
-											 "score REAL NOT NULL,"
-											 "PRIMARY KEY(poseId, cond_index)");
-	// スコア計算用の一時テーブルの名前
-	const dg::sql::Name ScoreTable{"temp", "score_accum"};
+	// 条件毎のスコアを並べたCTEの名前
+	const auto ScoreName = QStringLiteral("score_accum");
+	// 派生テーブルを作る接続の名前
+	const auto ScalarConnectionName = QStringLiteral("DGDB_scalar");
+	const auto FeatureConnectionName = QStringLiteral("DGDB_feature");
 } // namespace
 namespace dg {
 	void LoadVecExtension(dg::sql::Database &db) {
@@ -40,16 +50,32 @@ namespace dg {
 		}
 
 		// SQLiteのバージョンとsqlite-vecのバージョンを取得
-		auto q = db.exec("SELECT sqlite_version(), vec_version();");
+		auto q = db.exec("SELECT sqlite_version(), vec_version(), vec_kernel();");
 		if (q.next()) {
 			// SQLiteのバージョン
 			qDebug() << "SQLite Version: " << q.value(0).toString();
 			// sqlite-vecのバージョン
 			qDebug() << "sqlite-vec Version: " << q.value(1).toString();
+			// 小次元ベクトル用のL2カーネル (CPUIDで選択)
+			qDebug() << "sqlite-vec Kernel: " << q.value(2).toString();
 		}
 		else
 			qWarning() << "Failed to retrieve SQLite/vec version";
 	}
+	void *SqliteHandle(const sql::Database &db) {
+		const QVariant v = db.database().driver()->handle();
+		if (!v.isValid() || qstrcmp(v.typeName(), "sqlite3*") != 0)
+			return nullptr;
+		return *static_cast<void *const *>(v.constData());
+	}
+	void InterruptSqlite(void *handle) {
+		using Interrupt_p = void (*)(void *);
+		// 拡張は接続を開く時に読み込み済みなので、ロード済みのライブラリから引くだけになる
+		static const auto s_interrupt =
+			reinterpret_cast<Interrupt_p>(QLibrary::resolve("sqlite-vec.dll", "sqlite3_vec_interrupt"));
+		if (handle && s_interrupt)
+			s_interrupt(handle);
+	}
 } // namespace dg
 
 MyDatabase::MyDatabase(std::unique_ptr<dg::sql::Database> db) :
@@ -63,6 +89,7 @@ MyDatabase::MyDatabase(std::unique_ptr<dg::sql::Database> db) :
 		_db->attach(BLACKLIST_FILE, BLACKLIST_DB);
 		// Blacklistテーブルを未作成の場合は定義
 		_db->exec(blacklist_layout);
+		_blacklist = std::make_unique<Blacklist>(*_db, BLACKLIST_TABLE);
 
 		// Read meta info
 		q = _db->exec("SELECT partialHash FROM Meta");
@@ -72,6 +99,94 @@ MyDatabase::MyDatabase(std::unique_ptr<dg::sql::Database> db) :
 	catch (const std::exception &e) {
 		qWarning() << "Database initialization failed:" << e.what();
 	}
+	// 検索用の派生テーブルは、元データが変わっていれば作り直す (ポーズ数によっては数分掛かる)
+	_db->finishStatements();
+	_indexPool.setMaxThreadCount(1);
+	// ピッチ・屈曲角の条件は索引付きの列から近い値を探す
+	_scalarBuild = QtConcurrent::run(&_indexPool, [this]() {
+		_buildIndex(ScalarConnectionName, "PoseScalar", EnsurePoseScalar);
+	});
+	// 「似たポーズを探す」用の特徴ベクトル
+	// (索引のグラフは接続毎にメモリへ載るので、検索に使わない接続で作る)
+	_featureBuild = QtConcurrent::run(&_indexPool, [this]() {
+		_buildIndex(FeatureConnectionName, "PoseFeatureVec", EnsurePoseFeature);
+	});
+}
+
+MyDatabase::~MyDatabase() {
+	// 作成中なら実行中の文を止めて終わるのを待つ
+	// (文と文の間に呼ぶと中断は効かないので、終わるまで繰り返す)
+	_indexCancel = true;
+	while (!_scalarBuild.isFinished() || !_featureBuild.isFinished()) {
+		{
+			std::lock_guard lk(_indexMutex);
+			dg::InterruptSqlite(_indexHandle);
+		}
+		QThread::msleep(IndexPollMs);
+	}
+}
+
+void MyDatabase::_buildIndex(const QString &connectionName, const QString &table,
+							 void (*ensure)(dg::sql::Database &)) {
+	if (_indexCancel)
+		return;
+	try {
+		const auto db = openConnection(connectionName);
+		{
+			std::lock_guard lk(_indexMutex);
+			_indexHandle = dg::SqliteHandle(*db);
+		}
+		try {
+			// 作り終えるまで他の接続から読めなくならない様、変更したページはコミットまで書き出さない
+			db->exec("PRAGMA cache_spill = OFF");
+			ensure(*db);
+		}
+		catch (const std::exception &e) {
+			if (!_indexCancel)
+				qWarning() << "Failed to build" << table << ":" << e.what();
+		}
+		std::lock_guard lk(_indexMutex);
+		_indexHandle = nullptr;
+	}
+	catch (const std::exception &e) {
+		qWarning() << "Failed to open index connection:" << e.what();
+	}
+}
+
+bool MyDatabase::_waitForBuild(const QFuture<void> &build, const std::atomic_bool *cancel) const {
+	while (!build.isFinished()) {
+		if (cancel && cancel->load(std::memory_order_relaxed))
+			return false;
+		QThread::msleep(IndexPollMs);
+	}
+	return true;
+}
+bool MyDatabase::waitForScalarIndex(const std::atomic_bool *cancel) const {
+	return _waitForBuild(_scalarBuild, cancel);
+}
+bool MyDatabase::waitForFeatureIndex(const std::atomic_bool *cancel) const {
+	return _waitForBuild(_featureBuild, cancel);
+}
+
+void MyDatabase::enablePoseStore() {
+	try {
+		_store = std::make_unique<PoseStore>(*_db);
+	}
+	catch (const std::exception &e) {
+		qWarning() << "Failed to load PoseStore:" << e.what();
+		_store.reset();
+	}
+}
+bool MyDatabase::hasPoseStore() const noexcept {
+	return static_cast<bool>(_store);
+}
+void MyDatabase::setExactRanking(const bool b) noexcept {
+	_exactRanking = b;
+}
+void MyDatabase::setReadConnections(const int n) {
+	_readPool.reset();
+	if (n > 0)
+		_readPool = std::make_unique<dg::sql::ReadPool>(*_db, "DGDB_read", n);
 }
 
 const QStringList &MyDatabase::getTagList() const {
@@ -81,6 +196,13 @@ const QStringList &MyDatabase::getTagList() const {
 dg::sql::Database &MyDatabase::database() const {
 	return *_db;
 }
+std::unique_ptr<dg::sql::Database> MyDatabase::openConnection(const QString &name) const {
+	auto db = std::make_unique<dg::sql::Database>(name, _db->database().databaseName(), dg::sql::FeatureV{},
+												  dg::sql::PragmaV{{"foreign_keys", "true"}});
+	dg::LoadVecExtension(*db);
+	db->attach(BLACKLIST_FILE, BLACKLIST_DB);
+	return db;
+}
 QString MyDatabase::getTag(const int idx) const {
 	if (idx < 0 || idx >= _tags.size()) {
 		qWarning() << "Invalid tag index:" << idx;
@@ -89,32 +211,22 @@ QString MyDatabase::getTag(const int idx) const {
 	return _tags.at(idx);
 }
 
-void MyDatabase::addBlacklist(const FileId fileId) const {
-	const auto hash = getFileHash(fileId);
-	if (hash.isEmpty()) {
-		qWarning() << "addBlacklist: empty hash for fileId" << EnumToInt(fileId);
-		return;
-	}
-	_db->exec(QString("INSERT OR IGNORE INTO %1 (hash) VALUES (?)").arg(BLACKLIST_TABLE.text()), hash);
+Blacklist &MyDatabase::blacklist() const {
+	Q_ASSERT(_blacklist);
+	return *_blacklist;
 }
-void MyDatabase::removeBlacklist(const FileId fileId) const {
-	const auto hash = getFileHash(fileId);
-	if (hash.isEmpty()) {
-		qWarning() << "removeBlacklist: empty hash for fileId" << EnumToInt(fileId);
-		return;
-	}
-	_db->exec(QString("DELETE FROM %1 WHERE hash = ?").arg(BLACKLIST_TABLE.text()), hash);
-}
-bool MyDatabase::isBlacklisted(const FileId fileId) const {
-	const auto hash = getFileHash(fileId);
-	if (hash.isEmpty()) {
-		return false;
-	}
-	auto q = _db->exec(QString("SELECT 1 FROM %1 WHERE hash = ?").arg(BLACKLIST_TABLE.text()), hash);
-	return q.next();
+std::unordered_set<PoseId> MyDatabase::_getBlacklistedPoses(const dg::sql::Database &db) const {
+	const auto files = _blacklist->files();
+	if (files.empty())
+		return {};
+	auto q = db.exec("SELECT id FROM Pose WHERE fileId IN (SELECT value FROM json_each(?))", dg::sql::MakeIdArray(files));
+	std::unordered_set<PoseId> ret;
+	while (q.next())
+		ret.emplace(dg::ConvertQV<PoseId>(q.value(0)));
+	return ret;
 }
 void MyDatabase::deleteBlacklist() {
-	_db->exec("DELETE FROM blacklist.Blacklist");
+	_blacklist->clear();
 	QMessageBox::information(nullptr, "Blacklist Cleared", "Done.");
 }
 namespace {
@@ -137,6 +249,19 @@ namespace {
 		return result;
 	}
 
+	// キャッシュ1エントリ当たりの管理領域 (listとhashのノード分のおおよその値)
+	constexpr size_t CacheEntryOverhead = 64;
+	size_t CacheCost(const QString &s) {
+		return CacheEntryOverhead + sizeof(QString) + s.size() * sizeof(QChar);
+	}
+	size_t CacheCost(const QByteArray &b) {
+		return CacheEntryOverhead + sizeof(QByteArray) + b.size();
+	}
+	size_t CacheCost(const PoseInfo &info) {
+		return CacheEntryOverhead + sizeof(PoseInfo) + info.landmarks.size() * sizeof(QVector2D) +
+			   info.torsoMethod.size() * sizeof(QChar);
+	}
+
 	// QVariant から QVector3D を生成するヘルパー関数
 	QVector3D ConvertVec3(const QVariant &vx, const QVariant &vy, const QVariant &vz) {
 		return {
@@ -145,135 +270,254 @@ namespace {
 			dg::ConvertQV<float>(vz),
 		};
 	}
-	// 指定されたテーブルから poseId に対応する QVector3D を1つ取得する関数
-	std::optional<QVector3D> fetchSingleVec3(const dg::sql::Database &db, const QString &table, const PoseId poseId) {
-		auto q = db.exec(QString("SELECT x, y, z FROM %1 WHERE poseId = ? LIMIT 1").arg(table), poseId);
-		if (!q.next())
-			return std::nullopt;
-		return ConvertVec3(q.value(0), q.value(1), q.value(2));
-	}
-
-	// 指定された poseId の左右の方向ベクトルを取得する共通関数
-	std::array<std::optional<QVector3D>, 2> fetchLimbDirs(const dg::sql::Database &db, const QString &table,
-														  const PoseId poseId) {
-		std::array<std::optional<QVector3D>, 2> dirs; // [0]=left, [1]=right
-		auto q = db.exec(QString("SELECT is_right, x, y, z FROM %1 WHERE poseId = ?").arg(table), poseId);
-		while (q.next()) {
-			const int isRight = dg::ConvertQV<int>(q.value(0));
-			const int idx = (isRight != 0) ? 1 : 0;
-			dirs[idx] = ConvertVec3(q.value(1), q.value(2), q.value(3));
-		}
-		return dirs;
-	}
 } // namespace
 
-PoseIds MyDatabase::query(const int limit, const std::vector<Condition *> &clist) const {
+PoseIds MyDatabase::query(const int limit, const std::vector<Condition *> &clist) {
+	auto r = rank(*_db, limit, clist);
+	setScores(std::move(r.score));
+	return std::move(r.ids);
+}
+
+MyDatabase::Ranking MyDatabase::rank(dg::sql::Database &db, const int limit, const std::vector<Condition *> &clist,
+									 const std::atomic_bool *cancel) const {
 	if (clist.empty()) {
 		qWarning() << "query called with empty condition list";
 		return {};
 	}
-
-	// --- スコア計算用テーブル ---
-	try {
-		_db->dropTable(ScoreTable, true);
-		_db->createTempTable(ScoreTable.table, score_layout, false);
+	const auto isCancelled = [cancel]() { return cancel && cancel->load(std::memory_order_relaxed); };
+	if (_store) {
+		if (isCancelled())
+			return {};
+		return _rankNative(limit, clist);
 	}
-	catch (const std::exception &e) {
-		qWarning() << "Failed to create score table:" << e.what();
+	if (!waitForScalarIndex(cancel))
 		return {};
-	}
+	if (_readPool && clist.size() > 1)
+		return _rankParallel(db, limit, clist, cancel);
 
-	for (int index = 0; auto &&cond : clist) {
+	// 全条件を1つの文にまとめ、集計・ソートまでを一度に行う
+	QueryCompiler qc;
+	for (auto *cond : clist) {
 		try {
-			const auto qp = cond->getSqlQuery({
-				.outputTableName = ResultTableName,
-				.ratio = cond->getRatio(),
-			});
-			qp.exec(*_db,
-					QString("INSERT INTO %1 "
-							"SELECT poseId, %2, score * :ratio FROM %3")
-						.arg(ScoreTable.text())
-						.arg(index)
-						.arg(ResultTableName),
-					SearchAllLimit);
+			qc.add(*cond);
 		}
 		catch (const std::exception &e) {
 			qWarning() << "Condition query failed:" << e.what();
 		}
-		++index;
-	}
-	// scoreTableにずらっとスコアが入っているので
-	// FilePathと関連付けてソートし取り出す
-	auto q = _db->exec(QString("SELECT Pose.id, SUM(Result.score) AS score "
-							   "	FROM %1 AS Result "
-							   "INNER JOIN Pose "
-							   "	ON Result.poseId = Pose.id "
-							   "INNER JOIN File "
-							   "	ON Pose.fileId = File.id "
-							   // -- Blacklist除外 --
-							   "LEFT OUTER JOIN %2 BL"
-							   "  ON File.hash = BL.hash "
-							   "WHERE BL.hash IS NULL "
-							   // -------------------
-							   "GROUP BY Result.poseId "
-							   "ORDER BY score DESC "
-							   "LIMIT ?")
-						   .arg(ScoreTable.text())
-						   .arg(BLACKLIST_TABLE.text()),
-					   limit);
-	// 結果の集計
-	PoseIds res;
-	while (q.next()) {
-		if (!q.value(0).isValid()) {
-			qWarning() << "Invalid poseId in query result";
-			continue;
+	}
+	if (qc.empty() || isCancelled())
+		return {};
+
+	// 上位 limit 件と、それぞれの条件毎のスコアを並べて取り出す
+	// (行は ranked の順、同じポーズ内では cond_index 順)
+	const auto text = qc.withClause(ScoreName) +
+					  QString(", ranked AS ( "
+							  "SELECT S.poseId, SUM(S.score) AS total "
+							  "	FROM %1 AS S "
+							  "INNER JOIN Pose "
+							  "	ON S.poseId = Pose.id "
+							  // -- Blacklist除外 (メモリ上のFileId集合を渡す) --
+							  "WHERE Pose.fileId NOT IN (SELECT value FROM json_each(:excluded)) "
+							  // -------------------
+							  "GROUP BY S.poseId "
+							  "ORDER BY total DESC "
+							  "LIMIT :limit ) "
+							  "SELECT ranked.poseId, S.score "
+							  "	FROM ranked "
+							  "INNER JOIN %1 AS S "
+							  "	ON S.poseId = ranked.poseId "
+							  "ORDER BY ranked.total DESC, ranked.poseId, S.cond_index")
+						  .arg(ScoreName);
+	Ranking res;
+	try {
+		QSqlQuery q(db.database());
+		q.prepare(text);
+		qc.bind(q, SearchAllLimit);
+		q.bindValue(":limit", limit);
+		q.bindValue(":excluded", dg::sql::MakeIdArray(_blacklist->files()));
+		dg::sql::Query(q);
+		while (q.next()) {
+			if (!q.value(0).isValid()) {
+				qWarning() << "Invalid poseId in query result";
+				continue;
+			}
+			const auto poseId = dg::ConvertQV<PoseId>(q.value(0));
+			const float score = dg::ConvertQV<float>(q.value(1));
+			auto [itr, inserted] = res.score.try_emplace(poseId, QueryScore{0, {}});
+			if (inserted)
+				res.ids.emplace_back(poseId);
+			itr->second.score += score;
+			itr->second.individual.emplace_back(score);
 		}
-		res.emplace_back(dg::ConvertQV<PoseId>(q.value(0)));
+	}
+	catch (const std::exception &e) {
+		qWarning() << "Query failed:" << e.what();
+		return {};
 	}
 	return res;
 }
 
-MyDatabase::QueryScore MyDatabase::getScore(const PoseId poseId) const {
-	const auto QStr = QStringLiteral(R"(
-		SELECT score, SUM(score) OVER() AS accum_score
-			FROM %1
-		WHERE poseId = ?
-		ORDER BY cond_index ASC
-	)");
-	auto q = _db->exec(QString(QStr).arg(ScoreTable.text()), poseId);
-
-	QueryScore ret;
-	if (!q.next())
-		throw dg::RuntimeError("Pose ID " + std::to_string(EnumToInt(poseId)) + " not found in score table.");
+MyDatabase::Ranking MyDatabase::findSimilar(dg::sql::Database &db, const PoseId self, const int limit,
+										   const std::atomic_bool *cancel) const {
+	if (limit <= 0 || !waitForFeatureIndex(cancel))
+		return {};
+	Ranking res;
+	try {
+		const auto feature = PoseFeatureById(db, self);
+		if (!feature) {
+			qWarning() << "Pose has no feature vector:" << EnumToInt(self);
+			return {};
+		}
+		const auto excluded = _getBlacklistedPoses(db);
+		// 除外されるポーズの分だけ足りなければ、k を増やして引き直す
+		for (int k = std::min(limit + 1, SearchAllLimit);; k = std::min(k * 2, SearchAllLimit)) {
+			if (cancel && cancel->load(std::memory_order_relaxed))
+				return {};
+			const auto hits = FindSimilarPoses(db, *feature, k);
+			res = {};
+			for (auto &&[poseId, distance] : hits) {
+				if (poseId == self || excluded.contains(poseId))
+					continue;
+				const float score = dg::PoseFeature::Score(distance);
+				res.ids.emplace_back(poseId);
+				res.score.emplace(poseId, QueryScore{score, {score}});
+				if (int(res.ids.size()) == limit)
+					break;
+			}
+			if (int(res.ids.size()) == limit || int(hits.size()) < k || k == SearchAllLimit)
+				break;
+		}
+	}
+	catch (const std::exception &e) {
+		qWarning() << "Similar pose query failed:" << e.what();
+		return {};
+	}
+	return res;
+}
 
-	ret.score = dg::ConvertQV<float>(q.value(1));
-	do {
-		const float score = dg::ConvertQV<float>(q.value(0));
-		ret.individual.emplace_back(score);
+MyDatabase::Ranking MyDatabase::_rankNative(const int limit, const std::vector<Condition *> &clist) const {
+	const auto excluded = _blacklist->files();
+	auto hits = _exactRanking ? _store->searchExact(limit, clist, excluded)
+							  : _store->search(limit, clist, excluded, SearchAllLimit);
+	Ranking res;
+	res.ids.reserve(hits.size());
+	for (auto &&hit : hits) {
+		res.ids.emplace_back(hit.poseId);
+		res.score.emplace(hit.poseId, QueryScore{hit.score, std::move(hit.individual)});
 	}
-	while (q.next());
+	return res;
+}
 
-	return ret;
+MyDatabase::Ranking MyDatabase::_rankParallel(dg::sql::Database &db, const int limit,
+											  const std::vector<Condition *> &clist,
+											  const std::atomic_bool *cancel) const {
+	// 条件1つ分の結果 (poseId, ratio適用済みスコア)
+	using ScoreV = std::vector<std::pair<PoseId, float>>;
+	std::vector<QFuture<ScoreV>> futures;
+	futures.reserve(clist.size());
+	for (auto *cond : clist) {
+		futures.emplace_back(_readPool->run([cond, cancel](dg::sql::Database &rdb) {
+			ScoreV ret;
+			if (cancel && cancel->load(std::memory_order_relaxed))
+				return ret;
+			try {
+				const auto qp = cond->getSqlQuery({
+					.outputTableName = ResultTableName,
+					.ratio = cond->getRatio(),
+				});
+				auto q = qp.exec(rdb, QString("SELECT poseId, score * :ratio FROM %1").arg(ResultTableName),
+								 SearchAllLimit);
+				while (q.next())
+					ret.emplace_back(dg::ConvertQV<PoseId>(q.value(0)), dg::ConvertQV<float>(q.value(1)));
+			}
+			catch (const std::exception &e) {
+				qWarning() << "Condition query failed:" << e.what();
+			}
+			return ret;
+		}));
+	}
+	// 待っている間にブラックリストを取得しておく
+	const auto excluded = _getBlacklistedPoses(db);
+
+	// 条件の順に合計する (individualの並びはSQL版のcond_index順と同じ)
+	ScoreMap total;
+	for (auto &f : futures) {
+		for (auto &&[poseId, score] : f.result()) {
+			auto &ent = total[poseId];
+			ent.score += score;
+			ent.individual.emplace_back(score);
+		}
+	}
+	if (cancel && cancel->load(std::memory_order_relaxed))
+		return {};
+
+	std::vector<std::pair<PoseId, float>> cand;
+	cand.reserve(total.size());
+	for (auto &&[poseId, ent] : total) {
+		if (!excluded.contains(poseId))
+			cand.emplace_back(poseId, ent.score);
+	}
+	const size_t nOut = std::min(cand.size(), static_cast<size_t>(std::max(limit, 0)));
+	std::partial_sort(cand.begin(), cand.begin() + nOut, cand.end(), [](const auto &a, const auto &b) {
+		if (a.second != b.second)
+			return a.second > b.second;
+		return a.first < b.first;
+	});
+
+	Ranking res;
+	res.ids.reserve(nOut);
+	for (size_t i = 0; i < nOut; ++i) {
+		const PoseId poseId = cand[i].first;
+		res.ids.emplace_back(poseId);
+		res.score.emplace(poseId, std::move(total[poseId]));
+	}
+	return res;
+}
+
+void MyDatabase::setScores(ScoreMap score) {
+	_score = std::move(score);
+}
+
+MyDatabase::QueryScore MyDatabase::getScore(const PoseId poseId) const {
+	const auto itr = _score.find(poseId);
+	if (itr == _score.end())
+		throw dg::RuntimeError("Pose ID " + std::to_string(EnumToInt(poseId)) + " not found in score table.");
+	return itr->second;
 }
 
 QString MyDatabase::getFilePath(const FileId fileId) const {
+	if (auto path = _filePathCache.find(fileId))
+		return *path;
 	auto q = _db->exec("SELECT File.path FROM File WHERE id=?", fileId);
-	if (q.next())
-		return q.value(0).toString();
+	if (q.next()) {
+		auto path = q.value(0).toString();
+		_filePathCache.insert(fileId, path, CacheCost(path));
+		return path;
+	}
 	qWarning() << "File path not found for id" << EnumToInt(fileId);
 	return {};
 }
 QByteArray MyDatabase::getFileHash(const FileId fileId) const {
+	if (auto hash = _fileHashCache.find(fileId))
+		return *hash;
 	auto q = _db->exec("SELECT File.hash FROM File WHERE id=?", fileId);
-	if (q.next())
-		return dg::ConvertQV<QByteArray>(q.value(0));
+	if (q.next()) {
+		auto hash = dg::ConvertQV<QByteArray>(q.value(0));
+		_fileHashCache.insert(fileId, hash, CacheCost(hash));
+		return hash;
+	}
 	qWarning() << "File hash not found for id" << EnumToInt(fileId);
 	return {};
 }
 FileId MyDatabase::getFileId(const PoseId poseId) const {
+	if (auto fileId = _fileIdCache.find(poseId))
+		return *fileId;
 	auto q = _db->exec("SELECT fileId FROM Pose WHERE id=?", poseId);
-	if (q.next())
-		return dg::ConvertQV<FileId>(q.value(0));
+	if (q.next()) {
+		const auto fileId = dg::ConvertQV<FileId>(q.value(0));
+		_fileIdCache.insert(poseId, fileId, CacheEntryOverhead + sizeof(PoseId) + sizeof(FileId));
+		return fileId;
+	}
 	qWarning() << "FileId not found for poseId" << EnumToInt(poseId);
 	return FileId{-1};
 }
@@ -290,90 +534,147 @@ QRectF MyDatabase::getPoseRect(const PoseId poseId) const {
 	return {};
 }
 
+void MyDatabase::setCacheBudget(const CacheBudget &budget) {
+	_fileIdCache.setCapacity(budget.fileId);
+	_filePathCache.setCapacity(budget.filePath);
+	_fileHashCache.setCapacity(budget.fileHash);
+	_poseInfoCache.setCapacity(budget.poseInfo);
+}
+MyDatabase::CacheStats MyDatabase::cacheStats() const {
+	return {
+		_fileIdCache.stats(),
+		_filePathCache.stats(),
+		_fileHashCache.stats(),
+		_poseInfoCache.stats(),
+	};
+}
+
 PoseInfo MyDatabase::getPoseInfo(const PoseId poseId) const {
-	// torsoDir
-	const auto torsoOpt = fetchSingleVec3(*_db, "MasseTorsoDir", poseId);
-	if (!torsoOpt)
-		throw dg::RuntimeError("MasseTorsoDir not found for poseId=" + std::to_string(EnumToInt(poseId)));
-	const QVector3D torsoDir = *torsoOpt;
-
-	// torsoDir(Method)
-	QString method("unknown");
-	{
-		auto q = _db->exec("SELECT method FROM MasseTorsoDir WHERE poseId = ?", poseId);
-		if (q.next())
-			method = dg::ConvertQV<QString>(q.value(0));
+	auto infos = getPoseInfos({poseId});
+	const auto itr = infos.find(poseId);
+	if (itr == infos.end())
+		throw dg::RuntimeError("PoseInfo incomplete for poseId=" + std::to_string(EnumToInt(poseId)));
+	return std::move(itr->second);
+}
+
+MyDatabase::PoseInfoMap MyDatabase::getPoseInfos(const PoseIds &poseIds) const {
+	if (poseIds.empty())
+		return {};
+
+	// キャッシュにある分はそのまま使い、無い分だけをDBから取得する
+	PoseInfoMap ret;
+	PoseIds missing;
+	for (const auto poseId : poseIds) {
+		if (ret.contains(poseId))
+			continue;
+		if (auto info = _poseInfoCache.find(poseId))
+			ret.emplace(poseId, std::move(*info));
+		else
+			missing.emplace_back(poseId);
 	}
+	if (missing.empty())
+		return ret;
 
-	// thighDir (left/right)
-	const auto thighDirs = fetchLimbDirs(*_db, "MasseThighDir", poseId);
-	if (!thighDirs[0] || !thighDirs[1])
-		throw dg::RuntimeError("MasseThighDir incomplete for poseId=" + std::to_string(EnumToInt(poseId)));
+	// 組み立て途中のPoseInfo
+	struct Partial {
+			std::optional<QVector3D> torsoDir;
+			QString method{"unknown"};
+			std::array<std::optional<QVector3D>, 2> thighDir, crusDir;
+			std::vector<QVector2D> landmarks;
+			std::array<dg::Radian, 2> thighFlex, crusFlex;
+			QRectF rect;
+	};
+	std::unordered_map<PoseId, Partial> part;
+	part.reserve(missing.size());
+	for (const auto poseId : missing)
+		part.try_emplace(poseId);
 
-	// crusDir (left/right)
-	const auto crusDirs = fetchLimbDirs(*_db, "MasseCrusDir", poseId);
-	if (!crusDirs[0] || !crusDirs[1])
-		throw dg::RuntimeError("MasseCrusDir incomplete for poseId=" + std::to_string(EnumToInt(poseId)));
+	// ID一覧はJSON配列として1つのパラメータで渡す
+	const QString idJson = dg::sql::MakeIdArray(missing);
+	const auto select = [this, &idJson](const QString &body) {
+		return _db->exec(QString(body).arg("poseId IN (SELECT value FROM json_each(?))"), idJson);
+	};
+	const auto partOf = [&part](const QVariant &v) -> Partial & { return part.at(dg::ConvertQV<PoseId>(v)); };
+	const auto sideOf = [](const QVariant &v) { return dg::ConvertQV<int>(v) != 0 ? 1 : 0; };
 
-	std::vector<QVector2D> landmarks;
+	// torsoDir, method
 	{
-		// clang-format off
-		auto q = _db->exec(R"(
-			SELECT td_x, td_y, landmarkIndex
-				FROM Landmark
-				WHERE poseId = ?
-				ORDER BY landmarkIndex ASC
-		)", poseId);
-		// clang-format on
+		auto q = select("SELECT poseId, x, y, z, method FROM MasseTorsoDir WHERE %1");
 		while (q.next()) {
-			if (!q.value(0).isValid() || !q.value(1).isValid()) {
-				qWarning() << "Invalid landmark value for poseId" << EnumToInt(poseId);
+			auto &p = partOf(q.value(0));
+			if (p.torsoDir)
 				continue;
-			}
-			landmarks.emplace_back(dg::ConvertQV<float>(q.value(0)), dg::ConvertQV<float>(q.value(1)));
+			p.torsoDir = ConvertVec3(q.value(1), q.value(2), q.value(3));
+			if (!q.value(4).isNull())
+				p.method = dg::ConvertQV<QString>(q.value(4));
 		}
 	}
-	std::array<dg::Radian, 2> thighFlexInfo;
+	// thighDir, crusDir (left/right)
+	const auto fetchLimbDirs = [&](const QString &table, auto member) {
+		auto q = select(QString("SELECT poseId, is_right, x, y, z FROM %1 WHERE %2").arg(table, "%1"));
+		while (q.next())
+			(partOf(q.value(0)).*member)[sideOf(q.value(1))] = ConvertVec3(q.value(2), q.value(3), q.value(4));
+	};
+	fetchLimbDirs("MasseThighDir", &Partial::thighDir);
+	fetchLimbDirs("MasseCrusDir", &Partial::crusDir);
+
+	// landmarks
 	{
 		// clang-format off
-		auto qThighFlex = _db->exec(R"(
-			SELECT is_right, angleRad
-				FROM ThighFlexion
-				WHERE poseId = ?
-				ORDER BY is_right ASC
-			)", poseId);
+		auto q = select(R"(
+			SELECT poseId, td_x, td_y
+				FROM Landmark
+				WHERE %1
+				ORDER BY poseId ASC, landmarkIndex ASC
+		)");
 		// clang-format on
-		while (qThighFlex.next()) {
-			const int isRight = dg::ConvertQV<int>(qThighFlex.value(0));
-			const int idx = (isRight != 0) ? 1 : 0;
-			thighFlexInfo[idx].set(dg::ConvertQV<float>(qThighFlex.value(1)));
+		while (q.next()) {
+			if (!q.value(1).isValid() || !q.value(2).isValid()) {
+				qWarning() << "Invalid landmark value for poseId" << q.value(0).toInt();
+				continue;
+			}
+			partOf(q.value(0)).landmarks.emplace_back(dg::ConvertQV<float>(q.value(1)),
+													  dg::ConvertQV<float>(q.value(2)));
 		}
 	}
-	std::array<dg::Radian, 2> crusFlexInfo;
+	// thighFlex, crusFlex (left/right)
+	const auto fetchFlexion = [&](const QString &table, auto member) {
+		auto q = select(QString("SELECT poseId, is_right, angleRad FROM %1 WHERE %2").arg(table, "%1"));
+		while (q.next())
+			(partOf(q.value(0)).*member)[sideOf(q.value(1))].set(dg::ConvertQV<float>(q.value(2)));
+	};
+	fetchFlexion("ThighFlexion", &Partial::thighFlex);
+	fetchFlexion("CrusFlexion", &Partial::crusFlex);
+
+	// rect
 	{
-		// clang-format off
-		auto qCrusFlex = _db->exec(R"(
-			SELECT is_right, angleRad
-				FROM CrusFlexion
-				WHERE poseId = ?
-				ORDER BY is_right
-			)", poseId);
-		// clang-format on
-		while (qCrusFlex.next()) {
-			const int isRight = dg::ConvertQV<int>(qCrusFlex.value(0));
-			const int idx = (isRight != 0) ? 1 : 0;
-			crusFlexInfo[idx].set(dg::ConvertQV<float>(qCrusFlex.value(1)));
+		auto q = select("SELECT poseId, x0, x1, y0, y1 FROM PoseRect WHERE %1");
+		while (q.next()) {
+			const float x0 = dg::ConvertQV<float>(q.value(1));
+			const float x1 = dg::ConvertQV<float>(q.value(2));
+			const float y0 = dg::ConvertQV<float>(q.value(3));
+			const float y1 = dg::ConvertQV<float>(q.value(4));
+			partOf(q.value(0)).rect = QRectF(QPointF{x0, y0}, QPointF{x1, y1});
 		}
 	}
 
-	return PoseInfo{std::move(landmarks),
-					method,
-					torsoDir,
-					{*(thighDirs[0]), *(thighDirs[1])},
-					{*(crusDirs[0]), *(crusDirs[1])},
-					{thighFlexInfo[0], thighFlexInfo[1]},
-					{crusFlexInfo[0], crusFlexInfo[1]},
-					getPoseRect(poseId)};
+	for (auto &&[poseId, p] : part) {
+		if (!p.torsoDir || !p.thighDir[0] || !p.thighDir[1] || !p.crusDir[0] || !p.crusDir[1]) {
+			qWarning() << "PoseInfo incomplete for poseId" << EnumToInt(poseId);
+			continue;
+		}
+		PoseInfo info{std::move(p.landmarks),
+					  p.method,
+					  *p.torsoDir,
+					  {*p.thighDir[0], *p.thighDir[1]},
+					  {*p.crusDir[0], *p.crusDir[1]},
+					  {p.thighFlex[0], p.thighFlex[1]},
+					  {p.crusFlex[0], p.crusFlex[1]},
+					  p.rect};
+		_poseInfoCache.insert(poseId, info, CacheCost(info));
+		ret.emplace(poseId, std::move(info));
+	}
+	return ret;
 }
 
 size_t MyDatabase::getNImages() const {
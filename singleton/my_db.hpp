@@ -1,15 +1,32 @@
 #pragma once
+#include <QFuture>
 #include <QStringList>
+#include <QThreadPool>
 #include <QVector3D>
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include "aux_f/lru_cache.hpp"
 #include "aux_f_q/sql/database.hpp"
 #include "id.hpp"
 #include "poseinfo.hpp"
 #include "singleton.hpp"
 
 class Condition;
+class PoseStore;
+class Blacklist;
+namespace dg::sql {
+	class ReadPool;
+}
 
 namespace dg {
 	void LoadVecExtension(dg::sql::Database &db);
+	// 接続のsqlite3ハンドル (接続を作ったスレッドで取得すること)
+	void *SqliteHandle(const dg::sql::Database &db);
+	// 別スレッドから、ハンドルの接続で実行中の文を中断させる
+	// (Qtのドライバが内蔵するSQLiteに届くよう、sqlite-vec拡張の sqlite3_vec_interrupt を呼ぶ)
+	void InterruptSqlite(void *handle);
 }
 
 #define myDb (MyDatabase::Get())
@@ -23,12 +40,37 @@ class MyDatabase : public dg::Singleton<MyDatabase> {
 				std::vector<float> individual;
 		};
 		using QueryResult_V = std::vector<QueryScore>;
+		using ScoreMap = std::unordered_map<PoseId, QueryScore>;
+		using PoseInfoMap = std::unordered_map<PoseId, PoseInfo>;
+
+		// 変化しないデータ(ファイル情報, PoseInfo)を保持するキャッシュのメモリ上限 [byte]
+		struct CacheBudget {
+				size_t fileId = 1 << 20;
+				size_t filePath = 4 << 20;
+				size_t fileHash = 2 << 20;
+				size_t poseInfo = 16 << 20;
+		};
+		struct CacheStats {
+				dg::LruCacheStats fileId, filePath, fileHash, poseInfo;
+		};
+		// 検索結果 (スコア順のポーズと、それぞれのスコア)
+		struct Ranking {
+				PoseIds ids;
+				ScoreMap score;
+		};
+
+		// 索引の作成を待つ間に中断を確認する間隔 [ms]
+		constexpr static int IndexPollMs = 50;
 
-		// コンストラクタ
+		// コンストラクタ (検索用の派生テーブルは裏のスレッドで作り始める)
 		MyDatabase(std::unique_ptr<dg::sql::Database> db);
+		~MyDatabase();
 
 		// データベースアクセサ
 		dg::sql::Database &database() const;
+		// 同じDBファイルへの別の接続を開く (vec拡張のロードとブラックリストDBのattach済み)
+		// 接続は作成したスレッドでのみ使用可能
+		std::unique_ptr<dg::sql::Database> openConnection(const QString &name) const;
 
 		// タグ関連
 		const QStringList &getTagList() const;
@@ -42,19 +84,61 @@ class MyDatabase : public dg::Singleton<MyDatabase> {
 		// ポーズ関連
 		QRectF getPoseRect(PoseId poseId) const;
 		PoseInfo getPoseInfo(PoseId poseId) const;
+		// 複数ポーズ分をテーブル毎に1回のクエリでまとめて取得する
+		// (データが欠けているポーズは結果に含まれない)
+		PoseInfoMap getPoseInfos(const PoseIds &poseIds) const;
 		QueryScore getScore(PoseId poseId) const;
 
 		// クエリ関連
-		PoseIds query(int limit, const std::vector<Condition *> &clist) const;
+		// 結果のスコアはgetScoreで参照できるように保持される
+		PoseIds query(int limit, const std::vector<Condition *> &clist);
+		/**
+		 * @brief 指定した接続で条件リストを評価し、スコア上位のポーズを返す
+		 *
+		 * MyDatabaseの状態を変更しないので、接続を分ければ別スレッドから呼べる
+		 * @param cancel trueになったら条件の区切りで中断し、空の結果を返す
+		 */
+		Ranking rank(dg::sql::Database &db, int limit, const std::vector<Condition *> &clist,
+					 const std::atomic_bool *cancel = nullptr) const;
+		/**
+		 * @brief 指定した接続で、特徴ベクトルが self に近いポーズを近い順に返す (PoseFeatureVec を引く)
+		 *
+		 * self の特徴ベクトルも索引に入っている物を使う (作り終えるまで待つ)。
+		 * self とブラックリストのポーズは除く。スコアは dg::PoseFeature::Score
+		 */
+		Ranking findSimilar(dg::sql::Database &db, PoseId self, int limit,
+							const std::atomic_bool *cancel = nullptr) const;
+		// getScoreで参照するスコアを差し替える (rankの結果を登録する)
+		void setScores(ScoreMap score);
+		// 特徴量を列データとしてメモリに読み込み、以降の検索をSQLを介さずに行う
+		void enablePoseStore();
+		bool hasPoseStore() const noexcept;
+		// 条件毎の候補数(SearchAllLimit)で切り詰めず、厳密な上位K件を求める (PoseStoreが必要)
+		void setExactRanking(bool b) noexcept;
+		// 読み取り専用接続のプールを作成し、SQL版の検索で条件毎のクエリを並列に評価する (0で無効)
+		void setReadConnections(int n);
 
 		// ブラックリスト関連
-		void addBlacklist(FileId fileId) const;
-		void removeBlacklist(FileId fileId) const;
-		bool isBlacklisted(FileId fileId) const;
+		// (判定はメモリ上で行い、変更は Blacklist::changed で通知される)
+		Blacklist &blacklist() const;
 		void deleteBlacklist();
 
 		bool usingPartialHash() const;
 
+		/**
+		 * @brief 条件検索用の PoseScalar を作り終えるまで待つ (SQL版の rank から呼ばれる)
+		 *
+		 * @param cancel trueになったら待つのをやめる
+		 * @return 作り終えていれば真 (作るのに失敗した場合も真。中断したら偽)
+		 */
+		bool waitForScalarIndex(const std::atomic_bool *cancel = nullptr) const;
+		// 「似たポーズを探す」用の PoseFeatureVec を作り終えるまで待つ (findSimilar から呼ばれる)
+		bool waitForFeatureIndex(const std::atomic_bool *cancel = nullptr) const;
+
+		// キャッシュ関連
+		void setCacheBudget(const CacheBudget &budget);
+		CacheStats cacheStats() const;
+
 		size_t getNImages() const;
 		size_t getNPoses() const;
 	private:
@@ -62,4 +146,33 @@ class MyDatabase : public dg::Singleton<MyDatabase> {
 		std::unique_ptr<dg::sql::Database> _db;
 		bool _debugMode;
 		bool _usePartialHash;
+
+		std::unique_ptr<Blacklist> _blacklist;
+		std::unique_ptr<PoseStore> _store;
+		std::unique_ptr<dg::sql::ReadPool> _readPool;
+		// (ツールチップ等から頻繁に呼ばれるので、SQLiteを引かずに済むようにする)
+		mutable dg::SharedLruCache<PoseId, FileId> _fileIdCache{CacheBudget{}.fileId};
+		mutable dg::SharedLruCache<FileId, QString> _filePathCache{CacheBudget{}.filePath};
+		mutable dg::SharedLruCache<FileId, QByteArray> _fileHashCache{CacheBudget{}.fileHash};
+		mutable dg::SharedLruCache<PoseId, PoseInfo> _poseInfoCache{CacheBudget{}.poseInfo};
+		// 直近の検索結果のスコア (getScore用)
+		ScoreMap _score;
+		bool _exactRanking = false;
+
+		// 派生テーブルを作るスレッド (グローバルプールを長く占有しない為)
+		// 1スレッドなので PoseScalar, PoseFeatureVec の順に1つずつ作る (書き込みのロックを取り合わない様に)
+		QThreadPool _indexPool;
+		QFuture<void> _scalarBuild, _featureBuild;
+		std::atomic_bool _indexCancel = false;
+		// 作成中の接続のsqlite3ハンドル (終了時に実行中の文を止める為。接続を閉じる前に外す)
+		std::mutex _indexMutex;
+		void *_indexHandle = nullptr;
+
+		// 別の接続で派生テーブルを作る (_indexPoolのスレッドで呼ばれる)
+		void _buildIndex(const QString &connectionName, const QString &table, void (*ensure)(dg::sql::Database &));
+		bool _waitForBuild(const QFuture<void> &build, const std::atomic_bool *cancel) const;
+		Ranking _rankNative(int limit, const std::vector<Condition *> &clist) const;
+		Ranking _rankParallel(dg::sql::Database &db, int limit, const std::vector<Condition *> &clist,
+							  const std::atomic_bool *cancel) const;
+		std::unordered_set<PoseId> _getBlacklistedPoses(const dg::sql::Database &db) const;
 };
@@ -6,14 +6,20 @@ MySettings::MySettings(const QString &path) : _settings(path, QSettings::IniForm
 namespace {
 	const QString EntryStr[] = {
 		"database/fileName",
+		"search/nativeEngine",
+		"search/exactRanking",
+		"search/readConnections",
+		"cache/fileBytes",
+		"cache/poseInfoBytes",
+		"thumbnail/decodeThreads",
+		"thumbnail/inFlight",
+		"thumbnail/prewarm",
+		"thumbnail/diskBytes",
 	};
 }
 
 QVariant MySettings::getValue(const Entry entry) const {
-	if (entry == Entry::DBFileName) {
-		return _settings.value(GetEntryStr(entry));
-	}
-	return {};
+	return _settings.value(GetEntryStr(entry));
 }
 
 const QString &MySettings::GetEntryStr(Entry entry) {
@@ -12,6 +12,24 @@ class MySettings : public dg::Singleton<MySettings> {
 	public:
 		enum class Entry {
 			DBFileName,
+			// 検索をPoseStore(メモリ上の列データ)で行うか
+			NativeEngine,
+			// 候補数を制限せず、厳密な上位K件を求めるか (PoseStoreを使用)
+			ExactRanking,
+			// SQL版の検索で条件を並列に評価する為の読み取り専用接続の数 (0で無効)
+			ReadConnections,
+			// ファイル情報(FileId, パス, ハッシュ)キャッシュのそれぞれのメモリ上限 [byte]
+			CacheFileBytes,
+			// PoseInfoキャッシュのメモリ上限 [byte]
+			CachePoseInfoBytes,
+			// サムネイル生成で同時にデコードするスレッド数
+			ThumbnailDecodeThreads,
+			// サムネイル生成で一度に処理する(メモリ上に持つ)画像数
+			ThumbnailInFlight,
+			// 起動時にサムネイルの事前生成を始めるか
+			ThumbnailPrewarm,
+			// サムネイルキャッシュのディスク使用量の上限 [byte] (0で無制限)
+			ThumbnailDiskBytes,
 		};
 		static const QString& GetEntryStr(Entry entry);
 		MySettings(const QString &path);
@@ -1,105 +1,100 @@
 #include "my_thumbnail.hpp"
+#include <QApplication>
+#include <QCryptographicHash>
+#include <QDateTime>
 #include <QDir>
 #include <QFile>
+#include <QFileInfo>
 #include <QImage>
 #include <QImageReader>
 #include <QMessageBox>
 #include <QSqlError>
+#include <QThread>
 #include <QtConcurrent/QtConcurrent>
-#include <blake3.h>
+#include <cmath>
 #include "aux_f/exception.hpp"
 #include "aux_f_q/image.hpp"
+#include "aux_f_q/q_value.hpp"
 #include "aux_f_q/sql/database.hpp"
+#include "aux_f_q/sql/id_array.hpp"
 #include "my_db.hpp"
+#include "thumbnail_codec.hpp"
+#include "thumbnail_pack.hpp"
 
 namespace {
 	static const auto THUMBNAIL_DIR = QStringLiteral("thumbnail");
 	static const auto THUMBNAIL_DB = THUMBNAIL_DIR + "/" + "thumbnail.sqlite3";
 	static const auto THUMB_DB = QStringLiteral("thumb");
 	static const auto THUMB_TABLE = dg::sql::Name(THUMB_DB, "Thumbnail");
-	constexpr int IconSize = 64;
-
-	QString CalculateCacheName(const QString &filePath, const bool partialHash = false) {
-		QFile file(filePath);
-		if (!file.open(QIODevice::ReadOnly)) {
-			throw dg::CantOpenFile(filePath.toStdString());
-		}
-
-		const qint64 fileSize = file.size();
-		constexpr qint64 PARTIAL_BLOCK_SIZE = 128 * 1024; // 128KB
-
-		blake3_hasher hasher;
-		blake3_hasher_init(&hasher);
-
-		// ファイルサイズをまずハッシュに含める
-		{
-			const QByteArray sizeBytes = QByteArray::number(fileSize);
-			blake3_hasher_update(&hasher, reinterpret_cast<const uint8_t *>(sizeBytes.constData()),
-								 static_cast<size_t>(sizeBytes.size()));
-		}
+	// 事前生成をどこまで進めたか (1行だけ)
+	static const auto PREWARM_TABLE = dg::sql::Name(THUMB_DB, "Prewarm");
+	// Exifサムネイルを使う際に許容する縦横比のずれ
+	constexpr double ExifAspectTolerance = 0.02;
+
+	// 内容のハッシュ(File.hash)の長さ
+	constexpr qsizetype HashLength = 64;
+	// 上限を超えた時はこの割合まで減らす (境界付近で毎回捨てるのを避ける)
+	constexpr double EvictLowWater = 0.9;
+
+	// 段階毎のタイルを格納するパック (最小の段階は以前からのファイル名のまま)
+	QString PackPath(const int level) {
+		if (level == 0)
+			return THUMBNAIL_DIR + "/thumbnail.pack";
+		return THUMBNAIL_DIR + QString("/thumbnail_%1.pack").arg(MyThumbnail::LevelSize[level]);
+	}
+	// 段階毎のタイル番号の列
+	QString TileColumn(const int level) {
+		if (level == 0)
+			return "tile";
+		return QString("tile%1").arg(MyThumbnail::LevelSize[level]);
+	}
+	// "prefix.tile, prefix.tile128, ..."
+	QString TileColumns(const QString &prefix = {}) {
+		QStringList cols;
+		for (int lv = 0; lv < MyThumbnail::NLevel; ++lv)
+			cols << prefix + TileColumn(lv);
+		return cols.join(", ");
+	}
 
-		const auto closeFileAndThrowError = [&file, &filePath]() {
-			file.close();
-			throw dg::RuntimeError("Failed to read file for hashing: " + filePath.toStdString());
-		};
-		if (partialHash && fileSize > PARTIAL_BLOCK_SIZE * 3) {
-			QByteArray buf;
-			buf.resize(PARTIAL_BLOCK_SIZE);
-
-			// 先頭
-			file.seek(0);
-			qint64 readed = file.read(buf.data(), buf.size());
-			if (readed != buf.size())
-				closeFileAndThrowError();
-			blake3_hasher_update(&hasher, reinterpret_cast<const uint8_t *>(buf.constData()),
-								 static_cast<size_t>(readed));
-
-			// 中間
-			const qint64 mid = fileSize / 2;
-			file.seek(std::max<qint64>(0, mid - PARTIAL_BLOCK_SIZE / 2));
-			readed = file.read(buf.data(), buf.size());
-			if (readed != buf.size())
-				closeFileAndThrowError();
-			blake3_hasher_update(&hasher, reinterpret_cast<const uint8_t *>(buf.constData()),
-								 static_cast<size_t>(buf.size()));
-
-			// 末尾
-			file.seek(std::max<qint64>(0, fileSize - PARTIAL_BLOCK_SIZE));
-			readed = file.read(buf.data(), buf.size());
-			if (readed != buf.size())
-				closeFileAndThrowError();
-			blake3_hasher_update(&hasher, reinterpret_cast<const uint8_t *>(buf.constData()),
-								 static_cast<size_t>(buf.size()));
+	// 旧形式(fileIdをキーにしていた)のテーブルを、File.hashをキーにする形に移行する
+	void MigrateToHashKey(dg::sql::Database &db, const bool hasTile) {
+		db.beginTransaction();
+		try {
+			db.exec(QString(R"(
+				CREATE TABLE %1.Thumbnail_new (
+					hash		BLOB PRIMARY KEY,
+					tile		INTEGER,
+					cacheName	TEXT,
+					CHECK(LENGTH(hash) == %2)
+				)
+			)")
+						.arg(THUMB_DB)
+						.arg(HashLength));
+			// Fileに無いファイルの分はハッシュが分からないので捨てる
+			db.exec(QString("INSERT OR IGNORE INTO %1.Thumbnail_new (hash, tile, cacheName) "
+							"SELECT File.hash, %3, T.cacheName "
+							"FROM %2 AS T "
+							"INNER JOIN main.File "
+							"	ON File.id = T.fileId")
+						.arg(THUMB_DB, THUMB_TABLE.text(), hasTile ? "T.tile" : "NULL"));
+			db.exec(QString("DROP TABLE %1").arg(THUMB_TABLE.text()));
+			db.exec(QString("ALTER TABLE %1.Thumbnail_new RENAME TO %2").arg(THUMB_DB, THUMB_TABLE.table));
+			db.commitTransaction();
 		}
-		else {
-			// 全体ハッシュ（64KBチャンク）
-			QByteArray buf;
-			buf.resize(64 * 1024);
-			while (true) {
-				const qint64 readBytes = file.read(buf.data(), buf.size());
-				if (readBytes < 0)
-					closeFileAndThrowError();
-				if (readBytes == 0)
-					break;
-				blake3_hasher_update(&hasher, reinterpret_cast<const uint8_t *>(buf.constData()),
-									 static_cast<size_t>(readBytes));
-			}
+		catch (...) {
+			db.rollbackTransaction();
+			throw;
 		}
-		file.close();
-
-		// finalize
-		uint8_t out_c[BLAKE3_OUT_LEN];
-		blake3_hasher_finalize(&hasher, out_c, BLAKE3_OUT_LEN);
-		const QByteArray hashBytes(reinterpret_cast<const char *>(out_c), BLAKE3_OUT_LEN);
-
-		// ハッシュ値を16進数文字列に変換
-		const QString hashString = QString(hashBytes.toHex());
-		// ".png"拡張子を付けて返す
-		return hashString + ".png";
 	}
 } // namespace
 
 MyThumbnail::MyThumbnail() {
+	_decodePool.setObjectName("ThumbnailDecode");
+	_decodePool.setMaxThreadCount(QThread::idealThreadCount());
+	// 事前生成は操作の邪魔をしないよう少ないスレッド・低い優先度で行う
+	_prewarmPool.setObjectName("ThumbnailPrewarm");
+	_prewarmPool.setMaxThreadCount(std::max(1, QThread::idealThreadCount() / 4));
+	_prewarmPool.setThreadPriority(QThread::LowestPriority);
 	auto &db = myDb.database();
 	// THUMBNAIL_DBの場所にディレクトリがなければ作る
 	QDir thumbnailDir(THUMBNAIL_DIR);
@@ -111,19 +106,101 @@ MyThumbnail::MyThumbnail() {
 	}
 	db.attach(THUMBNAIL_DB, THUMB_DB);
 	if (!db.hasTable(THUMB_TABLE)) {
+		// キーは内容のハッシュ(File.hash)なので、データベースを作り直しても使い回せる
+		// cacheName はPNG単体で保存していた頃のキャッシュの移行用 (tile が NULL の間だけ使う)
+		// lastAccess は最後に参照された時刻 (UNIX時間[秒]、容量超過時に古い物から捨てる)
 		db.exec(QString(R"(
 			CREATE TABLE %1 (
-				fileId		INTEGER PRIMARY KEY,
-				cacheName	TEXT NOT NULL
+				hash		BLOB PRIMARY KEY,
+				tile		INTEGER,
+				cacheName	TEXT,
+				lastAccess	INTEGER,
+				CHECK(LENGTH(hash) == %2)
 			);
 		)")
-					.arg(THUMB_TABLE.text()));
+					.arg(THUMB_TABLE.text())
+					.arg(HashLength));
+	}
+	else {
+		// fileIdをキーにしていた頃のテーブルなら移行する (さらに古い物にはタイル番号の列も無い)
+		bool hasHash = false, hasTile = false;
+		auto q = db.exec(QString("PRAGMA %1.table_info(%2)").arg(THUMB_TABLE.db, THUMB_TABLE.table));
+		while (q.next()) {
+			const auto col = q.value(1).toString();
+			hasHash |= col == "hash";
+			hasTile |= col == "tile";
+		}
+		if (!hasHash)
+			MigrateToHashKey(db, hasTile);
+	}
+	// 大きい段階のタイル番号と参照時刻の列 (無いテーブルには追加する)
+	{
+		QStringList cols;
+		auto q = db.exec(QString("PRAGMA %1.table_info(%2)").arg(THUMB_TABLE.db, THUMB_TABLE.table));
+		while (q.next())
+			cols << q.value(1).toString();
+		QStringList added;
+		for (int lv = 1; lv < NLevel; ++lv)
+			added << TileColumn(lv);
+		added << "lastAccess";
+		for (auto &&col : added) {
+			if (!cols.contains(col))
+				db.exec(QString("ALTER TABLE %1 ADD COLUMN %2 INTEGER").arg(THUMB_TABLE.text(), col));
+		}
 	}
+	db.exec(QString("CREATE INDEX IF NOT EXISTS %1.Thumbnail_lastAccess ON Thumbnail(lastAccess)").arg(THUMB_DB));
+	db.exec(QString(R"(
+		CREATE TABLE IF NOT EXISTS %1 (
+			id			INTEGER PRIMARY KEY CHECK(id = 0),
+			lastFileId	INTEGER NOT NULL
+		)
+	)")
+				.arg(PREWARM_TABLE.text()));
+	// 最小の段階は一覧で最も多く読むので無圧縮でマップしたまま使い、大きい段階はQOIで圧縮して置く
+	for (int lv = 0; lv < NLevel; ++lv)
+		_packs[lv] = std::make_unique<ThumbnailPack>(PackPath(lv), LevelSize[lv],
+													 lv == 0 ? nullptr : &ThumbnailCodec::Get(ThumbnailCodec::Kind::Qoi));
+	_rebuildFreeTiles();
 }
 
-std::vector<QPixmap> MyThumbnail::getThumbnails(const FileIds &fileIdsSrc) {
+void MyThumbnail::_rebuildFreeTiles() {
+	auto &db = myDb.database();
+	for (int lv = 0; lv < NLevel; ++lv) {
+		auto &pack = *_packs[lv];
+		std::vector<bool> used(pack.size(), false);
+		auto q = db.exec(
+			QString("SELECT %2 FROM %1 WHERE %2 IS NOT NULL").arg(THUMB_TABLE.text(), TileColumn(lv)));
+		while (q.next()) {
+			const auto tile = dg::ConvertQV<ThumbnailPack::Tile>(q.value(0));
+			if (pack.contains(tile))
+				used[tile] = true;
+		}
+		ThumbnailPack::TileV free;
+		for (size_t i = 0; i < used.size(); ++i) {
+			if (!used[i])
+				free.emplace_back(static_cast<ThumbnailPack::Tile>(i));
+		}
+		pack.release(free);
+	}
+}
+
+MyThumbnail::~MyThumbnail() {
+	// 溜めておいた参照時刻を書き込む
+	try {
+		_flushAccess();
+	}
+	catch (const std::exception &e) {
+		qWarning() << "Failed to save thumbnail access times:" << e.what();
+	}
+}
+
+std::vector<QPixmap> MyThumbnail::getThumbnails(const FileIds &fileIdsSrc, const int level) {
+	// QPixmapはGUIスレッドでしか扱えない
+	Q_ASSERT(QThread::currentThread() == qApp->thread());
+	Q_ASSERT(level >= 0 && level < NLevel);
 	if (fileIdsSrc.empty())
 		return {};
+	const int size = LevelSize[level];
 
 	// 重複を省く
 	auto fileIds = fileIdsSrc;
@@ -132,159 +209,704 @@ std::vector<QPixmap> MyThumbnail::getThumbnails(const FileIds &fileIdsSrc) {
 		auto itr = std::unique(fileIds.begin(), fileIds.end());
 		fileIds.erase(itr, fileIds.end());
 	}
+	// ワーカーやパックから得た画像 (Pixmapへの変換は最後にまとめて行う)
+	std::unordered_map<FileId, QImage> imap;
+	// 生成が必要なアイテム
+	std::vector<WItem> wItem;
+	// パックにあった物 (参照時刻を更新する)
+	FileIds hitIds;
+
+	auto &db = myDb.database();
+	// PNG単体で保存されている(パックに移行していない)キャッシュ
+	std::vector<LegacyItem> legacy;
+	// 一部の段階が欠けている物 (今回は拡縮で済ませ、裏で作り直す)
+	std::vector<RItem> regen;
+	// 要求された全ファイルのパスとキャッシュ位置を1回のクエリで取得する
+	{
+		std::lock_guard lock(_packMutex);
+		auto q = db.exec(QString("SELECT File.id, File.path, File.hash, Thumbnail.cacheName, %2 "
+								 "FROM main.File "
+								 "LEFT JOIN %1 "
+								 "	ON File.hash = Thumbnail.hash "
+								 "WHERE File.id IN (SELECT value FROM json_each(?))")
+							 .arg(THUMB_TABLE.text(), TileColumns("Thumbnail.")),
+						 dg::sql::MakeIdArray(fileIds));
+		constexpr int TileCol = 4;
+		while (q.next()) {
+			const auto fileId = dg::ConvertQV<FileId>(q.value(0));
+			const QString filePath = q.value(1).toString();
+			const auto hash = dg::ConvertQV<QByteArray>(q.value(2));
+			Q_ASSERT(!filePath.isEmpty());
+			const auto hasTile = [&](const int lv) {
+				return !q.value(TileCol + lv).isNull() &&
+					   _packs[lv]->contains(dg::ConvertQV<ThumbnailPack::Tile>(q.value(TileCol + lv)));
+			};
+			// 要求された段階が無ければ、キャッシュ済みの最も大きい段階から拡縮して作る
+			int found = hasTile(level) ? level : -1;
+			for (int lv = NLevel - 1; found < 0 && lv >= 0; --lv) {
+				if (hasTile(lv))
+					found = lv;
+			}
+			if (found >= 0) {
+				if (!_regenerating.contains(hash)) {
+					RItem r{WItem{fileId, filePath, hash, {}}, {}};
+					bool any = false;
+					for (int lv = 0; lv < NLevel; ++lv) {
+						r.missing[lv] = !hasTile(lv);
+						any |= r.missing[lv];
+					}
+					if (any)
+						regen.push_back(std::move(r));
+				}
+				// 最小の段階のタイルはデコード無しで使える
+				// (マップ領域は後の追記で無効になるので複製しておく)
+				const QImage tile =
+					_packs[found]->image(dg::ConvertQV<ThumbnailPack::Tile>(q.value(TileCol + found)));
+				imap.emplace(fileId, found == level ? tile.copy()
+													: tile.scaled(size, size, Qt::IgnoreAspectRatio,
+																  Qt::SmoothTransformation));
+				hitIds.emplace_back(fileId);
+				continue;
+			}
+			if (!q.value(3).isNull()) {
+				legacy.push_back(LegacyItem{fileId, filePath, hash, q.value(3).toString(), {}});
+				continue;
+			}
+			// キャッシュが無いので処理予約
+			wItem.push_back(WItem{fileId, filePath, hash, {}});
+		}
+	}
+	_stats.hit += hitIds.size();
+	_stats.miss += legacy.size() + wItem.size();
+	_touch(hitIds);
+	_regenerate(std::move(regen));
+	// 旧形式のキャッシュはついでにパックへ移行する
+	for (auto &&item : _migrate(legacy)) {
+		if (!item.image.isNull())
+			imap.emplace(item.fileId, item.image.scaled(size, size, Qt::IgnoreAspectRatio, Qt::SmoothTransformation));
+		else
+			wItem.push_back(WItem{item.fileId, item.filePath, item.hash, {}});
+	}
+	_generate(db, wItem, _decodePool);
+	for (auto &&item : wItem)
+		imap.emplace(item.fileId, std::move(item.pyramid[level]));
+
+	// vectorに詰め直す (Fileに無いIDや生成に失敗した物は空のサムネイルにする)
 	std::unordered_map<FileId, QPixmap> pmap;
+	std::vector<QPixmap> ret;
+	ret.reserve(fileIdsSrc.size());
+	for (auto &&fileId : fileIdsSrc) {
+		auto itr = pmap.find(fileId);
+		if (itr == pmap.end()) {
+			const auto img = imap.find(fileId);
+			itr = pmap.emplace(fileId, img != imap.end() ? QPixmap::fromImage(img->second) : QPixmap()).first;
+		}
+		ret.emplace_back(itr->second);
+	}
+	return ret;
+}
 
-	struct WItem {
-			FileId fileId;
-			QString filePath;
-			QPixmap thumbnail;
-			QString cacheFileName;
+void MyThumbnail::setPipeline(const int decodeThreads, const int inFlight) {
+	_decodePool.setMaxThreadCount(std::max(1, decodeThreads));
+	_inFlight = std::max(1, inFlight);
+}
 
-			WItem(const FileId fileId_v, const QString &filePath_v, const QPixmap &pm = {}) :
-				fileId(fileId_v), filePath(filePath_v), thumbnail(pm) {
-			}
-	};
-	// サムネイル生成処理
+void MyThumbnail::_touch(const FileIds &fileIds) {
+	const qint64 now = QDateTime::currentSecsSinceEpoch();
+	for (auto &&fileId : fileIds)
+		_accessed[fileId] = now;
+}
+
+void MyThumbnail::_flushAccess() {
+	if (_accessed.empty())
+		return;
+	// [[fileId, 時刻], ...]
+	QStringList pairs;
+	for (auto &&[fileId, time] : _accessed)
+		pairs.append(QString("[%1,%2]").arg(EnumToInt(fileId)).arg(time));
+	// 同じ内容のファイルが複数あれば新しい方の時刻にする
+	myDb.database().exec(QString("UPDATE %1 SET lastAccess = A.t "
+								 "FROM ("
+								 "	SELECT File.hash AS hash, MAX(json_extract(value, '$[1]')) AS t "
+								 "	FROM json_each(?) "
+								 "	INNER JOIN main.File "
+								 "		ON File.id = json_extract(value, '$[0]') "
+								 "	GROUP BY File.hash) AS A "
+								 "WHERE Thumbnail.hash = A.hash")
+							 .arg(THUMB_TABLE.text()),
+						 "[" + pairs.join(',') + "]");
+	_accessed.clear();
+}
+
+double MyThumbnail::CacheStats::hitRate() const noexcept {
+	const uint64_t total = hit + miss;
+	return total == 0 ? 0.0 : static_cast<double>(hit) / static_cast<double>(total);
+}
+
+void MyThumbnail::setDiskBudget(const qint64 bytes) {
+	_diskBudget = std::max<qint64>(0, bytes);
+}
+qint64 MyThumbnail::diskBudget() const noexcept {
+	return _diskBudget;
+}
+MyThumbnail::DiskUsage MyThumbnail::diskUsage() const {
+	std::lock_guard lock(_packMutex);
+	DiskUsage ret{0, 0};
+	for (auto &&pack : _packs) {
+		ret.live += pack->liveBytes();
+		ret.file += pack->fileBytes();
+	}
+	return ret;
+}
+bool MyThumbnail::isOverBudget() const {
+	return _diskBudget > 0 && diskUsage().live > _diskBudget;
+}
+const MyThumbnail::CacheStats &MyThumbnail::stats() const noexcept {
+	return _stats;
+}
+
+size_t MyThumbnail::_collectDeleted(QSqlQuery &q, Freed &freed) const {
+	size_t count = 0;
+	while (q.next()) {
+		for (int lv = 0; lv < NLevel; ++lv) {
+			if (!q.value(lv).isNull())
+				freed.tiles[lv].emplace_back(dg::ConvertQV<ThumbnailPack::Tile>(q.value(lv)));
+		}
+		if (!q.value(NLevel).isNull())
+			freed.cacheNames.append(q.value(NLevel).toString());
+		++count;
+	}
+	return count;
+}
+void MyThumbnail::_release(const Freed &freed) {
+	std::lock_guard lock(_packMutex);
+	for (int lv = 0; lv < NLevel; ++lv)
+		_packs[lv]->release(freed.tiles[lv]);
+	QDir dir(THUMBNAIL_DIR);
+	for (auto &&name : freed.cacheNames)
+		dir.remove(name);
+}
+
+MyThumbnail::GcResult MyThumbnail::collectGarbage(const size_t maxRows) {
+	auto &db = myDb.database();
+	GcResult res{0, 0, false};
+	Freed freed;
+	// パックの排他はトランザクション中に取らないので、使用量と1行あたりの平均を先に求めておく
+	qint64 liveBefore = 0, rowBytes = 0;
+	{
+		std::lock_guard lock(_packMutex);
+		for (auto &&pack : _packs) {
+			const auto n = static_cast<qint64>(pack->liveCount());
+			liveBefore += pack->liveBytes();
+			rowBytes += n > 0 ? pack->liveBytes() / n : pack->tileBytes();
+		}
+	}
+	rowBytes = std::max<qint64>(1, rowBytes);
+	db.beginTransaction();
+	try {
+		// 追い出す順番に使うので先に書き込んでおく
+		_flushAccess();
+		// Fileに無いファイルの分 (データベースから消された画像)
+		{
+			auto q = db.exec(QString("DELETE FROM %1 WHERE rowid IN ("
+									 "	SELECT Thumbnail.rowid FROM %1 "
+									 "	LEFT JOIN main.File "
+									 "		ON File.hash = Thumbnail.hash "
+									 "	WHERE File.hash IS NULL "
+									 "	LIMIT ?) "
+									 "RETURNING %2, cacheName")
+								 .arg(THUMB_TABLE.text(), TileColumns()),
+							 static_cast<qint64>(maxRows));
+			res.orphan = _collectDeleted(q, freed);
+		}
+		// 上限を超えていれば参照時刻が古い物から捨てる (参照時刻が無い物が最初)
+		// (まだパックに戻していない分を差し引いて判断する)
+		const qint64 live = liveBefore - static_cast<qint64>(res.orphan) * rowBytes;
+		if (res.orphan < maxRows && _diskBudget > 0 && live > _diskBudget) {
+			const qint64 excess = live - static_cast<qint64>(_diskBudget * EvictLowWater);
+			const auto n = std::min<qint64>((excess + rowBytes - 1) / rowBytes, maxRows - res.orphan);
+			auto q = db.exec(QString("DELETE FROM %1 WHERE rowid IN ("
+									 "	SELECT rowid FROM %1 ORDER BY lastAccess LIMIT ?) "
+									 "RETURNING %2, cacheName")
+								 .arg(THUMB_TABLE.text(), TileColumns()),
+							 n);
+			res.eviction = _collectDeleted(q, freed);
+		}
+		db.commitTransaction();
+	}
+	catch (...) {
+		db.rollbackTransaction();
+		throw;
+	}
+	_release(freed);
+	_stats.orphan += res.orphan;
+	_stats.eviction += res.eviction;
+	res.more = res.orphan + res.eviction >= maxRows || (res.eviction > 0 && isOverBudget());
+	return res;
+}
+
+std::unique_ptr<dg::sql::Database> MyThumbnail::openConnection(const QString &name) const {
+	auto db = myDb_c.openConnection(name);
+	db->attach(THUMBNAIL_DB, THUMB_DB);
+	return db;
+}
+
+size_t MyThumbnail::prewarm(dg::sql::Database &db, const FileIds &fileIds) {
+	if (fileIds.empty())
+		return 0;
+	// キャッシュ(パック・旧形式とも)が無い物だけ生成する
+	std::vector<WItem> wItem;
+	{
+		auto q = db.exec(QString("SELECT File.id, File.path, File.hash "
+								 "FROM main.File "
+								 "LEFT JOIN %1 "
+								 "	ON File.hash = Thumbnail.hash "
+								 "WHERE File.id IN (SELECT value FROM json_each(?)) "
+								 "	AND Thumbnail.hash IS NULL")
+							 .arg(THUMB_TABLE.text()),
+						 dg::sql::MakeIdArray(fileIds));
+		while (q.next())
+			wItem.push_back(WItem{dg::ConvertQV<FileId>(q.value(0)), q.value(1).toString(),
+								  dg::ConvertQV<QByteArray>(q.value(2)), {}});
+	}
+	_generate(db, wItem, _prewarmPool);
+	return std::count_if(wItem.begin(), wItem.end(), [](const WItem &item) { return !item.pyramid[0].isNull(); });
+}
+
+FileId MyThumbnail::prewarmCursor(const dg::sql::Database &db) const {
+	auto q = db.exec(QString("SELECT lastFileId FROM %1 WHERE id = 0").arg(PREWARM_TABLE.text()));
+	if (q.next())
+		return dg::ConvertQV<FileId>(q.value(0));
+	return FileId{0};
+}
+
+void MyThumbnail::setPrewarmCursor(dg::sql::Database &db, const FileId fileId) {
+	db.exec(QString("INSERT OR REPLACE INTO %1 (id, lastFileId) VALUES (0, ?)").arg(PREWARM_TABLE.text()),
+			EnumToInt(fileId));
+}
+
+void MyThumbnail::_generate(dg::sql::Database &db, std::vector<WItem> &items, QThreadPool &pool) {
+	if (items.empty())
+		return;
+	// 読み込み・デコード・縮小 (ワーカースレッド、QImageのみを扱う)
 	const auto workerFunc = [](WItem &item) {
 		try {
-			std::tie(item.thumbnail, item.cacheFileName) = _GenerateThumbnail(item.filePath, item.fileId);
+			item.pyramid = _GenerateThumbnail(item.filePath, item.fileId);
 		}
 		catch (const dg::RuntimeError &e) {
 			qDebug() << "Error generating thumbnail for file-id:" << EnumToInt(item.fileId) << e.what();
 		}
 	};
-	// 並列処理するアイテム
-	std::vector<WItem> wItem;
+	// 生成されたサムネイルを段階毎のパックに追記してDBに登録 (呼び出し元スレッド)
+	const auto persist = [this, &db](const auto begin, const auto end) {
+		QByteArrayList hashes;
+		std::array<std::vector<QImage>, NLevel> images;
+		for (auto itr = begin; itr != end; ++itr) {
+			// 生成に成功した場合のみDBに登録
+			if (!itr->pyramid[0].isNull()) {
+				hashes.emplace_back(itr->hash);
+				for (int lv = 0; lv < NLevel; ++lv)
+					images[lv].emplace_back(itr->pyramid[lv]);
+			}
+		}
+		_registerThumbnails(db, hashes, images);
+	};
+	// _inFlight 件ずつ区切り、ある区間のデコード中に1つ前の区間を保存する
+	// (デコード途中の画像がメモリ上に同時に存在するのは高々 _inFlight 件)
+	const auto total = static_cast<std::ptrdiff_t>(items.size());
+	auto prev = items.end();
+	for (std::ptrdiff_t pos = 0; pos < total; pos += _inFlight) {
+		const auto begin = items.begin() + pos;
+		const auto end = begin + std::min<std::ptrdiff_t>(_inFlight, total - pos);
+		QFuture<void> future = QtConcurrent::map(&pool, begin, end, workerFunc);
+		if (prev != items.end())
+			persist(prev, begin);
+		future.waitForFinished();
+		prev = begin;
+	}
+	persist(prev, items.end());
+}
+
+void MyThumbnail::_regenerate(std::vector<RItem> items) {
+	if (items.empty())
+		return;
+	for (auto &&r : items)
+		_regenerating.insert(r.item.hash);
+	QtConcurrent::run(&_prewarmPool,
+					  [items = std::move(items)]() mutable {
+						  for (auto &&r : items) {
+							  try {
+								  r.item.pyramid = _GenerateThumbnail(r.item.filePath, r.item.fileId);
+							  }
+							  catch (const dg::RuntimeError &e) {
+								  qDebug() << "Error regenerating thumbnail for file-id:"
+										   << EnumToInt(r.item.fileId) << e.what();
+							  }
+						  }
+						  return items;
+					  })
+		.then(&_regenContext, [this](const std::vector<RItem> &items) { _storeRegenerated(items); });
+}
 
+void MyThumbnail::_storeRegenerated(const std::vector<RItem> &items) {
+	for (auto &&r : items)
+		_regenerating.remove(r.item.hash);
 	auto &db = myDb.database();
-	// キャッシュを確認して、生成の必要がある物を洗い出す
-	for (const FileId fileId : fileIds) {
-		// キャッシュがあるか確認
-		auto q = db.exec(QString("SELECT File.path, Thumbnail.cacheName "
-								 "FROM main.File "
-								 "LEFT JOIN %1 "
-								 "	ON File.id = Thumbnail.fileId "
-								 "WHERE File.id = ? ")
-							 .arg(THUMB_TABLE.text()),
-						 fileId);
-
-		q.next();
-
-		const QString filePath = q.value(0).toString();
-		Q_ASSERT(!filePath.isEmpty());
-
-		bool cacheUsed = false;
-		if (!q.value(1).isNull()) {
-			const auto cachedFileName = q.value(1).toString();
-			// tPathがサムネイルのファイルパスなので、これを読み取りQPixmapにして返す
-			QPixmap thumbnail;
-			thumbnail.load(THUMBNAIL_DIR + "/" + cachedFileName);
-			if (!thumbnail.isNull()) {
-				pmap.emplace(fileId, std::move(thumbnail));
-				cacheUsed = true;
+	std::lock_guard lock(_packMutex);
+	// 追記したタイルと、その内で行に結び付かなかった物 (コミットしてから空きに戻す)
+	std::array<ThumbnailPack::TileV, NLevel> appended, unlinked;
+	db.beginTransaction();
+	try {
+		// 欠けていた段階だけを追記して行に結び付ける (既にある段階はそのまま)
+		// (待っている間にGCで行が消えたり、作り直された行が既に使えるタイルを持っていれば結び付けない)
+		for (int lv = 0; lv < NLevel; ++lv) {
+			QByteArrayList hashes;
+			std::vector<QImage> images;
+			for (auto &&r : items) {
+				if (r.missing[lv] && !r.item.pyramid[lv].isNull()) {
+					hashes.append(r.item.hash);
+					images.emplace_back(r.item.pyramid[lv]);
+				}
 			}
-			else {
-				// キャッシュファイルが破損している場合は再生成
-				qDebug() << "Thumbnail cache corrupted for fileId:" << EnumToInt(fileId)
-						 << "cacheName:" << cachedFileName;
+			if (images.empty())
+				continue;
+			const auto nTile = static_cast<qint64>(_packs[lv]->size());
+			appended[lv] = _packs[lv]->append(images);
+			const QString sql = QString("UPDATE %1 SET %2 = ? WHERE hash = ? AND coalesce(%2 >= ?, 1)")
+									.arg(THUMB_TABLE.text(), TileColumn(lv));
+			for (qsizetype i = 0; i < hashes.size(); ++i) {
+				if (db.exec(sql, appended[lv][i], hashes[i], nTile).numRowsAffected() == 0)
+					unlinked[lv].emplace_back(appended[lv][i]);
 			}
 		}
-		if (!cacheUsed) {
-			// 処理予約
-			wItem.emplace_back(fileId, myDb_c.getFilePath(fileId));
-		}
+		db.commitTransaction();
 	}
-	if (!wItem.empty()) {
-		// 並列処理
-		QFuture<void> future = QtConcurrent::map(wItem, workerFunc);
-		future.waitForFinished();
+	catch (...) {
+		db.rollbackTransaction();
+		for (int lv = 0; lv < NLevel; ++lv)
+			_packs[lv]->release(appended[lv]);
+		throw;
+	}
+	for (int lv = 0; lv < NLevel; ++lv)
+		_packs[lv]->release(unlinked[lv]);
+}
 
-		// 生成されたサムネイルをDBに登録
-		FileIds generatedFileIds;
-		QStringList generatedCacheName;
-		for (const WItem &item : wItem) {
-			// 生成に成功した場合のみDBに登録
-			if (!item.thumbnail.isNull()) {
-				generatedFileIds.emplace_back(item.fileId);
-				generatedCacheName.emplace_back(item.cacheFileName);
+std::vector<MyThumbnail::LegacyItem> MyThumbnail::_migrate(std::vector<LegacyItem> items) {
+	if (items.empty())
+		return {};
+	// 読み込みはまとめて並列に行う (方式は拡張子で選ぶ)
+	// (ファイルが無い・壊れている場合は読み込みに失敗するので、それを存在確認とする)
+	QtConcurrent::blockingMap(&_decodePool, items, [](LegacyItem &item) {
+		item.image = ThumbnailCodec::Load(THUMBNAIL_DIR + "/" + item.cacheName);
+		if (item.image.isNull())
+			qDebug() << "Thumbnail cache corrupted for fileId:" << EnumToInt(item.fileId)
+					 << "cacheName:" << item.cacheName;
+	});
+	QByteArrayList hashes;
+	std::vector<QImage> images;
+	for (auto &&item : items) {
+		if (item.image.isNull())
+			continue;
+		hashes.emplace_back(item.hash);
+		images.emplace_back(item.image);
+	}
+	// PNGは最小の段階しか無い (大きい段階は必要になった時にそこから作る)
+	_registerThumbnails(myDb.database(), hashes, {std::move(images)});
+	// パックに移したPNGは不要
+	QDir dir(THUMBNAIL_DIR);
+	for (auto &&item : items)
+		dir.remove(item.cacheName);
+	return items;
+}
+
+size_t MyThumbnail::migratePngCache() {
+	auto &db = myDb.database();
+	std::vector<LegacyItem> legacy;
+	{
+		auto q = db.exec(QString("SELECT File.id, File.path, File.hash, Thumbnail.cacheName "
+								 "FROM %1 "
+								 "INNER JOIN main.File "
+								 "	ON File.hash = Thumbnail.hash "
+								 "WHERE Thumbnail.tile IS NULL AND Thumbnail.cacheName IS NOT NULL")
+							 .arg(THUMB_TABLE.text()));
+		while (q.next())
+			legacy.push_back(LegacyItem{dg::ConvertQV<FileId>(q.value(0)), q.value(1).toString(),
+										dg::ConvertQV<QByteArray>(q.value(2)), q.value(3).toString(), {}});
+	}
+	size_t count = 0;
+	// 一度に読み込むとメモリを食うので区切って行う
+	constexpr size_t Batch = 1024;
+	for (size_t i = 0; i < legacy.size(); i += Batch) {
+		const auto end = legacy.begin() + std::min(legacy.size(), i + Batch);
+		for (auto &&item : _migrate({legacy.begin() + i, end}))
+			count += item.image.isNull() ? 0 : 1;
+	}
+	// 読み込めなかった物は次回生成し直す
+	db.exec(QString("DELETE FROM %1 WHERE tile IS NULL AND cacheName IS NOT NULL").arg(THUMB_TABLE.text()));
+	return count;
+}
+
+MyThumbnail::CompactResult MyThumbnail::compact() {
+	std::lock_guard lock(_packMutex);
+	auto &db = myDb.database();
+	CompactResult res{0, 0};
+	for (int lv = 0; lv < NLevel; ++lv) {
+		const QString col = TileColumn(lv);
+		// 参照されているタイル (Fileから消えたファイルの分は捨てる)
+		QVariantList hashes;
+		ThumbnailPack::TileV tiles;
+		{
+			auto q = db.exec(QString("SELECT Thumbnail.hash, Thumbnail.%2 "
+									 "FROM %1 "
+									 "INNER JOIN main.File "
+									 "	ON File.hash = Thumbnail.hash "
+									 "WHERE Thumbnail.%2 IS NOT NULL "
+									 "ORDER BY Thumbnail.%2")
+								 .arg(THUMB_TABLE.text(), col));
+			while (q.next()) {
+				hashes.append(q.value(0));
+				tiles.emplace_back(dg::ConvertQV<ThumbnailPack::Tile>(q.value(1)));
 			}
 		}
-		_registerThumbnails(generatedFileIds, generatedCacheName);
+		auto &pack = *_packs[lv];
+		res.before += pack.size();
+		const auto remap = pack.compact(tiles);
+
+		QVariantList kept, newTiles;
+		for (size_t i = 0; i < tiles.size(); ++i) {
+			const auto itr = remap.find(tiles[i]);
+			if (itr == remap.end())
+				continue;
+			kept.append(hashes[i]);
+			newTiles.append(itr->second);
+		}
+		db.beginTransaction();
+		try {
+			// 新しいタイル番号に振り直し、それ以外(参照先が無い物)は外す
+			db.exec(QString("UPDATE %1 SET %2 = NULL").arg(THUMB_TABLE.text(), col));
+			if (!kept.isEmpty())
+				db.batch(QString("UPDATE %1 SET %2 = ? WHERE hash = ?").arg(THUMB_TABLE.text(), col), newTiles, kept);
+			db.commitTransaction();
+		}
+		catch (...) {
+			db.rollbackTransaction();
+			throw;
+		}
+		res.after += pack.size();
+	}
+	// どの段階のタイルも旧形式のキャッシュも無い行は消す
+	QStringList empty;
+	for (int lv = 0; lv < NLevel; ++lv)
+		empty << TileColumn(lv) + " IS NULL";
+	db.exec(QString("DELETE FROM %1 WHERE %2 AND cacheName IS NULL").arg(THUMB_TABLE.text(), empty.join(" AND ")));
+	return res;
+}
+MyThumbnail::VerifyTask MyThumbnail::startVerify() {
+	auto &db = myDb.database();
+	VerifyTask task{std::make_shared<std::vector<VerifyItem>>(), {}};
+	// 古いデータベースにはサイズ・更新日時の列が無い
+	{
+		bool hasSize = false, hasTimestamp = false;
+		auto q = db.exec("PRAGMA main.table_info(File)");
+		while (q.next()) {
+			const auto col = q.value(1).toString();
+			hasSize |= col == "size";
+			hasTimestamp |= col == "timestamp";
+		}
+		if (!hasSize || !hasTimestamp) {
+			qWarning() << "File table has no size/timestamp; thumbnail verification skipped";
+			// 既定の QFuture は終了済み扱いなので、そのまま finishVerify に渡せる
+			return task;
+		}
+	}
+	{
+		auto q = db.exec(QString("SELECT File.path, File.hash, File.size, File.timestamp "
+								 "FROM %1 "
+								 "INNER JOIN main.File "
+								 "	ON File.hash = Thumbnail.hash")
+							 .arg(THUMB_TABLE.text()));
+		while (q.next())
+			task.items->push_back(VerifyItem{q.value(0).toString(), dg::ConvertQV<QByteArray>(q.value(1)),
+											 q.value(2).toLongLong(), q.value(3).toLongLong(), false});
+	}
+	// 部分ハッシュの計算方法はデータベースの作成側に依るので、その場合は再計算せずに古いとみなす
+	const bool canRehash = !myDb_c.usingPartialHash();
+	task.future = QtConcurrent::map(&_decodePool, *task.items, [canRehash](VerifyItem &item) {
+		const QFileInfo info(item.path);
+		if (!info.exists()) {
+			item.stale = true;
+			return;
+		}
+		// サイズと更新日時が一致すれば内容も変わっていないとみなす
+		if (info.size() == item.size && info.lastModified().toSecsSinceEpoch() == item.timestamp)
+			return;
+		item.stale = true;
+		if (!canRehash)
+			return;
+		QFile file(item.path);
+		if (!file.open(QIODevice::ReadOnly))
+			return;
+		QCryptographicHash hash(QCryptographicHash::Sha512);
+		if (hash.addData(&file))
+			item.stale = hash.result() != item.hash;
+	});
+	return task;
+}
 
-		// キャッシュがあった分と統合する
-		for (auto &&item : wItem)
-			pmap.emplace(item.fileId, item.thumbnail);
+size_t MyThumbnail::finishVerify(const VerifyTask &task) {
+	Q_ASSERT(task.future.isFinished());
+	// 中断された場合、未確認の物は stale = false のまま残っている
+	auto &db = myDb.database();
+	size_t removed = 0;
+	Freed freed;
+	db.beginTransaction();
+	try {
+		for (auto &&item : *task.items) {
+			if (!item.stale)
+				continue;
+			auto q = db.exec(QString("DELETE FROM %1 WHERE hash = ? RETURNING %2, cacheName")
+								 .arg(THUMB_TABLE.text(), TileColumns()),
+							 item.hash);
+			removed += _collectDeleted(q, freed);
+		}
+		db.commitTransaction();
 	}
-	// vectorに詰め直す
-	std::vector<QPixmap> ret;
-	ret.reserve(fileIdsSrc.size());
-	for (auto &&fileId : fileIdsSrc)
-		ret.emplace_back(pmap.at(fileId));
-	return ret;
+	catch (...) {
+		db.rollbackTransaction();
+		throw;
+	}
+	// タイルは空きとしてパックに戻す
+	_release(freed);
+	return removed;
+}
+
+QImage MyThumbnail::_ExifPreview(const QByteArray &jpeg, const QSize &srcSize, const int minSide) {
+	if (jpeg.isEmpty() || !srcSize.isValid())
+		return {};
+	QImage img;
+	if (!img.loadFromData(jpeg, "JPEG"))
+		return {};
+	// サムネイルより小さい、または(黒帯付き等で)縦横比が本体と異なる物は使わない
+	if (img.width() < minSide || img.height() < minSide)
+		return {};
+	const double srcAspect = double(srcSize.width()) / srcSize.height();
+	const double aspect = double(img.width()) / img.height();
+	if (std::abs(aspect / srcAspect - 1.0) > ExifAspectTolerance)
+		return {};
+	return img;
 }
 
-std::pair<QPixmap, QString> MyThumbnail::_GenerateThumbnail(const QString &filePath, const FileId fileId) {
+MyThumbnail::Pyramid MyThumbnail::_GenerateThumbnail(const QString &filePath, const FileId fileId) {
 	if (EnumToInt(fileId) <= 0) {
 		throw dg::InvalidInput(std::string("Invalid fileId ") + std::to_string(EnumToInt(fileId)));
 	}
 
-	QImageReader reader(filePath);
+	QFile file(filePath);
+	if (!file.open(QIODevice::ReadOnly))
+		throw dg::CantOpenFile(filePath.toStdString());
+	// 読み込み位置を動かすので、リーダーに渡す前に取り出しておく
+	const QByteArray exifThumb = dg::ExifThumbnail(file);
+	file.seek(0);
+
+	QImageReader reader(&file);
 	reader.setAutoTransform(false);
 	if (!reader.canRead())
 		throw dg::CantOpenFile(filePath.toStdString());
 
-	QImage img = reader.read();
-	img = img.scaled(IconSize, IconSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	// 全ての段階を1回のデコードから作るので、最大の段階を基準にする
+	const int maxSize = LevelSize.back();
+	const QSize srcSize = reader.size();
+	QImage img = _ExifPreview(exifThumb, srcSize, maxSize);
+	if (img.isNull()) {
+		if (reader.format() == "jpeg" && srcSize.isValid()) {
+			// 縮小デコードで捨てる画素の展開を省く (最終的な縮小の品質の為に2倍の余裕を持たせる)
+			const QSize reduced = dg::JpegReducedSize(srcSize, maxSize * 2);
+			if (reduced != srcSize)
+				reader.setScaledSize(reduced);
+		}
+		img = reader.read();
+	}
+	img = img.scaled(maxSize, maxSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
 	if (img.isNull())
 		throw dg::CantMakeThumbnail("resizing image is failed");
-	img = dg::RotateByExif(reader.transformation(), img);
-
-	QPixmap ret;
-	ret = ret.fromImage(img);
 
-	const QString cacheName = CalculateCacheName(filePath, myDb_c.usingPartialHash());
-	const QString cachePath(THUMBNAIL_DIR + "/" + cacheName);
-
-	// サムネイルをキャッシュディレクトリに保存
-	if (ret.isNull())
+	// 大きい段階から順に半分ずつ縮小していく
+	// (パックに書き込む形式への変換もワーカー側で済ませておく)
+	Pyramid ret;
+	ret[NLevel - 1] = dg::RotateByExif(reader.transformation(), img).convertToFormat(ThumbnailPack::TileFormat);
+	if (ret[NLevel - 1].isNull())
 		throw dg::CantMakeThumbnail(filePath.toStdString());
-
-	QDir dir;
-	if (!dir.exists(THUMBNAIL_DIR)) {
-		if (!dir.mkpath(THUMBNAIL_DIR)) {
-			throw dg::RuntimeError(QString("Failed to mkdir \"%1\"").arg(THUMBNAIL_DIR).toStdString());
-		}
-	}
-	if (!ret.save(cachePath, "PNG")) {
-		throw dg::RuntimeError(QString("Failed to save thumbnail \"%1\"").arg(cachePath).toStdString());
-	}
-	return std::make_tuple(std::move(ret), cacheName);
+	for (int lv = NLevel - 2; lv >= 0; --lv)
+		ret[lv] = ret[lv + 1].scaled(LevelSize[lv], LevelSize[lv], Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+	return ret;
 }
 
-void MyThumbnail::_registerThumbnails(const FileIds &fileIds, const QStringList &cacheNames) {
-	if (fileIds.empty())
+void MyThumbnail::_registerThumbnails(dg::sql::Database &db, const QByteArrayList &hashes,
+									  const std::array<std::vector<QImage>, NLevel> &images) {
+	if (hashes.empty())
 		return;
+	static_assert(NLevel == 3, "adjust the bind list below");
+
+	// 既にある行が使えるタイルを持っていれば(同じ物を別スレッドが先に登録した)そちらを残し、
+	// 持っていない行(旧形式のPNGのみ・パックに無い番号)はこちらのタイルで置き換える
+	QStringList assign, usable;
+	for (int lv = 0; lv < NLevel; ++lv) {
+		assign << QString("%1 = excluded.%1").arg(TileColumn(lv));
+		usable << QString("coalesce(%1 < ?, 0)").arg(TileColumn(lv));
+	}
+	const QString sql = QString("INSERT INTO %1 (hash, %2, lastAccess) VALUES (?,?,?,?,?) "
+								"ON CONFLICT(hash) DO UPDATE SET %3, cacheName = NULL, lastAccess = excluded.lastAccess "
+								"WHERE NOT (%4) "
+								"RETURNING hash")
+							.arg(THUMB_TABLE.text(), TileColumns(), assign.join(", "), usable.join(" OR "));
+
+	const qint64 now = QDateTime::currentSecsSinceEpoch();
+	std::lock_guard lock(_packMutex);
+	// 追記する前のタイル数 (これ未満の番号を持つ行は使えるタイルがある)
+	std::array<qint64, NLevel> nTile;
+	std::array<ThumbnailPack::TileV, NLevel> tiles;
+	for (int lv = 0; lv < NLevel; ++lv) {
+		nTile[lv] = static_cast<qint64>(_packs[lv]->size());
+		Q_ASSERT(images[lv].empty() || images[lv].size() == static_cast<size_t>(hashes.size()));
+		tiles[lv] = _packs[lv]->append(images[lv]);
+	}
+	// 段階が無い物はNULL
+	const auto tileOf = [&tiles](const int lv, const qsizetype i) {
+		return tiles[lv].empty() ? QVariant() : QVariant(tiles[lv][i]);
+	};
 
-	std::vector<int> ids;
-	ids.reserve(fileIds.size());
-	for (auto &&f_id : fileIds)
-		ids.emplace_back(EnumToInt(f_id));
-
-	// データベースにキャッシュ情報を保存または更新
-	auto &db = myDb.database();
+	// 行に結び付かなかったタイル (コミットしてから空きに戻す)
+	std::array<ThumbnailPack::TileV, NLevel> unlinked;
 	db.beginTransaction();
-	const auto q =
-		db.batch(QString("INSERT INTO %1 (fileId, cacheName) VALUES (?,?)").arg(THUMB_TABLE.text()), ids, cacheNames);
-	QSqlError err = q.lastError();
-	if (err.isValid()) {
-		qDebug() << "Database error during thumbnail registration:" << err.text();
+	try {
+		for (qsizetype i = 0; i < hashes.size(); ++i) {
+			auto q = db.exec(sql, hashes[i], tileOf(0, i), tileOf(1, i), tileOf(2, i), now, nTile[0], nTile[1],
+							 nTile[2]);
+			if (q.next())
+				continue;
+			for (int lv = 0; lv < NLevel; ++lv) {
+				if (!tiles[lv].empty())
+					unlinked[lv].emplace_back(tiles[lv][i]);
+			}
+		}
+		db.commitTransaction();
+	}
+	catch (...) {
+		db.rollbackTransaction();
+		for (int lv = 0; lv < NLevel; ++lv)
+			_packs[lv]->release(tiles[lv]);
+		throw;
 	}
-	db.commitTransaction();
-	qDebug() << QString("Thumbnail register: (%1) files").arg(fileIds.size());
+	size_t dropped = 0;
+	for (int lv = 0; lv < NLevel; ++lv) {
+		dropped = std::max(dropped, unlinked[lv].size());
+		_packs[lv]->release(unlinked[lv]);
+	}
+	qDebug() << QString("Thumbnail register: (%1) files, (%2) already registered").arg(hashes.size()).arg(dropped);
 }
 
 void MyThumbnail::clearThumbnail() {
-	// THUMBNAIL_DIR内のpngファイルを全て消去
+	// THUMBNAIL_DIR内のpngファイル(旧形式)を全て消去
 	QDir dir(THUMBNAIL_DIR);
 	int removedCount = 0;
 	if (dir.exists()) {
@@ -298,9 +920,18 @@ void MyThumbnail::clearThumbnail() {
 			}
 		}
 	}
-	// データベースからも関連情報を削除
-	auto &db = myDb.database();
-	db.exec(QString("DELETE FROM %1").arg(THUMB_TABLE.text()));
+	{
+		std::lock_guard lock(_packMutex);
+		for (auto &&pack : _packs) {
+			removedCount += static_cast<int>(pack->size());
+			pack->clear();
+		}
+		// データベースからも関連情報を削除
+		auto &db = myDb.database();
+		db.exec(QString("DELETE FROM %1").arg(THUMB_TABLE.text()));
+		db.exec(QString("DELETE FROM %1").arg(PREWARM_TABLE.text()));
+	}
+	_accessed.clear();
 	// 削除した件数をQMessageBoxで表示
-	QMessageBox::information(nullptr, "Thumbnail Cleared", QString("Removed %1 thumbnail files.").arg(removedCount));
+	QMessageBox::information(nullptr, "Thumbnail Cleared", QString("Removed %1 thumbnails.").arg(removedCount));
 }
@@ -1,8 +1,18 @@
 #pragma once
+#include <QFuture>
 #include <QMap>
+#include <QObject>
 #include <QPixmap>
+#include <QSet>
+#include <QSqlQuery>
+#include <QThreadPool>
+#include <array>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "id.hpp"
 #include "singleton.hpp"
+#include "thumbnail_pack.hpp"
 
 namespace dg::sql {
 	class Database;
@@ -13,12 +23,186 @@ namespace dg::sql {
 // とりあえず指定サイズのサムネイルだけ担当
 class MyThumbnail : public dg::Singleton<MyThumbnail> {
 	public:
+		// 解像度の段階 (1辺のピクセル数、0が最小)
+		constexpr static int NLevel = 3;
+		constexpr static std::array<int, NLevel> LevelSize{64, 128, 256};
+		using Pyramid = std::array<QImage, NLevel>;
+
+		// ディスク使用量の上限の既定値 [byte]
+		constexpr static qint64 DefaultDiskBudget = qint64(4) << 30;
+
+		struct CompactResult {
+				size_t before, after;
+		};
+		// 起動してからのキャッシュの統計
+		struct CacheStats {
+				// パックにあった件数
+				uint64_t hit = 0;
+				// 生成した(旧形式から移した物を含む)件数
+				uint64_t miss = 0;
+				// 上限を超えた為に捨てた件数
+				uint64_t eviction = 0;
+				// 元画像がFileから消えていた為に回収した件数
+				uint64_t orphan = 0;
+
+				double hitRate() const noexcept;
+		};
+		struct DiskUsage {
+				// 使用中のタイルの合計 [byte]
+				qint64 live;
+				// パックファイルの合計 (空きタイルを含む) [byte]
+				qint64 file;
+		};
+		struct GcResult {
+				size_t orphan, eviction;
+				// 回収しきれなかった物が残っていれば真
+				bool more;
+		};
+		// 元画像の確認の対象 (キャッシュ済みの1ファイル)
+		struct VerifyItem {
+				QString path;
+				QByteArray hash;
+				qint64 size, timestamp;
+				bool stale;
+		};
+		struct VerifyTask {
+				// 確認中の対象 (future が終わるまで保持しておくこと)
+				std::shared_ptr<std::vector<VerifyItem>> items;
+				QFuture<void> future;
+		};
+
 		MyThumbnail();
+		~MyThumbnail();
 		void clearThumbnail();
-		std::vector<QPixmap> getThumbnails(const FileIds &fileIds);
+		/**
+		 * @brief 指定段階のサムネイルを取得 (無ければ生成する)
+		 *
+		 * その段階がキャッシュに無くても他の段階があれば、最も大きい物から拡縮して返す
+		 */
+		std::vector<QPixmap> getThumbnails(const FileIds &fileIds, int level = 0);
+		// PNG単体で保存されている旧形式のキャッシュを全てパックに移す (移した件数を返す)
+		size_t migratePngCache();
+		// 参照されなくなったタイルを除いてパックを詰め直す
+		CompactResult compact();
+		/**
+		 * @brief 元画像が変わったかの確認をデコード用のスレッドプールで始める
+		 *
+		 * File.size / File.timestamp がディスク上と一致しない物だけハッシュを計算し直して比較する。
+		 * 進捗と中断は future で扱い、終わったら finishVerify に渡す
+		 */
+		VerifyTask startVerify();
+		// 元画像が変わっていたキャッシュを破棄する (中断した場合は確認できた分だけ。破棄した件数を返す)
+		size_t finishVerify(const VerifyTask &task);
+		/**
+		 * @brief サムネイル生成の並列度とメモリ上限を設定
+		 *
+		 * @param decodeThreads 同時にデコードするスレッド数
+		 * @param inFlight 一度に生成する画像数 (この単位でパックへの保存と重ねて処理する)
+		 */
+		void setPipeline(int decodeThreads, int inFlight);
+
+		// --- 容量の管理 ---
+		// bytes: 使用中のタイルの合計の上限 (0で無制限)
+		void setDiskBudget(qint64 bytes);
+		qint64 diskBudget() const noexcept;
+		DiskUsage diskUsage() const;
+		bool isOverBudget() const;
+		const CacheStats &stats() const noexcept;
+		/**
+		 * @brief キャッシュを少しずつ回収する (ThumbnailCollectorから使う)
+		 *
+		 * Fileに無いファイルの分を捨て、上限を超えていれば最後に参照された時刻が古い物から捨てる。
+		 * 捨てたタイルは空きとしてパックに戻し、次の生成で再利用する。
+		 * @param maxRows 一度に捨てる最大件数
+		 */
+		GcResult collectGarbage(size_t maxRows);
+
+		// --- 事前生成 (ThumbnailWarmerのスレッドから使う) ---
+		// サムネイルDBもattachした別の接続を開く (接続は呼び出したスレッドでのみ使用可能)
+		std::unique_ptr<dg::sql::Database> openConnection(const QString &name) const;
+		// キャッシュが無い物だけを低優先度のスレッドで生成する (生成した件数を返す)
+		size_t prewarm(dg::sql::Database &db, const FileIds &fileIds);
+		// 事前生成を終えた最後のFileId (再開位置)
+		FileId prewarmCursor(const dg::sql::Database &db) const;
+		void setPrewarmCursor(dg::sql::Database &db, FileId fileId);
 
 	private:
-		static std::pair<QPixmap, QString> _GenerateThumbnail(const QString &filePath, FileId fileId);
+		// 旧形式のキャッシュ (PNGファイル)
+		struct LegacyItem {
+				FileId fileId;
+				QString filePath;
+				QByteArray hash;
+				QString cacheName;
+				QImage image;
+		};
+		// 生成するサムネイル
+		struct WItem {
+				FileId fileId;
+				QString filePath;
+				// キャッシュのキー (File.hash)
+				QByteArray hash;
+				Pyramid pyramid;
+		};
+		// 欠けた段階を元画像から作り直す物
+		struct RItem {
+				WItem item;
+				// 作り直す段階
+				std::array<bool, NLevel> missing;
+		};
+		// 削除した行が使っていたタイルとPNG (トランザクションをコミットしてから解放する)
+		struct Freed {
+				std::array<ThumbnailPack::TileV, NLevel> tiles;
+				QStringList cacheNames;
+		};
+		// 段階毎のパック
+		std::array<std::unique_ptr<ThumbnailPack>, NLevel> _packs;
+		// パックはGUIスレッドと事前生成のスレッドから使われる
+		// (デッドロックしない様、DBのトランザクションより先に取る。トランザクション中には取らない)
+		mutable std::mutex _packMutex;
+		// デコード専用のスレッドプール (検索等のグローバルプールを占有しない為)
+		QThreadPool _decodePool;
+		QThreadPool _prewarmPool;
+		int _inFlight = 256;
+		qint64 _diskBudget = DefaultDiskBudget;
+		CacheStats _stats;
+		// 欠けた段階を作り直し中のキャッシュ (同じ物を重ねて予約しない為)
+		QSet<QByteArray> _regenerating;
+		// 作り直した結果をGUIスレッドで受け取る為の文脈 (先に破棄されたら結果は捨てる)
+		QObject _regenContext;
+		// 参照された時刻 (表示の度に書き込まず、collectGarbage でまとめて書き込む)
+		std::unordered_map<FileId, qint64> _accessed;
+
+		// Exifに埋め込まれたサムネイルがそのまま使えるならデコードして返す
+		// (minSide: 必要な1辺の最小ピクセル数)
+		static QImage _ExifPreview(const QByteArray &jpeg, const QSize &srcSize, int minSide);
+		// ワーカースレッドで呼ばれるのでQPixmapは扱わない
+		// 1回のデコードから全ての段階を作る
+		static Pyramid _GenerateThumbnail(const QString &filePath, FileId fileId);
+		// 生成してパックに保存する (失敗した物は pyramid が空になる)
+		void _generate(dg::sql::Database &db, std::vector<WItem> &items, QThreadPool &pool);
 
-		void _registerThumbnails(const FileIds &fileIds, const QStringList &cacheName);
+		// 欠けた段階を低優先度のスレッドで元画像から作り直し、終わったらGUIスレッドで保存する
+		void _regenerate(std::vector<RItem> items);
+		void _storeRegenerated(const std::vector<RItem> &items);
+		// PNGを読み込んでパックに移す (読み込めなかった物は image が空になる)
+		std::vector<LegacyItem> _migrate(std::vector<LegacyItem> items);
+		// images: 段階毎の画像をパックに追記して登録する (空の段階はNULLで登録)
+		// 別のスレッドが先に登録していた物は既にある行を残し、追記したタイルは空きに戻す
+		// (パックの排他はこの中で取る)
+		void _registerThumbnails(dg::sql::Database &db, const QByteArrayList &hashes,
+								 const std::array<std::vector<QImage>, NLevel> &images);
+		// どの行からも参照されていないタイルをパックの空きにする
+		void _rebuildFreeTiles();
+		// 参照された時刻を記録する (書き込みは _flushAccess)
+		void _touch(const FileIds &fileIds);
+		// 記録しておいた参照時刻を1文で書き込む
+		void _flushAccess();
+		/**
+		 * @brief "DELETE ... RETURNING <タイル番号の列>, cacheName" の結果から解放する物を集める
+		 *
+		 * ロールバックされた場合に復活した行のタイルを再利用しない様、解放は _release でコミット後に行う
+		 * @return 削除した行数
+		 */
+		size_t _collectDeleted(QSqlQuery &q, Freed &freed) const;
+		void _release(const Freed &freed);
 };
@@ -0,0 +1,119 @@
+#include "thumbnail_codec.hpp"
+#include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <array>
+#include <cstring>
+#include "aux_f/qoi.hpp"
+#include "thumbnail_pack.hpp"
+
+namespace {
+	class RawCodec : public ThumbnailCodec {
+		public:
+			Kind kind() const noexcept override {
+				return Kind::Raw;
+			}
+			QString name() const override {
+				return "raw";
+			}
+			QByteArray encode(const QImage &src) const override {
+				const QImage img = src.convertToFormat(ThumbnailPack::TileFormat);
+				const qint32 size[2] = {img.width(), img.height()};
+				const qsizetype lineBytes = qsizetype(img.width()) * 4;
+				QByteArray ret;
+				ret.reserve(sizeof(size) + lineBytes * img.height());
+				ret.append(reinterpret_cast<const char *>(size), sizeof(size));
+				for (int y = 0; y < img.height(); ++y)
+					ret.append(reinterpret_cast<const char *>(img.constScanLine(y)), lineBytes);
+				return ret;
+			}
+			QImage decode(const QByteArray &data) const override {
+				qint32 size[2];
+				if (data.size() < qsizetype(sizeof(size)))
+					return {};
+				std::memcpy(size, data.constData(), sizeof(size));
+				const qsizetype lineBytes = qsizetype(size[0]) * 4;
+				if (size[0] <= 0 || size[1] <= 0 || data.size() != qsizetype(sizeof(size)) + lineBytes * size[1])
+					return {};
+				QImage img(size[0], size[1], ThumbnailPack::TileFormat);
+				const char *src = data.constData() + sizeof(size);
+				for (int y = 0; y < size[1]; ++y)
+					std::memcpy(img.scanLine(y), src + y * lineBytes, lineBytes);
+				return img;
+			}
+	};
+	// 乗算済みのまま符号化する (デコード後にタイル形式への変換が要らない)
+	class QoiCodec : public ThumbnailCodec {
+		public:
+			Kind kind() const noexcept override {
+				return Kind::Qoi;
+			}
+			QString name() const override {
+				return "qoi";
+			}
+			QByteArray encode(const QImage &src) const override {
+				const QImage img = src.convertToFormat(ThumbnailPack::TileFormat);
+				const auto enc = dg::qoi::Encode(img.constBits(), img.width(), img.height(), img.bytesPerLine());
+				return QByteArray(reinterpret_cast<const char *>(enc.data()), qsizetype(enc.size()));
+			}
+			QImage decode(const QByteArray &data) const override {
+				const auto *p = reinterpret_cast<const uint8_t *>(data.constData());
+				const auto header = dg::qoi::ReadHeader(p, data.size());
+				if (!header || header->width == 0 || header->height == 0)
+					return {};
+				QImage img(int(header->width), int(header->height), ThumbnailPack::TileFormat);
+				if (img.isNull() || !dg::qoi::Decode(p, data.size(), img.bits(), img.bytesPerLine()))
+					return {};
+				return img;
+			}
+	};
+	class PngCodec : public ThumbnailCodec {
+		public:
+			Kind kind() const noexcept override {
+				return Kind::Png;
+			}
+			QString name() const override {
+				return "png";
+			}
+			QByteArray encode(const QImage &img) const override {
+				QByteArray ret;
+				QBuffer buf(&ret);
+				buf.open(QIODevice::WriteOnly);
+				img.save(&buf, "PNG");
+				return ret;
+			}
+			QImage decode(const QByteArray &data) const override {
+				QImage img;
+				if (!img.loadFromData(data, "PNG"))
+					return {};
+				return img.convertToFormat(ThumbnailPack::TileFormat);
+			}
+	};
+
+	const RawCodec c_raw;
+	const QoiCodec c_qoi;
+	const PngCodec c_png;
+	const std::array<const ThumbnailCodec *, size_t(ThumbnailCodec::Kind::_Num)> c_codec{&c_raw, &c_qoi, &c_png};
+} // namespace
+
+const ThumbnailCodec &ThumbnailCodec::Get(const Kind kind) {
+	return *c_codec.at(static_cast<size_t>(kind));
+}
+
+const ThumbnailCodec *ThumbnailCodec::FromSuffix(const QString &suffix) {
+	for (const auto *codec : c_codec) {
+		if (suffix.compare(codec->name(), Qt::CaseInsensitive) == 0)
+			return codec;
+	}
+	return nullptr;
+}
+
+QImage ThumbnailCodec::Load(const QString &path) {
+	const auto *codec = FromSuffix(QFileInfo(path).suffix());
+	if (!codec)
+		return {};
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly))
+		return {};
+	return codec->decode(file.readAll());
+}
@@ -0,0 +1,37 @@
+#pragma once
+#include <QByteArray>
+#include <QImage>
+#include <QString>
+
+/**
+ * @brief サムネイル1枚をバイト列にする方式
+ *
+ * パック(ThumbnailPack)の大きい段階のタイルと、ファイル単体で置くキャッシュ(旧形式のPNG等)の読み書きに使う。
+ * デコード結果は常に ThumbnailPack::TileFormat になる。
+ */
+class ThumbnailCodec {
+	public:
+		enum class Kind {
+			// 無圧縮 (大きさ + 乗算済みARGB32)
+			Raw,
+			// QOI形式の可逆圧縮
+			Qoi,
+			// 互換用
+			Png,
+			_Num
+		};
+		virtual ~ThumbnailCodec() = default;
+
+		virtual Kind kind() const noexcept = 0;
+		// 表示名 (ファイルの拡張子にも使う)
+		virtual QString name() const = 0;
+		virtual QByteArray encode(const QImage &img) const = 0;
+		// 失敗したら空の画像を返す
+		virtual QImage decode(const QByteArray &data) const = 0;
+
+		static const ThumbnailCodec &Get(Kind kind);
+		// 拡張子から (該当する物が無ければ nullptr)
+		static const ThumbnailCodec *FromSuffix(const QString &suffix);
+		// ファイルを読み込んでデコードする (拡張子で方式を選ぶ)
+		static QImage Load(const QString &path);
+};
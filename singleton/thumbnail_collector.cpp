@@ -0,0 +1,50 @@
+#include "thumbnail_collector.hpp"
+#include "my_thumbnail.hpp"
+
+ThumbnailCollector::ThumbnailCollector(QObject *parent) : QObject(parent) {
+	_timer.setSingleShot(true);
+	connect(&_timer, &QTimer::timeout, this, &ThumbnailCollector::_onTimer);
+}
+
+void ThumbnailCollector::setBusyCheck(BusyCheck check) {
+	_isBusy = std::move(check);
+}
+
+void ThumbnailCollector::start() {
+	_orphan = _eviction = 0;
+	_timer.start(0);
+}
+
+void ThumbnailCollector::stop() {
+	_timer.stop();
+}
+
+size_t ThumbnailCollector::runBlocking() {
+	size_t count = 0;
+	for (;;) {
+		const auto res = myTn.collectGarbage(Batch);
+		count += res.orphan + res.eviction;
+		if (!res.more)
+			break;
+	}
+	return count;
+}
+
+void ThumbnailCollector::_onTimer() {
+	// 操作中は後回しにする
+	if (_isBusy && _isBusy()) {
+		_timer.start(PauseMs);
+		return;
+	}
+	const auto res = myTn.collectGarbage(Batch);
+	_orphan += res.orphan;
+	_eviction += res.eviction;
+	if (res.more) {
+		_timer.start(StepMs);
+		return;
+	}
+	if (_orphan + _eviction > 0)
+		emit collected(_orphan, _eviction);
+	_orphan = _eviction = 0;
+	_timer.start(IdleMs);
+}
@@ -0,0 +1,50 @@
+#pragma once
+#include <QObject>
+#include <QTimer>
+#include <functional>
+
+/**
+ * @brief サムネイルキャッシュを裏で少しずつ回収する
+ *
+ * MyThumbnail::collectGarbage を小分けに呼び、Fileから消えた画像の分と
+ * ディスク使用量の上限を超えた分(参照時刻が古い物から)を捨てる。
+ * 検索やサムネイルの表示中(isBusyが真)は一時停止する。
+ */
+class ThumbnailCollector : public QObject {
+		Q_OBJECT
+
+	public:
+		// 一度に捨てる最大件数
+		constexpr static size_t Batch = 256;
+		// 回収する物が残っている間の間隔 [ms]
+		constexpr static int StepMs = 100;
+		// 回収し終えてから次に確認するまでの間隔 [ms]
+		constexpr static int IdleMs = 60 * 1000;
+		// 一時停止中に再確認する間隔 [ms]
+		constexpr static int PauseMs = 500;
+
+		using BusyCheck = std::function<bool()>;
+
+		explicit ThumbnailCollector(QObject *parent = nullptr);
+
+		void setBusyCheck(BusyCheck check);
+		void start();
+		void stop();
+		/**
+		 * @brief イベントループを使わずに回収し終えるまで続ける (コマンドライン用)
+		 *
+		 * @return 捨てた件数
+		 */
+		size_t runBlocking();
+
+	signals:
+		// 一連の回収を終えた時に、その間に捨てた件数を通知する (何も捨てなかった時は通知しない)
+		void collected(size_t orphan, size_t eviction);
+
+	private:
+		QTimer _timer;
+		BusyCheck _isBusy;
+		size_t _orphan = 0, _eviction = 0;
+
+		void _onTimer();
+};
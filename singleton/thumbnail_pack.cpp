@@ -0,0 +1,306 @@
+#include "thumbnail_pack.hpp"
+#include <QDebug>
+#include <cstring>
+#include "aux_f/exception.hpp"
+#include "thumbnail_codec.hpp"
+
+namespace {
+	// ファイル先頭のヘッダ (タイル形式が変わったら作り直す)
+	struct Header {
+			char magic[4];
+			uint32_t version;
+			uint16_t tileSize;
+			uint16_t format;
+			uint32_t reserved;
+	};
+	static_assert(sizeof(Header) == 16);
+	constexpr char Magic[4] = {'D', 'G', 'T', 'P'};
+	constexpr uint32_t Version = 1;
+	// 圧縮する場合の Header::format (+ ThumbnailCodec::Kind)
+	constexpr uint16_t RecordFormat = 0x100;
+	// 圧縮する場合のタイル1つ分のレコードの先頭 (この後に符号化したデータが続く)
+	struct RecordHeader {
+			uint32_t tile;
+			uint32_t length;
+	};
+	static_assert(sizeof(RecordHeader) == 8);
+
+	Header MakeHeader(const int tileSize, const ThumbnailCodec *codec) {
+		Header h{};
+		std::memcpy(h.magic, Magic, sizeof(Magic));
+		h.version = Version;
+		h.tileSize = static_cast<uint16_t>(tileSize);
+		h.format = codec ? static_cast<uint16_t>(RecordFormat + static_cast<int>(codec->kind()))
+						 : static_cast<uint16_t>(ThumbnailPack::TileFormat);
+		return h;
+	}
+	bool IsValidHeader(const Header &h, const int tileSize, const ThumbnailCodec *codec) {
+		const auto ref = MakeHeader(tileSize, codec);
+		return std::memcmp(&h, &ref, sizeof(Header)) == 0;
+	}
+	// タイルの形式と大きさに揃える
+	QImage ToTile(const QImage &src, const int tileSize) {
+		QImage img = src.convertToFormat(ThumbnailPack::TileFormat);
+		if (img.width() != tileSize || img.height() != tileSize)
+			img = img.scaled(tileSize, tileSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+		return img;
+	}
+} // namespace
+
+ThumbnailPack::ThumbnailPack(const QString &path, const int tileSize, const ThumbnailCodec *codec) :
+	_path(path), _tileSize(tileSize), _tileBytes(qsizetype(tileSize) * tileSize * 4), _codec(codec), _file(path) {
+	_open();
+}
+ThumbnailPack::~ThumbnailPack() {
+	_close();
+}
+
+qint64 ThumbnailPack::_tileOffset(const Tile tile) const noexcept {
+	return sizeof(Header) + static_cast<qint64>(tile) * _tileBytes;
+}
+
+void ThumbnailPack::_writeHeader(QFile &file) const {
+	const auto h = MakeHeader(_tileSize, _codec);
+	file.resize(0);
+	file.seek(0);
+	if (file.write(reinterpret_cast<const char *>(&h), sizeof(h)) != sizeof(h))
+		throw dg::RuntimeError("Failed to write thumbnail pack header: " + file.fileName().toStdString());
+}
+
+void ThumbnailPack::_open() {
+	if (!_file.open(QIODevice::ReadWrite))
+		throw dg::CantOpenFile(_path.toStdString());
+
+	Header h{};
+	if (_file.size() < static_cast<qint64>(sizeof(Header)) ||
+		_file.read(reinterpret_cast<char *>(&h), sizeof(h)) != sizeof(h) || !IsValidHeader(h, _tileSize, _codec)) {
+		// 形式が違う(または空の)ファイルは作り直す
+		if (_file.size() > 0)
+			qWarning() << "Thumbnail pack has unknown format, recreating:" << _path;
+		_writeHeader(_file);
+	}
+	if (_codec)
+		_scanRecords();
+	else {
+		// 書き込み途中で終わった末尾のタイルは無視する
+		_nTile = static_cast<size_t>((_file.size() - sizeof(Header)) / _tileBytes);
+	}
+	_remap();
+}
+void ThumbnailPack::_scanRecords() {
+	_records.clear();
+	_liveBytes = 0;
+	const qint64 end = _file.size();
+	qint64 pos = sizeof(Header);
+	if (end > pos) {
+		const uchar *map = _file.map(0, end);
+		if (!map)
+			throw dg::RuntimeError("Failed to map thumbnail pack: " + _path.toStdString());
+		RecordHeader rh;
+		while (pos + qint64(sizeof(rh)) <= end) {
+			std::memcpy(&rh, map + pos, sizeof(rh));
+			// 書き込み途中のレコードか、タイル番号があり得ない値なら壊れている
+			if (pos + qint64(sizeof(rh)) + rh.length > end || rh.tile >= end / qint64(sizeof(rh)))
+				break;
+			if (rh.tile >= _records.size())
+				_records.resize(size_t(rh.tile) + 1, Record{0, 0});
+			// 同じタイル番号なら後のレコード(空きを再利用した物)が有効
+			auto &r = _records[rh.tile];
+			_liveBytes += qint64(rh.length) - r.length;
+			r = Record{pos + qint64(sizeof(rh)), rh.length};
+			pos += qint64(sizeof(rh)) + rh.length;
+		}
+		_file.unmap(const_cast<uchar *>(map));
+	}
+	if (pos < end) {
+		qWarning() << "Thumbnail pack ends with a partial record, truncating:" << _path;
+		_file.resize(pos);
+	}
+	_nTile = _records.size();
+}
+void ThumbnailPack::_close() {
+	if (_map) {
+		_file.unmap(_map);
+		_map = nullptr;
+	}
+	_file.close();
+}
+void ThumbnailPack::_remap() {
+	if (_map) {
+		_file.unmap(_map);
+		_map = nullptr;
+	}
+	if (_nTile == 0)
+		return;
+	_map = _file.map(0, fileBytes());
+	if (!_map)
+		throw dg::RuntimeError("Failed to map thumbnail pack: " + _path.toStdString());
+}
+
+int ThumbnailPack::tileSize() const noexcept {
+	return _tileSize;
+}
+size_t ThumbnailPack::size() const noexcept {
+	return _nTile;
+}
+size_t ThumbnailPack::liveCount() const noexcept {
+	return _nTile - _free.size();
+}
+qint64 ThumbnailPack::fileBytes() const noexcept {
+	if (_codec)
+		return _file.size();
+	return _tileOffset(static_cast<Tile>(_nTile));
+}
+qsizetype ThumbnailPack::tileBytes() const noexcept {
+	return _tileBytes;
+}
+qint64 ThumbnailPack::liveBytes() const noexcept {
+	if (_codec)
+		return _liveBytes;
+	return static_cast<qint64>(liveCount()) * _tileBytes;
+}
+bool ThumbnailPack::contains(const Tile tile) const noexcept {
+	return tile < _nTile;
+}
+
+ThumbnailPack::TileV ThumbnailPack::append(const std::vector<QImage> &images) {
+	if (images.empty())
+		return {};
+	if (_codec)
+		return _appendRecords(images);
+	TileV ret;
+	ret.reserve(images.size());
+	const size_t prevTile = _nTile;
+	const qint64 lineBytes = _tileSize * 4;
+	for (const auto &src : images) {
+		const QImage img = ToTile(src, _tileSize);
+		// 空きがあればそこに、無ければ末尾に書く
+		Tile tile;
+		if (!_free.empty()) {
+			tile = _free.back();
+			_free.pop_back();
+		}
+		else
+			tile = static_cast<Tile>(_nTile++);
+		_file.seek(_tileOffset(tile));
+		// 1行ずつ書き込む (bytesPerLineのパディングを含めない)
+		for (int y = 0; y < _tileSize; ++y) {
+			if (_file.write(reinterpret_cast<const char *>(img.constScanLine(y)), lineBytes) != lineBytes)
+				throw dg::RuntimeError("Failed to write thumbnail pack: " + _path.toStdString());
+		}
+		ret.emplace_back(tile);
+	}
+	_file.flush();
+	// 大きくなった時だけマップし直す (空きへの上書きはマップ領域にそのまま反映される)
+	if (_nTile != prevTile)
+		_remap();
+	return ret;
+}
+
+ThumbnailPack::TileV ThumbnailPack::_appendRecords(const std::vector<QImage> &images) {
+	TileV ret;
+	ret.reserve(images.size());
+	// 空きを再利用する場合も末尾に書く (古いレコードの領域は compact まで残る)
+	qint64 pos = _file.size();
+	_file.seek(pos);
+	for (const auto &src : images) {
+		const QByteArray data = _codec->encode(ToTile(src, _tileSize));
+		Tile tile;
+		if (!_free.empty()) {
+			tile = _free.back();
+			_free.pop_back();
+		}
+		else {
+			tile = static_cast<Tile>(_nTile++);
+			_records.emplace_back(Record{0, 0});
+		}
+		const RecordHeader rh{tile, static_cast<uint32_t>(data.size())};
+		if (_file.write(reinterpret_cast<const char *>(&rh), sizeof(rh)) != sizeof(rh) ||
+			_file.write(data) != data.size())
+			throw dg::RuntimeError("Failed to write thumbnail pack: " + _path.toStdString());
+		_records[tile] = Record{pos + qint64(sizeof(rh)), rh.length};
+		_liveBytes += rh.length;
+		pos += qint64(sizeof(rh)) + rh.length;
+		ret.emplace_back(tile);
+	}
+	_file.flush();
+	_remap();
+	return ret;
+}
+
+QImage ThumbnailPack::image(const Tile tile) const {
+	if (!contains(tile))
+		return {};
+	if (_codec) {
+		const auto &r = _records[tile];
+		if (r.length == 0)
+			return {};
+		return _codec->decode(QByteArray::fromRawData(reinterpret_cast<const char *>(_map + r.offset), r.length));
+	}
+	return QImage(_map + _tileOffset(tile), _tileSize, _tileSize, _tileSize * 4, TileFormat);
+}
+
+void ThumbnailPack::release(const TileV &tiles) {
+	for (const Tile tile : tiles) {
+		if (!contains(tile))
+			continue;
+		if (_codec) {
+			_liveBytes -= _records[tile].length;
+			_records[tile].length = 0;
+		}
+		_free.emplace_back(tile);
+	}
+}
+
+void ThumbnailPack::clear() {
+	if (_map) {
+		_file.unmap(_map);
+		_map = nullptr;
+	}
+	_writeHeader(_file);
+	_nTile = 0;
+	_free.clear();
+	_records.clear();
+	_liveBytes = 0;
+}
+
+std::unordered_map<ThumbnailPack::Tile, ThumbnailPack::Tile> ThumbnailPack::compact(const TileV &alive) {
+	// 新しいファイルに生きているタイルだけを書き出してから差し替える
+	const QString tmpPath = _path + ".tmp";
+	std::unordered_map<Tile, Tile> remap;
+	{
+		QFile tmp(tmpPath);
+		if (!tmp.open(QIODevice::WriteOnly | QIODevice::Truncate))
+			throw dg::CantOpenFile(tmpPath.toStdString());
+		_writeHeader(tmp);
+		for (const Tile tile : alive) {
+			if (!contains(tile) || remap.contains(tile))
+				continue;
+			const auto dst = static_cast<Tile>(remap.size());
+			bool ok;
+			if (_codec) {
+				const auto &r = _records[tile];
+				if (r.length == 0)
+					continue;
+				const RecordHeader rh{dst, r.length};
+				ok = tmp.write(reinterpret_cast<const char *>(&rh), sizeof(rh)) == sizeof(rh) &&
+					 tmp.write(reinterpret_cast<const char *>(_map + r.offset), r.length) == r.length;
+			}
+			else {
+				const auto *src = reinterpret_cast<const char *>(_map + _tileOffset(tile));
+				ok = tmp.write(src, _tileBytes) == _tileBytes;
+			}
+			if (!ok)
+				throw dg::RuntimeError("Failed to write thumbnail pack: " + tmpPath.toStdString());
+			remap.emplace(tile, dst);
+		}
+	}
+	_close();
+	_free.clear();
+	if (!QFile::remove(_path) || !QFile::rename(tmpPath, _path)) {
+		_open();
+		throw dg::RuntimeError("Failed to replace thumbnail pack: " + _path.toStdString());
+	}
+	_open();
+	return remap;
+}
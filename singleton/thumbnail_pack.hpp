@@ -0,0 +1,87 @@
+#pragma once
+#include <QFile>
+#include <QImage>
+#include <unordered_map>
+#include <vector>
+
+class ThumbnailCodec;
+
+/**
+ * @brief サムネイルをタイルとして1つのファイルに追記していく
+ *
+ * ファイルはメモリにマップしておく。方式を指定しなければ固定サイズの無圧縮タイルとして置き、
+ * デコード無しでそのままQImageとして参照する。方式を指定すると符号化した可変長のレコードとして置き、
+ * 参照する度にデコードする (ディスクの使用量と引き換え)。
+ * 不要になったタイルは release で空きにして次の append で再利用し、ファイルを詰めるには compact を使う。
+ * (圧縮する場合、空きになったタイルのレコードは compact まで領域が残る)
+ */
+class ThumbnailPack {
+	public:
+		using Tile = uint32_t;
+		using TileV = std::vector<Tile>;
+		constexpr static QImage::Format TileFormat = QImage::Format_ARGB32_Premultiplied;
+
+		// tileSize: タイル1辺のピクセル数, codec: 符号化の方式 (nullptrなら無圧縮)
+		// (どちらかがファイルと異なる場合は作り直す)
+		ThumbnailPack(const QString &path, int tileSize, const ThumbnailCodec *codec = nullptr);
+		~ThumbnailPack();
+
+		int tileSize() const noexcept;
+		// タイル数 (空きを含む)
+		size_t size() const noexcept;
+		// 使用中のタイル数
+		size_t liveCount() const noexcept;
+		// ファイルの大きさ [byte]
+		qint64 fileBytes() const noexcept;
+		// 無圧縮のタイル1つの大きさ [byte]
+		qsizetype tileBytes() const noexcept;
+		// 使用中のタイルの合計 [byte] (圧縮する場合は符号化後の大きさ)
+		qint64 liveBytes() const noexcept;
+		bool contains(Tile tile) const noexcept;
+		/**
+		 * @brief 画像を書き込んでタイル番号を返す (tileSizeと異なる大きさの画像は拡縮する)
+		 *
+		 * 空きタイルがあればそこを上書きし、無ければ末尾に追記する
+		 */
+		TileV append(const std::vector<QImage> &images);
+		// 使わなくなったタイルを空きとして再利用させる
+		void release(const TileV &tiles);
+		// 無圧縮ならマップ領域を直接参照するQImage (次の append/compact/clear まで有効)
+		// 圧縮していればデコードした物
+		QImage image(Tile tile) const;
+		void clear();
+		/**
+		 * @brief alive に含まれるタイルだけを残して詰め直す
+		 *
+		 * @return 古いタイル番号 -> 新しいタイル番号 (差し替えに失敗した場合は例外)
+		 */
+		std::unordered_map<Tile, Tile> compact(const TileV &alive);
+
+	private:
+		// 圧縮する場合のタイル毎のレコードの位置 (length == 0 は空き)
+		struct Record {
+				qint64 offset;
+				uint32_t length;
+		};
+		QString _path;
+		int _tileSize;
+		qsizetype _tileBytes;
+		const ThumbnailCodec *_codec;
+		QFile _file;
+		uchar *_map = nullptr;
+		size_t _nTile = 0;
+		// 再利用できるタイル
+		TileV _free;
+		std::vector<Record> _records;
+		qint64 _liveBytes = 0;
+
+		void _open();
+		// レコードを先頭から辿ってタイル毎の位置を作る (書き込み途中で終わった末尾は切り捨てる)
+		void _scanRecords();
+		// 圧縮する場合の append
+		TileV _appendRecords(const std::vector<QImage> &images);
+		void _close();
+		void _remap();
+		void _writeHeader(QFile &file) const;
+		qint64 _tileOffset(Tile tile) const noexcept;
+};
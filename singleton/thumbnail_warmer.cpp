@@ -0,0 +1,116 @@
+#include "thumbnail_warmer.hpp"
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QThread>
+#include <algorithm>
+#include "aux_f_q/q_value.hpp"
+#include "aux_f_q/sql/database.hpp"
+#include "my_thumbnail.hpp"
+
+namespace {
+	const auto WarmConnectionName = QStringLiteral("DGDB_prewarm");
+}
+
+ThumbnailWarmer::ThumbnailWarmer(QObject *parent) : QObject(parent) {
+	connect(&_busyTimer, &QTimer::timeout, this, [this]() { _busy = _isBusy && _isBusy(); });
+}
+
+ThumbnailWarmer::~ThumbnailWarmer() {
+	_stop = true;
+	_join();
+}
+
+void ThumbnailWarmer::setBusyCheck(BusyCheck check) {
+	_isBusy = std::move(check);
+}
+
+void ThumbnailWarmer::start() {
+	if (isRunning() && !_stop)
+		return;
+	// 止めたばかりのスレッドが残っていれば、接続名が重ならないよう終わるのを待つ
+	_join();
+	_stop = false;
+	_busy = _isBusy && _isBusy();
+	_busyTimer.start(PauseMs);
+	_thread = QThread::create([this]() {
+		try {
+			_run(true);
+		}
+		catch (const std::exception &e) {
+			qWarning() << "Thumbnail prewarm stopped:" << e.what();
+			return;
+		}
+		if (!_stop)
+			emit finished();
+	});
+	_thread->setObjectName("ThumbnailWarmer");
+	_thread->start(QThread::LowPriority);
+}
+
+void ThumbnailWarmer::stop() {
+	_stop = true;
+	_busyTimer.stop();
+}
+
+bool ThumbnailWarmer::isRunning() const noexcept {
+	return _thread && _thread->isRunning();
+}
+
+size_t ThumbnailWarmer::runBlocking() {
+	_stop = false;
+	return _run(false);
+}
+
+void ThumbnailWarmer::_join() {
+	if (!_thread)
+		return;
+	_thread->wait();
+	delete _thread;
+	_thread = nullptr;
+}
+
+size_t ThumbnailWarmer::_run(const bool throttle) {
+	const auto db = myTn.openConnection(WarmConnectionName);
+	FileId cursor = myTn.prewarmCursor(*db);
+	// 処理済みの数は最初に1回だけ数え、以降はバッチ毎に足していく
+	qint64 total = 0, done = 0;
+	{
+		auto q = db->exec("SELECT COUNT(*), COUNT(CASE WHEN id <= ? THEN 1 END) FROM File", EnumToInt(cursor));
+		if (q.next()) {
+			total = q.value(0).toLongLong();
+			done = q.value(1).toLongLong();
+		}
+	}
+	QElapsedTimer elapsed;
+	elapsed.start();
+	size_t generated = 0;
+	while (!_stop) {
+		// 操作中は後回しにする
+		if (throttle && _busy) {
+			QThread::msleep(PauseMs);
+			continue;
+		}
+		// 上限を超えて生成しても回収で捨てられるだけ
+		if (myTn.isOverBudget())
+			break;
+		FileIds fileIds;
+		{
+			auto q = db->exec("SELECT id FROM File WHERE id > ? ORDER BY id LIMIT ?", EnumToInt(cursor), Batch);
+			while (q.next())
+				fileIds.emplace_back(dg::ConvertQV<FileId>(q.value(0)));
+		}
+		if (fileIds.empty())
+			break;
+
+		generated += myTn.prewarm(*db, fileIds);
+		cursor = fileIds.back();
+		myTn.setPrewarmCursor(*db, cursor);
+		done += static_cast<qint64>(fileIds.size());
+
+		const double sec = std::max<qint64>(1, elapsed.elapsed()) / 1000.0;
+		emit progress(done, total, generated / sec);
+		if (throttle)
+			QThread::msleep(ThrottleMs);
+	}
+	return generated;
+}
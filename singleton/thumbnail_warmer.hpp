@@ -0,0 +1,71 @@
+#pragma once
+#include <QObject>
+#include <QTimer>
+#include <atomic>
+#include <functional>
+#include "id.hpp"
+
+class QThread;
+
+/**
+ * @brief データベースの全ファイルのサムネイルを裏で少しずつ生成しておく
+ *
+ * FileをIDの順に辿り、キャッシュが無い物を MyThumbnail::prewarm で生成する。
+ * 生成は専用のスレッドで自前の接続を使って行い、進捗はqueuedのシグナルで知らせる。
+ * 進んだ位置はサムネイルDBに保存するので、中断しても続きから再開できる。
+ * 検索やサムネイルの表示中(isBusyが真)は一時停止する。
+ * ディスク使用量の上限に達したら、古いキャッシュを押し出してしまわないようにそこで止める。
+ */
+class ThumbnailWarmer : public QObject {
+		Q_OBJECT
+
+	public:
+		// 一度に処理するファイル数
+		constexpr static int Batch = 16;
+		// 次のバッチまでの間隔 [ms] (ディスクを占有しない為)
+		constexpr static int ThrottleMs = 50;
+		// 一時停止中に再確認する間隔 [ms]
+		constexpr static int PauseMs = 500;
+
+		using BusyCheck = std::function<bool()>;
+
+		explicit ThumbnailWarmer(QObject *parent = nullptr);
+		~ThumbnailWarmer() override;
+
+		// check はGUIスレッドで PauseMs 毎に呼ばれ、その結果を生成スレッドが参照する
+		void setBusyCheck(BusyCheck check);
+		void start();
+		// 処理中のバッチを終えた所で止まる (終わるのを待たない)
+		void stop();
+		bool isRunning() const noexcept;
+		/**
+		 * @brief 呼び出したスレッドで最後まで生成する (コマンドライン用)
+		 *
+		 * @return 生成した件数
+		 */
+		size_t runBlocking();
+
+	signals:
+		// done: 処理し終えたファイル数, filesPerSec: 生成したサムネイルの毎秒数
+		void progress(qint64 done, qint64 total, double filesPerSec);
+		void finished();
+
+	private:
+		QThread *_thread = nullptr;
+		// GUIスレッドで isBusy を確認して _busy に反映する
+		QTimer _busyTimer;
+		BusyCheck _isBusy;
+		std::atomic_bool _busy = false;
+		std::atomic_bool _stop = false;
+
+		// 生成スレッドを片付ける (動いていれば終わるまで待つ)
+		void _join();
+		/**
+		 * @brief 最後まで、または止められるまで生成する
+		 *
+		 * 接続は呼び出したスレッドで開く
+		 * @param throttle 真ならバッチ毎に間を空け、isBusyの間は一時停止する
+		 * @return 生成した件数
+		 */
+		size_t _run(bool throttle);
+};
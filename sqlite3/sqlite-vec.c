@@ -403,6 +403,132 @@ static f32 distance_l2_sqr_float(const void *a, const void *b, const void *d) {
   return l2_sqr_float(a, b, d);
 }
 
+// Batched L2 kernels for small float32 vectors (dimensions 1..4).
+// vec0 chunks store vectors row-major, so a KNN full scan over e.g. float[3]
+// spends most of its time in per-row function calls. These kernels score a
+// whole chunk in one call; the AVX2 variant handles 8 rows per iteration by
+// gathering each component into its own register (a transposed view of the
+// chunk). The implementation is chosen by CPUID in the first sqlite3_vec_init().
+#define VEC0_SMALL_DIMENSIONS_MAX 4
+
+typedef void (*vec0_l2_small_batch_fn)(const f32 *base, const f32 *query,
+                                       size_t dimensions, i32 n, f32 *out);
+
+#define VEC0_L2_SMALL_ROWS(D)                                                  \
+  for (i32 i = 0; i < n; i++) {                                                \
+    const f32 *v = base + (size_t)i * (D);                                     \
+    f32 res = 0;                                                               \
+    for (size_t c = 0; c < (D); c++) {                                         \
+      f32 t = v[c] - query[c];                                                 \
+      res += t * t;                                                            \
+    }                                                                          \
+    out[i] = sqrt(res);                                                        \
+  }
+
+static void l2_small_batch_scalar(const f32 *base, const f32 *query,
+                                  size_t dimensions, i32 n, f32 *out) {
+  // constant trip counts let the compiler unroll the inner loop
+  switch (dimensions) {
+  case 1:
+    VEC0_L2_SMALL_ROWS(1);
+    break;
+  case 2:
+    VEC0_L2_SMALL_ROWS(2);
+    break;
+  case 3:
+    VEC0_L2_SMALL_ROWS(3);
+    break;
+  default:
+    VEC0_L2_SMALL_ROWS(dimensions);
+    break;
+  }
+}
+
+#if (defined(__x86_64__) || defined(__i386__)) &&                              \
+    (defined(__GNUC__) || defined(__clang__))
+#define SQLITE_VEC_DISPATCH_X86
+#include <cpuid.h>
+#include <immintrin.h>
+
+__attribute__((target("avx2"))) static void
+l2_small_batch_avx2(const f32 *base, const f32 *query, size_t dimensions,
+                    i32 n, f32 *out) {
+  const int d = (int)dimensions;
+  const __m256i offsets = _mm256_mullo_epi32(
+      _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(d));
+  __m256 q[VEC0_SMALL_DIMENSIONS_MAX];
+  for (int c = 0; c < d; c++) {
+    q[c] = _mm256_set1_ps(query[c]);
+  }
+  i32 i = 0;
+  for (; i + 8 <= n; i += 8) {
+    const f32 *rows = base + (size_t)i * dimensions;
+    __m256 sum = _mm256_setzero_ps();
+    for (int c = 0; c < d; c++) {
+      // mul + add (no FMA) keeps results bit-identical to the scalar path
+      __m256 t = _mm256_sub_ps(_mm256_i32gather_ps(rows + c, offsets, 4), q[c]);
+      sum = _mm256_add_ps(sum, _mm256_mul_ps(t, t));
+    }
+    _mm256_storeu_ps(out + i, _mm256_sqrt_ps(sum));
+  }
+  if (i < n) {
+    l2_small_batch_scalar(base + (size_t)i * dimensions, query, dimensions,
+                          n - i, out + i);
+  }
+}
+
+static int vec_cpu_has_avx2(void) {
+  unsigned int a, b, c, d;
+  if (!__get_cpuid(1, &a, &b, &c, &d)) {
+    return 0;
+  }
+  // OSXSAVE + AVX, and the OS must save YMM state
+  const unsigned int need = (1u << 27) | (1u << 28);
+  if ((c & need) != need) {
+    return 0;
+  }
+  unsigned int xlo, xhi;
+  __asm__ volatile("xgetbv" : "=a"(xlo), "=d"(xhi) : "c"(0));
+  (void)xhi;
+  if ((xlo & 6) != 6) {
+    return 0;
+  }
+  if (__get_cpuid_max(0, NULL) < 7) {
+    return 0;
+  }
+  __cpuid_count(7, 0, a, b, c, d);
+  return (b & (1u << 5)) != 0;
+}
+#endif
+
+static vec0_l2_small_batch_fn vec0_l2_small_batch = l2_small_batch_scalar;
+static const char *vec0_l2_small_batch_name = "scalar";
+
+// sqlite3_vec_init() runs once per connection, possibly while KNN queries on
+// other connections read the kernel pointer, so the globals are written only
+// by the first caller. 0: not selected, 1: selecting, 2: selected.
+static void vec_select_kernels(void) {
+#ifdef SQLITE_VEC_DISPATCH_X86
+  static int state = 0;
+  if (__atomic_load_n(&state, __ATOMIC_ACQUIRE) == 2) {
+    return;
+  }
+  int expected = 0;
+  if (!__atomic_compare_exchange_n(&state, &expected, 1, 0, __ATOMIC_ACQUIRE,
+                                   __ATOMIC_ACQUIRE)) {
+    // another thread is running CPUID; wait for its result
+    while (__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) {
+    }
+    return;
+  }
+  if (vec_cpu_has_avx2()) {
+    vec0_l2_small_batch = l2_small_batch_avx2;
+    vec0_l2_small_batch_name = "avx2";
+  }
+  __atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+#endif
+}
+
 static f32 distance_l2_sqr_int8(const void *a, const void *b, const void *d) {
 #ifdef SQLITE_VEC_ENABLE_NEON
   if ((*(const size_t *)d) > 7) {
@@ -2239,12 +2365,37 @@ enum Vec0DistanceMetrics {
   VEC0_DISTANCE_METRIC_L1 = 3,
 };
 
+#define VEC0_HNSW_DEFAULT_M 16
+#define VEC0_HNSW_DEFAULT_EF_CONSTRUCTION 200
+#define VEC0_HNSW_DEFAULT_EF_SEARCH 64
+#define VEC0_HNSW_MAX_M 256
+#define VEC0_HNSW_MAX_EF 4096
+#define VEC0_HNSW_MAX_LEVEL 16
+// a flush changing at least 1/N of the nodes also relinks unreachable ones
+#define VEC0_HNSW_REATTACH_RATIO 64
+
+/**
+ * @brief Options of a vector column declared with `index=hnsw`, ex
+ * `embedding float[128] index=hnsw hnsw_m=16 hnsw_ef_construction=200
+ * hnsw_ef_search=64`.
+ */
+struct Vec0HnswConfig {
+  int enabled;
+  // max links per node per level (2*M on level 0)
+  int M;
+  // candidate list size while inserting
+  int ef_construction;
+  // default candidate list size for KNN queries
+  int ef_search;
+};
+
 struct VectorColumnDefinition {
   char *name;
   int name_length;
   size_t dimensions;
   enum VectorElementType element_type;
   enum Vec0DistanceMetrics distance_metric;
+  struct Vec0HnswConfig hnsw;
 };
 
 struct Vec0PartitionColumnDefinition {
@@ -2304,6 +2455,9 @@ int vec0_parse_vector_column(const char *source, int source_length,
   int nameLength;
   enum VectorElementType elementType;
   enum Vec0DistanceMetrics distanceMetric = VEC0_DISTANCE_METRIC_L2;
+  struct Vec0HnswConfig hnsw = {0, VEC0_HNSW_DEFAULT_M,
+                                VEC0_HNSW_DEFAULT_EF_CONSTRUCTION,
+                                VEC0_HNSW_DEFAULT_EF_SEARCH};
   int dimensions;
 
   vec0_scanner_init(&scanner, source, source_length);
@@ -2407,6 +2561,62 @@ int vec0_parse_vector_column(const char *source, int source_length,
         return SQLITE_ERROR;
       }
     }
+    // `index=hnsw`, only for float32 vectors
+    else if (keyLength == 5 && sqlite3_strnicmp(key, "index", 5) == 0) {
+      if (elementType != SQLITE_VEC_ELEMENT_TYPE_FLOAT32) {
+        return SQLITE_ERROR;
+      }
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_EQ) {
+        return SQLITE_ERROR;
+      }
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME ||
+          token.token_type != TOKEN_TYPE_IDENTIFIER) {
+        return SQLITE_ERROR;
+      }
+      if (token.end - token.start == 4 &&
+          sqlite3_strnicmp(token.start, "hnsw", 4) == 0) {
+        hnsw.enabled = 1;
+      } else if (token.end - token.start == 5 &&
+                 sqlite3_strnicmp(token.start, "flat", 5) == 0) {
+        hnsw.enabled = 0;
+      } else {
+        return SQLITE_ERROR;
+      }
+    }
+    // integer HNSW parameters: hnsw_m, hnsw_ef_construction, hnsw_ef_search
+    else if ((keyLength == 6 && sqlite3_strnicmp(key, "hnsw_m", 6) == 0) ||
+             (keyLength == 20 &&
+              sqlite3_strnicmp(key, "hnsw_ef_construction", 20) == 0) ||
+             (keyLength == 14 &&
+              sqlite3_strnicmp(key, "hnsw_ef_search", 14) == 0)) {
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME || token.token_type != TOKEN_TYPE_EQ) {
+        return SQLITE_ERROR;
+      }
+      rc = vec0_scanner_next(&scanner, &token);
+      if (rc != VEC0_TOKEN_RESULT_SOME ||
+          token.token_type != TOKEN_TYPE_DIGIT) {
+        return SQLITE_ERROR;
+      }
+      int value = atoi(token.start);
+      if (keyLength == 6) {
+        if (value < 2 || value > VEC0_HNSW_MAX_M) {
+          return SQLITE_ERROR;
+        }
+        hnsw.M = value;
+      } else {
+        if (value < 1 || value > VEC0_HNSW_MAX_EF) {
+          return SQLITE_ERROR;
+        }
+        if (keyLength == 20) {
+          hnsw.ef_construction = value;
+        } else {
+          hnsw.ef_search = value;
+        }
+      }
+    }
     // unknown key
     else {
       return SQLITE_ERROR;
@@ -2421,6 +2631,7 @@ int vec0_parse_vector_column(const char *source, int source_length,
   outColumn->distance_metric = distanceMetric;
   outColumn->element_type = elementType;
   outColumn->dimensions = dimensions;
+  outColumn->hnsw = hnsw;
   return SQLITE_OK;
 }
 
@@ -3418,6 +3629,17 @@ static sqlite3_module vec_npy_eachModule = {
   "vectors BLOB NOT NULL"                                                      \
   ");"
 
+/// 1) schema, 2) original vtab table name, 3) vector column index
+#define VEC0_SHADOW_HNSW_N_NAME "\"%w\".\"%w_hnsw%02d\""
+
+/// 1) schema, 2) original vtab table name, 3) vector column index
+#define VEC0_SHADOW_HNSW_N_CREATE                                              \
+  "CREATE TABLE " VEC0_SHADOW_HNSW_N_NAME "("                                  \
+  "rowid INTEGER PRIMARY KEY,"                                                 \
+  "level INTEGER NOT NULL,"                                                    \
+  "neighbors BLOB NOT NULL"                                                    \
+  ");"
+
 #define VEC0_SHADOW_AUXILIARY_NAME "\"%w\".\"%w_auxiliary\""
 
 #define VEC0_SHADOW_METADATA_N_NAME "\"%w\".\"%w_metadatachunks%02d\""
@@ -3451,80 +3673,937 @@ typedef enum {
   SQLITE_VEC0_USER_COLUMN_KIND_METADATA = 4,
 } vec0_user_column_kind;
 
-struct vec0_vtab {
-  sqlite3_vtab base;
+#pragma region vec0 hnsw
+
+// HNSW (Hierarchical Navigable Small World, Malkov & Yashunin) approximate KNN
+// index for float32 vector columns declared with `index=hnsw`.
+//
+// The graph is kept in memory per vec0_vtab and persisted in the
+// `_hnswNN` shadow table, one row per vector: its level and, for each level,
+// the rowids of its neighbors. Changes are applied to the in-memory graph
+// immediately and written to the shadow table in xSync (and xSavepoint), so a
+// bulk insert in one transaction writes each node once. A rollback drops the
+// in-memory graph, which is then reloaded from the shadow table on next use.
+// Every flush bumps `hnswNN_generation` in `_info`; other connections compare
+// it against the generation they loaded and reload when it changed.
+//
+// Deleted vectors are only marked at first. Searches still walk through them
+// (without returning them), so links pointing at them keep the graph connected.
+// Before a flush, every live node that links to a deleted node re-selects its
+// links from its live links plus the nodes reachable through the deleted ones,
+// which costs one pass over the graph per transaction rather than per row.
+// After deletions or a bulk change, the flush also links nodes that no other
+// node links to any more (vec0_hnsw_reattach).
+
+struct Vec0HnswNode {
+  i64 rowid;
+  int level;
+  // set once the node is deleted; the slot is not reused until the next load
+  u8 deleted;
+  // set while the node has changes not yet written to the shadow table
+  u8 dirty;
+  // per level: count followed by up to max_links(level) node indexes
+  i32 *links;
+};
 
-  // the SQLite connection of the host database
-  sqlite3 *db;
+struct Vec0HnswCandidate {
+  f32 distance;
+  i32 node;
+};
 
-  // True if the primary key of the vec0 table has a column type TEXT.
-  // Will change the schema of the _rowids table, and insert/query logic.
-  int pkIsText;
+// binary heap of candidates. `max` keeps the farthest candidate on top
+struct Vec0HnswHeap {
+  struct Vec0HnswCandidate *z;
+  int n;
+  int capacity;
+  int max;
+};
 
-  // number of defined vector columns.
-  int numVectorColumns;
+struct Vec0Hnsw {
+  size_t dimensions;
+  enum Vec0DistanceMetrics distance_metric;
+  struct Vec0HnswConfig config;
+  // max links per node: M on upper levels, 2*M on level 0
+  int max_links0;
+  // level generation factor, 1/ln(M)
+  double level_mult;
+
+  struct Vec0HnswNode *nodes;
+  f32 *vectors;
+  i64 n;
+  i64 capacity;
+  i64 live;
+  i32 entry;
+  int max_level;
+
+  // open addressing hash of rowid -> node index (-1 for empty)
+  i64 *slot_rowids;
+  i32 *slot_nodes;
+  i64 slot_capacity;
+
+  // visited marks for searches
+  u32 *visited;
+  u32 visited_epoch;
+
+  // deleted nodes that live nodes may still link to (see vec0_hnsw_repair)
+  i64 unrepaired;
+
+  // nodes with unwritten changes, in the order they were first changed
+  i32 *dirty;
+  i64 dirty_n;
+  i64 dirty_capacity;
+
+  u64 rng;
+  i64 generation;
+  int loaded;
+};
 
-  // number of defined PARTITION KEY columns.
-  int numPartitionColumns;
+static int vec0_hnsw_offset(const struct Vec0Hnsw *h, int level) {
+  return level == 0 ? 0 : (h->max_links0 + 1) + (level - 1) * (h->config.M + 1);
+}
+static int vec0_hnsw_max_links(const struct Vec0Hnsw *h, int level) {
+  return level == 0 ? h->max_links0 : h->config.M;
+}
+static i32 *vec0_hnsw_links(struct Vec0Hnsw *h, i32 node, int level) {
+  return h->nodes[node].links + vec0_hnsw_offset(h, level);
+}
+static const f32 *vec0_hnsw_vector(const struct Vec0Hnsw *h, i32 node) {
+  return h->vectors + (size_t)node * h->dimensions;
+}
+
+static f32 vec0_hnsw_distance(const struct Vec0Hnsw *h, const f32 *a,
+                              const f32 *b) {
+  switch (h->distance_metric) {
+  case VEC0_DISTANCE_METRIC_L1:
+    return (f32)distance_l1_f32(a, b, &h->dimensions);
+  case VEC0_DISTANCE_METRIC_COSINE:
+    return distance_cosine_float(a, b, &h->dimensions);
+  case VEC0_DISTANCE_METRIC_L2:
+  default:
+    return distance_l2_sqr_float(a, b, &h->dimensions);
+  }
+}
+
+static void vec0_hnsw_clear(struct Vec0Hnsw *h) {
+  for (i64 i = 0; i < h->n; i++) {
+    sqlite3_free(h->nodes[i].links);
+  }
+  sqlite3_free(h->nodes);
+  sqlite3_free(h->vectors);
+  sqlite3_free(h->slot_rowids);
+  sqlite3_free(h->slot_nodes);
+  sqlite3_free(h->visited);
+  sqlite3_free(h->dirty);
+  h->nodes = NULL;
+  h->vectors = NULL;
+  h->slot_rowids = NULL;
+  h->slot_nodes = NULL;
+  h->visited = NULL;
+  h->dirty = NULL;
+  h->n = h->capacity = h->live = 0;
+  h->unrepaired = 0;
+  h->slot_capacity = 0;
+  h->dirty_n = h->dirty_capacity = 0;
+  h->visited_epoch = 0;
+  h->entry = -1;
+  h->max_level = -1;
+  h->loaded = 0;
+}
+
+static void vec0_hnsw_free(struct Vec0Hnsw *h) {
+  if (!h) {
+    return;
+  }
+  vec0_hnsw_clear(h);
+  sqlite3_free(h);
+}
 
-  // number of defined auxiliary columns
-  int numAuxiliaryColumns;
+static u64 vec0_hnsw_hash(i64 rowid) {
+  u64 x = (u64)rowid;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  return x;
+}
 
-  // number of defined metadata columns
-  int numMetadataColumns;
+static int vec0_hnsw_map_grow(struct Vec0Hnsw *h) {
+  i64 capacity = h->slot_capacity ? h->slot_capacity * 2 : 1024;
+  i64 *rowids = sqlite3_malloc64(capacity * sizeof(i64));
+  i32 *nodes = sqlite3_malloc64(capacity * sizeof(i32));
+  if (!rowids || !nodes) {
+    sqlite3_free(rowids);
+    sqlite3_free(nodes);
+    return SQLITE_NOMEM;
+  }
+  for (i64 i = 0; i < capacity; i++) {
+    nodes[i] = -1;
+  }
+  for (i64 i = 0; i < h->slot_capacity; i++) {
+    if (h->slot_nodes[i] < 0) {
+      continue;
+    }
+    u64 s = vec0_hnsw_hash(h->slot_rowids[i]) & (capacity - 1);
+    while (nodes[s] >= 0) {
+      s = (s + 1) & (capacity - 1);
+    }
+    rowids[s] = h->slot_rowids[i];
+    nodes[s] = h->slot_nodes[i];
+  }
+  sqlite3_free(h->slot_rowids);
+  sqlite3_free(h->slot_nodes);
+  h->slot_rowids = rowids;
+  h->slot_nodes = nodes;
+  h->slot_capacity = capacity;
+  return SQLITE_OK;
+}
 
+// node index for rowid, or -1. Deleted nodes are not returned.
+static i32 vec0_hnsw_lookup(const struct Vec0Hnsw *h, i64 rowid) {
+  if (!h->slot_capacity) {
+    return -1;
+  }
+  u64 s = vec0_hnsw_hash(rowid) & (h->slot_capacity - 1);
+  while (h->slot_nodes[s] >= 0) {
+    if (h->slot_rowids[s] == rowid) {
+      i32 node = h->slot_nodes[s];
+      return h->nodes[node].deleted ? -1 : node;
+    }
+    s = (s + 1) & (h->slot_capacity - 1);
+  }
+  return -1;
+}
 
-  // Name of the schema the table exists on.
-  // Must be freed with sqlite3_free()
-  char *schemaName;
+// map rowid to node, replacing any previous (deleted) node of that rowid
+static int vec0_hnsw_map_put(struct Vec0Hnsw *h, i64 rowid, i32 node) {
+  // keep the load factor under 1/2
+  if ((h->n + 1) * 2 > h->slot_capacity) {
+    int rc = vec0_hnsw_map_grow(h);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+  u64 s = vec0_hnsw_hash(rowid) & (h->slot_capacity - 1);
+  while (h->slot_nodes[s] >= 0 && h->slot_rowids[s] != rowid) {
+    s = (s + 1) & (h->slot_capacity - 1);
+  }
+  h->slot_rowids[s] = rowid;
+  h->slot_nodes[s] = node;
+  return SQLITE_OK;
+}
 
-  // Name of the table the table exists on.
-  // Must be freed with sqlite3_free()
-  char *tableName;
+static int vec0_hnsw_mark_dirty(struct Vec0Hnsw *h, i32 node) {
+  if (h->nodes[node].dirty) {
+    return SQLITE_OK;
+  }
+  if (h->dirty_n == h->dirty_capacity) {
+    i64 capacity = h->dirty_capacity ? h->dirty_capacity * 2 : 256;
+    i32 *z = sqlite3_realloc64(h->dirty, capacity * sizeof(i32));
+    if (!z) {
+      return SQLITE_NOMEM;
+    }
+    h->dirty = z;
+    h->dirty_capacity = capacity;
+  }
+  h->dirty[h->dirty_n++] = node;
+  h->nodes[node].dirty = 1;
+  return SQLITE_OK;
+}
 
-  // Name of the _rowids shadow table.
-  // Must be freed with sqlite3_free()
-  char *shadowRowidsName;
+// append a node (without links to others); returns its index or -1 on OOM.
+// vector may be NULL, to be filled in later
+static i32 vec0_hnsw_add_node(struct Vec0Hnsw *h, i64 rowid, int level,
+                              const f32 *vector) {
+  if (h->n == h->capacity) {
+    i64 capacity = h->capacity ? h->capacity * 2 : 1024;
+    struct Vec0HnswNode *nodes =
+        sqlite3_realloc64(h->nodes, capacity * sizeof(*nodes));
+    if (!nodes) {
+      return -1;
+    }
+    h->nodes = nodes;
+    f32 *vectors = sqlite3_realloc64(
+        h->vectors, capacity * h->dimensions * sizeof(f32));
+    if (!vectors) {
+      return -1;
+    }
+    h->vectors = vectors;
+    u32 *visited = sqlite3_realloc64(h->visited, capacity * sizeof(u32));
+    if (!visited) {
+      return -1;
+    }
+    memset(visited + h->capacity, 0,
+           (capacity - h->capacity) * sizeof(u32));
+    h->visited = visited;
+    h->capacity = capacity;
+  }
+  i32 node = (i32)h->n;
+  int nLinks = vec0_hnsw_offset(h, level + 1);
+  i32 *links = sqlite3_malloc64(nLinks * sizeof(i32));
+  if (!links) {
+    return -1;
+  }
+  for (int l = 0; l <= level; l++) {
+    links[vec0_hnsw_offset(h, l)] = 0;
+  }
+  if (vec0_hnsw_map_put(h, rowid, node) != SQLITE_OK) {
+    sqlite3_free(links);
+    return -1;
+  }
+  struct Vec0HnswNode *p = &h->nodes[node];
+  p->rowid = rowid;
+  p->level = level;
+  p->deleted = 0;
+  p->dirty = 0;
+  p->links = links;
+  if (vector) {
+    memcpy(h->vectors + (size_t)node * h->dimensions, vector,
+           h->dimensions * sizeof(f32));
+  }
+  h->n++;
+  h->live++;
+  return node;
+}
+
+static int vec0_hnsw_random_level(struct Vec0Hnsw *h) {
+  // xorshift64*
+  h->rng ^= h->rng >> 12;
+  h->rng ^= h->rng << 25;
+  h->rng ^= h->rng >> 27;
+  u64 r = h->rng * 0x2545F4914F6CDD1DULL;
+  double u = ((r >> 11) + 0.5) / 9007199254740992.0;
+  int level = (int)(-log(u) * h->level_mult);
+  return level < VEC0_HNSW_MAX_LEVEL ? level : VEC0_HNSW_MAX_LEVEL;
+}
+
+static int vec0_hnsw_heap_push(struct Vec0HnswHeap *heap,
+                               struct Vec0HnswCandidate c) {
+  if (heap->n == heap->capacity) {
+    int capacity = heap->capacity ? heap->capacity * 2 : 64;
+    struct Vec0HnswCandidate *z =
+        sqlite3_realloc64(heap->z, capacity * sizeof(*z));
+    if (!z) {
+      return SQLITE_NOMEM;
+    }
+    heap->z = z;
+    heap->capacity = capacity;
+  }
+  int i = heap->n++;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    f32 a = heap->z[parent].distance;
+    if (heap->max ? a >= c.distance : a <= c.distance) {
+      break;
+    }
+    heap->z[i] = heap->z[parent];
+    i = parent;
+  }
+  heap->z[i] = c;
+  return SQLITE_OK;
+}
 
-  // Name of the _chunks shadow table.
-  // Must be freed with sqlite3_free()
-  char *shadowChunksName;
+static struct Vec0HnswCandidate vec0_hnsw_heap_pop(struct Vec0HnswHeap *heap) {
+  struct Vec0HnswCandidate top = heap->z[0];
+  struct Vec0HnswCandidate last = heap->z[--heap->n];
+  int i = 0;
+  while (1) {
+    int child = i * 2 + 1;
+    if (child >= heap->n) {
+      break;
+    }
+    if (child + 1 < heap->n &&
+        (heap->max ? heap->z[child + 1].distance > heap->z[child].distance
+                   : heap->z[child + 1].distance < heap->z[child].distance)) {
+      child++;
+    }
+    if (heap->max ? heap->z[child].distance <= last.distance
+                  : heap->z[child].distance >= last.distance) {
+      break;
+    }
+    heap->z[i] = heap->z[child];
+    i = child;
+  }
+  if (heap->n > 0) {
+    heap->z[i] = last;
+  }
+  return top;
+}
 
-  // contains enum vec0_user_column_kind values for up to
-  // numVectorColumns + numPartitionColumns entries
-  vec0_user_column_kind user_column_kinds[VEC0_MAX_VECTOR_COLUMNS + VEC0_MAX_PARTITION_COLUMNS + VEC0_MAX_AUXILIARY_COLUMNS + VEC0_MAX_METADATA_COLUMNS];
+static int vec0_hnsw_candidate_cmp(const void *a, const void *b) {
+  const struct Vec0HnswCandidate *x = a, *y = b;
+  if (x->distance != y->distance) {
+    return x->distance < y->distance ? -1 : 1;
+  }
+  return x->node - y->node;
+}
 
-  uint8_t user_column_idxs[VEC0_MAX_VECTOR_COLUMNS + VEC0_MAX_PARTITION_COLUMNS + VEC0_MAX_AUXILIARY_COLUMNS + VEC0_MAX_METADATA_COLUMNS];
+static void vec0_hnsw_new_epoch(struct Vec0Hnsw *h) {
+  if (++h->visited_epoch == 0) {
+    memset(h->visited, 0, h->capacity * sizeof(u32));
+    h->visited_epoch = 1;
+  }
+}
 
+/**
+ * @brief Best-first search of one level starting from `entries`.
+ *
+ * @param out on success, the (up to) ef nearest nodes found, sorted by
+ * distance. Owned by the caller.
+ */
+static int vec0_hnsw_search_level(struct Vec0Hnsw *h, const f32 *query,
+                                  const struct Vec0HnswCandidate *entries,
+                                  int nEntries, int ef, int level,
+                                  struct Vec0HnswHeap *out) {
+  int rc = SQLITE_OK;
+  struct Vec0HnswHeap candidates = {NULL, 0, 0, 0};
+  out->z = NULL;
+  out->n = out->capacity = 0;
+  out->max = 1;
+  vec0_hnsw_new_epoch(h);
+  for (int i = 0; i < nEntries; i++) {
+    h->visited[entries[i].node] = h->visited_epoch;
+    if ((rc = vec0_hnsw_heap_push(&candidates, entries[i])) != SQLITE_OK ||
+        (rc = vec0_hnsw_heap_push(out, entries[i])) != SQLITE_OK) {
+      goto done;
+    }
+  }
+  while (candidates.n > 0) {
+    struct Vec0HnswCandidate c = vec0_hnsw_heap_pop(&candidates);
+    if (out->n >= ef && c.distance > out->z[0].distance) {
+      break;
+    }
+    const i32 *links = vec0_hnsw_links(h, c.node, level);
+    for (int i = 0; i < links[0]; i++) {
+      i32 e = links[1 + i];
+      if (h->visited[e] == h->visited_epoch) {
+        continue;
+      }
+      h->visited[e] = h->visited_epoch;
+      f32 d = vec0_hnsw_distance(h, query, vec0_hnsw_vector(h, e));
+      if (out->n < ef || d < out->z[0].distance) {
+        struct Vec0HnswCandidate ce = {d, e};
+        if ((rc = vec0_hnsw_heap_push(&candidates, ce)) != SQLITE_OK) {
+          goto done;
+        }
+        // deleted nodes are only walked through until they are repaired
+        if (h->nodes[e].deleted) {
+          continue;
+        }
+        if ((rc = vec0_hnsw_heap_push(out, ce)) != SQLITE_OK) {
+          goto done;
+        }
+        if (out->n > ef) {
+          vec0_hnsw_heap_pop(out);
+        }
+      }
+    }
+  }
+  qsort(out->z, out->n, sizeof(*out->z), vec0_hnsw_candidate_cmp);
+done:
+  sqlite3_free(candidates.z);
+  if (rc != SQLITE_OK) {
+    sqlite3_free(out->z);
+    out->z = NULL;
+    out->n = 0;
+  }
+  return rc;
+}
 
-  // Name of all the vector chunk shadow tables.
-  // Ex '_vector_chunks00'
-  // Only the first numVectorColumns entries will be available.
-  // The first numVectorColumns entries must be freed with sqlite3_free()
-  char *shadowVectorChunksNames[VEC0_MAX_VECTOR_COLUMNS];
+// greedy descent from the entry point down to (but excluding) `level`
+static struct Vec0HnswCandidate vec0_hnsw_descend(struct Vec0Hnsw *h,
+                                                  const f32 *query,
+                                                  int level) {
+  struct Vec0HnswCandidate cur = {
+      vec0_hnsw_distance(h, query, vec0_hnsw_vector(h, h->entry)), h->entry};
+  for (int l = h->max_level; l > level; l--) {
+    int changed = 1;
+    while (changed) {
+      changed = 0;
+      const i32 *links = vec0_hnsw_links(h, cur.node, l);
+      for (int i = 0; i < links[0]; i++) {
+        i32 e = links[1 + i];
+        if (h->nodes[e].deleted) {
+          continue;
+        }
+        f32 d = vec0_hnsw_distance(h, query, vec0_hnsw_vector(h, e));
+        if (d < cur.distance) {
+          cur.distance = d;
+          cur.node = e;
+          changed = 1;
+        }
+      }
+    }
+  }
+  return cur;
+}
 
-  // Name of all metadata chunk shadow tables, ie `_metadatachunks00`
-  // Only the first numMetadataColumns entries will be available.
-  // The first numMetadataColumns entries must be freed with sqlite3_free()
-  char *shadowMetadataChunksNames[VEC0_MAX_METADATA_COLUMNS];
+/**
+ * @brief Neighbor selection heuristic: keep a candidate only if it is closer
+ * to the base than to every candidate kept so far.
+ *
+ * @param candidates sorted by distance to the base, compacted in place
+ * @return number of candidates kept (at most max)
+ */
+static int vec0_hnsw_select(struct Vec0Hnsw *h,
+                            struct Vec0HnswCandidate *candidates, int n,
+                            int max) {
+  int kept = 0;
+  for (int i = 0; i < n && kept < max; i++) {
+    const f32 *v = vec0_hnsw_vector(h, candidates[i].node);
+    int good = 1;
+    for (int j = 0; j < kept; j++) {
+      if (vec0_hnsw_distance(h, v, vec0_hnsw_vector(h, candidates[j].node)) <
+          candidates[i].distance) {
+        good = 0;
+        break;
+      }
+    }
+    if (good) {
+      candidates[kept++] = candidates[i];
+    }
+  }
+  return kept;
+}
 
-  struct VectorColumnDefinition vector_columns[VEC0_MAX_VECTOR_COLUMNS];
-  struct Vec0PartitionColumnDefinition paritition_columns[VEC0_MAX_PARTITION_COLUMNS];
-  struct Vec0AuxiliaryColumnDefinition auxiliary_columns[VEC0_MAX_AUXILIARY_COLUMNS];
-  struct Vec0MetadataColumnDefinition metadata_columns[VEC0_MAX_METADATA_COLUMNS];
+/**
+ * @brief Re-select the links of `node` on `level` from its current live links
+ * plus `extra`.
+ */
+static int vec0_hnsw_relink(struct Vec0Hnsw *h, i32 node, int level,
+                            const i32 *extra, int nExtra) {
+  i32 *links = vec0_hnsw_links(h, node, level);
+  int max = vec0_hnsw_max_links(h, level);
+  int n = 0;
+  struct Vec0HnswCandidate *candidates =
+      sqlite3_malloc64((links[0] + nExtra) * sizeof(*candidates));
+  if (!candidates) {
+    return SQLITE_NOMEM;
+  }
+  const f32 *base = vec0_hnsw_vector(h, node);
+  for (int pass = 0; pass < 2; pass++) {
+    const i32 *src = pass == 0 ? links + 1 : extra;
+    int count = pass == 0 ? links[0] : nExtra;
+    for (int i = 0; i < count; i++) {
+      i32 e = src[i];
+      if (e == node || h->nodes[e].deleted ||
+          h->nodes[e].level < level) {
+        continue;
+      }
+      int dup = 0;
+      for (int j = 0; j < n && !dup; j++) {
+        dup = candidates[j].node == e;
+      }
+      if (!dup) {
+        candidates[n].node = e;
+        candidates[n].distance =
+            vec0_hnsw_distance(h, base, vec0_hnsw_vector(h, e));
+        n++;
+      }
+    }
+  }
+  qsort(candidates, n, sizeof(*candidates), vec0_hnsw_candidate_cmp);
+  n = vec0_hnsw_select(h, candidates, n, max);
+  links[0] = n;
+  for (int i = 0; i < n; i++) {
+    links[1 + i] = candidates[i].node;
+  }
+  sqlite3_free(candidates);
+  return vec0_hnsw_mark_dirty(h, node);
+}
 
-  int chunk_size;
+// add a link node -> target on level, shrinking with the heuristic if full
+static int vec0_hnsw_link(struct Vec0Hnsw *h, i32 node, int level,
+                          i32 target) {
+  i32 *links = vec0_hnsw_links(h, node, level);
+  for (int i = 0; i < links[0]; i++) {
+    if (links[1 + i] == target) {
+      return SQLITE_OK;
+    }
+  }
+  if (links[0] < vec0_hnsw_max_links(h, level)) {
+    links[1 + links[0]++] = target;
+    return vec0_hnsw_mark_dirty(h, node);
+  }
+  return vec0_hnsw_relink(h, node, level, &target, 1);
+}
 
-  // select latest chunk from _chunks, getting chunk_id
-  sqlite3_stmt *stmtLatestChunk;
+static int vec0_hnsw_insert(struct Vec0Hnsw *h, i64 rowid, const f32 *vector) {
+  int rc;
+  int level = vec0_hnsw_random_level(h);
+  i32 node = vec0_hnsw_add_node(h, rowid, level, vector);
+  if (node < 0) {
+    return SQLITE_NOMEM;
+  }
+  if ((rc = vec0_hnsw_mark_dirty(h, node)) != SQLITE_OK) {
+    return rc;
+  }
+  if (h->entry < 0) {
+    h->entry = node;
+    h->max_level = level;
+    return SQLITE_OK;
+  }
+  int top = level < h->max_level ? level : h->max_level;
+  struct Vec0HnswCandidate ep = vec0_hnsw_descend(h, vector, top);
+  struct Vec0HnswHeap found = {NULL, 0, 0, 1};
+  struct Vec0HnswCandidate *entries = &ep;
+  int nEntries = 1;
+  for (int l = top; l >= 0; l--) {
+    rc = vec0_hnsw_search_level(h, vector, entries, nEntries,
+                                h->config.ef_construction, l, &found);
+    if (entries != &ep) {
+      sqlite3_free(entries);
+    }
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    // the whole candidate list seeds the next level down
+    entries = sqlite3_malloc64(found.n * sizeof(*entries));
+    if (!entries) {
+      sqlite3_free(found.z);
+      return SQLITE_NOMEM;
+    }
+    memcpy(entries, found.z, found.n * sizeof(*entries));
+    nEntries = found.n;
 
-  /**
-   * Statement to insert a row into the _rowids table, with a rowid.
-   * Parameters:
-   *    1: int64, rowid to insert
-   * Result columns: none
-   * SQL: "INSERT INTO _rowids(rowid) VALUES (?)"
-   *
+    int n = vec0_hnsw_select(h, found.z, found.n, h->config.M);
+    i32 *links = vec0_hnsw_links(h, node, l);
+    links[0] = n;
+    for (int i = 0; i < n; i++) {
+      links[1 + i] = found.z[i].node;
+    }
+    for (int i = 0; i < n && rc == SQLITE_OK; i++) {
+      rc = vec0_hnsw_link(h, found.z[i].node, l, node);
+    }
+    sqlite3_free(found.z);
+    found.z = NULL;
+    if (rc != SQLITE_OK) {
+      sqlite3_free(entries);
+      return rc;
+    }
+  }
+  if (entries != &ep) {
+    sqlite3_free(entries);
+  }
+  if (level > h->max_level) {
+    h->entry = node;
+    h->max_level = level;
+  }
+  return SQLITE_OK;
+}
+
+static int vec0_hnsw_remove(struct Vec0Hnsw *h, i64 rowid) {
+  int rc;
+  i32 node = vec0_hnsw_lookup(h, rowid);
+  if (node < 0) {
+    return SQLITE_OK;
+  }
+  h->nodes[node].deleted = 1;
+  h->live--;
+  h->unrepaired++;
+  if ((rc = vec0_hnsw_mark_dirty(h, node)) != SQLITE_OK) {
+    return rc;
+  }
+  if (h->entry == node) {
+    h->entry = -1;
+    h->max_level = -1;
+    for (i64 i = 0; i < h->n; i++) {
+      if (!h->nodes[i].deleted && h->nodes[i].level > h->max_level) {
+        h->entry = (i32)i;
+        h->max_level = h->nodes[i].level;
+      }
+    }
+  }
+  return SQLITE_OK;
+}
+
+// append to a growable array of node indexes
+static int vec0_hnsw_push_node(i32 **z, i64 *n, i64 *capacity, i32 node) {
+  if (*n == *capacity) {
+    i64 newCapacity = *capacity ? *capacity * 2 : 64;
+    i32 *p = sqlite3_realloc64(*z, newCapacity * sizeof(i32));
+    if (!p) {
+      return SQLITE_NOMEM;
+    }
+    *z = p;
+    *capacity = newCapacity;
+  }
+  (*z)[(*n)++] = node;
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Link every live node that no live node links to on level 0 from one
+ * of its own neighbors, so a search that visits the whole graph reaches it.
+ *
+ * The neighbor selection heuristic (and repairing deletions) can drop the
+ * last link to a node. The nearest neighbor with room takes it; if all are
+ * full, the nearest one replaces its farthest link whose target is linked
+ * from elsewhere too.
+ */
+static int vec0_hnsw_reattach(struct Vec0Hnsw *h) {
+  int rc = SQLITE_OK;
+  i32 *incoming = sqlite3_malloc64((h->n > 0 ? h->n : 1) * sizeof(i32));
+  if (!incoming) {
+    return SQLITE_NOMEM;
+  }
+  memset(incoming, 0, (h->n > 0 ? h->n : 1) * sizeof(i32));
+  for (i64 i = 0; i < h->n; i++) {
+    if (h->nodes[i].deleted) {
+      continue;
+    }
+    const i32 *links = vec0_hnsw_links(h, (i32)i, 0);
+    for (int j = 0; j < links[0]; j++) {
+      incoming[links[1 + j]]++;
+    }
+  }
+  int max = vec0_hnsw_max_links(h, 0);
+  for (i64 i = 0; i < h->n && rc == SQLITE_OK; i++) {
+    if (h->nodes[i].deleted || incoming[i] > 0 || i == h->entry) {
+      continue;
+    }
+    const f32 *v = vec0_hnsw_vector(h, (i32)i);
+    const i32 *links = vec0_hnsw_links(h, (i32)i, 0);
+    // the nearest neighbor with room, and the nearest one overall
+    i32 roomy = -1, nearest = -1;
+    f32 roomyDistance = 0, nearestDistance = 0;
+    for (int j = 0; j < links[0]; j++) {
+      i32 e = links[1 + j];
+      f32 d = vec0_hnsw_distance(h, v, vec0_hnsw_vector(h, e));
+      if (nearest < 0 || d < nearestDistance) {
+        nearest = e;
+        nearestDistance = d;
+      }
+      if (vec0_hnsw_links(h, e, 0)[0] < max && (roomy < 0 || d < roomyDistance)) {
+        roomy = e;
+        roomyDistance = d;
+      }
+    }
+    if (roomy >= 0) {
+      i32 *target = vec0_hnsw_links(h, roomy, 0);
+      target[1 + target[0]++] = (i32)i;
+      incoming[i]++;
+      rc = vec0_hnsw_mark_dirty(h, roomy);
+      continue;
+    }
+    if (nearest < 0) {
+      continue;
+    }
+    i32 *target = vec0_hnsw_links(h, nearest, 0);
+    const f32 *base = vec0_hnsw_vector(h, nearest);
+    int replace = -1;
+    f32 replaceDistance = 0;
+    for (int j = 0; j < target[0]; j++) {
+      i32 e = target[1 + j];
+      if (incoming[e] < 2) {
+        continue;
+      }
+      f32 d = vec0_hnsw_distance(h, base, vec0_hnsw_vector(h, e));
+      if (replace < 0 || d > replaceDistance) {
+        replace = j;
+        replaceDistance = d;
+      }
+    }
+    if (replace >= 0) {
+      incoming[target[1 + replace]]--;
+      target[1 + replace] = (i32)i;
+      incoming[i]++;
+      rc = vec0_hnsw_mark_dirty(h, nearest);
+    }
+  }
+  sqlite3_free(incoming);
+  return rc;
+}
+
+/**
+ * @brief Reconnect every live node that still links to a deleted node.
+ *
+ * Links are directed, so a deleted node may be linked from nodes it does not
+ * link back to. Each such node re-selects its links from its live links plus
+ * the live nodes reached through its deleted links, following chains of
+ * deleted nodes breadth first (up to ef_construction live nodes).
+ */
+static int vec0_hnsw_repair(struct Vec0Hnsw *h) {
+  int rc = SQLITE_OK;
+  if (h->unrepaired == 0) {
+    return SQLITE_OK;
+  }
+  int limit = h->config.ef_construction;
+  i32 *extra = sqlite3_malloc64(limit * sizeof(i32));
+  if (!extra) {
+    return SQLITE_NOMEM;
+  }
+  // deleted nodes to walk through, in the order they were reached
+  i32 *queue = NULL;
+  i64 queueCapacity = 0;
+  for (i64 i = 0; i < h->n && rc == SQLITE_OK; i++) {
+    if (h->nodes[i].deleted) {
+      continue;
+    }
+    for (int l = 0; l <= h->nodes[i].level && rc == SQLITE_OK; l++) {
+      const i32 *links = vec0_hnsw_links(h, (i32)i, l);
+      i64 head = 0, tail = 0;
+      int nExtra = 0;
+      vec0_hnsw_new_epoch(h);
+      h->visited[i] = h->visited_epoch;
+      for (int j = 0; j < links[0]; j++) {
+        h->visited[links[1 + j]] = h->visited_epoch;
+      }
+      for (int j = 0; j < links[0] && rc == SQLITE_OK; j++) {
+        if (h->nodes[links[1 + j]].deleted) {
+          rc = vec0_hnsw_push_node(&queue, &tail, &queueCapacity, links[1 + j]);
+        }
+      }
+      if (rc != SQLITE_OK || tail == 0) {
+        continue;
+      }
+      while (head < tail && nExtra < limit && rc == SQLITE_OK) {
+        const i32 *next = vec0_hnsw_links(h, queue[head++], l);
+        for (int j = 0; j < next[0] && nExtra < limit && rc == SQLITE_OK;
+             j++) {
+          i32 e = next[1 + j];
+          if (h->visited[e] == h->visited_epoch) {
+            continue;
+          }
+          h->visited[e] = h->visited_epoch;
+          if (h->nodes[e].deleted) {
+            rc = vec0_hnsw_push_node(&queue, &tail, &queueCapacity, e);
+          } else {
+            extra[nExtra++] = e;
+          }
+        }
+      }
+      if (rc == SQLITE_OK) {
+        rc = vec0_hnsw_relink(h, (i32)i, l, extra, nExtra);
+      }
+    }
+  }
+  sqlite3_free(extra);
+  sqlite3_free(queue);
+  if (rc == SQLITE_OK) {
+    h->unrepaired = 0;
+  }
+  return rc;
+}
+
+static int vec0_hnsw_knn(struct Vec0Hnsw *h, const f32 *query, i64 k, int ef,
+                         i64 **out_rowids, f32 **out_distances,
+                         i64 *out_used) {
+  int rc;
+  i64 *rowids = sqlite3_malloc64(k * sizeof(i64));
+  f32 *distances = sqlite3_malloc64(k * sizeof(f32));
+  if (!rowids || !distances) {
+    sqlite3_free(rowids);
+    sqlite3_free(distances);
+    return SQLITE_NOMEM;
+  }
+  i64 used = 0;
+  if (h->entry >= 0) {
+    struct Vec0HnswCandidate ep = vec0_hnsw_descend(h, query, 0);
+    struct Vec0HnswHeap found;
+    rc = vec0_hnsw_search_level(h, query, &ep, 1, ef > k ? ef : (int)k, 0,
+                                &found);
+    if (rc != SQLITE_OK) {
+      sqlite3_free(rowids);
+      sqlite3_free(distances);
+      return rc;
+    }
+    for (int i = 0; i < found.n && used < k; i++) {
+      rowids[used] = h->nodes[found.z[i].node].rowid;
+      distances[used] = found.z[i].distance;
+      used++;
+    }
+    sqlite3_free(found.z);
+  }
+  *out_rowids = rowids;
+  *out_distances = distances;
+  *out_used = used;
+  return SQLITE_OK;
+}
+
+#pragma endregion
+
+/**
+ * @brief Per-connection settings of vec0 tables, shared by every vec0 table
+ * of the connection and the vec_hnsw_ef_search() function.
+ */
+struct Vec0ConnectionSettings {
+  // efSearch override for HNSW KNN queries, 0 to use each column's default
+  int hnsw_ef_search;
+};
+
+struct vec0_vtab {
+  sqlite3_vtab base;
+
+  // the SQLite connection of the host database
+  sqlite3 *db;
+
+  // True if the primary key of the vec0 table has a column type TEXT.
+  // Will change the schema of the _rowids table, and insert/query logic.
+  int pkIsText;
+
+  // number of defined vector columns.
+  int numVectorColumns;
+
+  // number of defined PARTITION KEY columns.
+  int numPartitionColumns;
+
+  // number of defined auxiliary columns
+  int numAuxiliaryColumns;
+
+  // number of defined metadata columns
+  int numMetadataColumns;
+
+
+  // Name of the schema the table exists on.
+  // Must be freed with sqlite3_free()
+  char *schemaName;
+
+  // Name of the table the table exists on.
+  // Must be freed with sqlite3_free()
+  char *tableName;
+
+  // Name of the _rowids shadow table.
+  // Must be freed with sqlite3_free()
+  char *shadowRowidsName;
+
+  // Name of the _chunks shadow table.
+  // Must be freed with sqlite3_free()
+  char *shadowChunksName;
+
+  // contains enum vec0_user_column_kind values for up to
+  // numVectorColumns + numPartitionColumns entries
+  vec0_user_column_kind user_column_kinds[VEC0_MAX_VECTOR_COLUMNS + VEC0_MAX_PARTITION_COLUMNS + VEC0_MAX_AUXILIARY_COLUMNS + VEC0_MAX_METADATA_COLUMNS];
+
+  uint8_t user_column_idxs[VEC0_MAX_VECTOR_COLUMNS + VEC0_MAX_PARTITION_COLUMNS + VEC0_MAX_AUXILIARY_COLUMNS + VEC0_MAX_METADATA_COLUMNS];
+
+
+  // Name of all the vector chunk shadow tables.
+  // Ex '_vector_chunks00'
+  // Only the first numVectorColumns entries will be available.
+  // The first numVectorColumns entries must be freed with sqlite3_free()
+  char *shadowVectorChunksNames[VEC0_MAX_VECTOR_COLUMNS];
+
+  // Name of all metadata chunk shadow tables, ie `_metadatachunks00`
+  // Only the first numMetadataColumns entries will be available.
+  // The first numMetadataColumns entries must be freed with sqlite3_free()
+  char *shadowMetadataChunksNames[VEC0_MAX_METADATA_COLUMNS];
+
+  struct VectorColumnDefinition vector_columns[VEC0_MAX_VECTOR_COLUMNS];
+  struct Vec0PartitionColumnDefinition paritition_columns[VEC0_MAX_PARTITION_COLUMNS];
+  struct Vec0AuxiliaryColumnDefinition auxiliary_columns[VEC0_MAX_AUXILIARY_COLUMNS];
+  struct Vec0MetadataColumnDefinition metadata_columns[VEC0_MAX_METADATA_COLUMNS];
+
+  int chunk_size;
+
+  // select latest chunk from _chunks, getting chunk_id
+  sqlite3_stmt *stmtLatestChunk;
+
+  /**
+   * Statement to insert a row into the _rowids table, with a rowid.
+   * Parameters:
+   *    1: int64, rowid to insert
+   * Result columns: none
+   * SQL: "INSERT INTO _rowids(rowid) VALUES (?)"
+   *
    * Must be cleaned up with sqlite3_finalize().
    */
   sqlite3_stmt *stmtRowidsInsertRowid;
@@ -3570,6 +4649,13 @@ struct vec0_vtab {
    * Must be cleaned up with sqlite3_finalize().
    */
   sqlite3_stmt *stmtRowidsGetChunkPosition;
+
+  // In-memory HNSW graphs of `index=hnsw` vector columns, loaded lazily.
+  // NULL for other columns or before first use.
+  struct Vec0Hnsw *hnsw[VEC0_MAX_VECTOR_COLUMNS];
+
+  // per-connection settings (the module's client data), not owned
+  struct Vec0ConnectionSettings *settings;
 };
 
 /**
@@ -3613,6 +4699,9 @@ void vec0_free(vec0_vtab *p) {
 
     sqlite3_free(p->vector_columns[i].name);
     p->vector_columns[i].name = NULL;
+
+    vec0_hnsw_free(p->hnsw[i]);
+    p->hnsw[i] = NULL;
   }
 }
 
@@ -4635,7 +5724,6 @@ void vec0_cursor_clear(vec0_cursor *pCur) {
 #define VEC_CONSTRUCTOR_ERROR "vec0 constructor error: "
 static int vec0_init(sqlite3 *db, void *pAux, int argc, const char *const *argv,
                      sqlite3_vtab **ppVtab, char **pzErr, bool isCreate) {
-  UNUSED_PARAMETER(pAux);
   vec0_vtab *pNew;
   int rc;
   const char *zSql;
@@ -4644,6 +5732,7 @@ static int vec0_init(sqlite3 *db, void *pAux, int argc, const char *const *argv,
   if (pNew == 0)
     return SQLITE_NOMEM;
   memset(pNew, 0, sizeof(*pNew));
+  pNew->settings = (struct Vec0ConnectionSettings *)pAux;
 
   // Declared chunk_size=N for entire table.
   // -1 to use the defualt, otherwise will get re-assigned on `chunk_size=N`
@@ -5089,6 +6178,25 @@ static int vec0_init(sqlite3 *db, void *pAux, int argc, const char *const *argv,
         goto error;
       }
       sqlite3_finalize(stmt);
+
+      if (!pNew->vector_columns[i].hnsw.enabled) {
+        continue;
+      }
+      zSql = sqlite3_mprintf(VEC0_SHADOW_HNSW_N_CREATE, pNew->schemaName,
+                             pNew->tableName, i);
+      if (!zSql) {
+        goto error;
+      }
+      rc = sqlite3_prepare_v2(db, zSql, -1, &stmt, 0);
+      sqlite3_free((void *)zSql);
+      if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+        sqlite3_finalize(stmt);
+        *pzErr = sqlite3_mprintf(
+            "Could not create '_hnsw%02d' shadow table: %s", i,
+            sqlite3_errmsg(db));
+        goto error;
+      }
+      sqlite3_finalize(stmt);
     }
 
     for (int i = 0; i < pNew->numMetadataColumns; i++) {
@@ -5231,6 +6339,19 @@ static int vec0Destroy(sqlite3_vtab *pVtab) {
       goto done;
     }
     sqlite3_finalize(stmt);
+
+    if (!p->vector_columns[i].hnsw.enabled) {
+      continue;
+    }
+    zSql = sqlite3_mprintf("DROP TABLE " VEC0_SHADOW_HNSW_N_NAME,
+                           p->schemaName, p->tableName, i);
+    rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, 0);
+    sqlite3_free((void *)zSql);
+    if ((rc != SQLITE_OK) || (sqlite3_step(stmt) != SQLITE_DONE)) {
+      rc = SQLITE_ERROR;
+      goto done;
+    }
+    sqlite3_finalize(stmt);
   }
 
   if(p->numAuxiliaryColumns > 0) {
@@ -5779,36 +6900,89 @@ void bitmap_fill(u8 *bitmap, i32 n) {
  * @param k: Size of output array
  * @return int
  */
-int min_idx(const f32 *distances, i32 n, u8 *candidates, i32 *out, i32 k,
-            u8 *bTaken, i32 *k_used) {
-  assert(k > 0);
-  assert(k <= n);
+struct vec0_dist_idx {
+  f32 distance;
+  i32 idx;
+};
 
-  bitmap_clear(bTaken, n);
+static int vec0_dist_idx_cmp(const void *pa, const void *pb) {
+  const struct vec0_dist_idx *a = (const struct vec0_dist_idx *)pa;
+  const struct vec0_dist_idx *b = (const struct vec0_dist_idx *)pb;
+  if (a->distance < b->distance) {
+    return -1;
+  }
+  if (a->distance > b->distance) {
+    return 1;
+  }
+  // equal distances: later rows first, matching the previous selection loop
+  return (a->idx < b->idx) - (a->idx > b->idx);
+}
 
-  for (int ik = 0; ik < k; ik++) {
-    int min_idx = 0;
-    while (min_idx < n &&
-           (bitmap_get(bTaken, min_idx) || !bitmap_get(candidates, min_idx))) {
-      min_idx++;
+// sift-down for a max-heap (worst element at the root) of vec0_dist_idx
+static void vec0_dist_idx_sift_down(struct vec0_dist_idx *heap, i32 size,
+                                    i32 pos) {
+  while (1) {
+    i32 largest = pos;
+    i32 l = pos * 2 + 1;
+    i32 r = l + 1;
+    if (l < size && vec0_dist_idx_cmp(&heap[l], &heap[largest]) > 0) {
+      largest = l;
     }
-    if (min_idx >= n) {
-      *k_used = ik;
-      return SQLITE_OK;
+    if (r < size && vec0_dist_idx_cmp(&heap[r], &heap[largest]) > 0) {
+      largest = r;
+    }
+    if (largest == pos) {
+      return;
     }
+    struct vec0_dist_idx tmp = heap[pos];
+    heap[pos] = heap[largest];
+    heap[largest] = tmp;
+    pos = largest;
+  }
+}
 
-    for (int i = 0; i < n; i++) {
-      if (distances[i] <= distances[min_idx] && !bitmap_get(bTaken, i) &&
-          (bitmap_get(candidates, i))) {
-        min_idx = i;
+/**
+ * Writes the indexes of the (at most) k smallest candidate distances to out,
+ * in ascending order. Uses a bounded max-heap, O(n log k); the previous
+ * repeated-selection loop was O(n * k), which dominated full-scan KNN with
+ * large k (n = chunk_size, k up to 4096).
+ *
+ * heap is caller-owned scratch space for at least k entries, so a query can
+ * allocate it once and reuse it for every chunk.
+ */
+void min_idx(const f32 *distances, i32 n, u8 *candidates, i32 *out, i32 k,
+             struct vec0_dist_idx *heap, i32 *k_used) {
+  assert(k > 0);
+  assert(k <= n);
+
+  i32 size = 0;
+  for (int i = 0; i < n; i++) {
+    if (!bitmap_get(candidates, i)) {
+      continue;
+    }
+    struct vec0_dist_idx item = {distances[i], i};
+    if (size < k) {
+      // sift-up
+      i32 pos = size++;
+      while (pos > 0) {
+        i32 parent = (pos - 1) / 2;
+        if (vec0_dist_idx_cmp(&heap[parent], &item) >= 0) {
+          break;
+        }
+        heap[pos] = heap[parent];
+        pos = parent;
       }
+      heap[pos] = item;
+    } else if (vec0_dist_idx_cmp(&item, &heap[0]) < 0) {
+      heap[0] = item;
+      vec0_dist_idx_sift_down(heap, size, 0);
     }
-
-    out[ik] = min_idx;
-    bitmap_set(bTaken, min_idx, 1);
   }
-  *k_used = k;
-  return SQLITE_OK;
+  qsort(heap, size, sizeof(*heap), vec0_dist_idx_cmp);
+  for (int i = 0; i < size; i++) {
+    out[i] = heap[i].idx;
+  }
+  *k_used = size;
 }
 
 int vec0_get_metadata_text_long_value(
@@ -6298,154 +7472,703 @@ int vec0_set_metadata_filter_bitmap(
     return rc;
   }
 
-  vec0_metadata_column_kind kind = p->metadata_columns[metadata_idx].kind;
-  int szMatch = 0;
-  int blobSize = sqlite3_blob_bytes(blob);
-  switch(kind) {
-    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
-      szMatch = blobSize == size / CHAR_BIT;
-      break;
+  vec0_metadata_column_kind kind = p->metadata_columns[metadata_idx].kind;
+  int szMatch = 0;
+  int blobSize = sqlite3_blob_bytes(blob);
+  switch(kind) {
+    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
+      szMatch = blobSize == size / CHAR_BIT;
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
+      szMatch = blobSize == size * sizeof(i64);
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
+      szMatch = blobSize == size * sizeof(double);
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_TEXT: {
+      szMatch = blobSize == size * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
+      break;
+    }
+  }
+  if(!szMatch) {
+    return SQLITE_ERROR;
+  }
+  void * buffer = sqlite3_malloc(blobSize);
+  if(!buffer) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_blob_read(blob, buffer, blobSize, 0);
+  if(rc != SQLITE_OK) {
+    goto done;
+  }
+  switch(kind) {
+    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
+      int target = sqlite3_value_int(value);
+      if( (target && op == VEC0_METADATA_OPERATOR_EQ) || (!target && op == VEC0_METADATA_OPERATOR_NE)) {
+        for(int i = 0; i < size; i++) { bitmap_set(b, i, bitmap_get((u8*) buffer, i)); }
+      }
+      else {
+        for(int i = 0; i < size; i++) { bitmap_set(b, i, !bitmap_get((u8*) buffer, i)); }
+      }
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
+      i64 * array = (i64*) buffer;
+      i64 target = sqlite3_value_int64(value);
+      switch(op) {
+        case VEC0_METADATA_OPERATOR_EQ: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] == target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_GT: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] > target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_LE: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] <= target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_LT: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] < target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_GE: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] >= target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_NE: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] != target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_IN: {
+          int metadataInIdx = -1;
+          for(size_t i = 0; i < aMetadataIn->length; i++) {
+            struct Vec0MetadataIn * metadataIn = &((struct Vec0MetadataIn *) aMetadataIn->z)[i];
+            if(metadataIn->argv_idx == argv_idx) {
+              metadataInIdx = i;
+              break;
+            }
+          }
+          if(metadataInIdx < 0) {
+            rc = SQLITE_ERROR;
+            goto done;
+          }
+          struct Vec0MetadataIn * metadataIn = &((struct Vec0MetadataIn *) aMetadataIn->z)[metadataInIdx];
+          struct Array * aTarget = &(metadataIn->array);
+
+          for(int i = 0; i < size; i++) {
+            for(size_t target_idx = 0; target_idx < aTarget->length; target_idx++) {
+              if( ((i64*)aTarget->z)[target_idx] == array[i]) {
+                bitmap_set(b, i, 1);
+                break;
+              }
+            }
+          }
+          break;
+        }
+      }
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
+      double * array = (double*) buffer;
+      double target = sqlite3_value_double(value);
+      switch(op) {
+        case VEC0_METADATA_OPERATOR_EQ: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] == target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_GT: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] > target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_LE: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] <= target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_LT: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] < target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_GE: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] >= target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_NE: {
+          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] != target); }
+          break;
+        }
+        case VEC0_METADATA_OPERATOR_IN: {
+          // should never be reached
+          break;
+        }
+      }
+      break;
+    }
+    case VEC0_METADATA_COLUMN_KIND_TEXT: {
+      rc = vec0_metadata_filter_text(p, value, buffer, size, op, b, metadata_idx, chunk_rowid, aMetadataIn, argv_idx);
+      if(rc != SQLITE_OK) {
+        goto done;
+      }
+      break;
+    }
+  }
+  done:
+    sqlite3_free(buffer);
+    return rc;
+}
+
+#pragma region vec0 hnsw persistence
+
+/**
+ * @brief Read the `hnswNN_generation` value of the given vector column from
+ * the _info shadow table, 0 if there is none yet.
+ */
+static int vec0_hnsw_read_generation(vec0_vtab *p, int vector_column_idx,
+                                     i64 *out_generation) {
+  int rc;
+  sqlite3_stmt *stmt = NULL;
+  char *zSql = sqlite3_mprintf("SELECT value FROM " VEC0_SHADOW_INFO_NAME
+                               " WHERE key = 'hnsw%02d_generation'",
+                               p->schemaName, p->tableName, vector_column_idx);
+  if (!zSql) {
+    return SQLITE_NOMEM;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+  rc = sqlite3_step(stmt);
+  if (rc == SQLITE_ROW) {
+    *out_generation = sqlite3_column_int64(stmt, 0);
+    rc = SQLITE_OK;
+  } else if (rc == SQLITE_DONE) {
+    *out_generation = 0;
+    rc = SQLITE_OK;
+  }
+  sqlite3_finalize(stmt);
+  return rc;
+}
+
+/**
+ * @brief Rebuild the in-memory graph of the given vector column from the
+ * _hnswNN shadow table, with vectors read from the vector chunks.
+ *
+ * Nodes whose row no longer exists are dropped and rows without a node are
+ * inserted, so the graph always covers exactly the rows of the table.
+ */
+static int vec0_hnsw_load(vec0_vtab *p, int vector_column_idx,
+                          struct Vec0Hnsw *h) {
+  int rc;
+  sqlite3_stmt *stmt = NULL;
+  char *zSql = NULL;
+  u8 *hasVector = NULL;
+  // rows without a node, inserted once loading is done
+  struct Array pendingRowids;
+  f32 *pendingVectors = NULL;
+  i64 pendingCapacity = 0;
+  memset(&pendingRowids, 0, sizeof(pendingRowids));
+
+  vec0_hnsw_clear(h);
+  rc = array_init(&pendingRowids, sizeof(i64), 16);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
+  // 1) nodes and their levels
+  zSql = sqlite3_mprintf("SELECT rowid, level FROM " VEC0_SHADOW_HNSW_N_NAME,
+                         p->schemaName, p->tableName, vector_column_idx);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    int level = sqlite3_column_int(stmt, 1);
+    if (level < 0 || level > VEC0_HNSW_MAX_LEVEL) {
+      rc = SQLITE_CORRUPT_VTAB;
+      goto cleanup;
+    }
+    if (vec0_hnsw_add_node(h, sqlite3_column_int64(stmt, 0), level, NULL) < 0) {
+      rc = SQLITE_NOMEM;
+      goto cleanup;
+    }
+  }
+  if (rc != SQLITE_DONE) {
+    goto cleanup;
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  // 2) links, stored per level as an i32 count followed by i64 rowids
+  zSql = sqlite3_mprintf("SELECT rowid, neighbors FROM " VEC0_SHADOW_HNSW_N_NAME,
+                         p->schemaName, p->tableName, vector_column_idx);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    i32 node = vec0_hnsw_lookup(h, sqlite3_column_int64(stmt, 0));
+    if (node < 0) {
+      continue;
+    }
+    const u8 *blob = sqlite3_column_blob(stmt, 1);
+    int nBlob = sqlite3_column_bytes(stmt, 1);
+    int offset = 0;
+    for (int l = 0; l <= h->nodes[node].level; l++) {
+      i32 count;
+      if (offset + (int)sizeof(i32) > nBlob) {
+        rc = SQLITE_CORRUPT_VTAB;
+        goto cleanup;
+      }
+      memcpy(&count, blob + offset, sizeof(i32));
+      offset += sizeof(i32);
+      if (count < 0 || offset + count * (int)sizeof(i64) > nBlob) {
+        rc = SQLITE_CORRUPT_VTAB;
+        goto cleanup;
+      }
+      i32 *links = vec0_hnsw_links(h, node, l);
+      int max = vec0_hnsw_max_links(h, l);
+      links[0] = 0;
+      for (int i = 0; i < count; i++) {
+        i64 rowid;
+        memcpy(&rowid, blob + offset, sizeof(i64));
+        offset += sizeof(i64);
+        i32 e = vec0_hnsw_lookup(h, rowid);
+        if (e >= 0 && e != node && links[0] < max) {
+          links[1 + links[0]++] = e;
+        }
+      }
+    }
+  }
+  if (rc != SQLITE_DONE) {
+    goto cleanup;
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  // 3) vectors of every valid row, chunk by chunk
+  hasVector = sqlite3_malloc64(h->n > 0 ? h->n : 1);
+  if (!hasVector) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  memset(hasVector, 0, h->n > 0 ? h->n : 1);
+  zSql = sqlite3_mprintf("SELECT c.size, c.validity, c.rowids, v.vectors FROM "
+                         VEC0_SHADOW_CHUNKS_NAME " AS c JOIN "
+                         VEC0_SHADOW_VECTOR_N_NAME
+                         " AS v ON v.rowid = c.chunk_id",
+                         p->schemaName, p->tableName, p->schemaName,
+                         p->tableName, vector_column_idx);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmt, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  size_t vectorSize = h->dimensions * sizeof(f32);
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    i64 size = sqlite3_column_int64(stmt, 0);
+    u8 *validity = (u8 *)sqlite3_column_blob(stmt, 1);
+    int nValidity = sqlite3_column_bytes(stmt, 1);
+    const u8 *rowids = sqlite3_column_blob(stmt, 2);
+    int nRowids = sqlite3_column_bytes(stmt, 2);
+    const u8 *vectors = sqlite3_column_blob(stmt, 3);
+    int nVectors = sqlite3_column_bytes(stmt, 3);
+    if (nValidity * CHAR_BIT < size || nRowids < size * (i64)sizeof(i64) ||
+        (size_t)nVectors < size * vectorSize) {
+      rc = SQLITE_CORRUPT_VTAB;
+      goto cleanup;
+    }
+    for (i64 i = 0; i < size; i++) {
+      if (!bitmap_get(validity, i)) {
+        continue;
+      }
+      i64 rowid;
+      memcpy(&rowid, rowids + i * sizeof(i64), sizeof(i64));
+      const u8 *vector = vectors + i * vectorSize;
+      i32 node = vec0_hnsw_lookup(h, rowid);
+      if (node >= 0) {
+        memcpy(h->vectors + (size_t)node * h->dimensions, vector, vectorSize);
+        hasVector[node] = 1;
+        continue;
+      }
+      if (pendingRowids.length == (size_t)pendingCapacity) {
+        i64 capacity = pendingCapacity ? pendingCapacity * 2 : 16;
+        f32 *z = sqlite3_realloc64(pendingVectors, capacity * vectorSize);
+        if (!z) {
+          rc = SQLITE_NOMEM;
+          goto cleanup;
+        }
+        pendingVectors = z;
+        pendingCapacity = capacity;
+      }
+      memcpy(pendingVectors + pendingRowids.length * h->dimensions, vector,
+             vectorSize);
+      rc = array_append(&pendingRowids, &rowid);
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
+  }
+  if (rc != SQLITE_DONE) {
+    goto cleanup;
+  }
+  sqlite3_finalize(stmt);
+  stmt = NULL;
+
+  // nodes of rows that are gone are dropped (and deleted on the next flush)
+  for (i64 i = 0; i < h->n; i++) {
+    if (!hasVector[i]) {
+      h->nodes[i].deleted = 1;
+      h->live--;
+      h->unrepaired++;
+      rc = vec0_hnsw_mark_dirty(h, (i32)i);
+      if (rc != SQLITE_OK) {
+        goto cleanup;
+      }
+    }
+  }
+  for (i64 i = 0; i < h->n; i++) {
+    if (!h->nodes[i].deleted && h->nodes[i].level > h->max_level) {
+      h->entry = (i32)i;
+      h->max_level = h->nodes[i].level;
+    }
+  }
+  for (size_t i = 0; i < pendingRowids.length; i++) {
+    rc = vec0_hnsw_insert(h, ((i64 *)pendingRowids.z)[i],
+                          pendingVectors + i * h->dimensions);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
+  }
+
+  rc = vec0_hnsw_read_generation(p, vector_column_idx, &h->generation);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  h->loaded = 1;
+
+cleanup:
+  sqlite3_finalize(stmt);
+  sqlite3_free(hasVector);
+  sqlite3_free(pendingVectors);
+  array_cleanup(&pendingRowids);
+  if (rc != SQLITE_OK) {
+    vec0_hnsw_clear(h);
+  }
+  return rc;
+}
+
+/**
+ * @brief Get the up-to-date in-memory graph of the given vector column,
+ * (re)loading it if it was never loaded or another connection changed it.
+ */
+static int vec0_hnsw_get(vec0_vtab *p, int vector_column_idx,
+                         struct Vec0Hnsw **out) {
+  int rc;
+  struct VectorColumnDefinition *column = &p->vector_columns[vector_column_idx];
+  struct Vec0Hnsw *h = p->hnsw[vector_column_idx];
+  if (!h) {
+    h = sqlite3_malloc(sizeof(*h));
+    if (!h) {
+      return SQLITE_NOMEM;
+    }
+    memset(h, 0, sizeof(*h));
+    h->dimensions = column->dimensions;
+    h->distance_metric = column->distance_metric;
+    h->config = column->hnsw;
+    h->max_links0 = column->hnsw.M * 2;
+    h->level_mult = 1.0 / log((double)column->hnsw.M);
+    h->entry = -1;
+    h->max_level = -1;
+    h->rng = 0x9E3779B97F4A7C15ULL ^ (u64)(vector_column_idx + 1);
+    p->hnsw[vector_column_idx] = h;
+  }
+  // unwritten changes can only come from this connection's own transaction
+  if (h->loaded && h->dirty_n == 0) {
+    i64 generation;
+    rc = vec0_hnsw_read_generation(p, vector_column_idx, &generation);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+    if (generation != h->generation) {
+      h->loaded = 0;
+    }
+  }
+  if (!h->loaded) {
+    rc = vec0_hnsw_load(p, vector_column_idx, h);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+  *out = h;
+  return SQLITE_OK;
+}
+
+/**
+ * @brief Write all changed nodes of the given vector column to its _hnswNN
+ * shadow table and bump its generation.
+ */
+static int vec0_hnsw_flush(vec0_vtab *p, int vector_column_idx) {
+  int rc = SQLITE_OK;
+  struct Vec0Hnsw *h = p->hnsw[vector_column_idx];
+  sqlite3_stmt *stmtWrite = NULL;
+  sqlite3_stmt *stmtDelete = NULL;
+  u8 *buffer = NULL;
+  char *zSql;
+  if (!h || h->dirty_n == 0) {
+    return SQLITE_OK;
+  }
+  // deleted nodes are dropped from the shadow table, so nothing may link to
+  // them once written
+  int repaired = h->unrepaired > 0;
+  rc = vec0_hnsw_repair(h);
+  // finding unlinked nodes scans the whole graph, so it only runs after
+  // deletions or when a large part of the graph changed
+  if (rc == SQLITE_OK &&
+      (repaired || h->dirty_n * VEC0_HNSW_REATTACH_RATIO >= h->n)) {
+    rc = vec0_hnsw_reattach(h);
+  }
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
+  zSql = sqlite3_mprintf("INSERT OR REPLACE INTO " VEC0_SHADOW_HNSW_N_NAME
+                         "(rowid, level, neighbors) VALUES (?, ?, ?)",
+                         p->schemaName, p->tableName, vector_column_idx);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmtWrite, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  zSql = sqlite3_mprintf("DELETE FROM " VEC0_SHADOW_HNSW_N_NAME
+                         " WHERE rowid = ?",
+                         p->schemaName, p->tableName, vector_column_idx);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmtDelete, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+
+  int maxBytes = vec0_hnsw_offset(h, VEC0_HNSW_MAX_LEVEL + 1) * sizeof(i64);
+  buffer = sqlite3_malloc(maxBytes);
+  if (!buffer) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  for (i64 i = 0; i < h->dirty_n; i++) {
+    i32 node = h->dirty[i];
+    struct Vec0HnswNode *n = &h->nodes[node];
+    n->dirty = 0;
+    if (n->deleted) {
+      // the rowid was re-inserted as another node, which writes the row
+      if (vec0_hnsw_lookup(h, n->rowid) >= 0) {
+        continue;
+      }
+      sqlite3_bind_int64(stmtDelete, 1, n->rowid);
+      rc = sqlite3_step(stmtDelete);
+      sqlite3_reset(stmtDelete);
+      if (rc != SQLITE_DONE) {
+        goto cleanup;
+      }
+      continue;
+    }
+    int nBuffer = 0;
+    for (int l = 0; l <= n->level; l++) {
+      const i32 *links = vec0_hnsw_links(h, node, l);
+      memcpy(buffer + nBuffer, &links[0], sizeof(i32));
+      nBuffer += sizeof(i32);
+      for (int j = 0; j < links[0]; j++) {
+        memcpy(buffer + nBuffer, &h->nodes[links[1 + j]].rowid, sizeof(i64));
+        nBuffer += sizeof(i64);
+      }
+    }
+    sqlite3_bind_int64(stmtWrite, 1, n->rowid);
+    sqlite3_bind_int(stmtWrite, 2, n->level);
+    sqlite3_bind_blob(stmtWrite, 3, buffer, nBuffer, SQLITE_STATIC);
+    rc = sqlite3_step(stmtWrite);
+    sqlite3_reset(stmtWrite);
+    if (rc != SQLITE_DONE) {
+      goto cleanup;
+    }
+  }
+  h->dirty_n = 0;
+
+  zSql = sqlite3_mprintf("INSERT OR REPLACE INTO " VEC0_SHADOW_INFO_NAME
+                         "(key, value) VALUES ('hnsw%02d_generation', ?)",
+                         p->schemaName, p->tableName, vector_column_idx);
+  if (!zSql) {
+    rc = SQLITE_NOMEM;
+    goto cleanup;
+  }
+  sqlite3_finalize(stmtWrite);
+  rc = sqlite3_prepare_v2(p->db, zSql, -1, &stmtWrite, NULL);
+  sqlite3_free(zSql);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+  sqlite3_bind_int64(stmtWrite, 1, h->generation + 1);
+  rc = sqlite3_step(stmtWrite);
+  if (rc != SQLITE_DONE) {
+    goto cleanup;
+  }
+  h->generation++;
+  rc = SQLITE_OK;
+
+cleanup:
+  sqlite3_finalize(stmtWrite);
+  sqlite3_finalize(stmtDelete);
+  sqlite3_free(buffer);
+  if (rc != SQLITE_OK) {
+    // the shadow table no longer matches; rebuild from it on next use
+    vec0_hnsw_clear(h);
+  }
+  return rc;
+}
+
+static int vec0_hnsw_flush_all(vec0_vtab *p) {
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    int rc = vec0_hnsw_flush(p, i);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
+  }
+  return SQLITE_OK;
+}
+
+// drop the in-memory graphs, ex after a rollback. Reloaded on next use.
+static void vec0_hnsw_discard_all(vec0_vtab *p) {
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    if (p->hnsw[i]) {
+      vec0_hnsw_clear(p->hnsw[i]);
+    }
+  }
+}
+
+/**
+ * @brief Add the vectors of a newly inserted row to every HNSW index.
+ *
+ * @param vectorDatas the inserted vectors, indexed by vector column
+ */
+static int vec0_hnsw_on_insert(vec0_vtab *p, i64 rowid, void **vectorDatas) {
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    if (!p->vector_columns[i].hnsw.enabled) {
+      continue;
     }
-    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
-      szMatch = blobSize == size * sizeof(i64);
-      break;
+    struct Vec0Hnsw *h;
+    int rc = vec0_hnsw_get(p, i, &h);
+    if (rc != SQLITE_OK) {
+      return rc;
     }
-    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
-      szMatch = blobSize == size * sizeof(double);
-      break;
+    // a row that was loaded from the chunks before this insert finished
+    if (vec0_hnsw_lookup(h, rowid) >= 0) {
+      continue;
     }
-    case VEC0_METADATA_COLUMN_KIND_TEXT: {
-      szMatch = blobSize == size * VEC0_METADATA_TEXT_VIEW_BUFFER_LENGTH;
-      break;
+    rc = vec0_hnsw_insert(h, rowid, (const f32 *)vectorDatas[i]);
+    if (rc != SQLITE_OK) {
+      return rc;
     }
   }
-  if(!szMatch) {
-    return SQLITE_ERROR;
-  }
-  void * buffer = sqlite3_malloc(blobSize);
-  if(!buffer) {
-    return SQLITE_NOMEM;
-  }
-  rc = sqlite3_blob_read(blob, buffer, blobSize, 0);
-  if(rc != SQLITE_OK) {
-    goto done;
-  }
-  switch(kind) {
-    case VEC0_METADATA_COLUMN_KIND_BOOLEAN: {
-      int target = sqlite3_value_int(value);
-      if( (target && op == VEC0_METADATA_OPERATOR_EQ) || (!target && op == VEC0_METADATA_OPERATOR_NE)) {
-        for(int i = 0; i < size; i++) { bitmap_set(b, i, bitmap_get((u8*) buffer, i)); }
-      }
-      else {
-        for(int i = 0; i < size; i++) { bitmap_set(b, i, !bitmap_get((u8*) buffer, i)); }
-      }
-      break;
-    }
-    case VEC0_METADATA_COLUMN_KIND_INTEGER: {
-      i64 * array = (i64*) buffer;
-      i64 target = sqlite3_value_int64(value);
-      switch(op) {
-        case VEC0_METADATA_OPERATOR_EQ: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] == target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_GT: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] > target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_LE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] <= target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_LT: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] < target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_GE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] >= target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_NE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] != target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_IN: {
-          int metadataInIdx = -1;
-          for(size_t i = 0; i < aMetadataIn->length; i++) {
-            struct Vec0MetadataIn * metadataIn = &((struct Vec0MetadataIn *) aMetadataIn->z)[i];
-            if(metadataIn->argv_idx == argv_idx) {
-              metadataInIdx = i;
-              break;
-            }
-          }
-          if(metadataInIdx < 0) {
-            rc = SQLITE_ERROR;
-            goto done;
-          }
-          struct Vec0MetadataIn * metadataIn = &((struct Vec0MetadataIn *) aMetadataIn->z)[metadataInIdx];
-          struct Array * aTarget = &(metadataIn->array);
+  return SQLITE_OK;
+}
 
-          for(int i = 0; i < size; i++) {
-            for(size_t target_idx = 0; target_idx < aTarget->length; target_idx++) {
-              if( ((i64*)aTarget->z)[target_idx] == array[i]) {
-                bitmap_set(b, i, 1);
-                break;
-              }
-            }
-          }
-          break;
-        }
-      }
-      break;
+static int vec0_hnsw_on_delete(vec0_vtab *p, i64 rowid) {
+  for (int i = 0; i < p->numVectorColumns; i++) {
+    if (!p->vector_columns[i].hnsw.enabled) {
+      continue;
     }
-    case VEC0_METADATA_COLUMN_KIND_FLOAT: {
-      double * array = (double*) buffer;
-      double target = sqlite3_value_double(value);
-      switch(op) {
-        case VEC0_METADATA_OPERATOR_EQ: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] == target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_GT: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] > target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_LE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] <= target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_LT: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] < target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_GE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] >= target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_NE: {
-          for(int i = 0; i < size; i++) { bitmap_set(b, i, array[i] != target); }
-          break;
-        }
-        case VEC0_METADATA_OPERATOR_IN: {
-          // should never be reached
-          break;
-        }
-      }
-      break;
+    struct Vec0Hnsw *h;
+    int rc = vec0_hnsw_get(p, i, &h);
+    if (rc != SQLITE_OK) {
+      return rc;
     }
-    case VEC0_METADATA_COLUMN_KIND_TEXT: {
-      rc = vec0_metadata_filter_text(p, value, buffer, size, op, b, metadata_idx, chunk_rowid, aMetadataIn, argv_idx);
-      if(rc != SQLITE_OK) {
-        goto done;
-      }
-      break;
+    rc = vec0_hnsw_remove(h, rowid);
+    if (rc != SQLITE_OK) {
+      return rc;
     }
   }
-  done:
-    sqlite3_free(buffer);
+  return SQLITE_OK;
+}
+
+// re-insert a row whose vector in the given column was updated
+static int vec0_hnsw_on_update(vec0_vtab *p, int vector_column_idx, i64 rowid,
+                               sqlite3_value *valueVector) {
+  int rc;
+  void *vector;
+  size_t dimensions;
+  enum VectorElementType elementType;
+  vector_cleanup cleanup = vector_cleanup_noop;
+  char *pzError = NULL;
+  struct Vec0Hnsw *h;
+  if (!p->vector_columns[vector_column_idx].hnsw.enabled) {
+    return SQLITE_OK;
+  }
+  // already validated by vec0Update_UpdateVectorColumn
+  rc = vector_from_value(valueVector, &vector, &dimensions, &elementType,
+                         &cleanup, &pzError);
+  if (rc != SQLITE_OK) {
+    sqlite3_free(pzError);
+    return rc;
+  }
+  rc = vec0_hnsw_get(p, vector_column_idx, &h);
+  if (rc == SQLITE_OK) {
+    rc = vec0_hnsw_remove(h, rowid);
+  }
+  if (rc == SQLITE_OK) {
+    rc = vec0_hnsw_insert(h, rowid, vector);
+  }
+  cleanup(vector);
+  return rc;
+}
+
+/**
+ * @brief Approximate KNN through the HNSW index of the given vector column.
+ *
+ * @param ef candidate list size, at least k is used
+ * @param out_rowids k rowids (k_used valid), nearest first. Must be freed
+ * with sqlite3_free()
+ * @param out_distances distances of out_rowids. Must be freed with
+ * sqlite3_free()
+ */
+static int vec0_hnsw_query(vec0_vtab *p, int vector_column_idx,
+                           const void *queryVector, i64 k, int ef,
+                           i64 **out_rowids, f32 **out_distances,
+                           i64 *out_used) {
+  struct Vec0Hnsw *h;
+  int rc = vec0_hnsw_get(p, vector_column_idx, &h);
+  if (rc != SQLITE_OK) {
     return rc;
+  }
+  return vec0_hnsw_knn(h, queryVector, k, ef, out_rowids, out_distances,
+                       out_used);
 }
 
+#pragma endregion
+
 int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
                                struct VectorColumnDefinition *vector_column,
                                int vectorColumnIdx, struct Array *arrayRowidsIn,
@@ -6471,7 +8194,7 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
   f32 *tmp_topk_distances = NULL; // memory: k * 4
   f32 *chunk_distances = NULL;    // memory: chunk_size * 4
   u8 *b = NULL;                   // memory: chunk_size / 8
-  u8 *bTaken = NULL;              // memory: chunk_size / 8
+  struct vec0_dist_idx *topk_heap = NULL; // memory: k * 8
   i32 *chunk_topk_idxs = NULL;    // memory: k * 4
   u8 *bmRowids = NULL;            // memory: chunk_size / 8
   u8 *bmMetadata = NULL;            // memory: chunk_size / 8
@@ -6527,8 +8250,8 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
     goto cleanup;
   }
 
-  bTaken = bitmap_new(p->chunk_size);
-  if (!bTaken) {
+  topk_heap = sqlite3_malloc(min(k, p->chunk_size) * sizeof(*topk_heap));
+  if (!topk_heap) {
     rc = SQLITE_NOMEM;
     goto cleanup;
   }
@@ -6686,7 +8409,17 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
     }
 
 
-    for (int i = 0; i < p->chunk_size; i++) {
+    int batched = 0;
+    if (vector_column->element_type == SQLITE_VEC_ELEMENT_TYPE_FLOAT32 &&
+        vector_column->distance_metric == VEC0_DISTANCE_METRIC_L2 &&
+        vector_column->dimensions <= VEC0_SMALL_DIMENSIONS_MAX) {
+      // distances of invalid rows are computed too, but min_idx() skips them
+      vec0_l2_small_batch((const f32 *)baseVectors, (const f32 *)queryVector,
+                          vector_column->dimensions, p->chunk_size,
+                          chunk_distances);
+      batched = 1;
+    }
+    for (int i = 0; !batched && i < p->chunk_size; i++) {
       if (!bitmap_get(b, i)) {
         continue;
       };
@@ -6752,7 +8485,7 @@ int vec0Filter_knn_chunks_iter(vec0_vtab *p, sqlite3_stmt *stmtChunks,
 
     int used1;
     min_idx(chunk_distances, p->chunk_size, b, chunk_topk_idxs,
-            min(k, p->chunk_size), bTaken, &used1);
+            min(k, p->chunk_size), topk_heap, &used1);
 
     i64 used;
     merge_sorted_lists(topk_distances, topk_rowids, k_used, chunk_distances,
@@ -6785,7 +8518,7 @@ cleanup:
   sqlite3_free(tmp_topk_rowids);
   sqlite3_free(tmp_topk_distances);
   sqlite3_free(b);
-  sqlite3_free(bTaken);
+  sqlite3_free(topk_heap);
   sqlite3_free(bmRowids);
   sqlite3_free(baseVectors);
   sqlite3_free(chunk_distances);
@@ -7031,22 +8764,40 @@ int vec0Filter_knn(vec0_cursor *pCur, vec0_vtab *p, int idxNum,
   }
   #endif
 
-  rc = vec0_chunks_iter(p, idxStr, argc, argv, &stmtChunks);
-  if (rc != SQLITE_OK) {
-    // IMP: V06942_23781
-    vtab_set_error(&p->base, "Error preparing stmtChunk: %s",
-                   sqlite3_errmsg(p->db));
-    goto cleanup;
-  }
-
   i64 *topk_rowids = NULL;
   f32 *topk_distances = NULL;
   i64 k_used = 0;
-  rc = vec0Filter_knn_chunks_iter(p, stmtChunks, vector_column, vectorColumnIdx,
-                                  arrayRowidsIn, aMetadataIn, idxStr, argc, argv, queryVector, k, &topk_rowids,
-                                  &topk_distances, &k_used);
-  if (rc != SQLITE_OK) {
-    goto cleanup;
+
+  // plain `MATCH ... AND k = ?` queries go through the HNSW index. Any other
+  // constraint (rowid in, partition keys, metadata) uses the exact scan below.
+  if (vector_column->hnsw.enabled && argc == 2) {
+    int ef = vector_column->hnsw.ef_search;
+    if (p->settings && p->settings->hnsw_ef_search > 0) {
+      ef = p->settings->hnsw_ef_search;
+    }
+    rc = vec0_hnsw_query(p, vectorColumnIdx, queryVector, k, ef, &topk_rowids,
+                         &topk_distances, &k_used);
+    if (rc != SQLITE_OK) {
+      vtab_set_error(&p->base, "Error searching the HNSW index of \"%.*s\": %s",
+                     vector_column->name_length, vector_column->name,
+                     sqlite3_errstr(rc));
+      goto cleanup;
+    }
+  } else {
+    rc = vec0_chunks_iter(p, idxStr, argc, argv, &stmtChunks);
+    if (rc != SQLITE_OK) {
+      // IMP: V06942_23781
+      vtab_set_error(&p->base, "Error preparing stmtChunk: %s",
+                     sqlite3_errmsg(p->db));
+      goto cleanup;
+    }
+
+    rc = vec0Filter_knn_chunks_iter(p, stmtChunks, vector_column, vectorColumnIdx,
+                                    arrayRowidsIn, aMetadataIn, idxStr, argc, argv, queryVector, k, &topk_rowids,
+                                    &topk_distances, &k_used);
+    if (rc != SQLITE_OK) {
+      goto cleanup;
+    }
   }
 
   knn_data->current_idx = 0;
@@ -8323,6 +10074,11 @@ int vec0Update_Insert(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv,
     }
   }
 
+  rc = vec0_hnsw_on_insert(p, rowid, vectorDatas);
+  if (rc != SQLITE_OK) {
+    goto cleanup;
+  }
+
   *pRowid = rowid;
   rc = SQLITE_OK;
 
@@ -8595,6 +10351,12 @@ int vec0Update_Delete(sqlite3_vtab *pVTab, sqlite3_value *idValue) {
     rc = vec0Update_Delete_ClearMetadata(p, i, rowid, chunk_id, chunk_offset);
   }
 
+  // 7. unlink from HNSW indexes
+  rc = vec0_hnsw_on_delete(p, rowid);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
+
   return SQLITE_OK;
 }
 
@@ -8801,6 +10563,10 @@ int vec0Update_Update(sqlite3_vtab *pVTab, int argc, sqlite3_value **argv) {
     if (rc != SQLITE_OK) {
       return SQLITE_ERROR;
     }
+    rc = vec0_hnsw_on_update(p, vector_idx, rowid, valueVector);
+    if (rc != SQLITE_OK) {
+      return rc;
+    }
   }
 
   return SQLITE_OK;
@@ -8865,6 +10631,24 @@ static int vec0ShadowName(const char *zName) {
   "metadatatext13",
   "metadatatext14",
   "metadatatext15",
+
+  // Up to VEC0_MAX_VECTOR_COLUMNS, for `index=hnsw` vector columns
+  "hnsw00",
+  "hnsw01",
+  "hnsw02",
+  "hnsw03",
+  "hnsw04",
+  "hnsw05",
+  "hnsw06",
+  "hnsw07",
+  "hnsw08",
+  "hnsw09",
+  "hnsw10",
+  "hnsw11",
+  "hnsw12",
+  "hnsw13",
+  "hnsw14",
+  "hnsw15",
   };
 
   for (size_t i = 0; i < sizeof(azName) / sizeof(azName[0]); i++) {
@@ -8880,8 +10664,11 @@ static int vec0Begin(sqlite3_vtab *pVTab) {
   return SQLITE_OK;
 }
 static int vec0Sync(sqlite3_vtab *pVTab) {
-  UNUSED_PARAMETER(pVTab);
   vec0_vtab *p = (vec0_vtab *)pVTab;
+  int rc = vec0_hnsw_flush_all(p);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
   if (p->stmtLatestChunk) {
     sqlite3_finalize(p->stmtLatestChunk);
     p->stmtLatestChunk = NULL;
@@ -8909,9 +10696,47 @@ static int vec0Commit(sqlite3_vtab *pVTab) {
   return SQLITE_OK;
 }
 static int vec0Rollback(sqlite3_vtab *pVTab) {
+  vec0_hnsw_discard_all((vec0_vtab *)pVTab);
+  return SQLITE_OK;
+}
+// HNSW changes made before a savepoint are written out, so rolling back to it
+// only loses (and reloads) the in-memory graph.
+static int vec0Savepoint(sqlite3_vtab *pVTab, int iSavepoint) {
+  UNUSED_PARAMETER(iSavepoint);
+  return vec0_hnsw_flush_all((vec0_vtab *)pVTab);
+}
+static int vec0Release(sqlite3_vtab *pVTab, int iSavepoint) {
   UNUSED_PARAMETER(pVTab);
+  UNUSED_PARAMETER(iSavepoint);
   return SQLITE_OK;
 }
+static int vec0RollbackTo(sqlite3_vtab *pVTab, int iSavepoint) {
+  UNUSED_PARAMETER(iSavepoint);
+  vec0_hnsw_discard_all((vec0_vtab *)pVTab);
+  return SQLITE_OK;
+}
+
+/**
+ * @brief `vec_hnsw_ef_search(n)`: set the candidate list size of HNSW KNN
+ * queries on this connection, overriding each column's hnsw_ef_search.
+ * 0 restores the column defaults. Returns the previous value.
+ */
+static void vec_hnsw_ef_search(sqlite3_context *context, int argc,
+                               sqlite3_value **argv) {
+  assert(argc == 1);
+  struct Vec0ConnectionSettings *settings = sqlite3_user_data(context);
+  i64 ef = sqlite3_value_int64(argv[0]);
+  if (sqlite3_value_type(argv[0]) != SQLITE_INTEGER || ef < 0 ||
+      ef > VEC0_HNSW_MAX_EF) {
+    sqlite3_result_error(context,
+                         "vec_hnsw_ef_search() expects an integer between 0 "
+                         "and 4096",
+                         -1);
+    return;
+  }
+  sqlite3_result_int(context, settings->hnsw_ef_search);
+  settings->hnsw_ef_search = (int)ef;
+}
 
 static sqlite3_module vec0Module = {
     /* iVersion      */ 3,
@@ -8934,9 +10759,9 @@ static sqlite3_module vec0Module = {
     /* xRollback     */ vec0Rollback,
     /* xFindFunction */ 0,
     /* xRename       */ 0, // https://github.com/asg017/sqlite-vec/issues/43
-    /* xSavepoint    */ 0,
-    /* xRelease      */ 0,
-    /* xRollbackTo   */ 0,
+    /* xSavepoint    */ vec0Savepoint,
+    /* xRelease      */ vec0Release,
+    /* xRollbackTo   */ vec0RollbackTo,
     /* xShadowName   */ vec0ShadowName,
 #if SQLITE_VERSION_NUMBER >= 3044000
     /* xIntegrity    */ 0, // https://github.com/asg017/sqlite-vec/issues/44
@@ -9449,15 +11274,17 @@ static int vec_static_blob_entriesFilter(sqlite3_vtab_cursor *pVtabCursor,
     u8 *candidates = bitmap_new(bsize);
     assert(candidates);
 
-    u8 *taken = bitmap_new(bsize);
-    assert(taken);
+    struct vec0_dist_idx *heap = sqlite3_malloc(k * sizeof(*heap));
+    assert(heap);
 
     bitmap_fill(candidates, bsize);
     for (size_t i = bsize; i >= p->blob->nvectors; i--) {
       bitmap_set(candidates, i, 0);
     }
     i32 k_used = 0;
-    min_idx(distances, bsize, candidates, topk_rowids, k, taken, &k_used);
+    min_idx(distances, bsize, candidates, topk_rowids, k, heap, &k_used);
+    sqlite3_free(heap);
+    sqlite3_free(candidates);
     knn_data->current_idx = 0;
     knn_data->distances = distances;
     knn_data->k = k;
@@ -9617,6 +11444,7 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
   SQLITE_EXTENSION_INIT2(pApi);
 #endif
   int rc = SQLITE_OK;
+  vec_select_kernels();
 
 #define DEFAULT_FLAGS (SQLITE_UTF8 | SQLITE_INNOCUOUS | SQLITE_DETERMINISTIC)
 
@@ -9632,6 +11460,12 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
   if (rc != SQLITE_OK) {
     return rc;
   }
+  rc = sqlite3_create_function_v2(db, "vec_kernel", 0, DEFAULT_FLAGS,
+                                  (void *)vec0_l2_small_batch_name,
+                                  _static_text_func, NULL, NULL, NULL);
+  if (rc != SQLITE_OK) {
+    return rc;
+  }
   static struct {
     const char *zFName;
     void (*xFunc)(sqlite3_context *, int, sqlite3_value **);
@@ -9667,7 +11501,6 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
     void (*xDestroy)(void *);
   } aMod[] = {
       // clang-format off
-    {"vec0",          &vec0Module,          NULL, NULL},
     {"vec_each",      &vec_eachModule,      NULL, NULL},
       // clang-format on
   };
@@ -9692,6 +11525,29 @@ SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
     }
   }
 
+  // vec0 tables of this connection share one settings struct, owned by the
+  // module and also used by vec_hnsw_ef_search()
+  struct Vec0ConnectionSettings *settings = sqlite3_malloc(sizeof(*settings));
+  if (!settings) {
+    return SQLITE_NOMEM;
+  }
+  memset(settings, 0, sizeof(*settings));
+  rc = sqlite3_create_module_v2(db, "vec0", &vec0Module, settings,
+                                sqlite3_free);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Error creating module vec0: %s",
+                                sqlite3_errmsg(db));
+    return rc;
+  }
+  rc = sqlite3_create_function_v2(db, "vec_hnsw_ef_search", 1, SQLITE_UTF8,
+                                  settings, vec_hnsw_ef_search, NULL, NULL,
+                                  NULL);
+  if (rc != SQLITE_OK) {
+    *pzErrMsg = sqlite3_mprintf("Error creating function %s: %s",
+                                "vec_hnsw_ef_search", sqlite3_errmsg(db));
+    return rc;
+  }
+
   return SQLITE_OK;
 }
 
@@ -9747,3 +11603,15 @@ sqlite3_vec_static_blobs_init(sqlite3 *db, char **pzErrMsg,
     return rc;
   return rc;
 }
+
+/**
+ * Interrupts whatever statement is running on db, like sqlite3_interrupt().
+ * Safe to call from any thread. Exported so that a host which links SQLite
+ * only indirectly (e.g. through a database driver plugin) reaches the same
+ * SQLite library this extension was loaded into.
+ */
+SQLITE_VEC_API void sqlite3_vec_interrupt(sqlite3 *db) {
+  if (db) {
+    sqlite3_interrupt(db);
+  }
+}
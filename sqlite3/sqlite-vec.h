@@ -34,6 +34,9 @@ extern "C" {
 SQLITE_VEC_API int sqlite3_vec_init(sqlite3 *db, char **pzErrMsg,
                   const sqlite3_api_routines *pApi);
 
+// Interrupts the statement running on db. Safe to call from any thread.
+SQLITE_VEC_API void sqlite3_vec_interrupt(sqlite3 *db);
+
 #ifdef __cplusplus
 }  /* end of the 'extern "C"' block */
 #endif
@@ -1,8 +1,17 @@
 -- サムネイル定義 --
+-- キーは File.hash (SHA2(512))、画像は段階毎のパックに格納 --
+--   tile: thumbnail.pack (64px), tile128: thumbnail_128.pack, tile256: thumbnail_256.pack --
+-- cacheName はPNG単体で保存していた頃のキャッシュ (tile が NULL の間だけ使う) --
 CREATE TABLE thumb.Thumbnail (
-	fileId		INTEGER PRIMARY KEY,
-	cacheName	TEXT NOT NULL
+	hash		BLOB PRIMARY KEY,
+	tile		INTEGER,
+	cacheName	TEXT,
+	tile128		INTEGER,
+	tile256		INTEGER,
+	lastAccess	INTEGER,
+	CHECK(LENGTH(hash) == 64)
 );
+CREATE INDEX thumb.Thumbnail_lastAccess ON Thumbnail(lastAccess);
 
 -- 姿勢解析が上手くいってないのをユーザーが手動でフラグ付けする --
 -- ポーズIdではデータベースを作り直す毎に対象が変わる可能性があるのでHashを格納
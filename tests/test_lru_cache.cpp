@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <thread>
+#include <vector>
+#include "lru_cache.hpp"
+
+using namespace dg;
+
+// 【基本動作のテスト】
+// 挿入した値が取り出せ、ヒット/ミスが数えられることを確認
+TEST(LruCacheTest, InsertAndFind) {
+	LruCache<int, std::string> cache(3);
+	cache.insert(1, "one");
+	cache.insert(2, "two");
+
+	ASSERT_NE(cache.find(1), nullptr);
+	EXPECT_EQ(*cache.find(1), "one");
+	EXPECT_EQ(cache.find(3), nullptr);
+	EXPECT_EQ(cache.stats().hit, 2u);
+	EXPECT_EQ(cache.stats().miss, 1u);
+	EXPECT_EQ(cache.size(), 2u);
+}
+
+// 【追い出し順のテスト】
+// 容量を超えたら最も長く使われていないエントリから破棄されることを確認
+TEST(LruCacheTest, EvictsLeastRecentlyUsed) {
+	LruCache<int, int> cache(3);
+	cache.insert(1, 10);
+	cache.insert(2, 20);
+	cache.insert(3, 30);
+	// 1を使ったので、次に追い出されるのは2
+	cache.find(1);
+	cache.insert(4, 40);
+
+	EXPECT_TRUE(cache.contains(1));
+	EXPECT_FALSE(cache.contains(2));
+	EXPECT_TRUE(cache.contains(3));
+	EXPECT_TRUE(cache.contains(4));
+	EXPECT_EQ(cache.stats().eviction, 1u);
+}
+
+// 【コスト指定のテスト】
+// 合計コストが容量内に収まるよう、複数エントリがまとめて追い出されることを確認
+TEST(LruCacheTest, CostBudget) {
+	LruCache<int, int> cache(100);
+	cache.insert(1, 1, 40);
+	cache.insert(2, 2, 40);
+	cache.insert(3, 3, 90);
+
+	EXPECT_FALSE(cache.contains(1));
+	EXPECT_FALSE(cache.contains(2));
+	EXPECT_TRUE(cache.contains(3));
+	EXPECT_EQ(cache.cost(), 90u);
+
+	// 容量を縮めると即座に追い出される
+	cache.setCapacity(50);
+	EXPECT_EQ(cache.size(), 0u);
+	EXPECT_EQ(cache.cost(), 0u);
+}
+
+// 【同一キーの再挿入テスト】
+// 同じキーで挿入すると値とコストが置き換わることを確認
+TEST(LruCacheTest, ReplaceSameKey) {
+	LruCache<int, int> cache(10);
+	cache.insert(1, 1, 4);
+	cache.insert(1, 2, 6);
+
+	EXPECT_EQ(cache.size(), 1u);
+	EXPECT_EQ(cache.cost(), 6u);
+	EXPECT_EQ(*cache.find(1), 2);
+	EXPECT_TRUE(cache.erase(1));
+	EXPECT_FALSE(cache.erase(1));
+	EXPECT_EQ(cache.cost(), 0u);
+}
+
+// 【スレッドセーフ版のテスト】
+// 複数スレッドから同時に挿入・検索しても、件数と統計の整合が取れていることを確認
+TEST(SharedLruCacheTest, ConcurrentAccess) {
+	SharedLruCache<int, int> cache(64);
+	constexpr int NThread = 4;
+	constexpr int NIter = 1000;
+	std::vector<std::thread> th;
+	for (int t = 0; t < NThread; ++t) {
+		th.emplace_back([&cache, t]() {
+			for (int i = 0; i < NIter; ++i) {
+				const int key = (t * NIter + i) % 100;
+				if (const auto v = cache.find(key))
+					EXPECT_EQ(*v, key * 2);
+				else
+					cache.insert(key, key * 2);
+			}
+		});
+	}
+	for (auto &t : th)
+		t.join();
+
+	const auto st = cache.stats();
+	EXPECT_EQ(st.hit + st.miss, static_cast<uint64_t>(NThread * NIter));
+	EXPECT_LE(cache.size(), 64u);
+	EXPECT_EQ(cache.cost(), cache.size());
+}
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "nearest_rank.hpp"
+
+using namespace dg;
+
+namespace {
+	constexpr float NaN = std::numeric_limits<float>::quiet_NaN();
+
+	float FlexTerm(const float d) {
+		return 2.f - d * d / 2;
+	}
+	// 全要素を評価してスコア降順に並べる (比較用)
+	std::vector<RankSource::Item> BruteForce(const std::vector<std::vector<float>> &cols, const std::vector<float> &target,
+											 const float scale) {
+		std::vector<RankSource::Item> ret;
+		for (uint32_t i = 0; i < cols[0].size(); ++i) {
+			float score = 0;
+			bool has = false;
+			for (size_t a = 0; a < cols.size(); ++a) {
+				if (std::isnan(cols[a][i]))
+					continue;
+				score += FlexTerm(std::abs(cols[a][i] - target[a]));
+				has = true;
+			}
+			if (has)
+				ret.emplace_back(RankSource::Item{i, score * scale});
+		}
+		std::stable_sort(ret.begin(), ret.end(), [](auto &a, auto &b) { return a.score > b.score; });
+		return ret;
+	}
+} // namespace
+
+TEST(NearestRank, SortedColumnSkipsNaN) {
+	const std::vector<float> col{3.f, NaN, 1.f, 2.f, NaN};
+	const auto sc = SortedColumn::Make(col);
+	EXPECT_EQ(sc.value, (std::vector<float>{1.f, 2.f, 3.f}));
+	EXPECT_EQ(sc.id, (std::vector<uint32_t>{2, 3, 0}));
+}
+
+TEST(NearestRank, WalkOutward) {
+	const std::vector<float> col{0.f, 1.f, 2.f, 3.f, 4.f, 10.f};
+	const auto sc = SortedColumn::Make(col);
+	NearestWalk walk(sc, 2.6f);
+	std::vector<uint32_t> order;
+	float prev = 0;
+	while (auto item = walk.next()) {
+		EXPECT_GE(item->dist, prev);
+		prev = item->dist;
+		order.emplace_back(item->id);
+	}
+	EXPECT_EQ(order, (std::vector<uint32_t>{3, 2, 4, 1, 0, 5}));
+	EXPECT_TRUE(walk.exhausted());
+
+	// 範囲外の目標値
+	NearestWalk below(sc, -5.f);
+	EXPECT_EQ(below.next()->id, 0u);
+	NearestWalk above(sc, 50.f);
+	EXPECT_EQ(above.next()->id, 5u);
+}
+
+TEST(NearestRank, SeparableMatchesBruteForce) {
+	std::mt19937 mt(3);
+	std::uniform_real_distribution<float> val(-1.5f, 3.1f);
+	std::uniform_real_distribution<float> p(0.f, 1.f);
+	constexpr size_t N = 2000;
+	// 片側だけ値がある要素・両方無い要素を混ぜる
+	std::vector<std::vector<float>> cols(2, std::vector<float>(N));
+	for (size_t i = 0; i < N; ++i) {
+		for (auto &c : cols)
+			c[i] = p(mt) < 0.15f ? NaN : val(mt);
+	}
+	const std::vector<float> target{0.4f, 2.5f};
+	std::vector<SortedColumn> sorted;
+	for (auto &c : cols)
+		sorted.emplace_back(SortedColumn::Make(c));
+
+	constexpr float Scale = 1.5f;
+	SeparableRankSource src({{&sorted[0], cols[0], target[0]}, {&sorted[1], cols[1], target[1]}}, FlexTerm, Scale);
+	const auto expect = BruteForce(cols, target, Scale);
+	for (size_t k = 0; k < expect.size(); ++k) {
+		const auto item = src.next();
+		ASSERT_TRUE(item);
+		EXPECT_FLOAT_EQ(item->score, expect[k].score) << k;
+		EXPECT_FLOAT_EQ(src.at(item->id), item->score);
+	}
+	EXPECT_FALSE(src.next());
+}
+
+TEST(NearestRank, WorksWithThresholdTopK) {
+	const std::vector<float> col{0.f, 0.5f, 0.9f, 0.1f, NaN};
+	const auto sorted = SortedColumn::Make(col);
+	std::vector<RankSource_U> sources;
+	sources.emplace_back(std::make_unique<SeparableRankSource>(
+		std::vector<SeparableRankSource::Axis>{{&sorted, col, 0.45f}}, [](const float d) { return (2.f - d) / 2; },
+		1.f));
+	const auto top = ThresholdTopK(2, sources, [](uint32_t) { return true; });
+	ASSERT_EQ(top.size(), 2u);
+	EXPECT_EQ(top[0].id, 1u);
+	EXPECT_EQ(top[1].id, 3u);
+}
+
+TEST(NearestRank, CircularWalkWrapsAround) {
+	constexpr float Pi = 3.14159265f, TwoPi = Pi * 2;
+	const std::vector<float> col{-3.0f, -1.0f, 0.f, 1.0f, 3.1f};
+	const auto sc = SortedColumn::Make(col);
+	// 3.0 からは -3.0 (回り込んで約0.28) が 3.1 (0.1) の次に近い
+	NearestWalk walk(sc, 3.0f, TwoPi);
+	std::vector<uint32_t> order;
+	float prev = 0;
+	while (auto item = walk.next()) {
+		EXPECT_GE(item->dist, prev);
+		EXPECT_NEAR(item->dist, PeriodicDistance(col[item->id], 3.0f, TwoPi), 1e-5f);
+		prev = item->dist;
+		order.emplace_back(item->id);
+	}
+	EXPECT_EQ(order, (std::vector<uint32_t>{4, 0, 3, 1, 2}));
+
+	// 列の端ちょうどの目標値
+	NearestWalk edge(sc, -Pi, TwoPi);
+	EXPECT_EQ(edge.next()->id, 4u);
+}
+
+TEST(NearestRank, CircularWithExactScore) {
+	// ほぼ単位ベクトルの向きを角度で辿り、スコアは弦の長さから求める
+	std::mt19937 mt(5);
+	std::uniform_real_distribution<float> ang(-3.14159265f, 3.14159265f);
+	std::uniform_real_distribution<float> rad(0.995f, 1.005f);
+	constexpr size_t N = 3000;
+	std::vector<float> x(N), y(N), a(N);
+	for (size_t i = 0; i < N; ++i) {
+		const float t = ang(mt), r = rad(mt);
+		x[i] = std::cos(t) * r;
+		y[i] = std::sin(t) * r;
+		a[i] = std::atan2(y[i], x[i]);
+	}
+	const float qa = 2.9f, qx = std::cos(qa), qy = std::sin(qa);
+	const auto score = [&](const uint32_t i) { return (2.f - std::hypot(x[i] - qx, y[i] - qy)) / 2; };
+	// 角度 θ 以上離れた要素の弦の長さの下限
+	const auto bound = [](const float theta) {
+		const float r = std::clamp(std::cos(theta), 0.995f, 1.005f);
+		return (2.f - std::sqrt(std::max(0.f, r * r + 1 - 2 * r * std::cos(theta)))) / 2;
+	};
+	const auto sorted = SortedColumn::Make(a);
+	SeparableRankSource src({{&sorted, a, qa, 2 * 3.14159265f}}, bound, score, 1.f);
+
+	std::vector<float> expect(N);
+	for (uint32_t i = 0; i < N; ++i)
+		expect[i] = score(i);
+	std::sort(expect.begin(), expect.end(), std::greater<>());
+	for (size_t k = 0; k < N; ++k) {
+		const auto item = src.next();
+		ASSERT_TRUE(item);
+		EXPECT_FLOAT_EQ(item->score, expect[k]) << k;
+	}
+	EXPECT_FALSE(src.next());
+}
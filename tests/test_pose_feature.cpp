@@ -0,0 +1,48 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <limits>
+#include <numbers>
+#include "pose_feature.hpp"
+
+using namespace dg;
+
+namespace {
+	constexpr float NaN = std::numeric_limits<float>::quiet_NaN();
+	constexpr float Pi = std::numbers::pi_v<float>;
+
+	PoseFeature Standing(const float kneeRad) {
+		return PoseFeature::Make({0, 2, 0}, {{{0, -1, 0}, {0, -1, 0}}}, {{{0, -1, 0}, {0, -1, 0}}}, {0, 0},
+								 {kneeRad, kneeRad});
+	}
+} // namespace
+
+TEST(PoseFeature, DirectionsAreNormalized) {
+	const auto f = Standing(0);
+	// 胴体の方向は長さ 2 で与えている
+	EXPECT_FLOAT_EQ(f.value[1], 1.f);
+	EXPECT_FLOAT_EQ(f.distance(f), 0.f);
+	EXPECT_FLOAT_EQ(PoseFeature::Score(0), 1.f);
+}
+
+TEST(PoseFeature, DistanceIsChordOfAngleDifference) {
+	// 左右の膝を 90度 曲げると、2つの要素がそれぞれ 2sin(45°) = √2 ずれる
+	const float d = Standing(0).distance(Standing(Pi / 2));
+	EXPECT_NEAR(d, std::sqrt(2 * 2.f), 1e-5f);
+
+	// 全ての要素が正反対なら MaxDistance
+	const auto a = PoseFeature::Make({1, 0, 0}, {{{1, 0, 0}, {1, 0, 0}}}, {{{1, 0, 0}, {1, 0, 0}}}, {0, 0}, {0, 0});
+	const auto b =
+		PoseFeature::Make({-1, 0, 0}, {{{-1, 0, 0}, {-1, 0, 0}}}, {{{-1, 0, 0}, {-1, 0, 0}}}, {Pi, Pi}, {Pi, Pi});
+	EXPECT_NEAR(a.distance(b), PoseFeature::MaxDistance, 1e-5f);
+	EXPECT_NEAR(PoseFeature::Score(a.distance(b)), 0.f, 1e-6f);
+}
+
+TEST(PoseFeature, MissingPartsAreZero) {
+	const auto f = PoseFeature::Make({NaN, 0, 0}, {{{0, 0, 0}, {0, -1, 0}}}, {{{0, -1, 0}, {0, -1, 0}}}, {NaN, 0},
+									 {0, 0});
+	for (int i = 0; i < 6; ++i)
+		EXPECT_EQ(f.value[i], 0.f) << i;
+	// 値が無い要素は、どの値からも距離 1
+	const auto full = Standing(0);
+	EXPECT_NEAR(f.distance(full), std::sqrt(3.f), 1e-5f);
+}
@@ -0,0 +1,83 @@
+#include <gtest/gtest.h>
+#include <random>
+#include "qoi.hpp"
+
+using namespace dg;
+
+namespace {
+	std::vector<uint8_t> RoundTrip(const std::vector<uint8_t> &src, const uint32_t w, const uint32_t h,
+								   const size_t stride) {
+		const auto enc = qoi::Encode(src.data(), w, h, stride);
+		const auto header = qoi::ReadHeader(enc.data(), enc.size());
+		EXPECT_TRUE(header);
+		EXPECT_EQ(header->width, w);
+		EXPECT_EQ(header->height, h);
+		std::vector<uint8_t> dst(src.size(), 0);
+		EXPECT_TRUE(qoi::Decode(enc.data(), enc.size(), dst.data(), stride));
+		return dst;
+	}
+} // namespace
+
+TEST(Qoi, RandomRoundTrip) {
+	std::mt19937 mt(1);
+	std::uniform_int_distribution<int> dist(0, 255);
+	constexpr uint32_t W = 37, H = 23;
+	std::vector<uint8_t> src(W * H * 4);
+	for (auto &v : src)
+		v = static_cast<uint8_t>(dist(mt));
+	EXPECT_EQ(RoundTrip(src, W, H, W * 4), src);
+}
+
+TEST(Qoi, GradientIsSmallerThanRaw) {
+	// 差分で符号化される滑らかな画像
+	constexpr uint32_t W = 64, H = 64;
+	std::vector<uint8_t> src(W * H * 4);
+	for (uint32_t y = 0; y < H; ++y) {
+		for (uint32_t x = 0; x < W; ++x) {
+			uint8_t *p = &src[(y * W + x) * 4];
+			p[0] = static_cast<uint8_t>(x);
+			p[1] = static_cast<uint8_t>(y * 3);
+			p[2] = static_cast<uint8_t>(x + y);
+			p[3] = 255;
+		}
+	}
+	const auto enc = qoi::Encode(src.data(), W, H, W * 4);
+	EXPECT_LT(enc.size(), src.size() / 2);
+	EXPECT_EQ(RoundTrip(src, W, H, W * 4), src);
+}
+
+TEST(Qoi, LongRunAndStride) {
+	// 同色が MaxRun を超えて続く + 行末にパディングがある
+	constexpr uint32_t W = 100, H = 3;
+	constexpr size_t Stride = W * 4 + 12;
+	std::vector<uint8_t> src(Stride * H, 0);
+	for (uint32_t y = 0; y < H; ++y) {
+		for (uint32_t x = 0; x < W; ++x) {
+			uint8_t *p = &src[y * Stride + x * 4];
+			p[0] = 10;
+			p[1] = 20;
+			p[2] = 30;
+			p[3] = x == 50 ? 128 : 255;
+		}
+	}
+	const auto enc = qoi::Encode(src.data(), W, H, Stride);
+	EXPECT_LT(enc.size(), 64u);
+	EXPECT_EQ(RoundTrip(src, W, H, Stride), src);
+}
+
+TEST(Qoi, RejectsBrokenData) {
+	const std::vector<uint8_t> src(16 * 16 * 4, 7);
+	auto enc = qoi::Encode(src.data(), 16, 16, 16 * 4);
+	std::vector<uint8_t> dst(src.size());
+
+	auto badMagic = enc;
+	badMagic[0] = 'x';
+	EXPECT_FALSE(qoi::ReadHeader(badMagic.data(), badMagic.size()));
+	EXPECT_FALSE(qoi::Decode(badMagic.data(), badMagic.size(), dst.data(), 16 * 4));
+
+	// 符号が足りない (大きさだけ偽る)
+	auto truncated = enc;
+	truncated[11] = 255;
+	std::vector<uint8_t> big(16 * 255 * 4);
+	EXPECT_FALSE(qoi::Decode(truncated.data(), truncated.size(), big.data(), 16 * 4));
+}
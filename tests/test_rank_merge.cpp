@@ -0,0 +1,136 @@
+#include <gtest/gtest.h>
+#include <numeric>
+#include <random>
+#include "rank_merge.hpp"
+
+using namespace dg;
+
+namespace {
+	// スコア配列から作るソース (NaN は該当なし)
+	class VecSource : public RankSource {
+		private:
+			std::vector<float> _score;
+			std::vector<uint32_t> _order;
+			size_t _cur = 0;
+			bool _dense;
+
+		public:
+			size_t nRead = 0;
+
+			VecSource(std::vector<float> score, const bool dense) : _score(std::move(score)), _dense(dense) {
+				for (uint32_t i = 0; i < _score.size(); ++i) {
+					if (!std::isnan(_score[i]))
+						_order.emplace_back(i);
+				}
+				std::stable_sort(_order.begin(), _order.end(),
+								 [this](const uint32_t a, const uint32_t b) { return _score[a] > _score[b]; });
+			}
+			std::optional<Item> next() override {
+				if (_cur == _order.size())
+					return std::nullopt;
+				++nRead;
+				const uint32_t id = _order[_cur++];
+				return Item{id, _score[id]};
+			}
+			float at(const uint32_t id) const override {
+				return _score[id];
+			}
+			bool dense() const noexcept override {
+				return _dense;
+			}
+	};
+
+	// 全件を合計してソートした結果 (比較用)
+	RankedItemV BruteForce(const size_t k, const std::vector<std::vector<float>> &scores,
+						   const std::vector<bool> &reject) {
+		const size_t n = scores.front().size();
+		RankedItemV all;
+		for (uint32_t i = 0; i < n; ++i) {
+			if (reject[i])
+				continue;
+			double total = 0;
+			bool any = false;
+			for (auto &sc : scores) {
+				if (!std::isnan(sc[i])) {
+					total += sc[i];
+					any = true;
+				}
+			}
+			if (any)
+				all.emplace_back(RankedItem{i, total});
+		}
+		std::sort(all.begin(), all.end(), [](const RankedItem &a, const RankedItem &b) {
+			if (a.score != b.score)
+				return a.score > b.score;
+			return a.id < b.id;
+		});
+		all.resize(std::min(all.size(), k));
+		return all;
+	}
+} // namespace
+
+// 【ランダムなスコアで総当たりと一致するか】
+// 密なソースと疎なソース(該当なし=0)を混ぜても上位k件が総当たりと同じになることを確認
+TEST(ThresholdTopKTest, MatchesBruteForce) {
+	std::mt19937 rng(1234);
+	std::uniform_real_distribution<float> dist(-1.f, 1.f);
+	std::bernoulli_distribution sparse(0.3);
+	constexpr size_t N = 2000;
+	for (int trial = 0; trial < 20; ++trial) {
+		std::vector<std::vector<float>> scores(3, std::vector<float>(N));
+		for (auto &v : scores[0])
+			v = dist(rng);
+		for (auto &v : scores[1])
+			v = dist(rng) * 0.5f + 0.5f;
+		for (auto &v : scores[2])
+			v = sparse(rng) ? 1.f : std::numeric_limits<float>::quiet_NaN();
+		std::vector<bool> reject(N);
+		for (size_t i = 0; i < N; ++i)
+			reject[i] = (i % 17) == 0;
+
+		std::vector<RankSource_U> src;
+		src.emplace_back(std::make_unique<VecSource>(scores[0], true));
+		src.emplace_back(std::make_unique<VecSource>(scores[1], true));
+		src.emplace_back(std::make_unique<VecSource>(scores[2], false));
+
+		const size_t k = 50;
+		const auto res = ThresholdTopK(k, src, [&reject](const uint32_t id) { return !reject[id]; });
+		const auto ref = BruteForce(k, scores, reject);
+		ASSERT_EQ(res.size(), ref.size());
+		for (size_t i = 0; i < ref.size(); ++i)
+			EXPECT_DOUBLE_EQ(res[i].score, ref[i].score);
+	}
+}
+
+// 【早期打ち切りのテスト】
+// スコアが偏っている場合、全件を読まずに終了することを確認
+TEST(ThresholdTopKTest, StopsEarly) {
+	constexpr size_t N = 10000;
+	std::vector<float> a(N), b(N);
+	for (size_t i = 0; i < N; ++i) {
+		a[i] = 1.f - static_cast<float>(i) / N;
+		b[i] = 1.f - static_cast<float>(i) / N;
+	}
+	std::vector<RankSource_U> src;
+	src.emplace_back(std::make_unique<VecSource>(a, true));
+	src.emplace_back(std::make_unique<VecSource>(b, true));
+	const auto res = ThresholdTopK(10, src, [](uint32_t) { return true; });
+
+	ASSERT_EQ(res.size(), 10u);
+	for (uint32_t i = 0; i < 10; ++i)
+		EXPECT_EQ(res[i].id, i);
+	EXPECT_LT(static_cast<VecSource &>(*src[0]).nRead, 100u);
+}
+
+// 【件数が足りない場合のテスト】
+// 該当要素がk件未満なら、全件をスコア順に返すことを確認
+TEST(ThresholdTopKTest, FewerThanK) {
+	const float nan = std::numeric_limits<float>::quiet_NaN();
+	std::vector<RankSource_U> src;
+	src.emplace_back(std::make_unique<VecSource>(std::vector<float>{nan, 0.5f, nan, 2.f}, false));
+	const auto res = ThresholdTopK(10, src, [](uint32_t) { return true; });
+
+	ASSERT_EQ(res.size(), 2u);
+	EXPECT_EQ(res[0].id, 3u);
+	EXPECT_EQ(res[1].id, 1u);
+}
@@ -0,0 +1,79 @@
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include "sphere_grid.hpp"
+
+using namespace dg;
+
+namespace {
+	constexpr float NaN = std::numeric_limits<float>::quiet_NaN();
+
+	struct Points {
+			std::vector<float> x, y, z;
+	};
+	// 長さが [0.995, 1.005] 程度の方向をランダムに作る
+	Points MakePoints(const size_t n, const uint32_t seed) {
+		std::mt19937 mt(seed);
+		std::normal_distribution<float> nd;
+		std::uniform_real_distribution<float> len(0.9975f, 1.0025f);
+		Points ret;
+		for (size_t i = 0; i < n; ++i) {
+			const float x = nd(mt), y = nd(mt), z = nd(mt);
+			const float s = len(mt) / std::sqrt(x * x + y * y + z * z);
+			ret.x.emplace_back(x * s);
+			ret.y.emplace_back(y * s);
+			ret.z.emplace_back(z * s);
+		}
+		return ret;
+	}
+} // namespace
+
+TEST(SphereGrid, CellCenterMapsToItself) {
+	constexpr uint32_t Div = 8;
+	for (uint32_t c = 0; c < SphereGrid::NumCells(Div); ++c) {
+		const auto p = SphereGrid::CellCenter(c, Div);
+		EXPECT_NEAR(p[0] * p[0] + p[1] * p[1] + p[2] * p[2], 1.f, 1e-5f);
+		EXPECT_EQ(SphereGrid::CellOf(p[0], p[1], p[2], Div), c);
+	}
+}
+
+TEST(SphereGrid, CellsCoverAllButNaN) {
+	auto pts = MakePoints(2000, 1);
+	pts.x[5] = NaN;
+	pts.z[9] = NaN;
+	const SphereGrid grid(pts.x, pts.y, pts.z, 6);
+	size_t total = 0;
+	for (auto &cell : grid.cells()) {
+		for (const uint32_t id : grid.ids(cell)) {
+			EXPECT_EQ(SphereGrid::CellOf(pts.x[id], pts.y[id], pts.z[id], grid.div()), cell.index);
+			// 中心を向くクエリとの距離は下限以上
+			const auto &c = cell.center;
+			const float d = std::hypot(pts.x[id] - c[0], pts.y[id] - c[1], pts.z[id] - c[2]);
+			EXPECT_LE(grid.minDistance(cell, c[0], c[1], c[2]), d);
+		}
+		total += cell.end - cell.begin;
+	}
+	EXPECT_EQ(total, 1998u);
+}
+
+TEST(SphereGrid, RankSourceMatchesBruteForce) {
+	const auto pts = MakePoints(20000, 2);
+	const SphereGrid grid(pts.x, pts.y, pts.z, 12);
+	for (const std::array<float, 3> q : {std::array<float, 3>{1, 0, 0}, {0.f, -0.6f, 0.8f}, {0.577f, 0.577f, -0.577f}}) {
+		std::vector<float> expect;
+		for (size_t i = 0; i < pts.x.size(); ++i) {
+			const float d = std::sqrt((pts.x[i] - q[0]) * (pts.x[i] - q[0]) + (pts.y[i] - q[1]) * (pts.y[i] - q[1]) +
+									  (pts.z[i] - q[2]) * (pts.z[i] - q[2]));
+			expect.emplace_back((2.f - d) / 2 * 0.5f);
+		}
+		std::sort(expect.begin(), expect.end(), std::greater<>());
+
+		SphereRankSource src(grid, pts.x, pts.y, pts.z, q, 0.5f);
+		for (size_t k = 0; k < 500; ++k) {
+			const auto item = src.next();
+			ASSERT_TRUE(item);
+			EXPECT_FLOAT_EQ(item->score, expect[k]) << k;
+			EXPECT_FLOAT_EQ(src.at(item->id), item->score);
+		}
+	}
+}
@@ -6,13 +6,36 @@
 #include <QMimeData>
 #include <QPainter>
 #include <QUrl>
+#include <algorithm>
+#include <array>
+#include <unordered_set>
 #include "aux_f_q/convert.hpp"
 #include "aux_f_q/q_value.hpp"
+#include "search/blacklist.hpp"
 #include "singleton/my_db.hpp"
 #include "singleton/my_thumbnail.hpp"
 
+namespace {
+	// サムネイルを読み込むまでの表示
+	const QPixmap &Placeholder(const int level) {
+		static const auto pms = [] {
+			std::array<QPixmap, MyThumbnail::NLevel> pms;
+			for (int lv = 0; lv < MyThumbnail::NLevel; ++lv) {
+				pms[lv] = QPixmap(MyThumbnail::LevelSize[lv], MyThumbnail::LevelSize[lv]);
+				pms[lv].fill(QColor(128, 128, 128, 64));
+			}
+			return pms;
+		}();
+		return pms[level];
+	}
+} // namespace
+
 // ---------------------------- ResultPathModel ------------------------------
 ResultPathModel::ResultPathModel(QObject *parent) : QAbstractListModel(parent) {
+	connect(&myDb_c.blacklist(), &Blacklist::changed, this, &ResultPathModel::_onBlacklistChanged);
+	// 0msタイマーで少しずつ読み込み、間にイベント(スクロール等)を処理させる
+	_loadTimer.setInterval(0);
+	connect(&_loadTimer, &QTimer::timeout, this, &ResultPathModel::_loadNext);
 }
 
 int ResultPathModel::rowCount(const QModelIndex &parent) const {
@@ -52,23 +75,30 @@ QVariant ResultPathModel::data(const QModelIndex &index, const int role) const {
 				}
 
 				case Qt::DecorationRole: {
+					// 段階を切り替えた直後は、読み込み直すまで前のサムネイルを表示しておく
+					if (ent.thumbnail.isNull() && !ent.loaded)
+						return Placeholder(_level);
 					// ブラックリストに登録されているファイルIDの場合はサムネイルを暗く表示する処理
-					if (myDb_c.isBlacklisted(ent.fileId)) {
-						QImage img = ent.thumbnail.toImage();
-						if (!img.isNull()) {
-							// 元画像と同じサイズの透過イメージを作成
-							QImage darkened(img.size(), QImage::Format_ARGB32);
-							darkened.fill(Qt::transparent);
-
-							// QPainter を使って元画像を描画し、その上に半透明の黒を重ねる
-							QPainter p(&darkened);
-							p.drawImage(0, 0, img);
-							p.fillRect(darkened.rect(), QColor(0, 0, 0, 128)); // 半透明黒で暗くする
-							p.end();
-
-							// 暗くした画像を QPixmap に変換して返す
-							return QPixmap::fromImage(darkened);
+					if (myDb_c.blacklist().contains(ent.fileId)) {
+						if (ent.darkened.isNull()) {
+							QImage img = ent.thumbnail.toImage();
+							if (!img.isNull()) {
+								// 元画像と同じサイズの透過イメージを作成
+								QImage darkened(img.size(), QImage::Format_ARGB32);
+								darkened.fill(Qt::transparent);
+
+								// QPainter を使って元画像を描画し、その上に半透明の黒を重ねる
+								QPainter p(&darkened);
+								p.drawImage(0, 0, img);
+								p.fillRect(darkened.rect(), QColor(0, 0, 0, 128)); // 半透明黒で暗くする
+								p.end();
+
+								// 暗くした画像を QPixmap に変換して保持しておく
+								ent.darkened = QPixmap::fromImage(darkened);
+							}
 						}
+						if (!ent.darkened.isNull())
+							return ent.darkened;
 					}
 					// ブラックリスト対象でない場合は通常のサムネイルを返す
 					return ent.thumbnail;
@@ -87,20 +117,112 @@ void ResultPathModel::addIds(const PoseIds &poseIds) {
 	if (count == 0)
 		return;
 
-	FileIds fileIds;
+	beginInsertRows(QModelIndex(), _data.size(), _data.size() + count - 1);
 	for (const auto poseId : poseIds)
-		fileIds.emplace_back(myDb_c.getFileId(poseId));
+		_data.append(Entry{poseId, myDb_c.getFileId(poseId), {}, {}, false});
+	endInsertRows();
 
-	const auto thumbnails = myTn.getThumbnails(fileIds);
-	Q_ASSERT(thumbnails.size() == count);
+	_nPending += count;
+	if (!_loadTimer.isActive())
+		_loadTimer.start();
+}
 
-	beginInsertRows(QModelIndex(), _data.size(), _data.size() + count - 1);
-	for (int i = 0; i < count; ++i)
-		_data.append(Entry{poseIds[i], fileIds[i], thumbnails[i]});
-	endInsertRows();
+void ResultPathModel::setVisibleRange(const int first, const int last, const int dir) {
+	_visFirst = std::max(0, first);
+	_visLast = last;
+	_dir = dir < 0 ? -1 : 1;
+}
+
+bool ResultPathModel::isLoading() const noexcept {
+	return _loadTimer.isActive();
+}
+
+void ResultPathModel::setLevel(const int level) {
+	Q_ASSERT(level >= 0 && level < MyThumbnail::NLevel);
+	if (level == _level)
+		return;
+	_level = level;
+	// 読み込み済みの物も含めて、表示中の行から順に読み込み直す
+	for (auto &ent : _data)
+		ent.loaded = false;
+	_nPending = _data.size();
+	if (_nPending > 0 && !_loadTimer.isActive())
+		_loadTimer.start();
+}
+
+int ResultPathModel::level() const noexcept {
+	return _level;
+}
+
+std::vector<int> ResultPathModel::_pickRows() const {
+	std::vector<int> rows;
+	rows.reserve(LoadBatch);
+	const int nRow = _data.size();
+	const auto pick = [&](const int row) {
+		if (row >= 0 && row < nRow && !_data[row].loaded && std::find(rows.begin(), rows.end(), row) == rows.end())
+			rows.emplace_back(row);
+		return static_cast<int>(rows.size()) >= LoadBatch;
+	};
+	// 表示中の行
+	const int visLast = std::min(_visLast, nRow - 1);
+	for (int row = _visFirst; row <= visLast; ++row) {
+		if (pick(row))
+			return rows;
+	}
+	// スクロール方向に1画面分先
+	const int span = std::max(1, visLast - _visFirst + 1);
+	for (int i = 1; i <= span; ++i) {
+		if (pick(_dir < 0 ? _visFirst - i : visLast + i))
+			return rows;
+	}
+	// 残りは先頭から
+	for (int row = 0; row < nRow; ++row) {
+		if (pick(row))
+			break;
+	}
+	return rows;
+}
+
+void ResultPathModel::_loadNext() {
+	const auto rows = _pickRows();
+	if (rows.empty()) {
+		_loadTimer.stop();
+		return;
+	}
+	FileIds fileIds;
+	fileIds.reserve(rows.size());
+	for (const int row : rows)
+		fileIds.emplace_back(_data[row].fileId);
+
+	const auto thumbnails = myTn.getThumbnails(fileIds, _level);
+	Q_ASSERT(thumbnails.size() == rows.size());
+	for (size_t i = 0; i < rows.size(); ++i) {
+		auto &ent = _data[rows[i]];
+		ent.thumbnail = thumbnails[i];
+		ent.darkened = {};
+		ent.loaded = true;
+		const auto idx = index(rows[i]);
+		emit dataChanged(idx, idx, {Qt::DecorationRole});
+	}
+	_nPending -= static_cast<int>(rows.size());
+	if (_nPending <= 0)
+		_loadTimer.stop();
+}
+
+void ResultPathModel::_onBlacklistChanged(const FileIds &fileIds) {
+	const std::unordered_set<FileId> changed(fileIds.begin(), fileIds.end());
+	for (int row = 0; row < _data.size(); ++row) {
+		if (changed.contains(_data[row].fileId)) {
+			const auto idx = index(row);
+			emit dataChanged(idx, idx, {Qt::DecorationRole});
+		}
+	}
 }
 
 void ResultPathModel::clear() {
+	// 読み込み待ちのサムネイルも破棄する
+	_loadTimer.stop();
+	_nPending = 0;
 	beginResetModel();
 	_data.clear();
 	endResetModel();
@@ -2,6 +2,7 @@
 #include <QAbstractItemModel>
 #include <QPixmap>
 #include <QStringList>
+#include <QTimer>
 #include "id.hpp"
 
 class ResultPathModel : public QAbstractListModel {
@@ -16,14 +17,45 @@ class ResultPathModel : public QAbstractListModel {
 		QStringList mimeTypes() const override;
 		Qt::DropActions supportedDragActions() const override;
 
+		// 行はすぐに追加し、サムネイルは後から優先度順に読み込む
 		void addIds(const PoseIds &poseIds);
 		void clear();
+		/**
+		 * @brief 表示されている行の範囲を設定 (サムネイルの読み込み順に使う)
+		 *
+		 * @param dir スクロール方向 (負なら上、それ以外は下)
+		 */
+		void setVisibleRange(int first, int last, int dir);
+		// サムネイルの読み込み待ちがあるか
+		bool isLoading() const noexcept;
+		// サムネイルの解像度の段階を切り替えて読み込み直す (MyThumbnail::LevelSize)
+		void setLevel(int level);
+		int level() const noexcept;
 
 	private:
+		// 一度に読み込むサムネイル数 (この単位でイベントループに処理を返す)
+		constexpr static int LoadBatch = 16;
+
 		struct Entry {
 				PoseId poseId;
 				FileId fileId;
+				// 読み込むまでは空 (プレースホルダを表示)
 				QPixmap thumbnail;
+				// ブラックリスト表示用に暗くしたサムネイル (最初に必要になった時に作る)
+				mutable QPixmap darkened;
+				bool loaded;
 		};
 		QList<Entry> _data;
+		// サムネイルを読み込んでいない行数
+		int _nPending = 0;
+		int _visFirst = 0, _visLast = -1, _dir = 1;
+		int _level = 0;
+		QTimer _loadTimer;
+
+		// 次に読み込む行を優先度順(表示中 -> スクロール方向の先 -> 残り)に選ぶ
+		std::vector<int> _pickRows() const;
+		void _loadNext();
+
+		// ブラックリストの登録状態が変わったファイルの行を再描画させる
+		void _onBlacklistChanged(const FileIds &fileIds);
 };
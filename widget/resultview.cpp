@@ -8,13 +8,92 @@
 #include <QMenu>
 #include <QMimeData>
 #include <QPointer>
+#include <QResizeEvent>
+#include <QWheelEvent>
+#include <algorithm>
 #include <QUrl>
 #include "aux_f_q/q_value.hpp"
 #include "poseinfodialog.h"
+#include "search/blacklist.hpp"
 #include "singleton/my_db.hpp"
+#include "singleton/my_thumbnail.hpp"
 
 ResultView::ResultView(QWidget *parent) : QListView(parent) {
 	setDragEnabled(true);
+	setZoomLevel(0);
+}
+
+void ResultView::setZoomLevel(int level) {
+	level = std::clamp(level, 0, MyThumbnail::NLevel - 1);
+	if (level == _zoomLevel)
+		return;
+	_zoomLevel = level;
+	const int size = MyThumbnail::LevelSize[level];
+	setIconSize(QSize(size, size));
+	// グリッドを変えると配置し直される
+	setGridSize(QSize(size + 8, size + 8));
+	emit zoomLevelChanged(level);
+	// 配置し直しは遅延されるので、先に済ませてから新しい配置で表示範囲を求める
+	executeDelayedItemsLayout();
+	_updateVisibleRange();
+}
+
+int ResultView::zoomLevel() const noexcept {
+	return _zoomLevel;
+}
+
+void ResultView::wheelEvent(QWheelEvent *event) {
+	if (event->modifiers() & Qt::ControlModifier) {
+		const int delta = event->angleDelta().y();
+		if (delta != 0)
+			setZoomLevel(_zoomLevel + (delta > 0 ? 1 : -1));
+		event->accept();
+		return;
+	}
+	QListView::wheelEvent(event);
+}
+
+void ResultView::scrollContentsBy(const int dx, const int dy) {
+	QListView::scrollContentsBy(dx, dy);
+	// 内容が上に動く(dy < 0)のは下へのスクロール
+	if (dy != 0)
+		_dir = dy < 0 ? 1 : -1;
+	_updateVisibleRange();
+}
+
+void ResultView::resizeEvent(QResizeEvent *event) {
+	QListView::resizeEvent(event);
+	_updateVisibleRange();
+}
+
+void ResultView::rowsInserted(const QModelIndex &parent, const int start, const int end) {
+	QListView::rowsInserted(parent, start, end);
+	_updateVisibleRange();
+}
+
+int ResultView::_findEdgeRow(const bool fromTop) const {
+	const QRect r = viewport()->rect();
+	// アイテム間の隙間を避ける為に細かく走査する
+	constexpr int Step = 8;
+	for (int i = 0; i <= r.height(); i += Step) {
+		const int y = fromTop ? r.top() + i : r.bottom() - i;
+		for (int x = fromTop ? r.left() : r.right(); fromTop ? x <= r.right() : x >= r.left();
+			 x += fromTop ? Step : -Step) {
+			const QModelIndex idx = indexAt(QPoint(x, y));
+			if (idx.isValid())
+				return idx.row();
+		}
+	}
+	return -1;
+}
+
+void ResultView::_updateVisibleRange() {
+	if (!model() || model()->rowCount() == 0)
+		return;
+	const int first = _findEdgeRow(true);
+	if (first < 0)
+		return;
+	emit visibleRangeChanged(first, std::max(first, _findEdgeRow(false)), _dir);
 }
 
 void ResultView::startDrag(Qt::DropActions supportedActions) {
@@ -70,25 +149,26 @@ void ResultView::contextMenuEvent(QContextMenuEvent *event) {
 	});
 	menu->addAction(showPoseInfoAction);
 
+	// --- 似たポーズを探す ---
+	auto *findSimilarAction = new QAction(tr("Find Similar Poses"), menu);
+	connect(findSimilarAction, &QAction::triggered, this, [this, poseId]() { emit findSimilarRequested(poseId); });
+	menu->addAction(findSimilarAction);
+
 	menu->addSeparator();
 	{
-		const auto idx2FileId = [](const QModelIndex &idx) {
-			const PoseId poseId = dg::ConvertQV<PoseId>(idx.data(Qt::UserRole));
-			const FileId fileId = myDb_c.getFileId(poseId);
-			return fileId;
-		};
-		// 選択中の全アイテムに対してブラックリスト解除
-		const std::function<void()> remBl = [this, idx2FileId]() {
-			for (const QModelIndex &idx : selectedIndexes())
-				myDb.removeBlacklist(idx2FileId(idx));
-		};
-		// 選択中の全アイテムに対してブラックリスト登録
-		const std::function<void()> addBl = [this, idx2FileId]() {
+		// 選択中の全アイテムのファイル
+		const auto selectedFiles = [this]() {
+			FileIds fileIds;
 			for (const QModelIndex &idx : selectedIndexes())
-				myDb.addBlacklist(idx2FileId(idx));
+				fileIds.emplace_back(myDb_c.getFileId(dg::ConvertQV<PoseId>(idx.data(Qt::UserRole))));
+			return fileIds;
 		};
+		// 選択中の全アイテムに対してブラックリスト解除 (まとめて1トランザクション)
+		const std::function<void()> remBl = [selectedFiles]() { myDb_c.blacklist().remove(selectedFiles()); };
+		// 選択中の全アイテムに対してブラックリスト登録 (まとめて1トランザクション)
+		const std::function<void()> addBl = [selectedFiles]() { myDb_c.blacklist().add(selectedFiles()); };
 		// --- ブラックリスト登録/解除 ---
-		const bool isBlacklisted = myDb.isBlacklisted(fileId);
+		const bool isBlacklisted = myDb_c.blacklist().contains(fileId);
 		// 判定基準はカレントアイテム
 		auto *blacklistAction = new QAction(isBlacklisted ? tr("Remove Blacklist") : tr("Add Blacklist"), menu);
 		connect(blacklistAction, &QAction::triggered, this, isBlacklisted ? remBl : addBl);
@@ -1,12 +1,36 @@
 #pragma once
 #include <QListView>
+#include "id.hpp"
 
 class ResultView : public QListView {
 		Q_OBJECT
 	public:
 		explicit ResultView(QWidget *parent = nullptr);
 
+		// サムネイルの段階 (MyThumbnail::LevelSize) に合わせてアイコンの大きさを変える
+		void setZoomLevel(int level);
+		int zoomLevel() const noexcept;
+
+	signals:
+		// 表示されている行の範囲が変わった (dir: スクロール方向 負なら上)
+		void visibleRangeChanged(int first, int last, int dir);
+		void zoomLevelChanged(int level);
+		// コンテキストメニューで「似たポーズを探す」が選ばれた
+		void findSimilarRequested(PoseId poseId);
+
 	protected:
 		void startDrag(Qt::DropActions supportedActions) override;
 		void contextMenuEvent(QContextMenuEvent *event) override;
+		void scrollContentsBy(int dx, int dy) override;
+		void resizeEvent(QResizeEvent *event) override;
+		void rowsInserted(const QModelIndex &parent, int start, int end) override;
+		// Ctrl+ホイールで拡大・縮小
+		void wheelEvent(QWheelEvent *event) override;
+
+	private:
+		int _dir = 1;
+		int _zoomLevel = -1;
+		void _updateVisibleRange();
+		// ビューポートを上(または下)から走査して最初に見つかった行
+		int _findEdgeRow(bool fromTop) const;
 };